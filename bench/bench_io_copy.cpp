@@ -0,0 +1,143 @@
+// Measures the latency of an interactive relay while a bulk relay saturates the same io thread.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/executor_work_guard.hpp>
+#include <asio/ts/buffer.hpp>
+#include <asio/ts/internet.hpp>
+#include <asio/ts/io_context.hpp>
+#include <benchmark/benchmark.h>
+
+#include "../src/connection.h"
+#include "../src/io.h"
+#include "../src/session.h"
+
+namespace {
+using clock = std::chrono::steady_clock;
+
+// Returns a connected pair of loopback sockets.
+std::pair<asio::ip::tcp::socket, asio::ip::tcp::socket> socket_pair(asio::io_context& client_ctx, asio::io_context& server_ctx) {
+    asio::ip::tcp::acceptor acceptor{server_ctx, {asio::ip::address_v4::loopback(), 0}};
+    asio::ip::tcp::socket client{client_ctx};
+    client.connect(acceptor.local_endpoint());
+    client.set_option(asio::ip::tcp::no_delay{true});
+
+    asio::ip::tcp::socket server = acceptor.accept();
+    server.set_option(asio::ip::tcp::no_delay{true});
+
+    return {std::move(client), std::move(server)};
+}
+
+// relay spawns an io_copy from `from` to `to` on ctx.
+void relay(asio::io_context& ctx, session_manager& sessions, asio::ip::tcp::socket from, asio::ip::tcp::socket to, flow_budget::options budget) {
+    auto r = std::make_shared<connection>(tcp_socket{std::move(from)});
+    auto w = std::make_shared<connection>(tcp_socket{std::move(to)});
+
+    asio::co_spawn(ctx, io_copy(w, r, sessions.open(), budget), asio::detached);
+}
+
+// Args: fair scheduling enabled, bulk flow running.
+void interactive_latency(benchmark::State& state) {
+    const bool fair = state.range(0);
+    const bool bulk = state.range(1);
+
+    flow_budget::options budget;
+    if (!fair) {
+        budget.yield_bytes = 0;
+        budget.yield_time = clock::duration::zero();
+    }
+
+    // sessions must outlive the coroutines destroyed along with ctx
+    session_manager sessions{0, 0};
+    asio::io_context ctx{1};
+    asio::io_context blocking_ctx;
+
+    // the relayed sockets run on ctx, the endpoints use blocking operations
+    auto [bulk_src, bulk_in] = socket_pair(blocking_ctx, ctx);
+    auto [bulk_out, bulk_dst] = socket_pair(ctx, blocking_ctx);
+    auto [interactive_src, interactive_in] = socket_pair(blocking_ctx, ctx);
+    auto [interactive_out, interactive_dst] = socket_pair(ctx, blocking_ctx);
+
+    relay(ctx, sessions, std::move(bulk_in), std::move(bulk_out), budget);
+    relay(ctx, sessions, std::move(interactive_in), std::move(interactive_out), budget);
+
+    auto work = asio::make_work_guard(ctx);
+    std::thread io_thread{[&ctx] { ctx.run(); }};
+
+    std::atomic<bool> stop = false;
+    std::thread source;
+    std::thread sink;
+
+    if (bulk) {
+        source = std::thread{[&] {
+            std::vector<std::uint8_t> buf(buffer_size);
+            std::error_code ignore_error;
+
+            while (!stop) {
+                asio::write(bulk_src, asio::buffer(buf), ignore_error);
+            }
+
+            bulk_src.shutdown(asio::ip::tcp::socket::shutdown_send, ignore_error);
+        }};
+
+        sink = std::thread{[&] {
+            std::vector<std::uint8_t> buf(buffer_size);
+            std::error_code err;
+
+            while (!err) {
+                bulk_dst.read_some(asio::buffer(buf), err);
+            }
+        }};
+
+        // let the bulk flow ramp up
+        std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    }
+
+    std::vector<double> samples;
+    std::uint8_t byte = 0;
+
+    for (auto _ : state) {
+        const auto start = clock::now();
+
+        asio::write(interactive_src, asio::buffer(&byte, 1));
+        asio::read(interactive_dst, asio::buffer(&byte, 1));
+
+        const std::chrono::duration<double> elapsed = clock::now() - start;
+        state.SetIterationTime(elapsed.count());
+        samples.push_back(elapsed.count() * 1e6);
+    }
+
+    stop = true;
+    if (source.joinable()) {
+        source.join();
+    }
+    if (sink.joinable()) {
+        sink.join();
+    }
+
+    work.reset();
+    ctx.stop();
+    io_thread.join();
+
+    std::sort(samples.begin(), samples.end());
+    state.counters["p50_us"] = samples[samples.size() / 2];
+    state.counters["p99_us"] = samples[samples.size() * 99 / 100];
+}
+} // namespace
+
+BENCHMARK(interactive_latency)
+    ->ArgNames({"fair", "bulk"})
+    ->ArgsProduct({{0, 1}, {0, 1}})
+    ->UseManualTime()
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
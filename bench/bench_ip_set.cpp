@@ -0,0 +1,144 @@
+// Measures ip_set lookups against the binary trie it replaced, with the IP ranges of acl/chn.acl.
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <asio/ts/internet.hpp>
+#include <benchmark/benchmark.h>
+
+#include "../src/ip_set.h"
+
+namespace {
+// binary_trie is the former ip_set::trie, a node per bit.
+class binary_trie {
+public:
+    void insert(std::span<const std::uint8_t> ip, std::uint8_t bits) {
+        node* n = &root;
+
+        for (std::uint8_t i = 0; i != bits; i++) {
+            std::unique_ptr<node>& next = get_bit(ip, i) ? n->right : n->left;
+            if (!next) {
+                next = std::make_unique<node>();
+            }
+
+            n = next.get();
+        }
+
+        n->is_complete = true;
+    }
+
+    bool contains(std::span<const std::uint8_t> ip) const {
+        const node* n = &root;
+
+        for (std::size_t i = 0; i != ip.size() * 8; i++) {
+            n = get_bit(ip, i) ? n->right.get() : n->left.get();
+
+            if (!n) {
+                return false;
+            }
+
+            if (n->is_complete) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+private:
+    struct node {
+        std::unique_ptr<node> left;
+        std::unique_ptr<node> right;
+        bool is_complete = false;
+    };
+
+    static bool get_bit(std::span<const std::uint8_t> bits, std::size_t i) {
+        return (bits[i / 8] >> (7 - i % 8)) & 1;
+    }
+
+    node root;
+};
+
+struct cidr {
+    std::array<std::uint8_t, 4> ip;
+    std::uint8_t bits;
+};
+
+// load_ranges returns the IPv4 ranges of the ACL file.
+std::vector<cidr> load_ranges() {
+    std::vector<cidr> ranges;
+    std::ifstream file{ACL_FILE};
+
+    for (std::string line; std::getline(file, line);) {
+        const auto pos = line.find('/');
+        if (pos == std::string::npos) {
+            continue;
+        }
+
+        std::error_code ec;
+        const asio::ip::address_v4 addr = asio::ip::make_address_v4(line.substr(0, pos), ec);
+        if (!ec) {
+            ranges.push_back({addr.to_bytes(), static_cast<std::uint8_t>(std::stoul(line.substr(pos + 1)))});
+        }
+    }
+
+    return ranges;
+}
+
+// random_addresses returns addresses spread over the whole IPv4 space.
+std::vector<std::array<std::uint8_t, 4>> random_addresses() {
+    std::vector<std::array<std::uint8_t, 4>> addresses(4096);
+    std::mt19937 random{42};
+
+    for (auto& address : addresses) {
+        const std::uint32_t value = random();
+        address = {static_cast<std::uint8_t>(value >> 24), static_cast<std::uint8_t>(value >> 16), static_cast<std::uint8_t>(value >> 8), static_cast<std::uint8_t>(value)};
+    }
+
+    return addresses;
+}
+
+template <typename Set>
+void lookup(benchmark::State& state) {
+    Set set;
+    for (const cidr& range : load_ranges()) {
+        set.insert(range.ip, range.bits);
+    }
+
+    const auto addresses = random_addresses();
+    std::size_t i = 0;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(set.contains(addresses[i++ % addresses.size()]));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Set>
+void build(benchmark::State& state) {
+    const std::vector<cidr> ranges = load_ranges();
+
+    for (auto _ : state) {
+        Set set;
+        for (const cidr& range : ranges) {
+            set.insert(range.ip, range.bits);
+        }
+
+        benchmark::DoNotOptimize(set);
+    }
+}
+} // namespace
+
+BENCHMARK_TEMPLATE(lookup, binary_trie);
+BENCHMARK_TEMPLATE(lookup, ip_set);
+BENCHMARK_TEMPLATE(build, binary_trie)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(build, ip_set)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,87 @@
+// Measures the decisions of an ACL made directly against those cached by live_acl, for a few hundred hosts
+// seen over and over, with the IP ranges of acl/chn.acl and a thousand host name rules.
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <asio/ip/address.hpp>
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+
+#include "../src/live_acl.h"
+
+namespace {
+struct target {
+    asio::ip::address address;
+    std::string host;
+};
+
+std::shared_ptr<const access_control_list> make_acl() {
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "bench_live_acl.acl";
+
+    {
+        std::ofstream ofs{path};
+        ofs << std::ifstream{ACL_FILE}.rdbuf() << "\n[proxy_list]\n";
+
+        for (std::size_t i = 0; i != 1000; i++) {
+            ofs << fmt::format(R"((^|\.)domain{}\.com$)", i) << "\n";
+        }
+
+        for (std::size_t i = 0; i != 100; i++) {
+            ofs << fmt::format(R"(^cdn[0-9]+\.site{}\.io$)", i) << "\n";
+        }
+    }
+
+    auto acl = std::make_shared<const access_control_list>(access_control_list::from_file(path.string()));
+    std::filesystem::remove(path);
+
+    return acl;
+}
+
+// make_targets returns hosts, half of them matching no rule.
+std::vector<target> make_targets() {
+    std::vector<target> targets;
+
+    for (std::size_t i = 0; i != 300; i++) {
+        const std::string host = i % 2 ? fmt::format("www.domain{}.com", i) : fmt::format("www.example{}.org", i);
+        targets.push_back({asio::ip::make_address(fmt::format("198.51.{}.{}", i / 256, i % 256)), host});
+    }
+
+    return targets;
+}
+
+void direct(benchmark::State& state) {
+    const std::shared_ptr<const access_control_list> acl = make_acl();
+    const std::vector<target> targets = make_targets();
+    std::size_t i = 0;
+
+    for (auto _ : state) {
+        const target& t = targets[i++ % targets.size()];
+        benchmark::DoNotOptimize(acl->is_bypass(t.address, t.host));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+void cached(benchmark::State& state) {
+    const live_acl acl{make_acl()};
+    const std::vector<target> targets = make_targets();
+    std::size_t i = 0;
+
+    for (auto _ : state) {
+        const target& t = targets[i++ % targets.size()];
+        benchmark::DoNotOptimize(acl.is_bypass(t.address, t.host));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+} // namespace
+
+BENCHMARK(direct);
+BENCHMARK(cached);
+
+BENCHMARK_MAIN();
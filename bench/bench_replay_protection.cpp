@@ -0,0 +1,94 @@
+// Measures the replay check of new sessions on several threads at once, sharded against the single lock it replaced.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <span>
+
+#include <benchmark/benchmark.h>
+#include <bloom_filter.hpp>
+
+#include "../src/replay_protection.h"
+
+namespace {
+// single_lock is the former replay_protection, both filters behind one mutex, taken to check and then to insert.
+class single_lock {
+public:
+    static single_lock& get() {
+        static single_lock instance;
+        return instance;
+    }
+
+    bool test_and_insert(std::span<const std::uint8_t> element) {
+        if (contains(element)) {
+            return true;
+        }
+
+        insert(element);
+        return false;
+    }
+
+private:
+    single_lock() {
+        bloom_parameters parameters;
+        parameters.projected_element_count = count;
+        parameters.false_positive_probability = 1e-6;
+        parameters.random_seed = 42;
+        parameters.compute_optimal_parameters();
+
+        for (auto& filter : filters) {
+            filter = bloom_filter{parameters};
+        }
+    }
+
+    bool contains(std::span<const std::uint8_t> element) {
+        std::lock_guard lock{mtx};
+        return std::any_of(filters.begin(), filters.end(), [element](auto& filter) {
+            return filter.contains(element.data(), element.size());
+        });
+    }
+
+    void insert(std::span<const std::uint8_t> element) {
+        std::lock_guard lock{mtx};
+
+        bloom_filter& filter = filters[current];
+        filter.insert(element.data(), element.size());
+
+        if (filter.element_count() >= count) {
+            current = !current;
+            filters[current].clear();
+        }
+    }
+
+    std::array<bloom_filter, 2> filters;
+    int current = 0;
+    int count = 1'000'000;
+
+    std::mutex mtx;
+};
+
+template <typename Protection>
+void check(benchmark::State& state) {
+    auto& protection = Protection::get();
+
+    // distinct salts on each thread, as every session brings a new one
+    std::array<std::uint8_t, 32> salt{};
+    salt[0] = static_cast<std::uint8_t>(state.thread_index());
+    std::uint64_t i = 0;
+
+    for (auto _ : state) {
+        i++;
+        std::memcpy(salt.data() + 1, &i, sizeof(i));
+        benchmark::DoNotOptimize(protection.test_and_insert(salt));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+} // namespace
+
+BENCHMARK_TEMPLATE(check, single_lock)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(check, replay_protection)->ThreadRange(1, 8)->UseRealTime();
+
+BENCHMARK_MAIN();
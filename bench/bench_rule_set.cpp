@@ -0,0 +1,58 @@
+// Measures rule_set lookups with many host name rules, most of them plain domains, and a tenth general regexes
+// which are compiled or run one by one.
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+
+#include "../src/rule_set.h"
+
+namespace {
+// make_rules returns count rules for domains and their subdomains, and count / 10 general ones.
+rule_set make_rules(std::size_t count, bool compile) {
+    rule_set rules;
+
+    for (std::size_t i = 0; i != count; i++) {
+        rules.insert(fmt::format(R"((^|\.)domain{}\.com$)", i));
+    }
+
+    for (std::size_t i = 0; i != count / 10; i++) {
+        rules.insert(fmt::format(R"(^cdn[0-9]+\.site{}\.io$)", i));
+    }
+
+    if (compile) {
+        rules.compile();
+    }
+
+    return rules;
+}
+
+// Args: number of domain rules, compiled, host matches nothing (0), a domain (1) or a general rule (2).
+void lookup(benchmark::State& state) {
+    const auto count = static_cast<std::size_t>(state.range(0));
+    const rule_set rules = make_rules(count, state.range(1));
+
+    std::string host = "www.example.org";
+    if (state.range(2) == 1) {
+        host = fmt::format("www.domain{}.com", count / 2);
+    } else if (state.range(2) == 2) {
+        host = fmt::format("cdn7.site{}.io", count / 20);
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(rules.contains(host));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+} // namespace
+
+BENCHMARK(lookup)
+    ->ArgNames({"rules", "compiled", "match"})
+    ->ArgsProduct({{1000, 100000}, {0, 1}, {0, 1, 2}})
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -1,6 +1,13 @@
+#include <algorithm>
+#include <array>
 #include <cctype>
+#include <chrono>
 #include <fstream>
+#include <istream>
+#include <iterator>
 #include <stdexcept>
+#include <utility>
+#include <vector>
 
 #include <fmt/format.h>
 #include <spdlog/spdlog.h>
@@ -19,18 +26,26 @@ void trim_space(std::string& str) {
 } // namespace
 
 access_control_list access_control_list::from_file(std::string_view path) {
-    access_control_list acl;
+    if (binary_image::is_image(std::string{path})) {
+        return from_image(std::string{path});
+    }
 
     std::ifstream ifs{path.data(), std::ifstream::in | std::ifstream::binary};
     if (!ifs) {
         throw std::runtime_error{fmt::format("Cannot open acl file: {}", path)};
     }
 
+    return from_stream(ifs);
+}
+
+access_control_list access_control_list::from_stream(std::istream& in) {
+    access_control_list acl;
+
     ip_set* cur_list = &acl.bypass_list;
     rule_set* cur_rule_set = &acl.bypass_rules;
 
     std::string line;
-    while (std::getline(ifs, line)) {
+    while (std::getline(in, line)) {
         trim_comment(line);
         trim_space(line);
 
@@ -64,18 +79,86 @@ access_control_list access_control_list::from_file(std::string_view path) {
         }
     }
 
+    acl.bypass_rules.compile();
+    acl.proxy_rules.compile();
+    acl.outbound_block_rules.compile();
+
+    return acl;
+}
+
+void access_control_list::save_image(const std::string& path) const {
+    binary_image::writer out;
+
+    out.write(static_cast<std::uint64_t>(acl_mode));
+
+    bypass_list.save(out);
+    proxy_list.save(out);
+    outbound_block_list.save(out);
+
+    bypass_rules.save(out);
+    proxy_rules.save(out);
+    outbound_block_rules.save(out);
+
+    out.save(path);
+}
+
+access_control_list access_control_list::from_image(const std::string& path) {
+    access_control_list acl;
+    acl.image = std::make_shared<const binary_image::mapped_file>(path);
+
+    binary_image::reader in{acl.image->bytes()};
+
+    const std::uint64_t acl_mode = in.read_value();
+    if (acl_mode != white_list && acl_mode != black_list) {
+        throw std::runtime_error{"Invalid acl image: unknown mode"};
+    }
+
+    acl.acl_mode = static_cast<mode>(acl_mode);
+
+    acl.bypass_list.load(in);
+    acl.proxy_list.load(in);
+    acl.outbound_block_list.load(in);
+
+    acl.bypass_rules.load(in);
+    acl.proxy_rules.load(in);
+    acl.outbound_block_rules.load(in);
+
     return acl;
 }
 
 bool access_control_list::is_bypass(std::string_view ip, std::string_view host) const {
     if (bypass_list.contains(ip)) {
+        count_list(bypass_list_index);
         return true;
     }
 
     if (proxy_list.contains(ip)) {
+        count_list(proxy_list_index);
         return false;
     }
 
+    return is_bypass_by_rules(ip, host);
+}
+
+bool access_control_list::is_bypass(const asio::ip::address& ip, std::string_view host) const {
+    if (bypass_list.contains(ip)) {
+        count_list(bypass_list_index);
+        return true;
+    }
+
+    if (proxy_list.contains(ip)) {
+        count_list(proxy_list_index);
+        return false;
+    }
+
+    if (bypass_rules.empty() && proxy_rules.empty()) {
+        return acl_mode == black_list;
+    }
+
+    return is_bypass_by_rules(ip.to_string(), host);
+}
+
+bool access_control_list::is_bypass_by_rules(std::string_view ip, std::string_view host) const {
     if (bypass_rules.contains(ip)) {
         return true;
     }
@@ -97,8 +180,54 @@ bool access_control_list::is_bypass(std::string_view ip, std::string_view host)
     return acl_mode == black_list;
 }
 
+std::optional<bool> access_control_list::is_bypass_host(std::string_view host) const {
+    if (bypass_rules.contains(host)) {
+        return true;
+    }
+
+    if (proxy_rules.contains(host)) {
+        return false;
+    }
+
+    if (!bypass_list.empty() || !proxy_list.empty() || bypass_rules.may_match_address() || proxy_rules.may_match_address()) {
+        return std::nullopt;
+    }
+
+    return acl_mode == black_list;
+}
+
 bool access_control_list::is_block_outbound(std::string_view ip, std::string_view host) const {
-    if (outbound_block_list.contains(ip) || outbound_block_rules.contains(ip)) {
+    if (outbound_block_list.contains(ip)) {
+        count_list(outbound_block_list_index);
+        return true;
+    }
+
+    return is_block_outbound_by_rules(ip, host);
+}
+
+bool access_control_list::is_block_outbound(const asio::ip::address& ip, std::string_view host) const {
+    if (outbound_block_list.contains(ip)) {
+        count_list(outbound_block_list_index);
+        return true;
+    }
+
+    if (outbound_block_rules.empty()) {
+        return acl_mode == black_list;
+    }
+
+    return is_block_outbound_by_rules(ip.to_string(), host);
+}
+
+std::size_t access_control_list::ip_range_count() const {
+    return bypass_list.size() + proxy_list.size() + outbound_block_list.size();
+}
+
+std::size_t access_control_list::host_rule_count() const {
+    return bypass_rules.size() + proxy_rules.size() + outbound_block_rules.size();
+}
+
+bool access_control_list::is_block_outbound_by_rules(std::string_view ip, std::string_view host) const {
+    if (outbound_block_rules.contains(ip)) {
         return true;
     }
 
@@ -110,3 +239,88 @@ bool access_control_list::is_block_outbound(std::string_view ip, std::string_vie
 
     return acl_mode == black_list;
 }
+
+void access_control_list::enable_profiling() {
+    list_counts = std::make_shared<rule_profile>(3);
+
+    bypass_rules.enable_profiling();
+    proxy_rules.enable_profiling();
+    outbound_block_rules.enable_profiling();
+}
+
+bool access_control_list::is_profiling() const {
+    return list_counts != nullptr;
+}
+
+std::string access_control_list::profile_report() const {
+    if (!list_counts) {
+        return {};
+    }
+
+    struct line {
+        std::string name;
+        std::uint64_t hits;
+        std::chrono::nanoseconds time;
+    };
+
+    auto format_lines = [](std::string& report, std::string_view title, const std::vector<line>& lines) {
+        fmt::format_to(std::back_inserter(report), "{}:\n{:>12} {:>12}  {}\n", title, "hits", "time (ms)", "rule");
+
+        for (const line& l : lines) {
+            fmt::format_to(std::back_inserter(report), "{:>12} {:>12.3f}  {}\n", l.hits, l.time.count() / 1e6, l.name);
+        }
+
+        report += '\n';
+    };
+
+    const std::array<std::pair<std::string_view, const rule_set*>, 3> rule_sets = {{
+        {"[bypass_list]", &bypass_rules},
+        {"[proxy_list]", &proxy_rules},
+        {"[outbound_block_list]", &outbound_block_rules},
+    }};
+
+    // the lists and rule sets, in the order of the ACL
+    std::vector<line> totals;
+    std::vector<line> rules;
+    std::size_t never_hit = 0;
+
+    for (std::size_t i = 0; i != rule_sets.size(); i++) {
+        const auto& [section, set] = rule_sets[i];
+
+        totals.push_back({fmt::format("{} IP ranges", section), list_counts->get(i).hits, std::chrono::nanoseconds::zero()});
+
+        const rule_set::rule_stats lookups = set->get_stats();
+        totals.push_back({fmt::format("{} host rules ({} lookups)", section, lookups.hits), 0, lookups.time});
+
+        for (rule_set::rule_stats& rule : set->get_rule_stats()) {
+            totals.back().hits += rule.hits;
+            never_hit += rule.hits == 0;
+            rules.push_back({fmt::format("{} {}", section, rule.rule), rule.hits, rule.time});
+        }
+    }
+
+    std::string report = fmt::format("ACL profile, times sampled 1 in {}, {} of {} host rules never hit\n\n", rule_profile::sample_rate, never_hit, rules.size());
+    format_lines(report, "Lists", totals);
+
+    std::stable_sort(rules.begin(), rules.end(), [](const line& a, const line& b) {
+        return a.hits > b.hits;
+    });
+    format_lines(report, "Rules by hits", rules);
+
+    // only the regexes are timed
+    std::erase_if(rules, [](const line& l) {
+        return l.time == std::chrono::nanoseconds::zero();
+    });
+    std::stable_sort(rules.begin(), rules.end(), [](const line& a, const line& b) {
+        return a.time > b.time;
+    });
+    format_lines(report, "Rules by time", rules);
+
+    return report;
+}
+
+void access_control_list::count_list(list_index list) const {
+    if (list_counts) {
+        list_counts->hit(list);
+    }
+}
@@ -1,9 +1,17 @@
 #ifndef ACCESS_CONTROL_LIST_H
 #define ACCESS_CONTROL_LIST_H
 
+#include <iosfwd>
+#include <memory>
+#include <optional>
+#include <string>
 #include <string_view>
 
+#include <asio/ip/address.hpp>
+
+#include "binary_image.h"
 #include "ip_set.h"
+#include "rule_profile.h"
 #include "rule_set.h"
 
 class access_control_list {
@@ -13,12 +21,56 @@ public:
         black_list, // bypasses all addresses that didn't match any rules
     };
 
+    // from_file reads an ACL file, or maps an image of one made by save_image.
     static access_control_list from_file(std::string_view path);
 
+    // from_stream parses the text of an ACL file from in.
+    static access_control_list from_stream(std::istream& in);
+
+    // save_image writes the ACL as a binary image, which is used in place instead of being parsed again.
+    void save_image(const std::string& path) const;
+
     bool is_bypass(std::string_view ip, std::string_view host = {}) const;
+
+    // The overloads taking an address format it only if there are rules to match its text against.
+    bool is_bypass(const asio::ip::address& ip, std::string_view host = {}) const;
+
+    // is_bypass_host decides by the host name rules alone, or by the default if there are no IP ranges
+    // and no rules which may match the text of an IP address.
+    // It returns std::nullopt if the decision depends on the IP address of host.
+    std::optional<bool> is_bypass_host(std::string_view host) const;
+
     bool is_block_outbound(std::string_view ip, std::string_view host = {}) const;
+    bool is_block_outbound(const asio::ip::address& ip, std::string_view host = {}) const;
+
+    // ip_range_count and host_rule_count return the number of rules of all the lists, for reporting.
+    std::size_t ip_range_count() const;
+    std::size_t host_rule_count() const;
+
+    // enable_profiling counts the matches of each host name rule from now on, and samples the time the rule sets
+    // take. IP ranges are merged into tables, so their matches are counted by list.
+    void enable_profiling();
+    bool is_profiling() const;
+
+    // profile_report returns the counts since profiling was enabled: by list and rule set, then the rules sorted
+    // by hits and by time. It is empty if not profiling.
+    std::string profile_report() const;
 
 private:
+    static access_control_list from_image(const std::string& path);
+
+    // decide by the rules, once the IP address matched no list
+    bool is_bypass_by_rules(std::string_view ip, std::string_view host) const;
+    bool is_block_outbound_by_rules(std::string_view ip, std::string_view host) const;
+
+    enum list_index {
+        bypass_list_index,
+        proxy_list_index,
+        outbound_block_list_index,
+    };
+
+    void count_list(list_index list) const;
+
     ip_set bypass_list;
     ip_set proxy_list;
     ip_set outbound_block_list;
@@ -28,6 +80,12 @@ private:
     rule_set outbound_block_rules;
 
     mode acl_mode = white_list;
+
+    // the image the lists are mapped from, if any
+    std::shared_ptr<const binary_image::mapped_file> image;
+
+    // the matches of the IP lists, if profiling
+    std::shared_ptr<rule_profile> list_counts;
 };
 
 #endif
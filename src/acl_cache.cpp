@@ -0,0 +1,64 @@
+#include "acl_cache.h"
+
+acl_cache::acl_cache(std::size_t capacity) : capacity(capacity) {
+    entries.reserve(capacity);
+    clock.reserve(capacity);
+}
+
+const std::optional<bool>* acl_cache::find(const std::string& key) {
+    const auto it = entries.find(key);
+
+    if (it == entries.end()) {
+        misses.store(misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    hits.store(hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    it->second.referenced = true;
+
+    return &it->second.decision;
+}
+
+void acl_cache::insert(const std::string& key, std::optional<bool> decision) {
+    if (capacity == 0) {
+        return;
+    }
+
+    const auto [it, inserted] = entries.try_emplace(key, entry{decision});
+    if (!inserted) {
+        it->second.decision = decision;
+        return;
+    }
+
+    if (clock.size() < capacity) {
+        clock.push_back(&*it);
+        return;
+    }
+
+    // evict the first entry which hasn't been hit since the hand last passed it
+    while (clock[hand]->second.referenced) {
+        clock[hand]->second.referenced = false;
+        hand = (hand + 1) % capacity;
+    }
+
+    entries.erase(clock[hand]->first);
+    clock[hand] = &*it;
+    hand = (hand + 1) % capacity;
+}
+
+void acl_cache::clear() {
+    entries.clear();
+    clock.clear();
+    hand = 0;
+}
+
+std::size_t acl_cache::size() const {
+    return entries.size();
+}
+
+acl_cache::stats acl_cache::get_stats() const {
+    return {
+        .hits = hits.load(std::memory_order_relaxed),
+        .misses = misses.load(std::memory_order_relaxed),
+    };
+}
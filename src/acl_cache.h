@@ -0,0 +1,56 @@
+#ifndef ACL_CACHE_H
+#define ACL_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// acl_cache remembers up to capacity decisions of an ACL, each of which is true, false, or std::nullopt for
+// "it depends on the IP address". When it is full, entries are evicted by the CLOCK algorithm: a hit marks an
+// entry, and the hand sweeping the entries passes over a marked one once, unmarking it, before evicting.
+//
+// It belongs to a single thread, but the stats may be read from any thread.
+class acl_cache {
+public:
+    struct stats {
+        std::uint64_t hits;
+        std::uint64_t misses;
+    };
+
+    explicit acl_cache(std::size_t capacity);
+
+    // find returns the decision cached for key, or nullptr on a miss. It is valid until the next insert or clear.
+    const std::optional<bool>* find(const std::string& key);
+
+    void insert(const std::string& key, std::optional<bool> decision);
+    void clear();
+
+    std::size_t size() const;
+    stats get_stats() const;
+
+private:
+    struct entry {
+        std::optional<bool> decision;
+        bool referenced = false;
+    };
+
+    using slot = std::pair<const std::string, entry>;
+
+    std::size_t capacity;
+    std::unordered_map<std::string, entry> entries;
+
+    // the entries in the order the hand sweeps them, which stay where they are as the map grows
+    std::vector<slot*> clock;
+    std::size_t hand = 0;
+
+    // written by the owning thread alone
+    std::atomic<std::uint64_t> hits = 0;
+    std::atomic<std::uint64_t> misses = 0;
+};
+
+#endif
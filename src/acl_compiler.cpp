@@ -0,0 +1,30 @@
+// acl_compiler compiles an ACL file into a binary image, which shadowsocks-asio maps instead of parsing it.
+
+#include <chrono>
+#include <exception>
+
+#include <spdlog/spdlog.h>
+
+#include "access_control_list.h"
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        spdlog::error("Usage: {} <input.acl> <output>", argv[0]);
+        return -1;
+    }
+
+    try {
+        const auto start = std::chrono::steady_clock::now();
+
+        const access_control_list acl = access_control_list::from_file(argv[1]);
+        acl.save_image(argv[2]);
+
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        spdlog::info("Compiled {} to {} in {} ms", argv[1], argv[2], elapsed.count());
+    } catch (const std::exception& e) {
+        spdlog::error("{}", e.what());
+        return -1;
+    }
+
+    return 0;
+}
@@ -3,6 +3,7 @@
 
 #include <asio/ts/internet.hpp>
 #include <asio/ts/socket.hpp>
+#include <asio/ts/timer.hpp>
 #include <asio/use_awaitable.hpp>
 
 using default_token = asio::use_awaitable_t<>;
@@ -10,5 +11,7 @@ using default_token = asio::use_awaitable_t<>;
 using tcp_acceptor = default_token::as_default_on_t<asio::ip::tcp::acceptor>;
 using tcp_socket = default_token::as_default_on_t<asio::ip::tcp::socket>;
 using tcp_resolver = default_token::as_default_on_t<asio::ip::tcp::resolver>;
+using udp_socket = default_token::as_default_on_t<asio::ip::udp::socket>;
+using steady_timer = default_token::as_default_on_t<asio::steady_timer>;
 
 #endif
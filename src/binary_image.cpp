@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+#ifndef _WIN32
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <fmt/format.h>
+
+#include "binary_image.h"
+
+namespace binary_image {
+namespace {
+constexpr std::array<char, 8> magic = {'S', 'S', 'A', 'S', 'I', 'O', 'B', 'I'};
+
+// tells the byte order the image was written in
+constexpr std::uint32_t byte_order_mark = 0x01020304;
+
+struct header {
+    std::array<char, 8> magic;
+    std::uint32_t version;
+    std::uint32_t byte_order_mark;
+};
+
+constexpr std::size_t alignment = 8;
+
+std::size_t align(std::size_t size) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+} // namespace
+
+bool is_image(const std::string& path) {
+    std::ifstream ifs{path, std::ifstream::in | std::ifstream::binary};
+
+    std::array<char, 8> start{};
+    ifs.read(start.data(), start.size());
+
+    return ifs && start == magic;
+}
+
+#ifndef _WIN32
+mapped_file::mapped_file(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        throw std::system_error{errno, std::generic_category(), fmt::format("Cannot open {}", path)};
+    }
+
+    struct stat st {};
+    if (::fstat(fd, &st) == -1) {
+        const int error = errno;
+        ::close(fd);
+        throw std::system_error{error, std::generic_category(), fmt::format("Cannot stat {}", path)};
+    }
+
+    size = static_cast<std::size_t>(st.st_size);
+
+    if (size != 0) {
+        // shared, so that the processes using the same image share its pages
+        void* addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            const int error = errno;
+            ::close(fd);
+            throw std::system_error{error, std::generic_category(), fmt::format("Cannot map {}", path)};
+        }
+
+        data = static_cast<const std::byte*>(addr);
+    }
+
+    ::close(fd);
+}
+
+mapped_file::~mapped_file() {
+    if (data) {
+        ::munmap(const_cast<std::byte*>(data), size);
+    }
+}
+#else
+mapped_file::mapped_file(const std::string& path) {
+    std::ifstream ifs{path, std::ifstream::in | std::ifstream::binary | std::ifstream::ate};
+    if (!ifs) {
+        throw std::runtime_error{fmt::format("Cannot open {}", path)};
+    }
+
+    size = static_cast<std::size_t>(ifs.tellg());
+    buffer.resize(align(size) / sizeof(std::uint64_t));
+
+    ifs.seekg(0);
+    ifs.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(size));
+    if (!ifs) {
+        throw std::runtime_error{fmt::format("Cannot read {}", path)};
+    }
+
+    data = reinterpret_cast<const std::byte*>(buffer.data());
+}
+
+mapped_file::~mapped_file() = default;
+#endif
+
+std::span<const std::byte> mapped_file::bytes() const {
+    return {data, size};
+}
+
+writer::writer() {
+    const header h{magic, version, byte_order_mark};
+    image.resize(align(sizeof(h)));
+    std::memcpy(image.data(), &h, sizeof(h));
+}
+
+void writer::save(const std::string& path) const {
+    // written aside and renamed, since the processes mapping the image would see it change, or crash if it shrank
+    const std::string temporary = path + ".tmp";
+
+    {
+        std::ofstream ofs{temporary, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc};
+        ofs.write(reinterpret_cast<const char*>(image.data()), static_cast<std::streamsize>(image.size()));
+
+        if (!ofs) {
+            throw std::runtime_error{fmt::format("Cannot write {}", temporary)};
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temporary, path, ec);
+    if (ec) {
+        std::filesystem::remove(temporary, ec);
+        throw std::runtime_error{fmt::format("Cannot write {}", path)};
+    }
+}
+
+void writer::write_bytes(std::span<const std::byte> bytes) {
+    const std::uint64_t size = bytes.size();
+    const std::size_t offset = image.size();
+
+    image.resize(offset + sizeof(size) + align(bytes.size()));
+    std::memcpy(image.data() + offset, &size, sizeof(size));
+    if (!bytes.empty()) {
+        std::memcpy(image.data() + offset + sizeof(size), bytes.data(), bytes.size());
+    }
+}
+
+reader::reader(std::span<const std::byte> image) : image(image) {
+    header h{};
+    if (image.size() < sizeof(h)) {
+        throw std::runtime_error{"Invalid binary image: truncated"};
+    }
+
+    std::memcpy(&h, image.data(), sizeof(h));
+
+    if (h.magic != magic) {
+        throw std::runtime_error{"Invalid binary image"};
+    }
+
+    if (h.byte_order_mark != byte_order_mark) {
+        throw std::runtime_error{"Binary image of another byte order"};
+    }
+
+    if (h.version != version) {
+        throw std::runtime_error{fmt::format("Binary image version {} isn't supported (expected {})", h.version, version)};
+    }
+
+    offset = align(sizeof(h));
+}
+
+std::uint64_t reader::read_value() {
+    const std::span<const std::uint64_t> value = read<std::uint64_t>();
+    if (value.size() != 1) {
+        throw std::runtime_error{"Invalid binary image: expected a value"};
+    }
+
+    return value.front();
+}
+
+std::span<const std::byte> reader::read_bytes() {
+    std::uint64_t size = 0;
+    if (image.size() - offset < sizeof(size)) {
+        throw std::runtime_error{"Invalid binary image: truncated"};
+    }
+
+    std::memcpy(&size, image.data() + offset, sizeof(size));
+    offset += sizeof(size);
+
+    if (image.size() - offset < size) {
+        throw std::runtime_error{"Invalid binary image: truncated"};
+    }
+
+    const std::span<const std::byte> bytes = image.subspan(offset, static_cast<std::size_t>(size));
+    offset += align(static_cast<std::size_t>(size));
+
+    // a truncated image may lack the padding
+    offset = std::min(offset, image.size());
+
+    return bytes;
+}
+} // namespace binary_image
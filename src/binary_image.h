@@ -0,0 +1,136 @@
+#ifndef BINARY_IMAGE_H
+#define BINARY_IMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// A binary image holds data structures which are built once and then mapped into memory, instead of being
+// rebuilt by every process. It is a header followed by arrays, each prefixed with its size in bytes and
+// aligned to 8 bytes, so that the arrays can be used in place.
+//
+// Images are only meant for the machine they were built for: they are in native byte order, and rejected otherwise.
+namespace binary_image {
+// version changes whenever the layout of an image changes.
+constexpr std::uint32_t version = 2;
+
+// is_image returns true if the file at path starts like an image.
+bool is_image(const std::string& path);
+
+// mapped_file maps a file into memory read-only, or reads it where mapping isn't supported.
+class mapped_file {
+public:
+    explicit mapped_file(const std::string& path);
+    ~mapped_file();
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    std::span<const std::byte> bytes() const;
+
+private:
+    const std::byte* data = nullptr;
+    std::size_t size = 0;
+
+    // where mapping isn't supported, 8 byte aligned
+    std::vector<std::uint64_t> buffer;
+};
+
+class writer {
+public:
+    writer();
+
+    template <typename T>
+    void write(std::span<const T> array) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write_bytes(std::as_bytes(array));
+    }
+
+    void write(std::uint64_t value) {
+        write(std::span<const std::uint64_t>{&value, 1});
+    }
+
+    std::span<const std::byte> bytes() const {
+        return image;
+    }
+
+    // save writes the image to path, replacing it at once.
+    void save(const std::string& path) const;
+
+private:
+    void write_bytes(std::span<const std::byte> bytes);
+
+    std::vector<std::byte> image;
+};
+
+// reader reads the arrays of an image in the order they were written, and throws std::runtime_error
+// if the image is truncated or of another version.
+class reader {
+public:
+    explicit reader(std::span<const std::byte> image);
+
+    template <typename T>
+    std::span<const T> read() {
+        static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= 8);
+
+        const std::span<const std::byte> bytes = read_bytes();
+        if (bytes.size() % sizeof(T) != 0) {
+            throw std::runtime_error{"Invalid binary image: misaligned array"};
+        }
+
+        return {reinterpret_cast<const T*>(bytes.data()), bytes.size() / sizeof(T)};
+    }
+
+    std::uint64_t read_value();
+
+private:
+    std::span<const std::byte> read_bytes();
+
+    std::span<const std::byte> image;
+    std::size_t offset = 0;
+};
+
+// array is an array which is either owned, or used in place in a mapped image until it is modified.
+template <typename T>
+class array {
+public:
+    array() = default;
+
+    explicit array(std::vector<T> owned) : owned(std::move(owned)) {}
+
+    std::span<const T> view() const {
+        return is_mapped ? mapped : std::span<const T>{owned};
+    }
+
+    // edit copies the mapped array before it is modified.
+    std::vector<T>& edit() {
+        if (is_mapped) {
+            owned.assign(mapped.begin(), mapped.end());
+            mapped = {};
+            is_mapped = false;
+        }
+
+        return owned;
+    }
+
+    // map uses data in place, which must outlive the array.
+    void map(std::span<const T> data) {
+        owned.clear();
+        mapped = data;
+        is_mapped = true;
+    }
+
+private:
+    std::vector<T> owned;
+    std::span<const T> mapped;
+    bool is_mapped = false;
+};
+} // namespace binary_image
+
+#endif
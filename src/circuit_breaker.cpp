@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <functional>
+#include <string_view>
+#include <utility>
+
+#include <fmt/format.h>
+
+#include "circuit_breaker.h"
+#include "format.h"
+
+namespace {
+// is_destination_failure returns true if err means that the destination can't be reached.
+bool is_destination_failure(const std::error_code& err) {
+    return err == asio::error::timed_out ||
+           err == asio::error::connection_refused ||
+           err == asio::error::host_unreachable ||
+           err == asio::error::network_unreachable;
+}
+} // namespace
+
+circuit_breaker::attempt::attempt(circuit_breaker* breaker, const asio::ip::tcp::endpoint& endpoint, bool probe)
+    : breaker(breaker),
+      endpoint(endpoint),
+      probe(probe) {}
+
+circuit_breaker::attempt::attempt(attempt&& other) noexcept
+    : breaker(std::exchange(other.breaker, nullptr)),
+      endpoint(other.endpoint),
+      probe(other.probe) {}
+
+circuit_breaker::attempt::~attempt() {
+    if (breaker && probe) {
+        breaker->abandoned(endpoint);
+    }
+}
+
+void circuit_breaker::attempt::succeeded() {
+    if (breaker) {
+        std::exchange(breaker, nullptr)->succeeded(endpoint);
+    }
+}
+
+void circuit_breaker::attempt::failed(const std::error_code& error) {
+    if (breaker && is_destination_failure(error)) {
+        std::exchange(breaker, nullptr)->failed(endpoint);
+    }
+}
+
+circuit_breaker::circuit_breaker() : circuit_breaker(options{}) {}
+
+circuit_breaker::circuit_breaker(const options& opts) : opts(opts) {}
+
+circuit_breaker::attempt circuit_breaker::begin(const asio::ip::tcp::endpoint& endpoint) {
+    shard& s = shard_of(endpoint);
+    std::lock_guard lock{s.mtx};
+
+    auto it = s.entries.find(endpoint);
+    if (it == s.entries.end() || it->second.failures < opts.failure_threshold) {
+        return attempt{this, endpoint, false};
+    }
+
+    entry& e = it->second;
+    if (clock::now() < e.open_until || e.probing) {
+        throw std::system_error{asio::error::host_unreachable, fmt::format("Circuit open: {}", endpoint)};
+    }
+
+    // half-open, let a single probe through
+    e.probing = true;
+    return attempt{this, endpoint, true};
+}
+
+bool circuit_breaker::is_open(const asio::ip::tcp::endpoint& endpoint) const {
+    const shard& s = shard_of(endpoint);
+    std::lock_guard lock{s.mtx};
+
+    auto it = s.entries.find(endpoint);
+    return it != s.entries.end() && it->second.failures >= opts.failure_threshold;
+}
+
+std::size_t circuit_breaker::size() const {
+    std::size_t n = 0;
+
+    for (const shard& s : shards) {
+        std::lock_guard lock{s.mtx};
+        n += s.entries.size();
+    }
+
+    return n;
+}
+
+std::size_t circuit_breaker::endpoint_hash::operator()(const asio::ip::tcp::endpoint& endpoint) const {
+    const asio::ip::address_v6::bytes_type bytes = endpoint.address().is_v4()
+                                                       ? asio::ip::make_address_v6(asio::ip::v4_mapped, endpoint.address().to_v4()).to_bytes()
+                                                       : endpoint.address().to_v6().to_bytes();
+
+    const std::size_t h = std::hash<std::string_view>{}(std::string_view{reinterpret_cast<const char*>(bytes.data()), bytes.size()});
+    return h ^ (std::size_t{endpoint.port()} * 0x9E3779B97F4A7C15ULL);
+}
+
+circuit_breaker::shard& circuit_breaker::shard_of(const asio::ip::tcp::endpoint& endpoint) {
+    return shards[endpoint_hash{}(endpoint) % shard_count];
+}
+
+const circuit_breaker::shard& circuit_breaker::shard_of(const asio::ip::tcp::endpoint& endpoint) const {
+    return shards[endpoint_hash{}(endpoint) % shard_count];
+}
+
+void circuit_breaker::succeeded(const asio::ip::tcp::endpoint& endpoint) {
+    shard& s = shard_of(endpoint);
+    std::lock_guard lock{s.mtx};
+
+    s.entries.erase(endpoint);
+}
+
+void circuit_breaker::failed(const asio::ip::tcp::endpoint& endpoint) {
+    shard& s = shard_of(endpoint);
+    std::lock_guard lock{s.mtx};
+
+    auto it = s.entries.find(endpoint);
+    if (it == s.entries.end()) {
+        if (s.entries.size() >= std::max<std::size_t>(opts.max_entries / shard_count, 1)) {
+            // forget an arbitrary destination rather than growing without bound
+            s.entries.erase(s.entries.begin());
+        }
+
+        it = s.entries.emplace(endpoint, entry{}).first;
+    }
+
+    entry& e = it->second;
+    e.failures++;
+    e.probing = false;
+
+    if (e.failures >= opts.failure_threshold) {
+        e.open_until = clock::now() + opts.cool_down;
+    }
+}
+
+void circuit_breaker::abandoned(const asio::ip::tcp::endpoint& endpoint) {
+    shard& s = shard_of(endpoint);
+    std::lock_guard lock{s.mtx};
+
+    if (auto it = s.entries.find(endpoint); it != s.entries.end()) {
+        it->second.probing = false;
+    }
+}
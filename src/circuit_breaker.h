@@ -0,0 +1,95 @@
+#ifndef CIRCUIT_BREAKER_H
+#define CIRCUIT_BREAKER_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <system_error>
+#include <unordered_map>
+
+#include <asio/ts/internet.hpp>
+
+// circuit_breaker remembers recent connect failures per destination, so that connects to a destination
+// that is down fail fast instead of each waiting for its own timeout.
+//
+// After failure_threshold consecutive failures the circuit of a destination opens, and connects to it are
+// rejected for cool_down. After that a single probe is let through, which closes the circuit on success
+// or opens it again on failure.
+class circuit_breaker {
+public:
+    struct options {
+        std::size_t failure_threshold = 5;
+        std::chrono::steady_clock::duration cool_down = std::chrono::seconds{10};
+
+        // Maximum number of destinations with recent failures that are remembered.
+        std::size_t max_entries = 65536;
+    };
+
+    // attempt is a connect attempt to a destination whose circuit is not open.
+    // An attempt that is neither succeeded nor failed doesn't affect the circuit.
+    class attempt {
+    public:
+        attempt(attempt&& other) noexcept;
+        attempt& operator=(attempt&&) = delete;
+        ~attempt();
+
+        void succeeded();
+
+        // failed records a connect failure. Errors which are not caused by the destination are ignored.
+        void failed(const std::error_code& error);
+
+    private:
+        friend class circuit_breaker;
+
+        attempt(circuit_breaker* breaker, const asio::ip::tcp::endpoint& endpoint, bool probe);
+
+        circuit_breaker* breaker;
+        asio::ip::tcp::endpoint endpoint;
+        bool probe;
+    };
+
+    circuit_breaker();
+    explicit circuit_breaker(const options& opts);
+
+    // begin starts a connect attempt to endpoint.
+    // Throws std::system_error if the circuit of endpoint is open.
+    attempt begin(const asio::ip::tcp::endpoint& endpoint);
+
+    bool is_open(const asio::ip::tcp::endpoint& endpoint) const;
+
+    // size returns the number of destinations with recent failures.
+    std::size_t size() const;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct endpoint_hash {
+        std::size_t operator()(const asio::ip::tcp::endpoint& endpoint) const;
+    };
+
+    struct entry {
+        std::size_t failures = 0;
+        clock::time_point open_until;
+        bool probing = false;
+    };
+
+    struct shard {
+        mutable std::mutex mtx;
+        std::unordered_map<asio::ip::tcp::endpoint, entry, endpoint_hash> entries;
+    };
+
+    static constexpr std::size_t shard_count = 16;
+
+    shard& shard_of(const asio::ip::tcp::endpoint& endpoint);
+    const shard& shard_of(const asio::ip::tcp::endpoint& endpoint) const;
+
+    void succeeded(const asio::ip::tcp::endpoint& endpoint);
+    void failed(const asio::ip::tcp::endpoint& endpoint);
+    void abandoned(const asio::ip::tcp::endpoint& endpoint);
+
+    options opts;
+    std::array<shard, shard_count> shards;
+};
+
+#endif
@@ -43,6 +43,10 @@ bool config::verify_params() {
             return false;
         }
 
+        if (balance != "latency" && balance != "weighted") {
+            return false;
+        }
+
         break;
     }
 
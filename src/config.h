@@ -1,8 +1,10 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <cstddef>
 #include <optional>
 #include <string>
+#include <vector>
 
 #include "ss_url.h"
 
@@ -26,6 +28,50 @@ struct config {
     std::string password;
 
     std::optional<std::string> acl_file_path;
+
+    // file the ACL rule profile is written to on SIGUSR1, profiling is off without it
+    std::optional<std::string> acl_profile_path;
+
+    // admission control, 0 means unlimited
+    std::size_t max_sessions = 0;
+    std::size_t max_handshakes = 0;
+
+    // fair scheduling, bulk flows yield after this many bytes or milliseconds (0 disables it)
+    std::size_t yield_bytes = 256 * 1024;
+    int yield_time = 2;
+
+    // source addresses of the outbound connections of ss-remote
+    std::vector<std::string> egress_addresses;
+
+    // name servers for resolving target host names, the ones of resolv.conf if empty
+    std::vector<std::string> dns_servers;
+
+    // port and address of the DNS forwarder of ss-local, and the name server it queries through ss-remote
+    std::optional<std::string> dns_local_port;
+    std::string dns_local_address = "127.0.0.1";
+    std::string dns_upstream = "8.8.8.8";
+
+    // seconds allowed for the sessions to finish when shutting down
+    int drain_timeout = 30;
+
+    // seconds allowed for connecting to the target or ss-remote (0 disables it)
+    int connect_timeout = 10;
+
+    // idle connections ss-local keeps to ss-remote, and seconds they are kept for
+    std::size_t warm_pool_size = 0;
+    int warm_pool_idle = 30;
+
+    // connections ss-local multiplexes its sessions over (0 disables multiplexing)
+    std::size_t mux_connections = 0;
+
+    // more ss-remote servers (host[:port]) ss-local balances its sessions across, sharing the method and password
+    std::vector<std::string> remote_servers;
+
+    // "latency" sends new sessions to the fastest server, "weighted" spreads them in inverse proportion to latency
+    std::string balance = "latency";
+
+    // seconds between the latency probes of the ss-remote servers
+    int probe_interval = 30;
 };
 
 #endif
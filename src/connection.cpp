@@ -7,71 +7,86 @@
 
 connection::connection(tcp_socket s)
     : socket(std::move(s)),
-      read_timer(socket.get_executor()),
-      connection_timer(socket.get_executor()) {}
+      timeouts(socket) {}
 
 connection::~connection() {
-    // we have to cancel these timers first because they may be referencing the socket
-    read_timer.cancel();
-    connection_timer.cancel();
+    // we have to cancel the timer first because it is referencing the socket
+    timeouts.cancel();
+}
+
+asio::awaitable<void> connection::wait_read() {
+    timeouts.update_read();
+
+    try {
+        co_await socket.async_wait(tcp_socket::wait_read);
+    } catch (const std::system_error& e) {
+        throw_timeout_error(e);
+    }
 }
 
 asio::awaitable<std::size_t> connection::read(std::span<std::uint8_t> buffer) {
-    read_timer.update();
-    connection_timer.update();
+    timeouts.update_read();
 
     std::size_t size = 0;
 
     try {
         size = co_await socket.async_read_some(asio::buffer(buffer.data(), buffer.size()));
     } catch (const std::system_error& e) {
-        if (read_timer.is_expired()) {
-            throw std::system_error{asio::error::timed_out, "Read timeout"};
-        } else if (connection_timer.is_expired()) {
-            throw std::system_error{asio::error::timed_out, "Connection timeout"};
-        } else {
-            throw std::system_error{e};
-        }
+        throw_timeout_error(e);
     }
 
     co_return size;
 }
 
 asio::awaitable<std::size_t> connection::write(std::span<const std::uint8_t> buffer) {
-    connection_timer.update();
+    timeouts.update_write();
 
     std::size_t size = 0;
 
     try {
         size = co_await asio::async_write(socket, asio::buffer(buffer.data(), buffer.size()));
     } catch (const std::system_error& e) {
-        if (connection_timer.is_expired()) {
-            throw std::system_error{asio::error::timed_out, "Connection timeout"};
-        } else {
-            throw std::system_error{e};
-        }
+        throw_timeout_error(e);
     }
 
     co_return size;
 }
 
+asio::awaitable<bool> connection::wait_disconnect() {
+    try {
+        co_await socket.async_wait(tcp_socket::wait_read);
+    } catch (const std::system_error& e) {
+        co_return e.code() != asio::error::operation_aborted;
+    }
+
+    // readable without anything to read means the end of the stream
+    std::error_code error;
+    const std::size_t size = socket.available(error);
+
+    co_return error || size == 0;
+}
+
+void connection::cancel() {
+    std::error_code ignore_error;
+    socket.cancel(ignore_error);
+}
+
 void connection::close() {
     std::error_code ignore_error;
     socket.shutdown(asio::ip::tcp::socket::shutdown_send, ignore_error);
 }
 
+void connection::abort() {
+    std::error_code ignore_error;
+    socket.close(ignore_error);
+}
+
 void connection::set_read_timeout(int val) {
-    read_timer.set_timeout(val, [this] {
-        std::error_code ignore_error;
-        socket.cancel(ignore_error);
-    });
+    timeouts.set_read_timeout(val);
 }
 
 void connection::set_connection_timeout(int val) {
-    connection_timer.set_timeout(val, [this] {
-        std::error_code ignore_error;
-        socket.cancel(ignore_error);
-    });
+    timeouts.set_connection_timeout(val);
 }
 
 asio::ip::tcp::endpoint connection::local_endpoint() const {
@@ -81,3 +96,14 @@ asio::ip::tcp::endpoint connection::local_endpoint() const {
 asio::ip::tcp::endpoint connection::remote_endpoint() const {
     return socket.remote_endpoint();
 }
+
+void connection::throw_timeout_error(const std::system_error& e) const {
+    switch (timeouts.expired()) {
+    case timer::kind::read:
+        throw std::system_error{asio::error::timed_out, "Read timeout"};
+    case timer::kind::connection:
+        throw std::system_error{asio::error::timed_out, "Connection timeout"};
+    default:
+        throw std::system_error{e};
+    }
+}
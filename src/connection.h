@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <optional>
 #include <span>
+#include <system_error>
 
 #include <asio/awaitable.hpp>
 #include <asio/ts/timer.hpp>
@@ -17,11 +18,23 @@ public:
     explicit connection(tcp_socket s);
     ~connection();
 
+    // wait_read waits until the socket is readable, so that callers don't need to hold a buffer while idle.
+    asio::awaitable<void> wait_read();
     asio::awaitable<std::size_t> read(std::span<std::uint8_t> buffer);
     asio::awaitable<std::size_t> write(std::span<const std::uint8_t> buffer);
 
+    // wait_disconnect waits until the peer closes the connection or sends more data.
+    // Returns true in the first case, and false if the wait is cancelled.
+    asio::awaitable<bool> wait_disconnect();
+
+    // cancel cancels all outstanding operations.
+    void cancel();
+
     void close();
 
+    // abort cancels all outstanding operations and closes the socket.
+    void abort();
+
     void set_read_timeout(int val);
     void set_connection_timeout(int val);
 
@@ -32,8 +45,10 @@ protected:
     tcp_socket socket;
 
 private:
-    timer read_timer;
-    timer connection_timer;
+    // throw_timeout_error rethrows e, or a timeout error if e was caused by a timeout.
+    [[noreturn]] void throw_timeout_error(const std::system_error& e) const;
+
+    timer timeouts;
 };
 
 #endif
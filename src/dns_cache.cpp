@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <utility>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/post.hpp>
+#include <asio/redirect_error.hpp>
+#include <asio/use_awaitable.hpp>
+
+#include "dns_cache.h"
+
+namespace {
+// The TTL assumed for system_lookup results.
+constexpr auto system_lookup_ttl = std::chrono::seconds{60};
+
+// is_negative returns true if err means that the name has no addresses.
+bool is_negative(const std::error_code& err) {
+    return err == asio::error::host_not_found || err == asio::error::no_data;
+}
+} // namespace
+
+dns_cache::dns_cache(lookup_function lookup) : dns_cache(std::move(lookup), options{}) {}
+
+dns_cache::dns_cache(lookup_function lookup, const options& opts)
+    : lookup_host(std::move(lookup)),
+      opts(opts) {}
+
+asio::awaitable<std::vector<asio::ip::address>> dns_cache::resolve(std::string_view name) {
+    const std::string host{name};
+    shard& s = shard_of(host);
+    auto executor = co_await asio::this_coro::executor;
+
+    bool counted = false;
+
+    while (true) {
+        std::shared_ptr<steady_timer> waiter;
+        bool refresh = false;
+        bool lookup_now = false;
+
+        {
+            std::lock_guard lock{s.mtx};
+
+            auto it = s.entries.find(host);
+            if (it == s.entries.end()) {
+                evict(s);
+                it = s.entries.emplace(host, entry{}).first;
+            }
+
+            entry& e = it->second;
+            const auto now = clock::now();
+
+            if (e.resolved && now < e.expires) {
+                if (!counted) {
+                    (e.error ? metrics.negative_hits : metrics.hits)++;
+                }
+
+                if (e.error) {
+                    throw std::system_error{e.error, host};
+                }
+
+                co_return e.addresses;
+            }
+
+            if (e.resolved && !e.error && now < e.expires + opts.stale_ttl) {
+                metrics.stale_hits++;
+
+                if (!e.resolving) {
+                    e.resolving = true;
+                    refresh = true;
+                } else {
+                    co_return e.addresses;
+                }
+            } else if (e.resolving) {
+                if (!counted) {
+                    metrics.coalesced++;
+                }
+
+                waiter = std::make_shared<steady_timer>(executor, clock::time_point::max());
+                e.waiters.push_back(waiter);
+            } else {
+                if (!counted) {
+                    metrics.misses++;
+                }
+
+                e.resolving = true;
+                lookup_now = true;
+            }
+
+            if (refresh) {
+                // serve the stale addresses, the lookup continues in the background
+                std::vector<asio::ip::address> addresses = e.addresses;
+                asio::co_spawn(executor, [self = shared_from_this(), host]() {
+                    return self->lookup(host);
+                }, asio::detached);
+
+                co_return addresses;
+            }
+        }
+
+        counted = true;
+
+        if (lookup_now) {
+            co_await lookup(host);
+        } else {
+            std::error_code ignore_error;
+            co_await waiter->async_wait(asio::redirect_error(asio::use_awaitable, ignore_error));
+        }
+
+        // the entry is resolved now, unless it was evicted in the meantime
+    }
+}
+
+dns_cache::stats dns_cache::get_stats() const {
+    return {
+        .hits = metrics.hits.load(std::memory_order_relaxed),
+        .stale_hits = metrics.stale_hits.load(std::memory_order_relaxed),
+        .negative_hits = metrics.negative_hits.load(std::memory_order_relaxed),
+        .misses = metrics.misses.load(std::memory_order_relaxed),
+        .coalesced = metrics.coalesced.load(std::memory_order_relaxed),
+        .lookups = metrics.lookups.load(std::memory_order_relaxed),
+        .lookup_failures = metrics.lookup_failures.load(std::memory_order_relaxed),
+        .lookup_time = clock::duration{metrics.lookup_time.load(std::memory_order_relaxed)},
+        .max_lookup_time = clock::duration{metrics.max_lookup_time.load(std::memory_order_relaxed)},
+    };
+}
+
+std::size_t dns_cache::size() const {
+    std::size_t n = 0;
+
+    for (const shard& s : shards) {
+        std::lock_guard lock{s.mtx};
+        n += s.entries.size();
+    }
+
+    return n;
+}
+
+dns_cache::shard& dns_cache::shard_of(const std::string& host) {
+    return shards[std::hash<std::string>{}(host) % shard_count];
+}
+
+asio::awaitable<void> dns_cache::lookup(std::string host) {
+    const auto start = clock::now();
+
+    answer result;
+    std::error_code error;
+
+    try {
+        result = co_await lookup_host(host);
+    } catch (const std::system_error& e) {
+        error = e.code();
+    }
+
+    const auto elapsed = (clock::now() - start).count();
+
+    metrics.lookups++;
+    metrics.lookup_time += elapsed;
+
+    auto max = metrics.max_lookup_time.load(std::memory_order_relaxed);
+    while (elapsed > max && !metrics.max_lookup_time.compare_exchange_weak(max, elapsed, std::memory_order_relaxed)) {
+    }
+
+    if (!error && result.addresses.empty()) {
+        error = asio::error::no_data;
+    }
+
+    if (error) {
+        metrics.lookup_failures++;
+    }
+
+    store(host, error ? nullptr : &result, error);
+}
+
+void dns_cache::store(const std::string& host, const answer* result, const std::error_code& error) {
+    shard& s = shard_of(host);
+    std::vector<std::shared_ptr<steady_timer>> waiters;
+
+    {
+        std::lock_guard lock{s.mtx};
+
+        auto it = s.entries.find(host);
+        if (it == s.entries.end()) {
+            return;
+        }
+
+        entry& e = it->second;
+        const auto now = clock::now();
+
+        e.resolving = false;
+        waiters = std::move(e.waiters);
+        e.waiters.clear();
+
+        if (result) {
+            e.resolved = true;
+            e.addresses = result->addresses;
+            e.error.clear();
+            e.expires = now + std::clamp(result->ttl, opts.min_ttl, opts.max_ttl);
+        } else if (!e.resolved || e.error || now >= e.expires + opts.stale_ttl) {
+            // a failed refresh keeps serving the stale addresses
+            e.resolved = true;
+            e.addresses.clear();
+            e.error = error;
+            e.expires = now + (is_negative(error) ? opts.negative_ttl : opts.failure_ttl);
+        }
+    }
+
+    for (auto& waiter : waiters) {
+        // on the executor of the waiter, setting the expiry also completes a wait which hasn't started yet
+        asio::post(waiter->get_executor(), [waiter] {
+            waiter->expires_at(clock::time_point::min());
+        });
+    }
+}
+
+void dns_cache::evict(shard& s) {
+    if (s.entries.size() < std::max<std::size_t>(opts.max_entries / shard_count, 1)) {
+        return;
+    }
+
+    // drop the entries which can't be served anymore, or an arbitrary idle one if there are none
+    const auto now = clock::now();
+    std::erase_if(s.entries, [this, now](const auto& item) {
+        const entry& e = item.second;
+        return !e.resolving && e.expires + opts.stale_ttl <= now;
+    });
+
+    if (s.entries.size() >= std::max<std::size_t>(opts.max_entries / shard_count, 1)) {
+        auto it = std::find_if(s.entries.begin(), s.entries.end(), [](const auto& item) {
+            return !item.second.resolving;
+        });
+
+        if (it != s.entries.end()) {
+            s.entries.erase(it);
+        }
+    }
+}
+
+asio::awaitable<dns_cache::answer> system_lookup(std::string host) {
+    tcp_resolver resolver{co_await asio::this_coro::executor};
+    const tcp_resolver::results_type results = co_await resolver.async_resolve(host, "");
+
+    dns_cache::answer result{.ttl = system_lookup_ttl};
+    for (const auto& r : results) {
+        const asio::ip::address addr = r.endpoint().address();
+
+        if (std::find(result.addresses.begin(), result.addresses.end(), addr) == result.addresses.end()) {
+            result.addresses.push_back(addr);
+        }
+    }
+
+    co_return result;
+}
@@ -0,0 +1,130 @@
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include <asio/awaitable.hpp>
+#include <asio/ts/internet.hpp>
+
+#include "awaitable.h"
+
+// dns_cache caches the addresses of host names for their TTL.
+//
+// Concurrent queries for the same name share a single lookup, failed lookups are cached for a short time,
+// and an expired entry is still served for a while after it expires, while it is refreshed in the background.
+//
+// resolve must be called from a strand, because the callers waiting for a shared lookup are woken up
+// through their executors.
+class dns_cache : public std::enable_shared_from_this<dns_cache> {
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct answer {
+        std::vector<asio::ip::address> addresses;
+        clock::duration ttl;
+    };
+
+    // lookup resolves a host name, and throws std::system_error on failure.
+    using lookup_function = std::function<asio::awaitable<answer>(std::string host)>;
+
+    struct options {
+        // TTLs are clamped to this range.
+        clock::duration min_ttl = std::chrono::seconds{5};
+        clock::duration max_ttl = std::chrono::hours{1};
+
+        // How long names that don't exist are cached.
+        clock::duration negative_ttl = std::chrono::seconds{30};
+
+        // How long other lookup failures are cached.
+        clock::duration failure_ttl = std::chrono::seconds{1};
+
+        // How long an expired entry is still served while it is refreshed.
+        clock::duration stale_ttl = std::chrono::minutes{5};
+
+        // Maximum number of cached names.
+        std::size_t max_entries = 65536;
+    };
+
+    struct stats {
+        std::uint64_t hits;
+        std::uint64_t stale_hits;
+        std::uint64_t negative_hits;
+        std::uint64_t misses;
+        std::uint64_t coalesced;
+        std::uint64_t lookups;
+        std::uint64_t lookup_failures;
+        clock::duration lookup_time; // total
+        clock::duration max_lookup_time;
+    };
+
+    explicit dns_cache(lookup_function lookup);
+    dns_cache(lookup_function lookup, const options& opts);
+
+    // resolve returns the addresses of host.
+    asio::awaitable<std::vector<asio::ip::address>> resolve(std::string_view host);
+
+    stats get_stats() const;
+
+    // size returns the number of cached names.
+    std::size_t size() const;
+
+private:
+    struct entry {
+        // the result of the last lookup, valid if resolved
+        bool resolved = false;
+        std::vector<asio::ip::address> addresses;
+        std::error_code error;
+        clock::time_point expires;
+
+        // waiters are woken up when the pending lookup finishes
+        bool resolving = false;
+        std::vector<std::shared_ptr<steady_timer>> waiters;
+    };
+
+    struct shard {
+        mutable std::mutex mtx;
+        std::unordered_map<std::string, entry> entries;
+    };
+
+    static constexpr std::size_t shard_count = 16;
+
+    shard& shard_of(const std::string& host);
+
+    // lookup runs a lookup for host and stores the result.
+    asio::awaitable<void> lookup(std::string host);
+    void store(const std::string& host, const answer* result, const std::error_code& error);
+    void evict(shard& s);
+
+    lookup_function lookup_host;
+    options opts;
+    std::array<shard, shard_count> shards;
+
+    struct counters {
+        std::atomic<std::uint64_t> hits = 0;
+        std::atomic<std::uint64_t> stale_hits = 0;
+        std::atomic<std::uint64_t> negative_hits = 0;
+        std::atomic<std::uint64_t> misses = 0;
+        std::atomic<std::uint64_t> coalesced = 0;
+        std::atomic<std::uint64_t> lookups = 0;
+        std::atomic<std::uint64_t> lookup_failures = 0;
+        std::atomic<clock::rep> lookup_time = 0;
+        std::atomic<clock::rep> max_lookup_time = 0;
+    } metrics;
+};
+
+// system_lookup resolves host names with getaddrinfo, which doesn't report TTLs.
+asio::awaitable<dns_cache::answer> system_lookup(std::string host);
+
+#endif
@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <array>
+#include <utility>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/read.hpp>
+#include <asio/redirect_error.hpp>
+#include <asio/use_awaitable.hpp>
+#include <asio/write.hpp>
+#include <spdlog/spdlog.h>
+
+#include "dns_forwarder.h"
+
+namespace {
+using namespace std::chrono_literals;
+
+// The accept loop pauses this long after accepting fails.
+constexpr auto accept_backoff = 100ms;
+
+// The ID and the question follow each other at the start of a message.
+constexpr std::size_t id_size = 2;
+constexpr std::size_t question_offset = 12;
+
+std::string cache_key(const dns::message_info& info) {
+    return info.name + '/' + std::to_string(info.type) + '/' + std::to_string(info.qclass);
+}
+
+std::uint32_t get32(std::span<const std::uint8_t> data, std::size_t offset) {
+    return static_cast<std::uint32_t>(data[offset]) << 24 |
+           static_cast<std::uint32_t>(data[offset + 1]) << 16 |
+           static_cast<std::uint32_t>(data[offset + 2]) << 8 |
+           static_cast<std::uint32_t>(data[offset + 3]);
+}
+
+void put32(std::span<std::uint8_t> data, std::size_t offset, std::uint32_t val) {
+    data[offset] = static_cast<std::uint8_t>(val >> 24);
+    data[offset + 1] = static_cast<std::uint8_t>(val >> 16);
+    data[offset + 2] = static_cast<std::uint8_t>(val >> 8);
+    data[offset + 3] = static_cast<std::uint8_t>(val);
+}
+} // namespace
+
+dns_forwarder::dns_forwarder(std::shared_ptr<const live_acl> acl, exchange_function direct, exchange_function tunnel)
+    : dns_forwarder(std::move(acl), std::move(direct), std::move(tunnel), options{}) {}
+
+dns_forwarder::dns_forwarder(std::shared_ptr<const live_acl> acl,
+                             exchange_function direct,
+                             exchange_function tunnel,
+                             const options& opts)
+    : acl(std::move(acl)),
+      direct(std::move(direct)),
+      tunnel(std::move(tunnel)),
+      opts(opts) {}
+
+asio::awaitable<std::vector<std::uint8_t>> dns_forwarder::answer(std::span<const std::uint8_t> query) {
+    const std::optional<dns::message_info> info = dns::inspect(query);
+    if (!info || info->is_response) {
+        co_return std::vector<std::uint8_t>{};
+    }
+
+    co_return co_await answer(query, *info);
+}
+
+asio::awaitable<std::vector<std::uint8_t>> dns_forwarder::answer(std::span<const std::uint8_t> query, const dns::message_info& info) {
+    const std::string key = cache_key(info);
+
+    if (auto it = entries.find(key); it != entries.end()) {
+        const clock::time_point now = clock::now();
+
+        if (now < it->second.expires) {
+            metrics.hits++;
+
+            std::vector<std::uint8_t> response = it->second.response;
+
+            // with the ID of the client, and its case of the name
+            std::copy_n(query.begin(), id_size, response.begin());
+            std::copy(query.begin() + question_offset, query.begin() + info.question_end, response.begin() + question_offset);
+
+            // the TTLs count down from when the response was received
+            const auto elapsed = static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(now - it->second.stored).count());
+            for (std::size_t offset : it->second.ttl_offsets) {
+                const std::uint32_t ttl = get32(response, offset);
+                put32(response, offset, ttl - std::min(ttl, elapsed));
+            }
+
+            co_return response;
+        }
+
+        entries.erase(it);
+    }
+
+    metrics.misses++;
+
+    // names are looked up locally only if the ACL bypasses them for sure
+    const bool bypass = acl && acl->is_bypass_host(info.name).value_or(false);
+    spdlog::debug("Forward DNS query {} (type {}) {}", info.name, info.type, bypass ? "directly" : "through the tunnel");
+
+    std::vector<std::uint8_t> response;
+    try {
+        response = co_await (bypass ? direct : tunnel)(std::vector<std::uint8_t>(query.begin(), query.end()));
+        (bypass ? metrics.direct : metrics.tunneled)++;
+    } catch (const std::system_error& e) {
+        spdlog::debug("DNS query {} failed: {}", info.name, e.what());
+    }
+
+    if (!dns::is_response_to(response, query)) {
+        metrics.failures++;
+        co_return dns::make_empty_response(query, info.question_end, dns::rcode::server_failure);
+    }
+
+    store(key, response);
+    co_return response;
+}
+
+asio::awaitable<void> dns_forwarder::serve_udp(std::shared_ptr<udp_socket> socket) {
+    auto executor = co_await asio::this_coro::executor;
+    std::array<std::uint8_t, dns::max_udp_size> buffer;
+
+    while (socket->is_open()) {
+        asio::ip::udp::endpoint client;
+        std::error_code error;
+        const std::size_t n = co_await socket->async_receive_from(asio::buffer(buffer), client, asio::redirect_error(asio::use_awaitable, error));
+
+        if (error) {
+            if (!socket->is_open()) {
+                // closed for draining
+                break;
+            }
+
+            spdlog::debug("DNS receive: {}", error.message());
+            continue;
+        }
+
+        // the queries are answered concurrently, on the strand of the forwarder
+        asio::co_spawn(
+            executor,
+            [self = shared_from_this(), socket, query = std::vector<std::uint8_t>(buffer.begin(), buffer.begin() + n), client]() -> asio::awaitable<void> {
+                co_await self->handle_udp(socket, std::move(query), client);
+            },
+            asio::detached);
+    }
+}
+
+asio::awaitable<void> dns_forwarder::serve_tcp(tcp_acceptor& acceptor) {
+    auto executor = co_await asio::this_coro::executor;
+    steady_timer backoff_timer{executor};
+
+    while (acceptor.is_open()) {
+        auto socket = std::make_shared<tcp_socket>(executor);
+
+        std::error_code error;
+        co_await acceptor.async_accept(*socket, asio::redirect_error(asio::use_awaitable, error));
+
+        if (error) {
+            if (!acceptor.is_open()) {
+                // closed for draining
+                break;
+            }
+
+            spdlog::warn("DNS accept: {}", error.message());
+
+            backoff_timer.expires_after(accept_backoff);
+            co_await backoff_timer.async_wait();
+            continue;
+        }
+
+        asio::co_spawn(
+            executor,
+            [self = shared_from_this(), socket]() -> asio::awaitable<void> {
+                co_await self->handle_tcp(socket);
+            },
+            asio::detached);
+    }
+}
+
+dns_forwarder::stats dns_forwarder::get_stats() const {
+    return {
+        .hits = metrics.hits,
+        .misses = metrics.misses,
+        .direct = metrics.direct,
+        .tunneled = metrics.tunneled,
+        .failures = metrics.failures,
+    };
+}
+
+std::size_t dns_forwarder::size() const {
+    return entries.size();
+}
+
+asio::awaitable<void> dns_forwarder::handle_udp(std::shared_ptr<udp_socket> socket, std::vector<std::uint8_t> query, asio::ip::udp::endpoint client) {
+    const std::optional<dns::message_info> info = dns::inspect(query);
+    if (!info || info->is_response) {
+        co_return;
+    }
+
+    std::vector<std::uint8_t> response = co_await answer(query, *info);
+
+    // the client retries over TCP
+    if (response.size() > info->udp_payload_size) {
+        response = dns::make_empty_response(response, info->question_end, dns::rcode::no_error, true);
+    }
+
+    std::error_code ignore_error;
+    co_await socket->async_send_to(asio::buffer(response), client, asio::redirect_error(asio::use_awaitable, ignore_error));
+}
+
+asio::awaitable<void> dns_forwarder::handle_tcp(std::shared_ptr<tcp_socket> socket) {
+    steady_timer idle_timer{socket->get_executor()};
+
+    try {
+        while (true) {
+            // clients keep the connection open for more queries, but not forever
+            idle_timer.expires_after(opts.idle_timeout);
+            idle_timer.async_wait([weak = std::weak_ptr<tcp_socket>{socket}](const std::error_code& error) {
+                if (auto s = weak.lock(); s && !error) {
+                    std::error_code ignore_error;
+                    s->close(ignore_error);
+                }
+            });
+
+            // messages are prefixed with their length over TCP
+            std::array<std::uint8_t, 2> length;
+            co_await asio::async_read(*socket, asio::buffer(length));
+
+            std::vector<std::uint8_t> query(length[0] << 8 | length[1]);
+            co_await asio::async_read(*socket, asio::buffer(query));
+
+            idle_timer.cancel();
+
+            const std::optional<dns::message_info> info = dns::inspect(query);
+            if (!info || info->is_response) {
+                break;
+            }
+
+            const std::vector<std::uint8_t> response = co_await answer(query, *info);
+
+            length = {static_cast<std::uint8_t>(response.size() >> 8), static_cast<std::uint8_t>(response.size())};
+            co_await asio::async_write(*socket, std::array<asio::const_buffer, 2>{asio::buffer(length), asio::buffer(response)});
+        }
+    } catch (const std::system_error&) {
+        // the client has disconnected, or has been idle for too long
+    }
+}
+
+void dns_forwarder::store(const std::string& key, std::vector<std::uint8_t> response) {
+    std::optional<dns::message_info> info = dns::inspect(response);
+    if (!info || info->truncated || (info->code != dns::rcode::no_error && info->code != dns::rcode::name_error)) {
+        return;
+    }
+
+    auto ttl = static_cast<std::uint32_t>(opts.max_ttl.count());
+    for (std::size_t offset : info->ttl_offsets) {
+        ttl = std::min(ttl, get32(response, offset));
+    }
+
+    // negative responses are cached for the TTL of their SOA record, within negative_ttl
+    if (info->code == dns::rcode::name_error || info->answer_count == 0) {
+        ttl = std::min(ttl, static_cast<std::uint32_t>(opts.negative_ttl.count()));
+    }
+
+    if (ttl == 0) {
+        return;
+    }
+
+    evict();
+
+    const clock::time_point now = clock::now();
+    entries.insert_or_assign(key, entry{
+                                      .response = std::move(response),
+                                      .ttl_offsets = std::move(info->ttl_offsets),
+                                      .stored = now,
+                                      .expires = now + std::chrono::seconds{ttl},
+                                  });
+}
+
+void dns_forwarder::evict() {
+    if (entries.size() < opts.max_entries) {
+        return;
+    }
+
+    const clock::time_point now = clock::now();
+    std::erase_if(entries, [now](const auto& item) {
+        return item.second.expires <= now;
+    });
+
+    // still full of live entries, make room for one
+    if (entries.size() >= opts.max_entries) {
+        entries.erase(entries.begin());
+    }
+}
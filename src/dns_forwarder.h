@@ -0,0 +1,108 @@
+#ifndef DNS_FORWARDER_H
+#define DNS_FORWARDER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <asio/awaitable.hpp>
+
+#include "awaitable.h"
+#include "dns_message.h"
+#include "live_acl.h"
+
+// dns_forwarder is a caching DNS forwarder, serving the clients of ss-local over UDP and TCP.
+//
+// Responses are cached for the smallest TTL of their records, and served from the cache with the TTLs
+// counted down. Queries for names the ACL bypasses are forwarded directly, the others through the tunnel,
+// so that the names the clients look up don't leak to the local network.
+//
+// The cache isn't synchronized, so a forwarder must only be used from a single strand.
+class dns_forwarder : public std::enable_shared_from_this<dns_forwarder> {
+public:
+    using clock = std::chrono::steady_clock;
+
+    // exchange sends a query upstream, and returns the response with the same ID.
+    // It throws std::system_error on failure.
+    using exchange_function = std::function<asio::awaitable<std::vector<std::uint8_t>>(std::vector<std::uint8_t> query)>;
+
+    struct options {
+        // TTLs are capped at this.
+        std::chrono::seconds max_ttl{3600};
+
+        // How long responses without answers are cached, at most.
+        std::chrono::seconds negative_ttl{30};
+
+        // Maximum number of cached responses.
+        std::size_t max_entries = 4096;
+
+        // TCP clients are disconnected after this long without a query.
+        std::chrono::seconds idle_timeout{10};
+    };
+
+    struct stats {
+        std::uint64_t hits;
+        std::uint64_t misses;
+        std::uint64_t direct;
+        std::uint64_t tunneled;
+        std::uint64_t failures;
+    };
+
+    dns_forwarder(std::shared_ptr<const live_acl> acl, exchange_function direct, exchange_function tunnel);
+    dns_forwarder(std::shared_ptr<const live_acl> acl, exchange_function direct, exchange_function tunnel, const options& opts);
+
+    // answer returns the response to query, from the cache or from upstream, or SERVFAIL if upstream fails.
+    // It returns an empty message if query is malformed.
+    asio::awaitable<std::vector<std::uint8_t>> answer(std::span<const std::uint8_t> query);
+
+    // serve_udp answers the queries received on socket until it is closed.
+    asio::awaitable<void> serve_udp(std::shared_ptr<udp_socket> socket);
+
+    // serve_tcp answers the queries of the clients accepted on acceptor until it is closed.
+    asio::awaitable<void> serve_tcp(tcp_acceptor& acceptor);
+
+    stats get_stats() const;
+
+    // size returns the number of cached responses.
+    std::size_t size() const;
+
+private:
+    struct entry {
+        std::vector<std::uint8_t> response;
+        std::vector<std::size_t> ttl_offsets;
+        clock::time_point stored;
+        clock::time_point expires;
+    };
+
+    asio::awaitable<std::vector<std::uint8_t>> answer(std::span<const std::uint8_t> query, const dns::message_info& info);
+    asio::awaitable<void> handle_udp(std::shared_ptr<udp_socket> socket, std::vector<std::uint8_t> query, asio::ip::udp::endpoint client);
+    asio::awaitable<void> handle_tcp(std::shared_ptr<tcp_socket> socket);
+
+    void store(const std::string& key, std::vector<std::uint8_t> response);
+    void evict();
+
+    std::shared_ptr<const live_acl> acl;
+    exchange_function direct;
+    exchange_function tunnel;
+    options opts;
+
+    // keyed by name, type and class
+    std::unordered_map<std::string, entry> entries;
+
+    struct counters {
+        std::atomic<std::uint64_t> hits = 0;
+        std::atomic<std::uint64_t> misses = 0;
+        std::atomic<std::uint64_t> direct = 0;
+        std::atomic<std::uint64_t> tunneled = 0;
+        std::atomic<std::uint64_t> failures = 0;
+    } metrics;
+};
+
+#endif
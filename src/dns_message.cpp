@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <limits>
+
+#include "dns_message.h"
+
+namespace {
+constexpr std::size_t header_size = 12;
+constexpr std::size_t max_name_size = 255;
+constexpr std::size_t max_label_size = 63;
+
+constexpr std::uint16_t class_in = 1;
+
+// header flags
+constexpr std::uint16_t flag_qr = 0x8000;
+constexpr std::uint16_t flag_tc = 0x0200;
+constexpr std::uint16_t flag_rd = 0x0100;
+constexpr std::uint16_t flag_ra = 0x0080;
+constexpr std::uint16_t rcode_mask = 0x000f;
+
+void put16(std::vector<std::uint8_t>& out, std::uint16_t val) {
+    out.push_back(static_cast<std::uint8_t>(val >> 8));
+    out.push_back(static_cast<std::uint8_t>(val));
+}
+
+std::uint16_t get16(std::span<const std::uint8_t> data, std::size_t offset) {
+    return static_cast<std::uint16_t>(data[offset] << 8 | data[offset + 1]);
+}
+
+std::uint32_t get32(std::span<const std::uint8_t> data, std::size_t offset) {
+    return static_cast<std::uint32_t>(get16(data, offset)) << 16 | get16(data, offset + 2);
+}
+
+// skip_name returns the offset following the (possibly compressed) name at offset, or std::nullopt if it is malformed.
+std::optional<std::size_t> skip_name(std::span<const std::uint8_t> data, std::size_t offset) {
+    while (offset < data.size()) {
+        const std::uint8_t len = data[offset];
+
+        if (len == 0) {
+            return offset + 1;
+        }
+
+        if ((len & 0xc0) == 0xc0) {
+            // a pointer ends the name
+            return offset + 2 <= data.size() ? std::optional{offset + 2} : std::nullopt;
+        }
+
+        if ((len & 0xc0) != 0) {
+            return std::nullopt;
+        }
+
+        offset += 1 + len;
+    }
+
+    return std::nullopt;
+}
+
+bool equal_ignore_case(std::span<const std::uint8_t> a, std::span<const std::uint8_t> b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](std::uint8_t x, std::uint8_t y) {
+        return std::tolower(x) == std::tolower(y);
+    });
+}
+} // namespace
+
+std::optional<std::vector<std::uint8_t>> dns::make_query(std::uint16_t id, std::string_view name, record_type type) {
+    if (name.ends_with('.')) {
+        name.remove_suffix(1);
+    }
+
+    if (name.empty() || name.size() + 2 > max_name_size) {
+        return std::nullopt;
+    }
+
+    std::vector<std::uint8_t> query;
+    query.reserve(header_size + name.size() + 2 + 4 + 11);
+
+    put16(query, id);
+    put16(query, flag_rd);
+    put16(query, 1); // QDCOUNT
+    put16(query, 0); // ANCOUNT
+    put16(query, 0); // NSCOUNT
+    put16(query, 1); // ARCOUNT
+
+    while (!name.empty()) {
+        const std::size_t end = std::min(name.find('.'), name.size());
+        const std::string_view label = name.substr(0, end);
+
+        if (label.empty() || label.size() > max_label_size) {
+            return std::nullopt;
+        }
+
+        query.push_back(static_cast<std::uint8_t>(label.size()));
+        query.insert(query.end(), label.begin(), label.end());
+
+        name.remove_prefix(std::min(end + 1, name.size()));
+    }
+
+    query.push_back(0);
+    put16(query, static_cast<std::uint16_t>(type));
+    put16(query, class_in);
+
+    // EDNS(0) OPT record as defined in RFC 6891, so that larger responses aren't truncated
+    query.push_back(0);
+    put16(query, static_cast<std::uint16_t>(record_type::opt));
+    put16(query, static_cast<std::uint16_t>(max_udp_size));
+    put16(query, 0); // extended RCODE and version
+    put16(query, 0); // flags
+    put16(query, 0); // RDLEN
+
+    return query;
+}
+
+bool dns::is_response_to(std::span<const std::uint8_t> message, std::span<const std::uint8_t> query) {
+    if (message.size() < header_size || query.size() < header_size) {
+        return false;
+    }
+
+    if (get16(message, 0) != get16(query, 0) || !(get16(message, 2) & flag_qr) || get16(message, 4) != 1) {
+        return false;
+    }
+
+    // the question must be the one we asked
+    const std::optional<std::size_t> query_name_end = skip_name(query, header_size);
+    const std::optional<std::size_t> name_end = skip_name(message, header_size);
+    if (!query_name_end || !name_end || *query_name_end + 4 > query.size() || *name_end + 4 > message.size()) {
+        return false;
+    }
+
+    const std::size_t question_size = *query_name_end + 4 - header_size;
+    return *name_end + 4 - header_size == question_size &&
+           equal_ignore_case(message.subspan(header_size, question_size), query.subspan(header_size, question_size));
+}
+
+std::optional<dns::message_info> dns::inspect(std::span<const std::uint8_t> message) {
+    if (message.size() < header_size || get16(message, 4) != 1) {
+        return std::nullopt;
+    }
+
+    const std::uint16_t flags = get16(message, 2);
+
+    message_info info{
+        .id = get16(message, 0),
+        .is_response = (flags & flag_qr) != 0,
+        .truncated = (flags & flag_tc) != 0,
+        .code = static_cast<rcode>(flags & 0x000f),
+        .answer_count = get16(message, 6),
+        .name = {},
+        .type = 0,
+        .qclass = 0,
+        .question_end = 0,
+        .ttl_offsets = {},
+        .udp_payload_size = min_udp_size,
+    };
+
+    // the question, names in questions are never compressed
+    std::size_t offset = header_size;
+    while (offset < message.size() && message[offset] != 0) {
+        const std::uint8_t len = message[offset];
+        if ((len & 0xc0) != 0 || offset + 1 + len > message.size()) {
+            return std::nullopt;
+        }
+
+        if (!info.name.empty()) {
+            info.name += '.';
+        }
+
+        for (std::size_t i = offset + 1; i != offset + 1 + len; i++) {
+            info.name += static_cast<char>(std::tolower(message[i]));
+        }
+
+        offset += 1 + len;
+    }
+
+    if (offset + 5 > message.size()) {
+        return std::nullopt;
+    }
+
+    info.type = get16(message, offset + 1);
+    info.qclass = get16(message, offset + 3);
+    info.question_end = offset + 5;
+
+    // the records of all sections
+    const std::size_t count = get16(message, 6) + get16(message, 8) + get16(message, 10);
+    offset = info.question_end;
+
+    for (std::size_t i = 0; i != count; i++) {
+        const std::optional<std::size_t> rr = skip_name(message, offset);
+        if (!rr || *rr + 10 > message.size()) {
+            return std::nullopt;
+        }
+
+        const std::uint16_t rdlen = get16(message, *rr + 8);
+        if (*rr + 10 + rdlen > message.size()) {
+            return std::nullopt;
+        }
+
+        if (get16(message, *rr) == static_cast<std::uint16_t>(record_type::opt)) {
+            // the class of an OPT record is the UDP payload size, and its TTL holds flags
+            info.udp_payload_size = std::max<std::size_t>(get16(message, *rr + 2), min_udp_size);
+        } else {
+            info.ttl_offsets.push_back(*rr + 4);
+        }
+
+        offset = *rr + 10 + rdlen;
+    }
+
+    return info;
+}
+
+std::vector<std::uint8_t> dns::make_empty_response(std::span<const std::uint8_t> message, std::size_t question_end, rcode code, bool truncated) {
+    std::vector<std::uint8_t> response(message.begin(), message.begin() + question_end);
+
+    std::uint16_t flags = get16(message, 2) & ~(rcode_mask | flag_tc);
+    flags |= flag_qr | flag_ra | static_cast<std::uint16_t>(code);
+    if (truncated) {
+        flags |= flag_tc;
+    }
+
+    response[2] = static_cast<std::uint8_t>(flags >> 8);
+    response[3] = static_cast<std::uint8_t>(flags);
+
+    // only the question is left
+    std::fill(response.begin() + 6, response.begin() + header_size, 0);
+
+    return response;
+}
+
+std::optional<dns::response> dns::parse_response(std::span<const std::uint8_t> message, std::span<const std::uint8_t> query) {
+    if (!is_response_to(message, query)) {
+        return std::nullopt;
+    }
+
+    const std::uint16_t flags = get16(message, 2);
+    const std::uint16_t ancount = get16(message, 6);
+
+    const std::size_t query_name_end = *skip_name(query, header_size);
+    const std::size_t question_size = query_name_end + 4 - header_size;
+
+    const std::uint16_t type = get16(query, query_name_end);
+
+    response result{
+        .code = static_cast<rcode>(flags & 0x000f),
+        .truncated = (flags & flag_tc) != 0,
+        .addresses = {},
+        .ttl = std::numeric_limits<std::uint32_t>::max(),
+    };
+
+    std::size_t offset = header_size + question_size;
+
+    for (std::uint16_t i = 0; i != ancount; i++) {
+        const std::optional<std::size_t> rr = skip_name(message, offset);
+        if (!rr || *rr + 10 > message.size()) {
+            // a truncated response may end anywhere
+            if (result.truncated) {
+                break;
+            }
+
+            return std::nullopt;
+        }
+
+        const std::uint16_t rr_type = get16(message, *rr);
+        const std::uint16_t rr_class = get16(message, *rr + 2);
+        const std::uint32_t rr_ttl = get32(message, *rr + 4);
+        const std::uint16_t rdlen = get16(message, *rr + 8);
+        const std::size_t rdata = *rr + 10;
+
+        if (rdata + rdlen > message.size()) {
+            if (result.truncated) {
+                break;
+            }
+
+            return std::nullopt;
+        }
+
+        // CNAME records are followed by the records of the canonical name, which are all we need
+        if (rr_type == type && rr_class == class_in) {
+            if (rr_type == static_cast<std::uint16_t>(record_type::a) && rdlen == 4) {
+                asio::ip::address_v4::bytes_type bytes;
+                std::copy_n(message.begin() + rdata, 4, bytes.begin());
+                result.addresses.emplace_back(asio::ip::make_address_v4(bytes));
+            } else if (rr_type == static_cast<std::uint16_t>(record_type::aaaa) && rdlen == 16) {
+                asio::ip::address_v6::bytes_type bytes;
+                std::copy_n(message.begin() + rdata, 16, bytes.begin());
+                result.addresses.emplace_back(asio::ip::make_address_v6(bytes));
+            } else {
+                return std::nullopt;
+            }
+
+            result.ttl = std::min(result.ttl, rr_ttl);
+        }
+
+        offset = rdata + rdlen;
+    }
+
+    if (result.addresses.empty()) {
+        result.ttl = 0;
+    }
+
+    return result;
+}
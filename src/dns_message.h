@@ -0,0 +1,88 @@
+#ifndef DNS_MESSAGE_H
+#define DNS_MESSAGE_H
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <asio/ts/internet.hpp>
+
+namespace dns {
+// The maximum size of a UDP response, advertised with EDNS(0).
+constexpr std::size_t max_udp_size = 1232;
+
+// The maximum size of a UDP response without EDNS(0).
+constexpr std::size_t min_udp_size = 512;
+
+// Resource record types as defined in RFC 1035 and RFC 3596.
+enum class record_type : std::uint16_t {
+    a = 1,
+    cname = 5,
+    aaaa = 28,
+    opt = 41
+};
+
+// Response codes as defined in RFC 1035 section 4.1.1.
+enum class rcode : std::uint8_t {
+    no_error = 0,
+    format_error = 1,
+    server_failure = 2,
+    name_error = 3,
+    not_implemented = 4,
+    refused = 5
+};
+
+struct response {
+    rcode code;
+    bool truncated;
+
+    // the addresses of the queried type, and the smallest TTL of them in seconds
+    std::vector<asio::ip::address> addresses;
+    std::uint32_t ttl;
+};
+
+// message_info describes a message for forwarding and caching it.
+struct message_info {
+    std::uint16_t id;
+    bool is_response;
+    bool truncated;
+    rcode code;
+    std::uint16_t answer_count;
+
+    // the question, with the name in lower case
+    std::string name;
+    std::uint16_t type;
+    std::uint16_t qclass;
+    std::size_t question_end;
+
+    // the offsets of the TTLs of the resource records, other than EDNS(0) options
+    std::vector<std::size_t> ttl_offsets;
+
+    // the UDP payload size advertised with EDNS(0)
+    std::size_t udp_payload_size;
+};
+
+// make_query encodes a recursive query of type for name.
+// It returns std::nullopt if name is not a valid domain name.
+std::optional<std::vector<std::uint8_t>> make_query(std::uint16_t id, std::string_view name, record_type type);
+
+// is_response_to returns true if message is a response to query.
+bool is_response_to(std::span<const std::uint8_t> message, std::span<const std::uint8_t> query);
+
+// inspect decodes the header, the question and the record TTLs of message.
+// It returns std::nullopt if message is malformed or doesn't have exactly one question.
+std::optional<message_info> inspect(std::span<const std::uint8_t> message);
+
+// make_empty_response returns a response with the header and question of message, and no records.
+// It is used to answer a query with an error, or to truncate a response that is too large for the client.
+std::vector<std::uint8_t> make_empty_response(std::span<const std::uint8_t> message, std::size_t question_end, rcode code, bool truncated = false);
+
+// parse_response decodes the response to query.
+// It returns std::nullopt if message is malformed or doesn't answer query.
+std::optional<response> parse_response(std::span<const std::uint8_t> message, std::span<const std::uint8_t> query);
+} // namespace dns
+
+#endif
@@ -0,0 +1,378 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <system_error>
+#include <utility>
+
+#include <asio/read.hpp>
+#include <asio/redirect_error.hpp>
+#include <asio/use_awaitable.hpp>
+#include <asio/write.hpp>
+
+#include "dns_message.h"
+#include "dns_resolver.h"
+
+namespace {
+constexpr std::uint16_t default_port = 53;
+
+// The TTL of IP addresses and names in the hosts file.
+constexpr auto static_ttl = std::chrono::hours{1};
+
+// resolv.conf caps these options at the same values.
+constexpr int max_timeout = 30;
+constexpr int max_attempts = 5;
+
+struct pending_query {
+    std::vector<std::uint8_t> message;
+
+    // the raw response, empty until it has been received
+    std::vector<std::uint8_t> reply;
+};
+
+std::uint16_t random_id() {
+    thread_local std::mt19937 engine{std::random_device{}()};
+    return static_cast<std::uint16_t>(std::uniform_int_distribution<unsigned>{0, 0xffff}(engine));
+}
+
+// is_truncated returns true if the TC flag of message is set, without requiring the rest of it to be intact.
+bool is_truncated(std::span<const std::uint8_t> message) {
+    return message.size() > 2 && (message[2] & 0x02) != 0;
+}
+
+std::string to_lower(std::string_view s) {
+    std::string result{s};
+    std::transform(result.begin(), result.end(), result.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+
+    return result;
+}
+
+// cancel_after cancels the operations of socket after timeout, unless the returned timer is destroyed first.
+template <typename Socket>
+steady_timer cancel_after(const std::shared_ptr<Socket>& socket, std::chrono::milliseconds timeout) {
+    steady_timer timer{socket->get_executor(), timeout};
+    timer.async_wait([weak = std::weak_ptr<Socket>{socket}](const std::error_code& error) {
+        if (auto s = weak.lock(); s && !error) {
+            std::error_code ignore_error;
+            s->cancel(ignore_error);
+        }
+    });
+
+    return timer;
+}
+
+// exchange_tcp sends query to server over TCP, and returns the response.
+asio::awaitable<std::vector<std::uint8_t>> exchange_tcp(const asio::ip::udp::endpoint& server,
+                                                           std::span<const std::uint8_t> query,
+                                                           std::chrono::milliseconds timeout) {
+    auto socket = std::make_shared<tcp_socket>(co_await asio::this_coro::executor);
+    steady_timer deadline = cancel_after(socket, timeout);
+
+    co_await socket->async_connect(asio::ip::tcp::endpoint{server.address(), server.port()});
+
+    // messages are prefixed with their length over TCP
+    std::array<std::uint8_t, 2> length{static_cast<std::uint8_t>(query.size() >> 8), static_cast<std::uint8_t>(query.size())};
+    co_await asio::async_write(*socket, std::array<asio::const_buffer, 2>{asio::buffer(length), asio::buffer(query.data(), query.size())});
+
+    co_await asio::async_read(*socket, asio::buffer(length));
+    std::vector<std::uint8_t> message(length[0] << 8 | length[1]);
+    co_await asio::async_read(*socket, asio::buffer(message));
+
+    if (!dns::is_response_to(message, query)) {
+        throw std::system_error{asio::error::host_not_found_try_again, "Unexpected DNS response"};
+    }
+
+    co_return message;
+}
+
+// exchange sends the queries to server over UDP, and waits for their responses until timeout.
+// Truncated responses are retried over TCP.
+asio::awaitable<void> exchange(const asio::ip::udp::endpoint& server, std::vector<pending_query>& queries, std::chrono::milliseconds timeout) {
+    auto socket = std::make_shared<udp_socket>(co_await asio::this_coro::executor);
+    steady_timer deadline = cancel_after(socket, timeout);
+
+    // a connected socket only receives datagrams from server
+    socket->open(server.protocol());
+    socket->connect(server);
+
+    for (const pending_query& q : queries) {
+        co_await socket->async_send(asio::buffer(q.message));
+    }
+
+    // one more byte than we advertise, to tell whether a datagram didn't fit
+    std::array<std::uint8_t, dns::max_udp_size + 1> buffer;
+
+    while (std::any_of(queries.begin(), queries.end(), [](const pending_query& q) { return q.reply.empty(); })) {
+        std::error_code error;
+        const std::size_t n = co_await socket->async_receive(asio::buffer(buffer), asio::redirect_error(asio::use_awaitable, error));
+
+        if (error == asio::error::operation_aborted) {
+            break;
+        }
+
+        if (error) {
+            throw std::system_error{error};
+        }
+
+        const std::span<const std::uint8_t> message{buffer.data(), n};
+
+        for (pending_query& q : queries) {
+            if (q.reply.empty() && dns::is_response_to(message, q.message)) {
+                q.reply.assign(message.begin(), message.end());
+
+                // the rest of a datagram which doesn't fit is lost, as if it was truncated
+                if (n > dns::max_udp_size) {
+                    q.reply[2] |= 0x02;
+                }
+
+                break;
+            }
+        }
+    }
+
+    for (pending_query& q : queries) {
+        if (is_truncated(q.reply)) {
+            try {
+                q.reply = co_await exchange_tcp(server, q.message, timeout);
+            } catch (const std::system_error&) {
+                // keep what the truncated response has
+            }
+        }
+    }
+}
+
+// is_definitive returns true if the response can be trusted to be complete.
+bool is_definitive(const std::optional<dns::response>& r) {
+    return r &&
+           (r->code == dns::rcode::no_error || r->code == dns::rcode::name_error) &&
+           !(r->truncated && r->addresses.empty());
+}
+} // namespace
+
+dns_resolver::dns_resolver(options opts) : opts(std::move(opts)) {}
+
+dns_resolver::options dns_resolver::system_options() {
+    options opts;
+
+    auto read_file = [](const char* path) {
+        std::ifstream file{path};
+        return std::string{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    };
+
+    parse_resolv_conf(read_file("/etc/resolv.conf"), opts);
+    parse_hosts(read_file("/etc/hosts"), opts);
+
+    return opts;
+}
+
+void dns_resolver::parse_resolv_conf(std::string_view content, options& opts) {
+    std::istringstream in{std::string{content}};
+    std::string line;
+
+    while (std::getline(in, line)) {
+        line = line.substr(0, line.find_first_of("#;"));
+
+        std::istringstream words{line};
+        std::string keyword;
+        words >> keyword;
+
+        if (keyword == "nameserver") {
+            std::string server;
+            words >> server;
+
+            std::error_code ec;
+            const asio::ip::address addr = asio::ip::make_address(server, ec);
+            if (!ec) {
+                opts.servers.emplace_back(addr, default_port);
+            }
+        } else if (keyword == "options") {
+            std::string option;
+            while (words >> option) {
+                try {
+                    if (option.starts_with("timeout:")) {
+                        opts.timeout = std::chrono::seconds{std::clamp(std::stoi(option.substr(8)), 1, max_timeout)};
+                    } else if (option.starts_with("attempts:")) {
+                        opts.attempts = std::clamp(std::stoi(option.substr(9)), 1, max_attempts);
+                    }
+                } catch (const std::exception&) {
+                    // ignore malformed options, like the C library does
+                }
+            }
+        }
+    }
+}
+
+void dns_resolver::parse_hosts(std::string_view content, options& opts) {
+    std::istringstream in{std::string{content}};
+    std::string line;
+
+    while (std::getline(in, line)) {
+        std::istringstream words{line.substr(0, line.find('#'))};
+
+        std::string address;
+        words >> address;
+
+        std::error_code ec;
+        const asio::ip::address addr = asio::ip::make_address(address, ec);
+        if (ec) {
+            continue;
+        }
+
+        std::string name;
+        while (words >> name) {
+            std::vector<asio::ip::address>& addresses = opts.hosts[to_lower(name)];
+
+            if (std::find(addresses.begin(), addresses.end(), addr) == addresses.end()) {
+                addresses.push_back(addr);
+            }
+        }
+    }
+}
+
+asio::ip::udp::endpoint dns_resolver::parse_server(const std::string& server) {
+    std::error_code ec;
+    const asio::ip::address addr = asio::ip::make_address(server, ec);
+    if (!ec) {
+        return {addr, default_port};
+    }
+
+    // address:port or [address]:port
+    const std::size_t colon = server.rfind(':');
+    if (colon == std::string::npos) {
+        return {asio::ip::make_address(server), default_port};
+    }
+
+    std::string host = server.substr(0, colon);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+
+    return {asio::ip::make_address(host), static_cast<std::uint16_t>(std::stoul(server.substr(colon + 1)))};
+}
+
+asio::awaitable<dns_cache::answer> dns_resolver::resolve(std::string host) const {
+    std::error_code ec;
+    const asio::ip::address literal = asio::ip::make_address(host, ec);
+    if (!ec) {
+        co_return dns_cache::answer{.addresses = {literal}, .ttl = static_ttl};
+    }
+
+    std::string name = to_lower(host);
+    if (name.ends_with('.')) {
+        name.pop_back();
+    }
+
+    if (auto it = opts.hosts.find(name); it != opts.hosts.end()) {
+        co_return dns_cache::answer{.addresses = it->second, .ttl = static_ttl};
+    }
+
+    auto query_a = dns::make_query(random_id(), name, dns::record_type::a);
+    auto query_aaaa = dns::make_query(random_id(), name, dns::record_type::aaaa);
+    if (!query_a || !query_aaaa) {
+        throw std::system_error{asio::error::host_not_found, host};
+    }
+
+    std::error_code last_error = asio::error::timed_out;
+
+    for (int attempt = 0; attempt != opts.attempts; attempt++) {
+        for (const asio::ip::udp::endpoint& server : opts.servers) {
+            std::vector<pending_query> queries{{*query_a, {}}, {*query_aaaa, {}}};
+
+            try {
+                co_await exchange(server, queries, opts.timeout);
+            } catch (const std::system_error& e) {
+                last_error = e.code();
+                continue;
+            }
+
+            const std::array<std::optional<dns::response>, 2> responses{dns::parse_response(queries[0].reply, queries[0].message),
+                                                                        dns::parse_response(queries[1].reply, queries[1].message)};
+            const std::optional<dns::response>& a = responses[0];
+            const std::optional<dns::response>& aaaa = responses[1];
+
+            if ((a && a->code == dns::rcode::name_error) || (aaaa && aaaa->code == dns::rcode::name_error)) {
+                throw std::system_error{asio::error::host_not_found, host};
+            }
+
+            const bool has_addresses = (a && !a->addresses.empty()) || (aaaa && !aaaa->addresses.empty());
+
+            // wait for both answers, unless the other one doesn't come in time
+            if (!(is_definitive(a) && is_definitive(aaaa)) && !has_addresses) {
+                if (a || aaaa) {
+                    last_error = asio::error::host_not_found_try_again;
+                } else {
+                    last_error = asio::error::timed_out;
+                }
+                continue;
+            }
+
+            dns_cache::answer result{.addresses = {}, .ttl = static_ttl};
+            for (const std::optional<dns::response>& r : responses) {
+                if (r && r->code == dns::rcode::no_error && !r->addresses.empty()) {
+                    result.addresses.insert(result.addresses.end(), r->addresses.begin(), r->addresses.end());
+                    result.ttl = std::min<dns_cache::clock::duration>(result.ttl, std::chrono::seconds{r->ttl});
+                }
+            }
+
+            if (result.addresses.empty()) {
+                throw std::system_error{asio::error::no_data, host};
+            }
+
+            co_return result;
+        }
+    }
+
+    throw std::system_error{last_error, host};
+}
+
+asio::awaitable<std::vector<std::uint8_t>> dns_resolver::forward(std::vector<std::uint8_t> query) const {
+    if (query.size() < 2) {
+        throw std::system_error{asio::error::invalid_argument, "Malformed DNS query"};
+    }
+
+    const std::array<std::uint8_t, 2> id{query[0], query[1]};
+    std::error_code last_error = asio::error::timed_out;
+
+    for (int attempt = 0; attempt != opts.attempts; attempt++) {
+        for (const asio::ip::udp::endpoint& server : opts.servers) {
+            // a fresh ID each time, so that the IDs of the clients can't be used to spoof responses
+            const std::uint16_t new_id = random_id();
+            query[0] = static_cast<std::uint8_t>(new_id >> 8);
+            query[1] = static_cast<std::uint8_t>(new_id);
+
+            std::vector<pending_query> queries{{query, {}}};
+
+            try {
+                co_await exchange(server, queries, opts.timeout);
+            } catch (const std::system_error& e) {
+                last_error = e.code();
+                continue;
+            }
+
+            std::vector<std::uint8_t>& reply = queries[0].reply;
+            if (reply.empty()) {
+                last_error = asio::error::timed_out;
+                continue;
+            }
+
+            // another server may know better
+            const auto code = static_cast<dns::rcode>(reply[3] & 0x0f);
+            if (code == dns::rcode::server_failure || code == dns::rcode::refused) {
+                last_error = asio::error::host_not_found_try_again;
+                continue;
+            }
+
+            std::copy(id.begin(), id.end(), reply.begin());
+            co_return std::move(reply);
+        }
+    }
+
+    throw std::system_error{last_error, "DNS query"};
+}
@@ -0,0 +1,55 @@
+#ifndef DNS_RESOLVER_H
+#define DNS_RESOLVER_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <asio/awaitable.hpp>
+#include <asio/ts/internet.hpp>
+
+#include "dns_cache.h"
+
+// dns_resolver is a stub resolver, which sends the A and AAAA queries for a name to the name servers in parallel,
+// over UDP with a fallback to TCP for truncated responses.
+//
+// Names in the hosts file and IP addresses are answered without any query.
+class dns_resolver {
+public:
+    struct options {
+        std::vector<asio::ip::udp::endpoint> servers;
+
+        // How long to wait for the responses of a server, and how many times to try each server.
+        std::chrono::milliseconds timeout{2000};
+        int attempts = 2;
+
+        // static host names, lower case
+        std::unordered_map<std::string, std::vector<asio::ip::address>> hosts;
+    };
+
+    explicit dns_resolver(options opts);
+
+    // system_options returns the name servers and options of resolv.conf, and the entries of the hosts file.
+    static options system_options();
+
+    static void parse_resolv_conf(std::string_view content, options& opts);
+    static void parse_hosts(std::string_view content, options& opts);
+
+    // parse_server parses a name server given as an address, optionally followed by a port.
+    static asio::ip::udp::endpoint parse_server(const std::string& server);
+
+    // resolve returns the addresses of host, and throws std::system_error on failure.
+    asio::awaitable<dns_cache::answer> resolve(std::string host) const;
+
+    // forward sends query to the name servers as is, and returns the first response that isn't a server failure or refusal.
+    // The ID of query is replaced on the wire, and restored in the response. Throws std::system_error on failure.
+    asio::awaitable<std::vector<std::uint8_t>> forward(std::vector<std::uint8_t> query) const;
+
+private:
+    options opts;
+};
+
+#endif
@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+#include "domain_set.h"
+
+namespace {
+// Returns the text a regex spells, if it is made of letters, digits, hyphens, underscores and escaped dots.
+std::optional<std::string> unescape_domain(std::string_view re) {
+    std::string domain;
+
+    for (std::size_t i = 0; i != re.size(); i++) {
+        const char c = re[i];
+
+        if (c == '\\' && i + 1 != re.size() && re[i + 1] == '.') {
+            domain += '.';
+            i++;
+        } else if (std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_') {
+            domain += c;
+        } else {
+            return std::nullopt;
+        }
+    }
+
+    if (domain.empty() || domain.front() == '.' || domain.back() == '.') {
+        return std::nullopt;
+    }
+
+    return domain;
+}
+
+// hash is FNV-1a, the same everywhere, since the table may be used by another build than the one which made it.
+std::uint64_t hash(std::uint32_t parent, std::string_view label) {
+    std::uint64_t h = 0xcbf29ce484222325;
+
+    for (char c : label) {
+        h = (h ^ static_cast<std::uint8_t>(c)) * 0x100000001b3;
+    }
+
+    return (h ^ parent) * 0x100000001b3;
+}
+} // namespace
+
+std::optional<domain_set::rule> domain_set::parse_rule(std::string_view re) {
+    constexpr std::string_view any_subdomain = R"((^|\.))";
+
+    if (!re.ends_with('$')) {
+        return std::nullopt;
+    }
+    re.remove_suffix(1);
+
+    bool subdomains = false;
+    if (re.starts_with(any_subdomain)) {
+        re.remove_prefix(any_subdomain.size());
+        subdomains = true;
+    } else if (re.starts_with('^')) {
+        re.remove_prefix(1);
+    } else {
+        return std::nullopt;
+    }
+
+    std::optional<std::string> domain = unescape_domain(re);
+    if (!domain) {
+        return std::nullopt;
+    }
+
+    return rule{std::move(*domain), subdomains};
+}
+
+void domain_set::insert(std::string_view domain, bool subdomains) {
+    std::vector<std::uint8_t>& n = nodes.edit();
+    std::vector<slot>& table = slots.edit();
+    std::vector<char>& text = labels.edit();
+
+    std::uint32_t current = 0;
+
+    while (true) {
+        const std::size_t dot = domain.rfind('.');
+        const std::string_view label = dot == std::string_view::npos ? domain : domain.substr(dot + 1);
+
+        std::uint32_t child = find(current, label);
+
+        if (child == 0) {
+            child = static_cast<std::uint32_t>(n.size());
+            n.push_back(0);
+
+            const slot edge{current, child, static_cast<std::uint32_t>(text.size()), static_cast<std::uint32_t>(label.size())};
+            text.insert(text.end(), label.begin(), label.end());
+
+            // keep the table at most half full
+            if ((n.size() - 1) * 2 > table.size()) {
+                std::vector<slot> grown(std::max<std::size_t>(16, table.size() * 2), slot{});
+                for (const slot& s : table) {
+                    if (s.child != 0) {
+                        add_edge(grown, s);
+                    }
+                }
+
+                table = std::move(grown);
+            }
+
+            add_edge(table, edge);
+        }
+
+        current = child;
+
+        if (dot == std::string_view::npos) {
+            break;
+        }
+
+        domain = domain.substr(0, dot);
+    }
+
+    n[current] |= subdomains ? matches_subdomains : matches_domain;
+}
+
+bool domain_set::contains(std::string_view host) const {
+    return match(host) != 0;
+}
+
+std::uint32_t domain_set::match(std::string_view host) const {
+    const std::span<const std::uint8_t> n = nodes.view();
+    std::uint32_t current = 0;
+
+    while (true) {
+        const std::size_t dot = host.rfind('.');
+        const std::string_view label = dot == std::string_view::npos ? host : host.substr(dot + 1);
+
+        current = find(current, label);
+        if (current == 0) {
+            return 0;
+        }
+
+        if (dot == std::string_view::npos) {
+            return n[current] != 0 ? current : 0;
+        }
+
+        // a subdomain
+        if (n[current] & matches_subdomains) {
+            return current;
+        }
+
+        host = host.substr(0, dot);
+    }
+}
+
+std::vector<domain_set::rule> domain_set::rules() const {
+    const std::span<const std::uint8_t> n = nodes.view();
+    const std::span<const char> text = labels.view();
+
+    // the edge to each node
+    std::vector<const slot*> parent_edge(n.size(), nullptr);
+    for (const slot& s : slots.view()) {
+        if (s.child != 0) {
+            parent_edge[s.child] = &s;
+        }
+    }
+
+    std::vector<rule> result(n.size());
+    for (std::size_t node = 1; node != n.size(); node++) {
+        if (n[node] == 0) {
+            continue;
+        }
+
+        std::string& domain = result[node].domain;
+        for (const slot* edge = parent_edge[node]; edge; edge = parent_edge[edge->parent]) {
+            if (!domain.empty()) {
+                domain += '.';
+            }
+            domain.append(text.data() + edge->label_offset, edge->label_size);
+        }
+
+        result[node].subdomains = n[node] & matches_subdomains;
+    }
+
+    return result;
+}
+
+bool domain_set::empty() const {
+    return nodes.view().size() <= 1;
+}
+
+std::size_t domain_set::size() const {
+    const std::span<const std::uint8_t> n = nodes.view();
+    return n.size() - static_cast<std::size_t>(std::count(n.begin(), n.end(), 0));
+}
+
+bool domain_set::has_numeric_top_label() const {
+    const std::span<const char> text = labels.view();
+
+    return std::any_of(slots.view().begin(), slots.view().end(), [text](const slot& s) {
+        if (s.child == 0 || s.parent != 0) {
+            return false;
+        }
+
+        const auto first = text.begin() + s.label_offset;
+        return std::all_of(first, first + s.label_size, [](char c) {
+            return std::isdigit(static_cast<unsigned char>(c)) != 0;
+        });
+    });
+}
+
+void domain_set::save(binary_image::writer& out) const {
+    out.write(nodes.view());
+    out.write(slots.view());
+    out.write(labels.view());
+}
+
+void domain_set::load(binary_image::reader& in) {
+    const std::span<const std::uint8_t> n = in.read<std::uint8_t>();
+    const std::span<const slot> table = in.read<slot>();
+    const std::span<const char> text = in.read<char>();
+
+    // the lookups rely on a table which is a power of two in size, and has free slots
+    const std::size_t edges = n.empty() ? 0 : n.size() - 1;
+    if (n.empty() || (table.size() & (table.size() - 1)) != 0 || (edges != 0 && edges * 2 > table.size())) {
+        throw std::runtime_error{"Invalid domain table"};
+    }
+
+    std::size_t used = 0;
+    for (const slot& s : table) {
+        if (s.child == 0) {
+            continue;
+        }
+
+        used++;
+        if (s.parent >= n.size() || s.child >= n.size() || s.label_offset > text.size() || s.label_size > text.size() - s.label_offset) {
+            throw std::runtime_error{"Invalid domain table"};
+        }
+    }
+
+    if (used != edges) {
+        throw std::runtime_error{"Invalid domain table"};
+    }
+
+    nodes.map(n);
+    slots.map(table);
+    labels.map(text);
+}
+
+std::uint32_t domain_set::find(std::uint32_t parent, std::string_view label) const {
+    const std::span<const slot> table = slots.view();
+    if (table.empty()) {
+        return 0;
+    }
+
+    const std::span<const char> text = labels.view();
+    const std::size_t mask = table.size() - 1;
+
+    for (std::size_t i = hash(parent, label) & mask;; i = (i + 1) & mask) {
+        const slot& s = table[i];
+
+        if (s.child == 0) {
+            return 0;
+        }
+
+        if (s.parent == parent && std::string_view{text.data() + s.label_offset, s.label_size} == label) {
+            return s.child;
+        }
+    }
+}
+
+void domain_set::add_edge(std::vector<slot>& table, const slot& edge) const {
+    const std::span<const char> text = labels.view();
+    const std::size_t mask = table.size() - 1;
+
+    std::size_t i = hash(edge.parent, {text.data() + edge.label_offset, edge.label_size}) & mask;
+    while (table[i].child != 0) {
+        i = (i + 1) & mask;
+    }
+
+    table[i] = edge;
+}
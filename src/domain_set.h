@@ -0,0 +1,75 @@
+#ifndef DOMAIN_SET_H
+#define DOMAIN_SET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "binary_image.h"
+
+// domain_set matches host names against domains, or domains and their subdomains, in a trie of their labels
+// from right to left. The edges of the trie are kept in a single hash table, so that a lookup costs one probe
+// per label of the host, however many domains there are. The table is flat, so that it can be used in place
+// in a binary image.
+class domain_set {
+public:
+    struct rule {
+        std::string domain;
+        bool subdomains = false;
+    };
+
+    // parse_rule returns the domain an ACL regex matches, if it is one of
+    //     (^|\.)example\.com$    example.com and its subdomains
+    //     ^example\.com$         example.com alone
+    static std::optional<rule> parse_rule(std::string_view re);
+
+    void insert(std::string_view domain, bool subdomains);
+    bool contains(std::string_view host) const;
+    bool empty() const;
+
+    // match returns the node of the domain host matches, or 0. rules returns the domain of each node, by node,
+    // an empty one for the nodes which aren't a domain of the set.
+    std::uint32_t match(std::string_view host) const;
+    std::vector<rule> rules() const;
+
+    // size returns the number of domains inserted.
+    std::size_t size() const;
+
+    // has_numeric_top_label returns true if a domain ends in a label of digits, so that it may match an IPv4 address.
+    bool has_numeric_top_label() const;
+
+    // save writes the trie to a binary image, and load uses it in place in a mapped image.
+    void save(binary_image::writer& out) const;
+    void load(binary_image::reader& in);
+
+private:
+    // An edge from parent to child, labelled with labels[label_offset, label_offset + label_size).
+    // Slots without an edge have child 0, since the root is no one's child.
+    struct slot {
+        std::uint32_t parent;
+        std::uint32_t child;
+        std::uint32_t label_offset;
+        std::uint32_t label_size;
+    };
+
+    enum node_flags : std::uint8_t {
+        matches_domain = 1,
+        matches_subdomains = 2
+    };
+
+    // find returns the child of parent labelled label, or 0.
+    std::uint32_t find(std::uint32_t parent, std::string_view label) const;
+    void add_edge(std::vector<slot>& table, const slot& edge) const;
+
+    // the flags of the nodes, node 0 is the root
+    binary_image::array<std::uint8_t> nodes{std::vector<std::uint8_t>(1)};
+
+    // an open addressing hash table of the edges, whose size is a power of two
+    binary_image::array<slot> slots;
+    binary_image::array<char> labels;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include <utility>
+
+#ifdef __linux__
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#include "egress_pool.h"
+
+namespace {
+using clock = std::chrono::steady_clock;
+
+// An address that ran out of ephemeral ports is avoided for this long.
+constexpr auto exhausted_period = std::chrono::seconds{1};
+
+clock::rep now() {
+    return clock::now().time_since_epoch().count();
+}
+
+bool same_family(const asio::ip::address& addr, const asio::ip::tcp& protocol) {
+    return addr.is_v4() == (protocol == asio::ip::tcp::v4());
+}
+} // namespace
+
+egress_pool::lease::lease(slot* s) : s(s) {
+    s->active++;
+    s->connects++;
+}
+
+egress_pool::lease::lease(lease&& other) noexcept : s(std::exchange(other.s, nullptr)) {}
+
+egress_pool::lease& egress_pool::lease::operator=(lease&& other) noexcept {
+    std::swap(s, other.s);
+    return *this;
+}
+
+egress_pool::lease::~lease() {
+    if (s) {
+        s->active--;
+    }
+}
+
+const asio::ip::address& egress_pool::lease::address() const {
+    return s->address;
+}
+
+void egress_pool::lease::bind(tcp_socket& socket) const {
+    const asio::ip::tcp::endpoint local_endpoint{s->address, 0};
+
+    socket.open(local_endpoint.protocol());
+
+#ifdef IP_BIND_ADDRESS_NO_PORT
+    // defer choosing the port to connect, where the 4-tuple is known
+    int enable = 1;
+    ::setsockopt(socket.native_handle(), IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &enable, sizeof(enable));
+#endif
+
+    socket.bind(local_endpoint);
+}
+
+void egress_pool::lease::exhausted() {
+    s->failures++;
+    s->exhausted_until.store(now() + clock::duration{exhausted_period}.count(), std::memory_order_relaxed);
+}
+
+egress_pool::egress_pool(const std::vector<asio::ip::address>& addresses) : slots(addresses.size()) {
+    for (std::size_t i = 0; i != addresses.size(); i++) {
+        slots[i].address = addresses[i];
+    }
+}
+
+std::optional<egress_pool::lease> egress_pool::acquire(const asio::ip::tcp& protocol) {
+    const auto t = now();
+
+    slot* best = nullptr;
+    bool best_exhausted = true;
+
+    for (slot& s : slots) {
+        if (!same_family(s.address, protocol)) {
+            continue;
+        }
+
+        const bool exhausted = s.exhausted_until.load(std::memory_order_relaxed) > t;
+        const std::size_t active = s.active.load(std::memory_order_relaxed);
+
+        if (!best ||
+            (best_exhausted && !exhausted) ||
+            (best_exhausted == exhausted && active < best->active.load(std::memory_order_relaxed))) {
+            best = &s;
+            best_exhausted = exhausted;
+        }
+    }
+
+    if (!best) {
+        return std::nullopt;
+    }
+
+    return lease{best};
+}
+
+std::size_t egress_pool::size(const asio::ip::tcp& protocol) const {
+    std::size_t n = 0;
+
+    for (const slot& s : slots) {
+        if (same_family(s.address, protocol)) {
+            n++;
+        }
+    }
+
+    return n;
+}
+
+bool egress_pool::empty() const {
+    return slots.empty();
+}
+
+std::vector<egress_pool::address_stats> egress_pool::stats() const {
+    std::vector<address_stats> result;
+    result.reserve(slots.size());
+
+    for (const slot& s : slots) {
+        result.push_back({
+            .address = s.address,
+            .active = s.active.load(std::memory_order_relaxed),
+            .connects = s.connects.load(std::memory_order_relaxed),
+            .failures = s.failures.load(std::memory_order_relaxed),
+        });
+    }
+
+    return result;
+}
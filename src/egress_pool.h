@@ -0,0 +1,77 @@
+#ifndef EGRESS_POOL_H
+#define EGRESS_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <asio/ts/internet.hpp>
+
+#include "awaitable.h"
+
+// egress_pool spreads outbound connections across a set of local source addresses,
+// so that popular targets don't exhaust the ephemeral ports of a single address.
+class egress_pool {
+public:
+    struct address_stats {
+        asio::ip::address address;
+        std::size_t active;
+        std::uint64_t connects;
+        std::uint64_t failures;
+    };
+
+private:
+    struct slot {
+        asio::ip::address address;
+        std::atomic<std::size_t> active = 0;
+        std::atomic<std::uint64_t> connects = 0;
+        std::atomic<std::uint64_t> failures = 0;
+        std::atomic<std::chrono::steady_clock::rep> exhausted_until = 0;
+    };
+
+public:
+    // lease keeps an address counted as in use until it is destroyed.
+    class lease {
+    public:
+        lease(lease&& other) noexcept;
+        lease& operator=(lease&& other) noexcept;
+        ~lease();
+
+        const asio::ip::address& address() const;
+
+        // bind opens socket and binds it to the leased address.
+        // The port is chosen by connect, so the same port can be reused for different targets.
+        void bind(tcp_socket& socket) const;
+
+        // exhausted records that the address has run out of ephemeral ports.
+        void exhausted();
+
+    private:
+        friend class egress_pool;
+
+        explicit lease(slot* s);
+
+        slot* s;
+    };
+
+    egress_pool() = default;
+    explicit egress_pool(const std::vector<asio::ip::address>& addresses);
+
+    // acquire leases the least used address of the protocol family, nullopt if there is none.
+    // Addresses that recently ran out of ports are only used when there is no alternative.
+    std::optional<lease> acquire(const asio::ip::tcp& protocol);
+
+    // size returns the number of addresses of the protocol family.
+    std::size_t size(const asio::ip::tcp& protocol) const;
+    bool empty() const;
+
+    std::vector<address_stats> stats() const;
+
+private:
+    std::vector<slot> slots;
+};
+
+#endif
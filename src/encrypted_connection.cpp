@@ -5,25 +5,34 @@
 
 #include "encrypted_connection.h"
 #include "io.h"
+#include "recycling_allocator.h"
 #include "replay_protection.h"
 
 encrypted_connection::encrypted_connection(tcp_socket s, crypto::aead::method method, std::span<const std::uint8_t> key)
     : conn(std::move(s)),
       cipher(method),
-      key(crypto::aead::key_size(method)),
-      enc_nonce(nonce_size, 0),
-      dec_nonce(nonce_size, 0) {
-    assert(key.size() == this->key.size());
-    std::copy(key.begin(), key.end(), this->key.begin());
+      key(key) {
+    assert(key.size() == crypto::aead::key_size(method));
+    assert(key.size() <= maximum_key_size);
+}
+
+asio::awaitable<void> encrypted_connection::wait_read() {
+    if (remaining > 0) {
+        co_return;
+    }
+
+    co_await conn.wait_read();
 }
 
 asio::awaitable<std::size_t> encrypted_connection::read(std::span<std::uint8_t> buffer) {
     bool check_replay_attack = false;
+    auto salt = std::span{in_salt.data(), salt_size()};
 
     // read salt
-    if (in_salt.empty()) {
-        in_salt.resize(salt_size());
-        co_await read_full(conn, in_salt);
+    if (!in_salt_received) {
+        co_await read_full(conn, salt);
+        crypto::hkdf_sha1(key, salt, crypto::to_span("ss-subkey"), std::span{dec_subkey.data(), key.size()});
+        in_salt_received = true;
 
         // need to check replay attack
         check_replay_attack = true;
@@ -31,41 +40,38 @@ asio::awaitable<std::size_t> encrypted_connection::read(std::span<std::uint8_t>
 
     if (remaining > 0) {
         std::size_t n = std::min(remaining, buffer.size());
-        std::copy_n(buf.begin() + index, n, buffer.begin());
+        std::copy_n(staging.data() + index, n, buffer.begin());
 
         index += n;
         remaining -= n;
 
+        if (remaining == 0) {
+            staging = recycled_buffer{};
+        }
+
         co_return n;
     }
 
-    std::size_t payload_size = co_await read_encrypted_payload(buf);
+    std::size_t n = co_await read_encrypted_payload(buffer);
 
     // check replay attack
     if (check_replay_attack) {
-        auto& protection = replay_protection::get();
-        if (protection.contains(in_salt)) {
+        if (replay_protection::get().test_and_insert(salt)) {
             throw duplicate_salt{"Duplicate salt received. Possible replay attack"};
-        } else {
-            protection.insert(in_salt);
         }
     }
 
-    std::size_t n = std::min(payload_size, buffer.size());
-    std::copy_n(buf.begin(), n, buffer.begin());
-
-    index += n;
-    remaining = payload_size - n;
-
     co_return n;
 }
 
 asio::awaitable<std::size_t> encrypted_connection::write(std::span<const std::uint8_t> buffer) {
     // write salt
-    if (out_salt.empty()) {
-        out_salt.resize(salt_size());
-        crypto::random_bytes(out_salt);
-        co_await conn.write(out_salt);
+    if (!out_salt_sent) {
+        auto salt = std::span{out_salt.data(), salt_size()};
+        crypto::random_bytes(salt);
+        crypto::hkdf_sha1(key, salt, crypto::to_span("ss-subkey"), std::span{enc_subkey.data(), key.size()});
+        out_salt_sent = true;
+        co_await conn.write(salt);
     }
 
     std::size_t size = co_await write_unencrypted_payload(buffer);
@@ -73,10 +79,26 @@ asio::awaitable<std::size_t> encrypted_connection::write(std::span<const std::ui
     co_return size;
 }
 
+asio::awaitable<bool> encrypted_connection::wait_disconnect() {
+    if (remaining > 0) {
+        co_return false;
+    }
+
+    co_return co_await conn.wait_disconnect();
+}
+
+void encrypted_connection::cancel() {
+    conn.cancel();
+}
+
 void encrypted_connection::close() {
     conn.close();
 }
 
+void encrypted_connection::abort() {
+    conn.abort();
+}
+
 void encrypted_connection::set_read_timeout(int val) {
     conn.set_read_timeout(val);
 }
@@ -107,24 +129,18 @@ std::size_t encrypted_connection::salt_size() const {
 }
 
 void encrypted_connection::encrypt(std::span<const std::uint8_t> plaintext, std::span<std::uint8_t> ciphertext) {
-    std::vector<std::uint8_t> subkey(key.size());
-    crypto::hkdf_sha1(key, out_salt, crypto::to_span("ss-subkey"), subkey);
-
-    cipher.encrypt(subkey, enc_nonce, {}, plaintext, ciphertext);
+    cipher.encrypt(std::span{enc_subkey.data(), key.size()}, enc_nonce, {}, plaintext, ciphertext);
     crypto::increment(enc_nonce);
 }
 
 void encrypted_connection::decrypt(std::span<const std::uint8_t> ciphertext, std::span<std::uint8_t> plaintext) {
-    std::vector<std::uint8_t> subkey(key.size());
-    crypto::hkdf_sha1(key, in_salt, crypto::to_span("ss-subkey"), subkey);
-
-    cipher.decrypt(subkey, dec_nonce, {}, ciphertext, plaintext);
+    cipher.decrypt(std::span{dec_subkey.data(), key.size()}, dec_nonce, {}, ciphertext, plaintext);
     crypto::increment(dec_nonce);
 }
 
 asio::awaitable<std::size_t> encrypted_connection::read_encrypted_payload(std::span<std::uint8_t> out) {
     std::size_t tag_size = cipher.get_tag_size();
-    std::vector<std::uint8_t> buf(maximum_payload_size + tag_size);
+    recycled_buffer buf{maximum_payload_size + tag_size};
 
     // read encrypted length
     std::size_t n = co_await read_full(conn, std::span{buf.data(), 2 + tag_size});
@@ -135,16 +151,28 @@ asio::awaitable<std::size_t> encrypted_connection::read_encrypted_payload(std::s
 
     // read encrypted payload
     n = co_await read_full(conn, std::span{buf.data(), payload_len + tag_size});
-    decrypt(std::span{buf.data(), n}, std::span{out.data(), payload_len});
 
-    co_return payload_len;
+    if (payload_len <= out.size()) {
+        decrypt(std::span{buf.data(), n}, std::span{out.data(), payload_len});
+        co_return payload_len;
+    }
+
+    // stage what doesn't fit in out
+    staging = recycled_buffer{payload_len};
+    decrypt(std::span{buf.data(), n}, staging.span());
+
+    std::copy_n(staging.data(), out.size(), out.begin());
+    index = out.size();
+    remaining = payload_len - out.size();
+
+    co_return out.size();
 }
 
 asio::awaitable<std::size_t> encrypted_connection::write_unencrypted_payload(std::span<const std::uint8_t> in) {
     std::size_t remaining = in.size();
     std::size_t n_write = 0;
     std::size_t tag_size = cipher.get_tag_size();
-    std::vector<std::uint8_t> buf(maximum_payload_size + tag_size);
+    recycled_buffer buf{maximum_payload_size + tag_size};
 
     while (remaining > 0) {
         std::uint16_t payload_len = static_cast<std::uint16_t>(remaining);
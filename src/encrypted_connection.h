@@ -5,11 +5,11 @@
 #include <memory>
 #include <span>
 #include <stdexcept>
-#include <vector>
 
 #include <crypto/aead.h>
 
 #include "connection.h"
+#include "recycling_allocator.h"
 
 // encrypted_connection decrypts the data after receiving it,
 // and encrypts the data before sending it.
@@ -20,12 +20,18 @@ public:
         using std::runtime_error::runtime_error;
     };
 
+    // key is referenced rather than copied, so it must outlive the connection.
     encrypted_connection(tcp_socket s, crypto::aead::method method, std::span<const std::uint8_t> key);
 
+    asio::awaitable<void> wait_read();
     asio::awaitable<std::size_t> read(std::span<std::uint8_t> buffer);
     asio::awaitable<std::size_t> write(std::span<const std::uint8_t> buffer);
 
+    asio::awaitable<bool> wait_disconnect();
+    void cancel();
+
     void close();
+    void abort();
 
     void set_read_timeout(int val);
     void set_connection_timeout(int val);
@@ -38,6 +44,8 @@ private:
     static constexpr std::size_t maximum_tag_size = 16;
     static constexpr std::size_t maximum_message_size = 2 + maximum_payload_size + 2 * maximum_tag_size;
     static constexpr std::size_t nonce_size = 12;
+    static constexpr std::size_t maximum_key_size = 32;
+    static constexpr std::size_t maximum_salt_size = 32;
 
     std::size_t salt_size() const;
 
@@ -51,14 +59,21 @@ private:
     connection conn;
 
     crypto::aead cipher;
-    std::vector<std::uint8_t> key;
-    std::vector<std::uint8_t> enc_nonce;
-    std::vector<std::uint8_t> dec_nonce;
-    std::vector<std::uint8_t> in_salt;
-    std::vector<std::uint8_t> out_salt;
-
-    // When the buffer for calling the read function is too small, temporarily put it in buf.
-    std::array<std::uint8_t, maximum_message_size> buf;
+    std::span<const std::uint8_t> key;
+    std::array<std::uint8_t, nonce_size> enc_nonce{};
+    std::array<std::uint8_t, nonce_size> dec_nonce{};
+    std::array<std::uint8_t, maximum_salt_size> in_salt;
+    std::array<std::uint8_t, maximum_salt_size> out_salt;
+    bool in_salt_received = false;
+    bool out_salt_sent = false;
+
+    // subkeys are derived once from the salts
+    std::array<std::uint8_t, maximum_key_size> enc_subkey;
+    std::array<std::uint8_t, maximum_key_size> dec_subkey;
+
+    // When the buffer for calling the read function is too small, the rest of the payload is staged here.
+    // It is only allocated in that case and released as soon as it has been consumed.
+    recycled_buffer staging;
     std::size_t index = 0;
     std::size_t remaining = 0;
 };
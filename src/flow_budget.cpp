@@ -0,0 +1,42 @@
+#include "flow_budget.h"
+
+flow_budget::flow_budget() : flow_budget(options{}) {}
+
+flow_budget::flow_budget(const options& opts)
+    : opts(opts),
+      last_transfer(clock::now()),
+      last_yield(last_transfer) {}
+
+bool flow_budget::consume(std::size_t n) {
+    const auto now = clock::now();
+
+    if (now - last_transfer >= opts.idle_gap) {
+        // the flow paused, so this is a new burst
+        burst_bytes = 0;
+        bytes_since_yield = 0;
+        last_yield = now;
+    }
+
+    last_transfer = now;
+    burst_bytes += n;
+    bytes_since_yield += n;
+
+    if (!is_bulk()) {
+        return false;
+    }
+
+    const bool bytes_exhausted = opts.yield_bytes != 0 && bytes_since_yield >= opts.yield_bytes;
+    const bool time_exhausted = opts.yield_time != clock::duration::zero() && now - last_yield >= opts.yield_time;
+
+    if (bytes_exhausted || time_exhausted) {
+        bytes_since_yield = 0;
+        last_yield = now;
+        return true;
+    }
+
+    return false;
+}
+
+bool flow_budget::is_bulk() const {
+    return burst_bytes >= opts.bulk_threshold;
+}
@@ -0,0 +1,44 @@
+#ifndef FLOW_BUDGET_H
+#define FLOW_BUDGET_H
+
+#include <chrono>
+#include <cstddef>
+
+// flow_budget classifies one direction of a relay as bulk or interactive from its observed traffic,
+// and tells bulk relays when to yield the io thread so that interactive sessions are serviced first.
+class flow_budget {
+public:
+    struct options {
+        // A flow that moves this many bytes without pausing is considered bulk.
+        std::size_t bulk_threshold = 128 * 1024;
+
+        // A pause in traffic at least this long ends a burst.
+        std::chrono::steady_clock::duration idle_gap = std::chrono::milliseconds{50};
+
+        // Bulk flows yield after moving this many bytes (0 disables it),
+        std::size_t yield_bytes = 256 * 1024;
+
+        // or after running for this long since the last yield (0 disables it).
+        std::chrono::steady_clock::duration yield_time = std::chrono::milliseconds{2};
+    };
+
+    flow_budget();
+    explicit flow_budget(const options& opts);
+
+    // consume records a transfer of n bytes and returns true if the relay should yield now.
+    bool consume(std::size_t n);
+
+    bool is_bulk() const;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    options opts;
+
+    clock::time_point last_transfer;
+    clock::time_point last_yield;
+    std::size_t burst_bytes = 0;
+    std::size_t bytes_since_yield = 0;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <asio/ts/internet.hpp>
+#include <fmt/format.h>
+
+// Formatters for the asio types that appear in log messages.
+// They are only converted to strings when a message is actually logged.
+
+template <>
+struct fmt::formatter<asio::ip::address> {
+    constexpr auto parse(format_parse_context& ctx) {
+        return ctx.begin();
+    }
+
+    template <typename FormatContext>
+    auto format(const asio::ip::address& addr, FormatContext& ctx) const {
+        return fmt::format_to(ctx.out(), "{}", addr.to_string());
+    }
+};
+
+template <>
+struct fmt::formatter<asio::ip::tcp::endpoint> {
+    constexpr auto parse(format_parse_context& ctx) {
+        return ctx.begin();
+    }
+
+    template <typename FormatContext>
+    auto format(const asio::ip::tcp::endpoint& endpoint, FormatContext& ctx) const {
+        if (endpoint.address().is_v6()) {
+            return fmt::format_to(ctx.out(), "[{}]:{}", endpoint.address().to_string(), endpoint.port());
+        }
+
+        return fmt::format_to(ctx.out(), "{}:{}", endpoint.address().to_string(), endpoint.port());
+    }
+};
+
+#endif
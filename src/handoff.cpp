@@ -0,0 +1,399 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#ifndef _WIN32
+#include <cerrno>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include "handoff.h"
+#include "replay_protection.h"
+
+#ifndef _WIN32
+extern char** environ;
+
+namespace {
+// The successor finds its end of the handoff socket in this environment variable.
+constexpr std::string_view env_name = "SHADOWSOCKS_ASIO_HANDOFF_FD";
+
+constexpr std::uint32_t magic = 0x73736866;
+constexpr std::size_t max_listeners = 16;
+
+// How long the predecessor waits for its successor to start accepting connections.
+constexpr int ready_timeout_ms = 60'000;
+
+#ifdef MSG_NOSIGNAL
+constexpr int send_flags = MSG_NOSIGNAL;
+#else
+constexpr int send_flags = 0;
+#endif
+
+struct header {
+    std::uint32_t magic;
+    std::uint32_t listener_count;
+    std::uint64_t state_size;
+};
+
+// state received from the predecessor
+std::mutex mtx;
+int channel = -1;
+std::vector<int> inherited;
+
+void set_cloexec(int fd) {
+    ::fcntl(fd, F_SETFD, ::fcntl(fd, F_GETFD) | FD_CLOEXEC);
+}
+
+bool send_all(int fd, const void* data, std::size_t size) {
+    const auto* p = static_cast<const std::uint8_t*>(data);
+
+    while (size > 0) {
+        const ssize_t n = ::send(fd, p, size, send_flags);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if (n <= 0) {
+            return false;
+        }
+
+        p += n;
+        size -= n;
+    }
+
+    return true;
+}
+
+bool recv_all(int fd, void* data, std::size_t size) {
+    auto* p = static_cast<std::uint8_t*>(data);
+
+    while (size > 0) {
+        const ssize_t n = ::recv(fd, p, size, 0);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if (n <= 0) {
+            return false;
+        }
+
+        p += n;
+        size -= n;
+    }
+
+    return true;
+}
+
+// find_executable returns the path to exec for argv0, the same way the shell found it.
+std::string find_executable(const char* argv0) {
+    if (std::strchr(argv0, '/')) {
+        return argv0;
+    }
+
+    const char* path = std::getenv("PATH");
+    std::string_view dirs = path ? path : "";
+
+    while (!dirs.empty()) {
+        const std::size_t end = dirs.find(':');
+        const std::string_view dir = dirs.substr(0, end);
+        dirs = end == std::string_view::npos ? std::string_view{} : dirs.substr(end + 1);
+
+        std::string candidate = fmt::format("{}/{}", dir.empty() ? "." : dir, argv0);
+        if (::access(candidate.c_str(), X_OK) == 0) {
+            return candidate;
+        }
+    }
+
+    return argv0;
+}
+
+// send_state sends the listening sockets, followed by the replay protection state.
+bool send_state(int fd, const std::vector<int>& listeners, const std::vector<std::uint8_t>& state) {
+    header h{
+        .magic = magic,
+        .listener_count = static_cast<std::uint32_t>(listeners.size()),
+        .state_size = state.size(),
+    };
+
+    iovec iov{.iov_base = &h, .iov_len = sizeof(h)};
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * max_listeners)]{};
+
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * listeners.size());
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * listeners.size());
+    std::memcpy(CMSG_DATA(cmsg), listeners.data(), sizeof(int) * listeners.size());
+
+    ssize_t n = 0;
+    do {
+        n = ::sendmsg(fd, &msg, send_flags);
+    } while (n == -1 && errno == EINTR);
+
+    if (n == -1) {
+        return false;
+    }
+
+    // the rest of the header, if it was sent partially
+    if (!send_all(fd, reinterpret_cast<const std::uint8_t*>(&h) + n, sizeof(h) - n)) {
+        return false;
+    }
+
+    return send_all(fd, state.data(), state.size());
+}
+
+// wait_ready waits for the byte the successor sends when it is accepting connections.
+bool wait_ready(int fd) {
+    pollfd p{.fd = fd, .events = POLLIN, .revents = 0};
+
+    int n = 0;
+    do {
+        n = ::poll(&p, 1, ready_timeout_ms);
+    } while (n == -1 && errno == EINTR);
+
+    char ready = 0;
+    return n == 1 && recv_all(fd, &ready, 1);
+}
+
+// take_socket removes the inherited socket of type bound to endpoint from the inherited sockets, and returns it.
+template <typename Endpoint>
+std::optional<int> take_socket(const Endpoint& endpoint, int type) {
+    std::lock_guard lock{mtx};
+
+    for (auto it = inherited.begin(); it != inherited.end(); ++it) {
+        int socket_type = 0;
+        socklen_t type_len = sizeof(socket_type);
+
+        if (::getsockopt(*it, SOL_SOCKET, SO_TYPE, &socket_type, &type_len) != 0 || socket_type != type) {
+            continue;
+        }
+
+        Endpoint local_endpoint;
+        socklen_t len = static_cast<socklen_t>(local_endpoint.capacity());
+
+        if (::getsockname(*it, local_endpoint.data(), &len) == 0) {
+            local_endpoint.resize(len);
+
+            if (local_endpoint == endpoint) {
+                const int fd = *it;
+                inherited.erase(it);
+                return fd;
+            }
+        }
+    }
+
+    return std::nullopt;
+}
+} // namespace
+
+bool handoff::receive() {
+    const char* env = std::getenv(env_name.data());
+    if (!env) {
+        return false;
+    }
+
+    const int fd = std::atoi(env);
+    ::unsetenv(env_name.data());
+    set_cloexec(fd);
+
+    header h{};
+    iovec iov{.iov_base = &h, .iov_len = sizeof(h)};
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * max_listeners)]{};
+
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n = 0;
+    do {
+        n = ::recvmsg(fd, &msg, 0);
+    } while (n == -1 && errno == EINTR);
+
+    std::vector<int> fds;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); n > 0 && cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            const std::size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const std::size_t offset = fds.size();
+
+            fds.resize(offset + count);
+            std::memcpy(fds.data() + offset, CMSG_DATA(cmsg), sizeof(int) * count);
+        }
+    }
+
+    for (int listener : fds) {
+        set_cloexec(listener);
+    }
+
+    if (n <= 0 ||
+        !recv_all(fd, reinterpret_cast<std::uint8_t*>(&h) + n, sizeof(h) - n) ||
+        h.magic != magic) {
+        spdlog::warn("Failed to receive the handoff from the previous process");
+
+        for (int listener : fds) {
+            ::close(listener);
+        }
+
+        ::close(fd);
+        return false;
+    }
+
+    std::vector<std::uint8_t> state(h.state_size);
+    if (!recv_all(fd, state.data(), state.size()) || !replay_protection::get().restore(state)) {
+        spdlog::warn("Failed to restore the replay protection state of the previous process");
+    }
+
+    spdlog::info("Took over {} listeners from the previous process", fds.size());
+
+    std::lock_guard lock{mtx};
+    channel = fd;
+    inherited = std::move(fds);
+
+    return true;
+}
+
+std::optional<handoff::native_handle_type> handoff::take_listener(const asio::ip::tcp::endpoint& endpoint) {
+    return take_socket(endpoint, SOCK_STREAM);
+}
+
+std::optional<handoff::native_handle_type> handoff::take_datagram_socket(const asio::ip::udp::endpoint& endpoint) {
+    return take_socket(endpoint, SOCK_DGRAM);
+}
+
+void handoff::ready() {
+    std::lock_guard lock{mtx};
+
+    if (channel == -1) {
+        return;
+    }
+
+    // the predecessor keeps listening on sockets which are no longer used
+    for (int fd : inherited) {
+        ::close(fd);
+    }
+
+    inherited.clear();
+
+    const char ready = 1;
+    send_all(channel, &ready, 1);
+
+    ::close(channel);
+    channel = -1;
+}
+
+bool handoff::start_successor(char* argv[], const std::vector<native_handle_type>& listeners) {
+    if (listeners.size() > max_listeners) {
+        spdlog::error("Too many listeners to hand over: {}", listeners.size());
+        return false;
+    }
+
+    const std::string path = find_executable(argv[0]);
+
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+        spdlog::error("socketpair: {}", std::strerror(errno));
+        return false;
+    }
+
+    set_cloexec(fds[0]);
+
+#ifdef SO_NOSIGPIPE
+    int enable = 1;
+    ::setsockopt(fds[0], SOL_SOCKET, SO_NOSIGPIPE, &enable, sizeof(enable));
+#endif
+
+    // the environment of the successor, prepared before forking
+    const std::string env_var = fmt::format("{}={}", env_name, fds[1]);
+
+    std::vector<char*> envp;
+    for (char** e = environ; *e; e++) {
+        if (!std::string_view{*e}.starts_with(env_name)) {
+            envp.push_back(*e);
+        }
+    }
+
+    envp.push_back(const_cast<char*>(env_var.c_str()));
+    envp.push_back(nullptr);
+
+    const long max_fd = ::sysconf(_SC_OPEN_MAX);
+
+    const pid_t pid = ::fork();
+    if (pid == 0) {
+        // only async-signal-safe functions may be called here
+        // don't let the successor keep the sessions of this process open
+        for (int fd = 3; fd < max_fd; fd++) {
+            if (fd != fds[1]) {
+                ::close(fd);
+            }
+        }
+
+        ::execve(path.c_str(), argv, envp.data());
+        ::_exit(127);
+    }
+
+    ::close(fds[1]);
+
+    if (pid == -1) {
+        spdlog::error("fork: {}", std::strerror(errno));
+        ::close(fds[0]);
+        return false;
+    }
+
+    spdlog::info("Started {} (pid {}), handing over {} listeners", path, pid, listeners.size());
+
+    // saved as late as possible, to hand over as many salts as possible. A session accepted before pausing
+    // may still be in its handshake though, and its salt is missed by the successor.
+    const std::vector<std::uint8_t> state = replay_protection::get().save();
+
+    const bool ok = send_state(fds[0], listeners, state) && wait_ready(fds[0]);
+    ::close(fds[0]);
+
+    if (!ok) {
+        spdlog::error("The new process (pid {}) failed to take over", pid);
+
+        ::kill(pid, SIGKILL);
+        ::waitpid(pid, nullptr, 0);
+    }
+
+    return ok;
+}
+#else
+bool handoff::receive() {
+    return false;
+}
+
+std::optional<handoff::native_handle_type> handoff::take_listener(const asio::ip::tcp::endpoint&) {
+    return std::nullopt;
+}
+
+std::optional<handoff::native_handle_type> handoff::take_datagram_socket(const asio::ip::udp::endpoint&) {
+    return std::nullopt;
+}
+
+void handoff::ready() {}
+
+bool handoff::start_successor(char*[], const std::vector<native_handle_type>&) {
+    spdlog::error("Upgrading is not supported on this platform");
+    return false;
+}
+#endif
@@ -0,0 +1,35 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <optional>
+#include <vector>
+
+#include <asio/ts/internet.hpp>
+
+// handoff passes the listening (and bound UDP) sockets and the replay protection state of the process to a
+// newly started instance of the program, so that it can be upgraded without refusing connections.
+// Only supported on POSIX systems.
+namespace handoff {
+using native_handle_type = asio::ip::tcp::acceptor::native_handle_type;
+
+// receive takes over the listening sockets and the state from the predecessor, if this process
+// was started by start_successor. Returns false otherwise.
+bool receive();
+
+// take_listener returns the inherited listening socket bound to endpoint, if any.
+std::optional<native_handle_type> take_listener(const asio::ip::tcp::endpoint& endpoint);
+
+// take_datagram_socket returns the inherited UDP socket bound to endpoint, if any.
+std::optional<native_handle_type> take_datagram_socket(const asio::ip::udp::endpoint& endpoint);
+
+// ready tells the predecessor that this process is accepting connections, so that it can drain.
+void ready();
+
+// start_successor starts a new instance of the program with argv and hands listeners over to it.
+// It blocks until the successor is ready, and returns false if it failed to start. The caller pauses accepting
+// on the listeners first (see lifecycle::pause), so that the successor takes over the new clients. The salts that
+// the sessions still in their handshake receive after the state is saved aren't handed over.
+bool start_successor(char* argv[], const std::vector<native_handle_type>& listeners);
+} // namespace handoff
+
+#endif
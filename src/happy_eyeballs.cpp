@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <utility>
+
+#include <spdlog/spdlog.h>
+
+#include "happy_eyeballs.h"
+
+std::vector<asio::ip::tcp::endpoint> happy_eyeballs::interleave(std::span<const asio::ip::tcp::endpoint> endpoints) {
+    std::vector<asio::ip::tcp::endpoint> v6;
+    std::vector<asio::ip::tcp::endpoint> v4;
+
+    for (const asio::ip::tcp::endpoint& endpoint : endpoints) {
+        (endpoint.address().is_v6() ? v6 : v4).push_back(endpoint);
+    }
+
+    std::vector<asio::ip::tcp::endpoint> result;
+    result.reserve(endpoints.size());
+
+    for (std::size_t i = 0; i != std::max(v6.size(), v4.size()); i++) {
+        if (i < v6.size()) {
+            result.push_back(v6[i]);
+        }
+
+        if (i < v4.size()) {
+            result.push_back(v4[i]);
+        }
+    }
+
+    return result;
+}
+
+void happy_eyeballs::race::cancel() {
+    for (std::size_t i = 0; i != attempts.size(); i++) {
+        if (i != winner) {
+            std::error_code ignore_error;
+            attempts[i].socket.cancel(ignore_error);
+        }
+    }
+
+    wakeup.cancel();
+}
+
+asio::awaitable<void> happy_eyeballs::run_attempt(std::shared_ptr<race> r,
+                                                  std::size_t index,
+                                                  asio::ip::tcp::endpoint endpoint,
+                                                  circuit_breaker& breaker,
+                                                  egress_pool* egress) {
+    race::attempt& a = r->attempts[index];
+    std::size_t egress_attempts = egress ? egress->size(endpoint.protocol()) : 0;
+
+    try {
+        circuit_breaker::attempt circuit = breaker.begin(endpoint);
+
+        while (true) {
+            a.lease = egress ? egress->acquire(endpoint.protocol()) : std::nullopt;
+            if (a.lease) {
+                a.lease->bind(a.socket);
+            }
+
+            std::error_code error;
+            co_await a.socket.async_connect(endpoint, asio::redirect_error(asio::use_awaitable, error));
+
+            if (!error) {
+                circuit.succeeded();
+                break;
+            }
+
+            // when an egress address runs out of ephemeral ports, retry from the next one
+            if (a.lease && error == std::errc::address_not_available) {
+                spdlog::warn("Egress address {} is exhausted", a.lease->address());
+                a.lease->exhausted();
+
+                if (--egress_attempts != 0 && r->result == race::state::racing) {
+                    std::error_code ignore_error;
+                    a.socket.close(ignore_error);
+                    continue;
+                }
+            }
+
+            // losing the race or the client leaving says nothing about the destination
+            if (error != asio::error::operation_aborted) {
+                circuit.failed(error);
+            } else if (r->result == race::state::timed_out) {
+                circuit.failed(asio::error::timed_out);
+            }
+
+            throw std::system_error{error};
+        }
+
+        if (r->result == race::state::racing) {
+            r->result = race::state::won;
+            r->winner = index;
+            r->cancel();
+        }
+    } catch (const std::system_error&) {
+        r->failure = std::current_exception();
+    }
+
+    if (r->winner != index) {
+        std::error_code ignore_error;
+        a.socket.close(ignore_error);
+        a.lease.reset();
+    }
+
+    r->running--;
+    r->wakeup.cancel();
+}
@@ -0,0 +1,160 @@
+#ifndef HAPPY_EYEBALLS_H
+#define HAPPY_EYEBALLS_H
+
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <span>
+#include <system_error>
+#include <vector>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/redirect_error.hpp>
+#include <asio/ts/internet.hpp>
+#include <fmt/format.h>
+
+#include "awaitable.h"
+#include "circuit_breaker.h"
+#include "egress_pool.h"
+#include "format.h"
+
+// Connecting to the first reachable of the addresses of a target, as described in RFC 8305 (Happy Eyeballs v2).
+namespace happy_eyeballs {
+// A connect attempt gets this head start before the next address is tried as well (RFC 8305 section 5).
+constexpr auto connection_attempt_delay = std::chrono::milliseconds{250};
+
+// interleave orders endpoints for connecting, alternating address families and starting with IPv6 (RFC 8305 section 4).
+std::vector<asio::ip::tcp::endpoint> interleave(std::span<const asio::ip::tcp::endpoint> endpoints);
+
+// race is shared by the attempts of a connect and the handlers watching it,
+// which all run on the strand of the session.
+struct race {
+    enum class state {
+        racing,
+        won,
+        timed_out,
+        client_left
+    };
+
+    struct attempt {
+        explicit attempt(const asio::any_io_executor& executor) : socket(executor) {}
+
+        tcp_socket socket;
+        std::optional<egress_pool::lease> lease;
+    };
+
+    race(const asio::any_io_executor& executor, std::size_t size) : deadline(executor), wakeup(executor) {
+        // the attempts refer to their elements
+        attempts.reserve(size);
+    }
+
+    // cancel cancels the attempts other than the winner, and wakes up the racer.
+    void cancel();
+
+    steady_timer deadline;
+    steady_timer wakeup;
+    std::vector<attempt> attempts;
+
+    state result = state::racing;
+    std::optional<std::size_t> winner;
+    std::size_t running = 0;
+    std::exception_ptr failure;
+};
+
+// run_attempt runs the attempt to connect to endpoint at index of r.
+asio::awaitable<void> run_attempt(std::shared_ptr<race> r,
+                                  std::size_t index,
+                                  asio::ip::tcp::endpoint endpoint,
+                                  circuit_breaker& breaker,
+                                  egress_pool* egress);
+
+// connect connects socket to one of endpoints, racing them.
+// The attempts are started connection_attempt_delay apart, or as soon as the previous one fails, alternating
+// address families. The first to succeed wins, and the others are cancelled and closed.
+//
+// Endpoints that breaker knows to be down fail fast. The race is abandoned after timeout seconds (0 disables it),
+// or as soon as client disconnects, instead of waiting for the kernel to give up retrying.
+// Client is anything with asio::awaitable<bool> wait_disconnect() and void cancel().
+//
+// If egress is given, the sockets are bound to its addresses of the same family, and the lease of the winner is returned.
+template <typename Client>
+asio::awaitable<std::optional<egress_pool::lease>> connect(tcp_socket& socket,
+                                                          std::span<const asio::ip::tcp::endpoint> endpoints,
+                                                          int timeout,
+                                                          std::shared_ptr<Client> client,
+                                                          circuit_breaker& breaker,
+                                                          egress_pool* egress = nullptr) {
+    using state = race::state;
+
+    const std::vector<asio::ip::tcp::endpoint> order = interleave(endpoints);
+    if (order.empty()) {
+        throw std::system_error{asio::error::host_unreachable, "No address to connect to"};
+    }
+
+    auto executor = co_await asio::this_coro::executor;
+    auto r = std::make_shared<race>(executor, order.size());
+
+    if (timeout > 0) {
+        r->deadline.expires_after(std::chrono::seconds{timeout});
+        r->deadline.async_wait([r](const std::error_code& error) {
+            if (!error && r->result == state::racing) {
+                r->result = state::timed_out;
+                r->cancel();
+            }
+        });
+    }
+
+    auto watch_client = [r, client]() -> asio::awaitable<void> {
+        if (co_await client->wait_disconnect() && r->result == state::racing) {
+            r->result = state::client_left;
+            r->cancel();
+        }
+    };
+    asio::co_spawn(executor, std::move(watch_client), asio::detached);
+
+    for (std::size_t i = 0; i != order.size() && r->result == state::racing; i++) {
+        r->attempts.emplace_back(executor);
+        r->running++;
+        asio::co_spawn(executor, run_attempt(r, i, order[i], breaker, egress), asio::detached);
+
+        // give the attempt a head start, unless an attempt finishes first
+        std::error_code ignore_error;
+        r->wakeup.expires_after(connection_attempt_delay);
+        co_await r->wakeup.async_wait(asio::redirect_error(asio::use_awaitable, ignore_error));
+    }
+
+    while (r->result == state::racing && r->running > 0) {
+        std::error_code ignore_error;
+        r->wakeup.expires_at(steady_timer::time_point::max());
+        co_await r->wakeup.async_wait(asio::redirect_error(asio::use_awaitable, ignore_error));
+    }
+
+    // stop watching, the losers finish on their own
+    const state result = r->result;
+    if (result == state::racing) {
+        r->result = state::won;
+    }
+
+    client->cancel();
+    r->deadline.cancel();
+
+    switch (result) {
+    case state::won: {
+        race::attempt& a = r->attempts[*r->winner];
+        socket = std::move(a.socket);
+        co_return std::move(a.lease);
+    }
+    case state::timed_out:
+        throw std::system_error{asio::error::timed_out, fmt::format("Connect timeout: {}", fmt::join(order, ", "))};
+    case state::client_left:
+        throw std::system_error{asio::error::connection_aborted, fmt::format("Client disconnected while connecting to {}", fmt::join(order, ", "))};
+    default:
+        std::rethrow_exception(r->failure);
+    }
+}
+} // namespace happy_eyeballs
+
+#endif
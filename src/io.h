@@ -4,12 +4,19 @@
 #include <array>
 #include <concepts>
 #include <cstdint>
+#include <memory>
 #include <span>
 #include <system_error>
 
 #include <asio/awaitable.hpp>
+#include <asio/post.hpp>
+#include <asio/use_awaitable.hpp>
 #include <spdlog/spdlog.h>
 
+#include "flow_budget.h"
+#include "recycling_allocator.h"
+#include "session.h"
+
 template <typename T>
 concept reader = requires(T r, std::span<std::uint8_t> buf) {
     { r.read(buf) } -> std::same_as<asio::awaitable<std::size_t>>;
@@ -33,6 +40,7 @@ concept reader_writer_closer = reader<T> && writer<T> && closer<T>;
 
 template <typename T>
 concept conn = reader_writer_closer<T> && requires(T conn, int timeout) {
+    { conn.wait_read() } -> std::same_as<asio::awaitable<void>>;
     { conn.set_read_timeout(timeout) } -> std::same_as<void>;
     { conn.set_connection_timeout(timeout) } -> std::same_as<void>;
     { conn.local_endpoint() } -> std::same_as<asio::ip::tcp::endpoint>;
@@ -42,13 +50,31 @@ concept conn = reader_writer_closer<T> && requires(T conn, int timeout) {
 constexpr auto buffer_size = 32768;
 
 template <conn W, conn R>
-asio::awaitable<void> io_copy(std::shared_ptr<W> w, std::shared_ptr<R> r) {
-    std::array<std::uint8_t, buffer_size> buf;
+asio::awaitable<void> io_copy(std::shared_ptr<W> w, std::shared_ptr<R> r, std::shared_ptr<session> s, flow_budget::options budget_opts) {
+    // keep the buffer out of the coroutine frame, so that the frame is small enough to be recycled
+    recycled_buffer buf;
+    flow_budget budget{budget_opts};
 
     try {
         while (true) {
-            std::size_t size = co_await r->read(buf);
+            if (!budget.is_bulk()) {
+                // wait for data without holding a buffer, so that idle sessions stay small
+                buf = recycled_buffer{};
+                co_await r->wait_read();
+            }
+
+            if (!buf.data()) {
+                buf = recycled_buffer{buffer_size};
+            }
+
+            std::size_t size = co_await r->read(buf.span());
+            s->touch();
             co_await w->write(std::span{buf.data(), size});
+
+            if (budget.consume(size)) {
+                // let the other sessions on this thread run first
+                co_await asio::post(co_await asio::this_coro::executor, asio::use_awaitable);
+            }
         }
     } catch (const std::system_error& e) {
         w->close();
@@ -1,7 +1,6 @@
-#include <cassert>
-#include <functional>
+#include <algorithm>
 #include <optional>
-#include <vector>
+#include <stdexcept>
 
 #include <asio/ts/internet.hpp>
 
@@ -11,8 +10,8 @@ namespace {
 constexpr std::size_t ipv4_bits = 32;
 constexpr std::size_t ipv6_bits = 128;
 
-// Returns ip address, network byte order.
-std::optional<std::vector<std::uint8_t>> parse_ip_address(std::string_view ip) {
+// Returns the address ip spells, if any.
+std::optional<asio::ip::address> parse_ip_address(std::string_view ip) {
     std::error_code err;
     const asio::ip::address addr = asio::ip::make_address(ip, err);
 
@@ -20,25 +19,7 @@ std::optional<std::vector<std::uint8_t>> parse_ip_address(std::string_view ip) {
         return std::nullopt;
     }
 
-    if (addr.is_v4()) {
-        const auto bytes = addr.to_v4().to_bytes();
-        return std::vector<std::uint8_t>{bytes.begin(), bytes.end()};
-    } else if (addr.is_v6()) {
-        const auto bytes = addr.to_v6().to_bytes();
-        return std::vector<std::uint8_t>{bytes.begin(), bytes.end()};
-    }
-
-    return std::nullopt;
-}
-
-// Returns bit i in bits, network byte order.
-bool get_bit(std::span<const std::uint8_t> bits, std::size_t i) {
-    assert(i < bits.size() * 8);
-
-    const auto bank = i / 8;
-    const auto offset = i % 8;
-
-    return (bits[bank] >> (7 - offset)) & 1;
+    return addr;
 }
 } // namespace
 
@@ -55,7 +36,12 @@ bool ip_set::insert(std::string_view cidr) {
 
     try {
         std::uint8_t bits = stoul(std::string{cidr.substr(pos + 1)});
-        return insert(*ip, bits);
+
+        if (ip->is_v4()) {
+            return insert(ip->to_v4().to_bytes(), bits);
+        }
+
+        return insert(ip->to_v6().to_bytes(), bits);
     } catch (const std::exception& e) {
         return false;
     }
@@ -76,11 +62,12 @@ bool ip_set::insert(std::span<const std::uint8_t> ip, std::uint8_t bits) {
         return false;
     }
 
-    if (ipbits == ipv4_bits) {
-        return ipv4.insert(ip, bits);
+    if (!(ipbits == ipv4_bits ? ipv4 : ipv6).insert(ip, bits)) {
+        return false;
     }
 
-    return ipv6.insert(ip, bits);
+    ranges++;
+    return true;
 }
 
 bool ip_set::contains(std::string_view ip_str) const {
@@ -92,6 +79,14 @@ bool ip_set::contains(std::string_view ip_str) const {
     return contains(*ip);
 }
 
+bool ip_set::contains(const asio::ip::address& ip) const {
+    if (ip.is_v4()) {
+        return ipv4.contains(ip.to_v4().to_bytes());
+    }
+
+    return ipv6.contains(ip.to_v6().to_bytes());
+}
+
 bool ip_set::contains(std::span<const std::uint8_t> ip) const {
     const auto ipbits = ip.size() * 8;
 
@@ -106,95 +101,117 @@ bool ip_set::contains(std::span<const std::uint8_t> ip) const {
     return ipv6.contains(ip);
 }
 
-void ip_set::clear() {
-    ipv4.clear();
-    ipv6.clear();
+void ip_set::save(binary_image::writer& out) const {
+    out.write(static_cast<std::uint64_t>(ranges));
+    ipv4.save(out);
+    ipv6.save(out);
 }
 
-ip_set::trie::trie(trie&& other) noexcept : root(other.root) {
-    other.root.left = nullptr;
-    other.root.right = nullptr;
+void ip_set::load(binary_image::reader& in) {
+    ranges = static_cast<std::size_t>(in.read_value());
+    ipv4.load(in);
+    ipv6.load(in);
 }
 
-ip_set::trie& ip_set::trie::operator=(trie&& other) noexcept {
-    if (&other == this) {
-        return *this;
-    }
-
-    root = other.root;
-    other.root.left = nullptr;
-    other.root.right = nullptr;
-
-    return *this;
+void ip_set::clear() {
+    ipv4.clear();
+    ipv6.clear();
+    ranges = 0;
 }
 
-ip_set::trie::~trie() {
-    clear();
+bool ip_set::empty() const {
+    return ipv4.empty() && ipv6.empty();
 }
 
-bool ip_set::trie::insert(std::span<const std::uint8_t> ip, std::uint8_t bits) {
-    trie_node* node = &root;
+std::size_t ip_set::size() const {
+    return ranges;
+}
 
+bool ip_set::table::insert(std::span<const std::uint8_t> ip, std::uint8_t bits) {
     if (bits == 0) {
         return false;
     }
 
-    for (std::uint8_t i = 0; i != bits; i++) {
-        if (get_bit(ip, i)) {
-            if (!node->right) {
-                node->right = new trie_node{};
-            }
-            node = node->right;
-        } else {
-            if (!node->left) {
-                node->left = new trie_node{};
-            }
-            node = node->left;
+    std::vector<std::uint32_t>& e = entries.edit();
+
+    if (e.empty()) {
+        e.assign(root_size, miss);
+    }
+
+    std::size_t base = 0;
+    std::size_t index = ip[0] << 8 | ip[1];
+    std::size_t level_bits = 16;
+
+    // descend to the level the prefix ends in
+    while (bits > level_bits) {
+        const std::uint32_t entry = e[base + index];
+
+        if (entry == hit) {
+            // already covered by a shorter prefix
+            return true;
         }
 
-        if (i == bits - 1) {
-            node->is_complete = true;
+        if (entry == miss) {
+            const auto child = static_cast<std::uint32_t>(e.size());
+            e[base + index] = child;
+            e.resize(e.size() + child_size, miss);
         }
+
+        base = e[base + index];
+        index = ip[level_bits / 8];
+        level_bits += 8;
     }
 
+    // the prefix covers a range of the entries of this level, the children below them become unreachable
+    const std::size_t count = std::size_t{1} << (level_bits - bits);
+    const std::size_t first = index & ~(count - 1);
+
+    std::fill_n(e.begin() + base + first, count, hit);
+
     return true;
 }
 
-bool ip_set::trie::contains(std::span<const std::uint8_t> ip) const {
-    const auto ipbits = ip.size() * 8;
-    const trie_node* node = &root;
-
-    for (std::uint8_t i = 0; i != ipbits; i++) {
-        if (get_bit(ip, i)) {
-            node = node->right;
-        } else {
-            node = node->left;
-        }
+bool ip_set::table::contains(std::span<const std::uint8_t> ip) const {
+    const std::span<const std::uint32_t> e = entries.view();
+    if (e.empty()) {
+        return false;
+    }
 
-        if (!node) {
-            return false;
-        }
+    std::uint32_t entry = e[ip[0] << 8 | ip[1]];
 
-        if (node->is_complete) {
-            return true;
-        }
+    // bounded by the length of ip, even if a mapped image is corrupt
+    for (std::size_t i = 2; entry > hit && i < ip.size(); i++) {
+        entry = e[entry + ip[i]];
     }
 
-    return false;
+    return entry == hit;
 }
 
-void ip_set::trie::clear() {
-    std::function<void(trie_node*)> free = [&](trie_node* node) {
-        if (node) {
-            free(node->left);
-            free(node->right);
-            delete node;
-        }
-    };
+void ip_set::table::clear() {
+    entries = {};
+}
 
-    free(root.left);
-    free(root.right);
+bool ip_set::table::empty() const {
+    return entries.view().empty();
+}
+
+void ip_set::table::save(binary_image::writer& out) const {
+    out.write(entries.view());
+}
+
+void ip_set::table::load(binary_image::reader& in) {
+    const std::span<const std::uint32_t> e = in.read<std::uint32_t>();
+
+    if (!e.empty() && (e.size() < root_size || (e.size() - root_size) % child_size != 0)) {
+        throw std::runtime_error{"Invalid IP table"};
+    }
+
+    // every child must be within the table
+    for (const std::uint32_t entry : e) {
+        if (entry > hit && (entry < root_size || entry > e.size() - child_size || (entry - root_size) % child_size != 0)) {
+            throw std::runtime_error{"Invalid IP table"};
+        }
+    }
 
-    root.left = nullptr;
-    root.right = nullptr;
+    entries.map(e);
 }
@@ -5,6 +5,11 @@
 #include <span>
 #include <string>
 #include <string_view>
+#include <vector>
+
+#include <asio/ip/address.hpp>
+
+#include "binary_image.h"
 
 class ip_set {
 public:
@@ -38,6 +43,9 @@ public:
 
     bool contains(std::span<const std::uint8_t> ip) const;
 
+    // contains looks up an address without formatting or allocating.
+    bool contains(const asio::ip::address& ip) const;
+
     /**
      * @brief clear the ip_set
      * @par Example
@@ -51,34 +59,45 @@ public:
      */
     void clear();
 
-private:
-    struct trie_node {
-        trie_node* left = nullptr;  // bit 0
-        trie_node* right = nullptr; // bit 1
-        bool is_complete = false;
-    };
-
-    class trie {
-    public:
-        trie() = default;
-        ~trie();
+    /**
+     * @brief check whether the ip_set has no ranges
+     */
+    bool empty() const;
 
-        trie(const trie&) = delete;
-        trie& operator=(const trie&) = delete;
+    // size returns the number of ranges inserted, overlapping ones included.
+    std::size_t size() const;
 
-        trie(trie&& other) noexcept;
-        trie& operator=(trie&& other) noexcept;
+    // save writes the tables to a binary image, and load uses them in place in a mapped image.
+    void save(binary_image::writer& out) const;
+    void load(binary_image::reader& in);
 
+private:
+    // table is a multibit trie with a 16 bit stride at the root and 8 bit strides below, stored in a single array,
+    // so that an IPv4 lookup takes at most three memory accesses, and an IPv6 lookup one per byte of the prefix.
+    class table {
+    public:
         bool insert(std::span<const std::uint8_t> ip, std::uint8_t bits);
         bool contains(std::span<const std::uint8_t> ip) const;
         void clear();
+        bool empty() const;
+
+        void save(binary_image::writer& out) const;
+        void load(binary_image::reader& in);
 
     private:
-        trie_node root;
+        // Each entry is miss, hit, or the offset of the 256 entries of its child.
+        static constexpr std::uint32_t miss = 0;
+        static constexpr std::uint32_t hit = 1;
+
+        static constexpr std::size_t root_size = 1 << 16;
+        static constexpr std::size_t child_size = 1 << 8;
+
+        binary_image::array<std::uint32_t> entries;
     };
 
-    trie ipv4;
-    trie ipv6;
+    table ipv4;
+    table ipv6;
+    std::size_t ranges = 0;
 };
 
 #endif
@@ -0,0 +1,99 @@
+#include <utility>
+
+#include "lifecycle.h"
+
+lifecycle& lifecycle::get() {
+    static lifecycle instance;
+    return instance;
+}
+
+std::size_t lifecycle::add_listener(native_handle_type handle, std::function<void()> close, std::function<void()> pause) {
+    std::unique_lock lock{mtx};
+
+    if (draining) {
+        lock.unlock();
+        close();
+        return 0;
+    }
+
+    const std::size_t id = ++next_id;
+    entries.push_back({id, handle, std::move(close), std::move(pause)});
+
+    return id;
+}
+
+void lifecycle::remove_listener(std::size_t id) {
+    std::lock_guard lock{mtx};
+    std::erase_if(entries, [id](const listener& l) { return l.id == id; });
+}
+
+std::vector<lifecycle::native_handle_type> lifecycle::listeners() const {
+    std::lock_guard lock{mtx};
+
+    std::vector<native_handle_type> handles;
+    for (const listener& l : entries) {
+        handles.push_back(l.handle);
+    }
+
+    return handles;
+}
+
+bool lifecycle::drain() {
+    std::vector<listener> closing;
+
+    {
+        std::lock_guard lock{mtx};
+
+        if (draining) {
+            return false;
+        }
+
+        draining = true;
+        closing = std::move(entries);
+        entries.clear();
+    }
+
+    for (listener& l : closing) {
+        l.close();
+    }
+
+    return true;
+}
+
+bool lifecycle::is_draining() const {
+    std::lock_guard lock{mtx};
+    return draining;
+}
+
+void lifecycle::pause() {
+    std::vector<std::function<void()>> pausing;
+
+    {
+        std::lock_guard lock{mtx};
+
+        if (paused) {
+            return;
+        }
+
+        paused = true;
+        for (const listener& l : entries) {
+            if (l.pause) {
+                pausing.push_back(l.pause);
+            }
+        }
+    }
+
+    for (auto& pause : pausing) {
+        pause();
+    }
+}
+
+void lifecycle::resume() {
+    std::lock_guard lock{mtx};
+    paused = false;
+}
+
+bool lifecycle::is_paused() const {
+    std::lock_guard lock{mtx};
+    return paused;
+}
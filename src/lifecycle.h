@@ -0,0 +1,54 @@
+#ifndef LIFECYCLE_H
+#define LIFECYCLE_H
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <asio/ts/internet.hpp>
+
+// lifecycle keeps track of the listening sockets of the process, so that they can be closed
+// for a graceful drain, or handed over to a successor process for an upgrade.
+class lifecycle {
+public:
+    using native_handle_type = asio::ip::tcp::acceptor::native_handle_type;
+
+    // get returns the lifecycle of the process. Tests construct their own.
+    static lifecycle& get();
+    lifecycle() = default;
+
+    // add_listener registers a listening socket. close is called once when the process starts draining,
+    // and pause whenever it pauses, from any thread. Returns an id for remove_listener.
+    std::size_t add_listener(native_handle_type handle, std::function<void()> close, std::function<void()> pause = {});
+    void remove_listener(std::size_t id);
+
+    std::vector<native_handle_type> listeners() const;
+
+    // drain closes the listeners, so that the servers return once their sessions have finished.
+    // Returns false if the process is already draining.
+    bool drain();
+    bool is_draining() const;
+
+    // pause stops accepting clients until resume, while the listeners stay open, so that the clients wait
+    // in their backlog for this process or its successor.
+    void pause();
+    void resume();
+    bool is_paused() const;
+
+private:
+    struct listener {
+        std::size_t id;
+        native_handle_type handle;
+        std::function<void()> close;
+        std::function<void()> pause;
+    };
+
+    mutable std::mutex mtx;
+    std::vector<listener> entries;
+    std::size_t next_id = 0;
+    bool draining = false;
+    bool paused = false;
+};
+
+#endif
@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "live_acl.h"
+
+namespace {
+// Each thread caches this many decisions.
+constexpr std::size_t cache_capacity = 4096;
+
+std::atomic<std::uint64_t> next_generation{1};
+
+struct thread_state;
+
+// the states of the running threads, and the cache stats of those which have exited
+std::mutex threads_mtx;
+std::vector<const thread_state*> threads;
+acl_cache::stats exited_stats{};
+
+// the reference of a thread to the ACL of the generation it was taken at, and its decisions
+struct thread_state {
+    std::uint64_t generation = 0;
+    std::shared_ptr<const access_control_list> acl;
+    acl_cache cache{cache_capacity};
+
+    // reused, so that a hit doesn't allocate
+    std::string key;
+
+    thread_state() {
+        std::lock_guard lock{threads_mtx};
+        threads.push_back(this);
+    }
+
+    ~thread_state() {
+        const acl_cache::stats stats = cache.get_stats();
+
+        std::lock_guard lock{threads_mtx};
+        std::erase(threads, this);
+        exited_stats.hits += stats.hits;
+        exited_stats.misses += stats.misses;
+    }
+};
+
+thread_local thread_state state;
+
+// make_key writes the key of a decision: its kind, then the bytes of the address and the host, if any.
+void make_key(std::string& key, char kind, const asio::ip::address* ip, std::string_view host) {
+    key.clear();
+    key += kind;
+
+    if (ip && ip->is_v4()) {
+        const asio::ip::address_v4::bytes_type bytes = ip->to_v4().to_bytes();
+        key += '4';
+        key.append(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    } else if (ip) {
+        const asio::ip::address_v6::bytes_type bytes = ip->to_v6().to_bytes();
+        key += '6';
+        key.append(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+
+    key += host;
+}
+
+// decide returns the cached decision for state.key, or makes it. A profiling ACL makes every decision, so that they are all counted.
+template <typename Decide>
+std::optional<bool> decide(Decide&& make_decision) {
+    if (state.acl->is_profiling()) {
+        return make_decision(*state.acl);
+    }
+
+    if (const std::optional<bool>* decision = state.cache.find(state.key)) {
+        return *decision;
+    }
+
+    const std::optional<bool> decision = make_decision(*state.acl);
+    state.cache.insert(state.key, decision);
+
+    return decision;
+}
+
+// decide_with makes a decision with acl of generation, cached if this thread refers to it. A thread referring to
+// an older ACL moves on to acl, while one already referring to a newer ACL keeps it, and the decision isn't cached.
+template <typename Decide>
+std::optional<bool> decide_with(const std::shared_ptr<const access_control_list>& acl,
+                                std::uint64_t generation,
+                                char kind,
+                                const asio::ip::address* ip,
+                                std::string_view host,
+                                Decide&& make_decision) {
+    if (state.generation > generation) {
+        return make_decision(*acl);
+    }
+
+    if (state.generation < generation) {
+        state.acl = acl;
+        state.generation = generation;
+        state.cache.clear();
+    }
+
+    make_key(state.key, kind, ip, host);
+    return decide(std::forward<Decide>(make_decision));
+}
+} // namespace
+
+live_acl::view::view(std::shared_ptr<const access_control_list> acl, std::uint64_t generation)
+    : acl(std::move(acl)), generation(generation) {}
+
+std::optional<bool> live_acl::view::is_bypass_host(std::string_view host) const {
+    return decide_with(acl, generation, 'h', nullptr, host, [host](const access_control_list& acl) {
+        return acl.is_bypass_host(host);
+    });
+}
+
+bool live_acl::view::is_bypass(const asio::ip::address& ip, std::string_view host) const {
+    return *decide_with(acl, generation, 'b', &ip, host, [&ip, host](const access_control_list& acl) {
+        return std::optional<bool>{acl.is_bypass(ip, host)};
+    });
+}
+
+bool live_acl::view::is_block_outbound(const asio::ip::address& ip, std::string_view host) const {
+    return *decide_with(acl, generation, 'o', &ip, host, [&ip, host](const access_control_list& acl) {
+        return std::optional<bool>{acl.is_block_outbound(ip, host)};
+    });
+}
+
+live_acl::live_acl(std::shared_ptr<const access_control_list> acl) : current(std::move(acl)), current_generation(next_generation++) {}
+
+std::shared_ptr<const access_control_list> live_acl::snapshot() const {
+    refresh();
+    return state.acl;
+}
+
+live_acl::view live_acl::get_view() const {
+    refresh();
+    return view{state.acl, state.generation};
+}
+
+std::optional<bool> live_acl::is_bypass_host(std::string_view host) const {
+    refresh();
+    make_key(state.key, 'h', nullptr, host);
+
+    return decide([host](const access_control_list& acl) {
+        return acl.is_bypass_host(host);
+    });
+}
+
+bool live_acl::is_bypass(const asio::ip::address& ip, std::string_view host) const {
+    refresh();
+    make_key(state.key, 'b', &ip, host);
+
+    return *decide([&ip, host](const access_control_list& acl) {
+        return std::optional<bool>{acl.is_bypass(ip, host)};
+    });
+}
+
+bool live_acl::is_block_outbound(const asio::ip::address& ip, std::string_view host) const {
+    refresh();
+    make_key(state.key, 'o', &ip, host);
+
+    return *decide([&ip, host](const access_control_list& acl) {
+        return std::optional<bool>{acl.is_block_outbound(ip, host)};
+    });
+}
+
+void live_acl::publish(std::shared_ptr<const access_control_list> acl) {
+    {
+        std::lock_guard lock{mtx};
+        current.swap(acl);
+        current_generation.store(next_generation++, std::memory_order_release);
+    }
+
+    // the previous ACL is freed out of the lock, unless a snapshot holds it
+}
+
+std::uint64_t live_acl::generation() const {
+    return current_generation.load(std::memory_order_acquire);
+}
+
+acl_cache::stats live_acl::get_cache_stats() {
+    std::lock_guard lock{threads_mtx};
+
+    acl_cache::stats total = exited_stats;
+    for (const thread_state* thread : threads) {
+        const acl_cache::stats stats = thread->cache.get_stats();
+        total.hits += stats.hits;
+        total.misses += stats.misses;
+    }
+
+    return total;
+}
+
+void live_acl::refresh() const {
+    // generations are unique, so a reference of the same generation is to this ACL
+    if (state.generation == current_generation.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    std::lock_guard lock{mtx};
+    state.acl = current;
+    state.generation = current_generation.load(std::memory_order_relaxed);
+    state.cache.clear();
+}
@@ -0,0 +1,72 @@
+#ifndef LIVE_ACL_H
+#define LIVE_ACL_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+
+#include <asio/ip/address.hpp>
+
+#include "access_control_list.h"
+#include "acl_cache.h"
+
+// live_acl holds the ACL in use, which a reload may replace at any time. A snapshot stays valid however long it
+// is kept, and an ACL is freed once its last snapshot is gone.
+//
+// Neither snapshots nor decisions lock: each thread keeps a reference to the current ACL, and takes the lock only
+// to refresh it, the first time after a publish. Each thread also caches the decisions it made with that ACL,
+// so that the hosts and addresses seen over and over cost a hash lookup. The caches are cleared by a publish.
+class live_acl {
+public:
+    // view decides with the ACL that was current when it was taken, so that a session makes all of its decisions
+    // with one ACL, even if a publish comes in between. Its decisions are cached while the ACL is current.
+    class view {
+    public:
+        // The decisions of the ACL, as those of access_control_list.
+        std::optional<bool> is_bypass_host(std::string_view host) const;
+        bool is_bypass(const asio::ip::address& ip, std::string_view host = {}) const;
+        bool is_block_outbound(const asio::ip::address& ip, std::string_view host = {}) const;
+
+    private:
+        friend class live_acl;
+
+        view(std::shared_ptr<const access_control_list> acl, std::uint64_t generation);
+
+        std::shared_ptr<const access_control_list> acl;
+        std::uint64_t generation;
+    };
+
+    explicit live_acl(std::shared_ptr<const access_control_list> acl);
+
+    std::shared_ptr<const access_control_list> snapshot() const;
+
+    // get_view returns a view of the current ACL.
+    view get_view() const;
+
+    // The decisions of the current ACL, as those of access_control_list.
+    std::optional<bool> is_bypass_host(std::string_view host) const;
+    bool is_bypass(const asio::ip::address& ip, std::string_view host = {}) const;
+    bool is_block_outbound(const asio::ip::address& ip, std::string_view host = {}) const;
+
+    // publish replaces the ACL for the snapshots and decisions from now on.
+    void publish(std::shared_ptr<const access_control_list> acl);
+
+    // generation changes with every publish. It is unique across all the instances.
+    std::uint64_t generation() const;
+
+    // get_cache_stats sums the decision caches of all the threads, including those which have exited.
+    static acl_cache::stats get_cache_stats();
+
+private:
+    // refresh updates the reference of this thread, and clears its cache if the ACL has changed.
+    void refresh() const;
+
+    mutable std::mutex mtx;
+    std::shared_ptr<const access_control_list> current;
+    std::atomic<std::uint64_t> current_generation;
+};
+
+#endif
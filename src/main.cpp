@@ -1,18 +1,27 @@
+#include <atomic>
+#include <chrono>
 #include <cstring>
+#include <exception>
+#include <memory>
 #include <iostream>
 #include <optional>
+#include <string>
 #include <thread>
 #include <vector>
 
 #include <asio/co_spawn.hpp>
 #include <asio/detached.hpp>
 #include <asio/signal_set.hpp>
+#include <asio/ts/timer.hpp>
+#include <asio/use_awaitable.hpp>
 #include <asio/ts/io_context.hpp>
 #include <fmt/format.h>
 #include <spdlog/spdlog.h>
 
 #include "config.h"
 #include "convert.h"
+#include "handoff.h"
+#include "lifecycle.h"
 #include "ss_url.h"
 #include "tcp.h"
 
@@ -43,10 +52,99 @@ void print_usage() {
                              "                               chacha20-ietf-poly1305 (Default)\n"
                              "\n"
                              "    --acl <file path>          Access control list\n"
+                             "    --acl-profile <file path>  Count ACL rule hits, and write them there on SIGUSR1\n"
                              "    --url <SS-URL>             SS-URL\n"
+                             "\n"
+                             "    --max-sessions <num>       Maximum number of concurrent sessions (Default: unlimited)\n"
+                             "    --max-handshakes <num>     Maximum number of in-progress handshakes (Default: unlimited)\n"
+                             "    --yield-bytes <num>        Bulk flows yield to interactive ones after this many bytes (Default: 262144)\n"
+                             "    --yield-time <ms>          Bulk flows yield to interactive ones after this many milliseconds (Default: 2)\n"
+                             "    --connect-timeout <sec>    Timeout for connecting to the target or ss-remote (Default: 10)\n"
+                             "    --egress <address>         Source address of outbound connections, can be repeated (ss-remote only)\n"
+                             "    --dns <address[:port]>     Name server for target host names, can be repeated (Default: from resolv.conf)\n"
+                             "    --dns-port <port>          Serve a caching DNS forwarder on this port (ss-local only)\n"
+                             "    --dns-bind <address>       Address the DNS forwarder listens on (Default: 127.0.0.1)\n"
+                             "    --dns-upstream <addr>      Name server (address[:port]) the DNS forwarder queries through ss-remote (Default: 8.8.8.8)\n"
+                             "    --warm-pool <num>          Idle connections to ss-remote kept ready for new sessions (ss-local only, Default: 0)\n"
+                             "    --warm-pool-idle <sec>     Idle connections are replaced after this many seconds (Default: 30)\n"
+                             "    --mux <num>                Multiplex sessions over this many connections to ss-remote (ss-local only, Default: 0)\n"
+                             "    --server <host[:port]>     Another ss-remote server to balance sessions across, can be repeated (ss-local only)\n"
+                             "    --balance <policy>         Server choice for new sessions: latency, weighted (Default: latency)\n"
+                             "    --probe-interval <sec>     Seconds between latency probes of the ss-remote servers (Default: 30, at least 5)\n"
+                             "    --drain-timeout <sec>      Time for sessions to finish after SIGINT or SIGTERM (Default: 30)\n"
                              "\n",
                              config::version);
 }
+// drain stops accepting clients, and stops ctx if the sessions don't finish within timeout.
+void drain(asio::io_context& ctx, std::chrono::seconds timeout) {
+    if (!lifecycle::get().drain()) {
+        return;
+    }
+
+    spdlog::info("Draining for up to {} seconds, repeat the signal to exit now", timeout.count());
+
+    auto deadline = std::make_shared<asio::steady_timer>(ctx, timeout);
+    deadline->async_wait([&ctx, deadline](const std::error_code&) {
+        spdlog::warn("Drain timeout, closing the remaining sessions");
+        ctx.stop();
+    });
+}
+
+// handle_signals drains on SIGINT and SIGTERM, and hands the listeners over to a new process on SIGUSR2.
+// upgrading is set while upgrader hands over, so that a failed upgrade can be retried.
+asio::awaitable<void> handle_signals(asio::io_context& ctx,
+                                     std::chrono::seconds drain_timeout,
+                                     char* argv[],
+                                     std::thread& upgrader,
+                                     std::atomic<bool>& upgrading) {
+    asio::signal_set signals{ctx, SIGINT, SIGTERM};
+#ifndef _WIN32
+    signals.add(SIGUSR2);
+#endif
+
+    while (true) {
+        const int signal = co_await signals.async_wait(asio::use_awaitable);
+
+#ifndef _WIN32
+        if (signal == SIGUSR2) {
+            if (upgrading || lifecycle::get().is_draining()) {
+                spdlog::warn("Ignore upgrade request, already upgrading or draining");
+                continue;
+            }
+
+            // the previous attempt has failed
+            if (upgrader.joinable()) {
+                upgrader.join();
+            }
+
+            upgrading = true;
+
+            // the handoff blocks until the new process is ready. Accepting pauses meanwhile, so that the salts
+            // of the sessions this process accepts are in the replay protection state it hands over.
+            upgrader = std::thread{[&ctx, &upgrading, argv, drain_timeout, listeners = lifecycle::get().listeners()] {
+                lifecycle::get().pause();
+
+                if (handoff::start_successor(argv, listeners)) {
+                    drain(ctx, drain_timeout);
+                } else {
+                    lifecycle::get().resume();
+                }
+
+                upgrading = false;
+            }};
+
+            continue;
+        }
+#endif
+
+        if (lifecycle::get().is_draining()) {
+            ctx.stop();
+            co_return;
+        }
+
+        drain(ctx, drain_timeout);
+    }
+}
 } // namespace
 
 int main(int argc, char* argv[]) {
@@ -73,6 +171,8 @@ int main(int argc, char* argv[]) {
             conf.method = argv[++i];
         } else if (!strcmp("--acl", argv[i])) {
             conf.acl_file_path = argv[++i];
+        } else if (!strcmp("--acl-profile", argv[i])) {
+            conf.acl_profile_path = argv[++i];
         } else if (!strcmp("--url", argv[i])) {
             ss_url url = ss_url::parse(argv[++i]);
 
@@ -80,6 +180,40 @@ int main(int argc, char* argv[]) {
             conf.password = url.userinfo.password;
             conf.remote_host = url.hostname;
             conf.remote_port = url.port;
+        } else if (!strcmp("--max-sessions", argv[i])) {
+            conf.max_sessions = std::stoul(argv[++i]);
+        } else if (!strcmp("--max-handshakes", argv[i])) {
+            conf.max_handshakes = std::stoul(argv[++i]);
+        } else if (!strcmp("--yield-bytes", argv[i])) {
+            conf.yield_bytes = std::stoul(argv[++i]);
+        } else if (!strcmp("--yield-time", argv[i])) {
+            conf.yield_time = std::stoi(argv[++i]);
+        } else if (!strcmp("--connect-timeout", argv[i])) {
+            conf.connect_timeout = std::stoi(argv[++i]);
+        } else if (!strcmp("--egress", argv[i])) {
+            conf.egress_addresses.emplace_back(argv[++i]);
+        } else if (!strcmp("--dns", argv[i])) {
+            conf.dns_servers.emplace_back(argv[++i]);
+        } else if (!strcmp("--dns-port", argv[i])) {
+            conf.dns_local_port = argv[++i];
+        } else if (!strcmp("--dns-bind", argv[i])) {
+            conf.dns_local_address = argv[++i];
+        } else if (!strcmp("--dns-upstream", argv[i])) {
+            conf.dns_upstream = argv[++i];
+        } else if (!strcmp("--warm-pool", argv[i])) {
+            conf.warm_pool_size = std::stoul(argv[++i]);
+        } else if (!strcmp("--warm-pool-idle", argv[i])) {
+            conf.warm_pool_idle = std::stoi(argv[++i]);
+        } else if (!strcmp("--mux", argv[i])) {
+            conf.mux_connections = std::stoul(argv[++i]);
+        } else if (!strcmp("--server", argv[i])) {
+            conf.remote_servers.emplace_back(argv[++i]);
+        } else if (!strcmp("--balance", argv[i])) {
+            conf.balance = argv[++i];
+        } else if (!strcmp("--probe-interval", argv[i])) {
+            conf.probe_interval = std::stoi(argv[++i]);
+        } else if (!strcmp("--drain-timeout", argv[i])) {
+            conf.drain_timeout = std::stoi(argv[++i]);
         } else if (!strcmp("-V", argv[i])) {
             spdlog::set_level(spdlog::level::debug);
         } else if (!strcmp("-VV", argv[i])) {
@@ -104,19 +238,37 @@ int main(int argc, char* argv[]) {
 
     spdlog::debug("{}", conf.debug_str());
 
+    // take over from the previous process when started by an upgrade
+    handoff::receive();
+
     asio::io_context ctx;
+    const std::chrono::seconds drain_timeout{conf.drain_timeout};
+
+    // the server returns once it has drained
+    auto on_server_exit = [&ctx](std::exception_ptr e) {
+        if (e) {
+            try {
+                std::rethrow_exception(e);
+            } catch (const std::exception& e) {
+                spdlog::error("{}", e.what());
+            }
+        }
+
+        ctx.stop();
+    };
 
     switch (conf.mode) {
     case config::running_mode::remote:
-        asio::co_spawn(ctx, tcp_remote(std::move(conf)), asio::detached);
+        asio::co_spawn(ctx, tcp_remote(std::move(conf)), on_server_exit);
         break;
     case config::running_mode::local:
-        asio::co_spawn(ctx, tcp_local(std::move(conf)), asio::detached);
+        asio::co_spawn(ctx, tcp_local(std::move(conf)), on_server_exit);
         break;
     }
 
-    asio::signal_set signals(ctx, SIGINT, SIGTERM);
-    signals.async_wait([&ctx](auto, auto) { ctx.stop(); });
+    std::thread upgrader;
+    std::atomic<bool> upgrading = false;
+    asio::co_spawn(ctx, handle_signals(ctx, drain_timeout, argv, upgrader, upgrading), asio::detached);
 
     std::vector<std::thread> thread_pool(std::thread::hardware_concurrency());
     for (std::thread& t : thread_pool) {
@@ -131,5 +283,9 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    if (upgrader.joinable()) {
+        upgrader.join();
+    }
+
     return 0;
 }
@@ -0,0 +1,759 @@
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <system_error>
+#include <utility>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/post.hpp>
+#include <asio/redirect_error.hpp>
+#include <asio/strand.hpp>
+#include <asio/use_awaitable.hpp>
+#include <spdlog/spdlog.h>
+
+#include "format.h"
+#include "io.h"
+#include "mux.h"
+
+namespace mux {
+namespace {
+// Streams stop writing while this many bytes are waiting for the connection.
+constexpr std::size_t max_outbox_size = 1024 * 1024;
+
+// The window is returned to the peer once this much of it has been consumed.
+constexpr std::uint32_t window_update_threshold = initial_window / 4;
+
+std::uint32_t get_u32(std::span<const std::uint8_t> p) {
+    return static_cast<std::uint32_t>(p[0]) << 24 | static_cast<std::uint32_t>(p[1]) << 16 | static_cast<std::uint32_t>(p[2]) << 8 | p[3];
+}
+
+void put_u32(std::uint8_t* p, std::uint32_t v) {
+    p[0] = static_cast<std::uint8_t>(v >> 24);
+    p[1] = static_cast<std::uint8_t>(v >> 16);
+    p[2] = static_cast<std::uint8_t>(v >> 8);
+    p[3] = static_cast<std::uint8_t>(v);
+}
+
+// parse_address parses the SOCKS5 address of an open frame.
+bool parse_address(std::span<const std::uint8_t> payload, socks5::address& addr) {
+    if (payload.empty()) {
+        return false;
+    }
+
+    std::size_t size = 0;
+    switch (static_cast<socks5::atyp>(payload[0])) {
+    case socks5::atyp::ipv4:
+        size = 1 + 4 + 2;
+        break;
+    case socks5::atyp::domainname:
+        size = payload.size() >= 2 ? 2 + payload[1] + 2 : 0;
+        break;
+    case socks5::atyp::ipv6:
+        size = 1 + 16 + 2;
+        break;
+    default:
+        return false;
+    }
+
+    if (payload.size() != size) {
+        return false;
+    }
+
+    std::copy(payload.begin(), payload.end(), addr.data.begin());
+    addr.size = size;
+
+    return true;
+}
+
+std::system_error protocol_error(const char* what) {
+    return std::system_error{std::make_error_code(std::errc::protocol_error), what};
+}
+} // namespace
+
+// stream_state is the state of a stream, used on the strand of its multiplexer.
+struct stream_state {
+    stream_state(const asio::any_io_executor& strand, std::uint32_t id) : id(id), readable(strand), writable(strand) {}
+
+    std::uint32_t id;
+
+    // received data, from offset on is not read yet
+    std::vector<std::uint8_t> inbound;
+    std::size_t offset = 0;
+
+    // bytes the peer may send, and bytes read but not yet returned to the peer
+    std::uint32_t receive_window = initial_window;
+    std::uint32_t unacknowledged = 0;
+
+    // bytes we may send
+    std::uint64_t send_window = initial_window;
+
+    bool fin_received = false;
+    bool fin_sent = false;
+    bool was_reset = false;
+
+    // removed from the multiplexer, no more frames are sent or received
+    bool finished = false;
+
+    int read_timeout = 0;
+    multiplexer::clock::time_point read_deadline = multiplexer::clock::time_point::max();
+
+    // pushed back whenever data is read or written
+    int connection_timeout = 0;
+    multiplexer::clock::time_point idle_deadline = multiplexer::clock::time_point::max();
+
+    std::uint64_t cancels = 0;
+
+    // wake up the reader and the writer of the stream
+    steady_timer readable;
+    steady_timer writable;
+};
+
+socks5::address address() {
+    socks5::address addr;
+    std::uint8_t* out = addr.data.data();
+
+    *out++ = static_cast<std::uint8_t>(socks5::atyp::domainname);
+    *out++ = static_cast<std::uint8_t>(host.size());
+    out = std::copy(host.begin(), host.end(), out);
+    *out++ = 0;
+    *out++ = 0;
+    addr.size = static_cast<std::size_t>(out - addr.data.data());
+
+    return addr;
+}
+
+bool is_mux_address(const socks5::address& addr) {
+    return addr.domain() == host && addr.port() == 0;
+}
+
+stream::stream(std::shared_ptr<multiplexer> m, std::shared_ptr<stream_state> state)
+    : m(std::move(m)),
+      state(std::move(state)) {}
+
+stream::~stream() {
+    // nobody reads or writes the stream any more, so the peer is told to stop
+    const asio::any_io_executor strand = m->strand;
+    asio::post(strand, [m = std::move(m), state = std::move(state)] {
+        if (!state->finished) {
+            m->reset(*state);
+        }
+    });
+}
+
+// The stream operations run on the strand of the multiplexer. The lambdas are bound to locals,
+// because GCC 12 destroys the captures of a lambda twice if it is a temporary of a co_await expression.
+asio::awaitable<void> stream::wait_read() {
+    auto op = [self = m, st = state]() -> asio::awaitable<void> {
+        co_await self->wait_readable(*st);
+    };
+
+    co_await asio::co_spawn(m->strand, std::move(op), asio::use_awaitable);
+}
+
+asio::awaitable<std::size_t> stream::read(std::span<std::uint8_t> buffer) {
+    auto op = [self = m, st = state, buffer]() -> asio::awaitable<std::size_t> {
+        co_return co_await self->read(*st, buffer);
+    };
+
+    co_return co_await asio::co_spawn(m->strand, std::move(op), asio::use_awaitable);
+}
+
+asio::awaitable<std::size_t> stream::write(std::span<const std::uint8_t> buffer) {
+    auto op = [self = m, st = state, buffer]() -> asio::awaitable<std::size_t> {
+        co_return co_await self->write(*st, buffer);
+    };
+
+    co_return co_await asio::co_spawn(m->strand, std::move(op), asio::use_awaitable);
+}
+
+asio::awaitable<bool> stream::wait_disconnect() {
+    auto op = [self = m, st = state]() -> asio::awaitable<bool> {
+        co_return co_await self->wait_disconnect(*st);
+    };
+
+    co_return co_await asio::co_spawn(m->strand, std::move(op), asio::use_awaitable);
+}
+
+void stream::cancel() {
+    asio::post(m->strand, [state = state] {
+        state->cancels++;
+        state->readable.cancel();
+        state->writable.cancel();
+    });
+}
+
+void stream::close() {
+    asio::post(m->strand, [m = m, state = state] {
+        if (state->finished || state->fin_sent) {
+            return;
+        }
+
+        m->send(state->id, frame_type::fin);
+        state->fin_sent = true;
+        state->writable.cancel();
+        m->finish(*state);
+    });
+}
+
+void stream::abort() {
+    asio::post(m->strand, [m = m, state = state] {
+        if (!state->finished) {
+            m->reset(*state);
+        }
+    });
+}
+
+void stream::set_read_timeout(int val) {
+    asio::post(m->strand, [state = state, val] {
+        state->read_timeout = val;
+        state->read_deadline = val > 0 ? multiplexer::clock::now() + std::chrono::seconds{val} : multiplexer::clock::time_point::max();
+        state->readable.cancel();
+    });
+}
+
+void stream::set_connection_timeout(int val) {
+    asio::post(m->strand, [state = state, val] {
+        state->connection_timeout = val;
+        state->idle_deadline = val > 0 ? multiplexer::clock::now() + std::chrono::seconds{val} : multiplexer::clock::time_point::max();
+        state->readable.cancel();
+        state->writable.cancel();
+    });
+}
+
+asio::ip::tcp::endpoint stream::local_endpoint() const {
+    return m->local;
+}
+
+asio::ip::tcp::endpoint stream::remote_endpoint() const {
+    return m->remote;
+}
+
+multiplexer::multiplexer(const asio::any_io_executor& strand, std::shared_ptr<encrypted_connection> ec)
+    : strand(strand),
+      ec(std::move(ec)),
+      local(this->ec->local_endpoint()),
+      remote(this->ec->remote_endpoint()),
+      outbox_ready(strand),
+      outbox_drained(strand),
+      idle_since_ticks(clock::now().time_since_epoch().count()) {}
+
+asio::awaitable<void> multiplexer::run(accept_function on_accept) {
+    asio::co_spawn(
+        strand,
+        [self = shared_from_this()]() -> asio::awaitable<void> {
+            co_await self->write_frames();
+        },
+        asio::detached);
+
+    std::exception_ptr failure;
+
+    try {
+        co_await read_frames(on_accept);
+    } catch (const std::system_error& e) {
+        spdlog::debug("Multiplexed connection {}: {}", remote, e.what());
+    } catch (const std::exception&) {
+        failure = std::current_exception();
+    }
+
+    shutdown();
+
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+asio::awaitable<std::shared_ptr<stream>> multiplexer::open(const socks5::address& target) {
+    auto op = [self = shared_from_this(), target]() -> asio::awaitable<std::shared_ptr<stream>> {
+        if (self->closed) {
+            throw std::system_error{asio::error::connection_reset, "Multiplexed connection closed"};
+        }
+
+        const std::uint32_t id = self->next_id++;
+        auto st = std::make_shared<stream_state>(self->strand, id);
+        self->streams.emplace(id, st);
+        self->active++;
+
+        self->send(id, frame_type::open, target.bytes());
+
+        co_return std::make_shared<stream>(self, std::move(st));
+    };
+
+    co_return co_await asio::co_spawn(strand, std::move(op), asio::use_awaitable);
+}
+
+void multiplexer::close() {
+    asio::post(strand, [self = shared_from_this()] {
+        self->shutdown();
+    });
+}
+
+bool multiplexer::is_closed() const {
+    return closed_flag;
+}
+
+std::size_t multiplexer::stream_count() const {
+    return active;
+}
+
+multiplexer::clock::time_point multiplexer::idle_since() const {
+    return clock::time_point{clock::duration{idle_since_ticks}};
+}
+
+asio::awaitable<void> multiplexer::read_frames(const accept_function& on_accept) {
+    std::array<std::uint8_t, header_size> header;
+    std::vector<std::uint8_t> payload;
+
+    while (true) {
+        co_await read_full(*ec, header);
+
+        const std::uint32_t id = get_u32(header);
+        const auto type = static_cast<frame_type>(header[4]);
+        payload.resize(static_cast<std::size_t>(header[5] << 8 | header[6]));
+        co_await read_full(*ec, payload);
+
+        if (type == frame_type::open) {
+            accept(id, payload, on_accept);
+            continue;
+        }
+
+        // frames of a finished stream may still be on the way
+        auto it = streams.find(id);
+        if (it == streams.end()) {
+            continue;
+        }
+
+        // finishing removes the stream from the map
+        std::shared_ptr<stream_state> st = it->second;
+
+        switch (type) {
+        case frame_type::data:
+            receive(*st, payload);
+            break;
+        case frame_type::window_update:
+            if (payload.size() != 4) {
+                throw protocol_error("Malformed window update");
+            }
+
+            st->send_window += get_u32(payload);
+            st->writable.cancel();
+            break;
+        case frame_type::fin:
+            st->fin_received = true;
+            st->readable.cancel();
+            finish(*st);
+            break;
+        case frame_type::reset:
+            st->was_reset = true;
+            st->readable.cancel();
+            st->writable.cancel();
+            finish(*st);
+            break;
+        default:
+            throw protocol_error("Unknown frame type");
+        }
+    }
+}
+
+asio::awaitable<void> multiplexer::write_frames() {
+    std::vector<std::uint8_t> sending;
+
+    try {
+        while (true) {
+            if (outbox.empty()) {
+                if (closed) {
+                    break;
+                }
+
+                std::error_code ignore_error;
+                outbox_ready.expires_at(steady_timer::time_point::max());
+                co_await outbox_ready.async_wait(asio::redirect_error(asio::use_awaitable, ignore_error));
+                continue;
+            }
+
+            // the frames of all streams go out in a single write
+            sending.clear();
+            sending.swap(outbox);
+            co_await ec->write(sending);
+
+            outbox_drained.cancel();
+        }
+    } catch (const std::system_error& e) {
+        spdlog::debug("Multiplexed connection {}: {}", remote, e.what());
+    }
+
+    shutdown();
+}
+
+void multiplexer::accept(std::uint32_t id, std::span<const std::uint8_t> payload, const accept_function& on_accept) {
+    socks5::address target;
+    if (id == 0 || streams.contains(id) || !parse_address(payload, target)) {
+        throw protocol_error("Malformed open frame");
+    }
+
+    auto st = std::make_shared<stream_state>(strand, id);
+    streams.emplace(id, st);
+    active++;
+
+    if (!on_accept) {
+        reset(*st);
+        return;
+    }
+
+    on_accept(std::make_shared<stream>(shared_from_this(), std::move(st)), target);
+}
+
+void multiplexer::receive(stream_state& st, std::span<const std::uint8_t> payload) {
+    if (st.fin_received || payload.size() > st.receive_window) {
+        spdlog::debug("Multiplexed connection {}: stream {} exceeded its window", remote, st.id);
+        reset(st);
+        return;
+    }
+
+    st.receive_window -= static_cast<std::uint32_t>(payload.size());
+    st.inbound.insert(st.inbound.end(), payload.begin(), payload.end());
+    st.readable.cancel();
+}
+
+void multiplexer::send(std::uint32_t id, frame_type type, std::span<const std::uint8_t> payload) {
+    std::array<std::uint8_t, header_size> header;
+    put_u32(header.data(), id);
+    header[4] = static_cast<std::uint8_t>(type);
+    header[5] = static_cast<std::uint8_t>(payload.size() >> 8);
+    header[6] = static_cast<std::uint8_t>(payload.size());
+
+    outbox.insert(outbox.end(), header.begin(), header.end());
+    outbox.insert(outbox.end(), payload.begin(), payload.end());
+    outbox_ready.cancel();
+}
+
+void multiplexer::reset(stream_state& st) {
+    if (!st.was_reset && !closed) {
+        send(st.id, frame_type::reset);
+    }
+
+    st.was_reset = true;
+    st.readable.cancel();
+    st.writable.cancel();
+    finish(st);
+}
+
+void multiplexer::finish(stream_state& st) {
+    if (st.finished || !(st.was_reset || (st.fin_sent && st.fin_received))) {
+        return;
+    }
+
+    st.finished = true;
+    streams.erase(st.id);
+
+    if (--active == 0) {
+        idle_since_ticks = clock::now().time_since_epoch().count();
+    }
+}
+
+void multiplexer::shutdown() {
+    if (closed) {
+        return;
+    }
+
+    closed = true;
+    closed_flag = true;
+
+    for (auto& [id, st] : streams) {
+        st->was_reset = true;
+        st->finished = true;
+        st->readable.cancel();
+        st->writable.cancel();
+    }
+
+    streams.clear();
+    active = 0;
+    idle_since_ticks = clock::now().time_since_epoch().count();
+
+    outbox.clear();
+    outbox_ready.cancel();
+    outbox_drained.cancel();
+    ec->abort();
+}
+
+asio::awaitable<void> multiplexer::wait_readable(stream_state& st) {
+    const std::uint64_t cancels = st.cancels;
+
+    while (st.offset == st.inbound.size() && !st.fin_received && !st.was_reset) {
+        if (st.cancels != cancels) {
+            throw std::system_error{asio::error::operation_aborted};
+        }
+
+        if (clock::now() >= st.read_deadline) {
+            reset(st);
+            throw std::system_error{asio::error::timed_out, "Read timeout"};
+        }
+
+        check_idle(st);
+
+        std::error_code ignore_error;
+        st.readable.expires_at(std::min(st.read_deadline, st.idle_deadline));
+        co_await st.readable.async_wait(asio::redirect_error(asio::use_awaitable, ignore_error));
+    }
+}
+
+asio::awaitable<std::size_t> multiplexer::read(stream_state& st, std::span<std::uint8_t> buffer) {
+    co_await wait_readable(st);
+
+    // a reset after the fin of the peer only means it doesn't read any more
+    if (st.offset == st.inbound.size()) {
+        if (st.fin_received) {
+            throw std::system_error{asio::error::eof};
+        }
+
+        throw std::system_error{asio::error::connection_reset};
+    }
+
+    const std::size_t n = std::min(buffer.size(), st.inbound.size() - st.offset);
+    std::copy_n(st.inbound.begin() + static_cast<std::ptrdiff_t>(st.offset), n, buffer.begin());
+    st.offset += n;
+
+    // drop the data read, once it is the larger part of the buffer
+    if (st.offset == st.inbound.size()) {
+        st.inbound.clear();
+        st.offset = 0;
+    } else if (st.offset > st.inbound.size() / 2) {
+        st.inbound.erase(st.inbound.begin(), st.inbound.begin() + static_cast<std::ptrdiff_t>(st.offset));
+        st.offset = 0;
+    }
+
+    if (st.read_timeout > 0) {
+        st.read_deadline = clock::now() + std::chrono::seconds{st.read_timeout};
+    }
+
+    touch(st);
+
+    // give the window back to the peer
+    st.unacknowledged += static_cast<std::uint32_t>(n);
+    if (st.unacknowledged >= window_update_threshold && !st.finished && !st.fin_received) {
+        std::array<std::uint8_t, 4> increment;
+        put_u32(increment.data(), st.unacknowledged);
+        send(st.id, frame_type::window_update, increment);
+
+        st.receive_window += st.unacknowledged;
+        st.unacknowledged = 0;
+    }
+
+    co_return n;
+}
+
+asio::awaitable<std::size_t> multiplexer::write(stream_state& st, std::span<const std::uint8_t> buffer) {
+    std::size_t written = 0;
+
+    while (written < buffer.size()) {
+        if (st.was_reset) {
+            throw std::system_error{asio::error::connection_reset};
+        }
+
+        if (st.fin_sent) {
+            throw std::system_error{asio::error::broken_pipe};
+        }
+
+        // wait for the peer to read, or for the connection to catch up with the other streams
+        if (st.send_window == 0) {
+            check_idle(st);
+
+            std::error_code ignore_error;
+            st.writable.expires_at(st.idle_deadline);
+            co_await st.writable.async_wait(asio::redirect_error(asio::use_awaitable, ignore_error));
+            continue;
+        }
+
+        if (outbox.size() >= max_outbox_size) {
+            std::error_code ignore_error;
+            outbox_drained.expires_at(steady_timer::time_point::max());
+            co_await outbox_drained.async_wait(asio::redirect_error(asio::use_awaitable, ignore_error));
+            continue;
+        }
+
+        const std::size_t n = std::min({buffer.size() - written, max_payload_size, static_cast<std::size_t>(st.send_window)});
+        send(st.id, frame_type::data, buffer.subspan(written, n));
+
+        st.send_window -= n;
+        written += n;
+    }
+
+    touch(st);
+
+    co_return written;
+}
+
+asio::awaitable<bool> multiplexer::wait_disconnect(stream_state& st) {
+    const std::uint64_t cancels = st.cancels;
+
+    while (true) {
+        if (st.offset != st.inbound.size() || st.cancels != cancels) {
+            co_return false;
+        }
+
+        if (st.fin_received || st.was_reset) {
+            co_return true;
+        }
+
+        std::error_code ignore_error;
+        st.readable.expires_at(steady_timer::time_point::max());
+        co_await st.readable.async_wait(asio::redirect_error(asio::use_awaitable, ignore_error));
+    }
+}
+
+void multiplexer::touch(stream_state& st) {
+    if (st.connection_timeout > 0) {
+        st.idle_deadline = clock::now() + std::chrono::seconds{st.connection_timeout};
+    }
+}
+
+void multiplexer::check_idle(stream_state& st) {
+    if (clock::now() >= st.idle_deadline) {
+        reset(st);
+        throw std::system_error{asio::error::timed_out, "Connection timeout"};
+    }
+}
+
+pool::pool(const asio::any_io_executor& executor, connect_function connect, std::size_t size, multiplexer::clock::duration idle_timeout)
+    : executor(executor),
+      connect(std::move(connect)),
+      size(size),
+      idle_timeout(idle_timeout) {}
+
+asio::awaitable<std::shared_ptr<stream>> pool::open(const socks5::address& target) {
+    auto waiter_executor = co_await asio::this_coro::executor;
+    bool waited = false;
+
+    while (true) {
+        std::shared_ptr<steady_timer> waiter;
+        std::shared_ptr<pending_connect> connect_pending;
+        std::shared_ptr<multiplexer> m = acquire(waiter_executor, waited, waiter, connect_pending);
+
+        if (!m && !waiter) {
+            m = co_await add(std::move(connect_pending));
+        }
+
+        if (m) {
+            co_return co_await m->open(target);
+        }
+
+        std::error_code ignore_error;
+        co_await waiter->async_wait(asio::redirect_error(asio::use_awaitable, ignore_error));
+
+        // the streams waiting fail with the connection, instead of each trying in turn
+        if (connect_pending->failure) {
+            std::rethrow_exception(connect_pending->failure);
+        }
+
+        waited = true;
+    }
+}
+
+std::shared_ptr<multiplexer> pool::acquire(const asio::any_io_executor& waiter_executor,
+                                           bool waited,
+                                           std::shared_ptr<steady_timer>& waiter,
+                                           std::shared_ptr<pending_connect>& connect_pending) {
+    const multiplexer::clock::time_point now = multiplexer::clock::now();
+    std::lock_guard lock{mtx};
+
+    std::erase_if(connections, [this, now](const std::shared_ptr<multiplexer>& m) {
+        if (m->is_closed()) {
+            return true;
+        }
+
+        if (m->stream_count() == 0 && now - m->idle_since() >= idle_timeout) {
+            m->close();
+            return true;
+        }
+
+        return false;
+    });
+
+    auto least = std::min_element(connections.begin(), connections.end(), [](const std::shared_ptr<multiplexer>& a, const std::shared_ptr<multiplexer>& b) {
+        return a->stream_count() < b->stream_count();
+    });
+
+    if (least == connections.end() && pending) {
+        waiter = std::make_shared<steady_timer>(waiter_executor, steady_timer::time_point::max());
+        pending->waiters.push_back(waiter);
+        connect_pending = pending;
+        return nullptr;
+    }
+
+    // the streams which waited share the connection they waited for
+    const bool full = connections.size() + connecting >= size || waited;
+    if (least == connections.end() || ((*least)->stream_count() > 0 && !full)) {
+        connecting++;
+
+        // the streams opened until it is made wait for it
+        if (least == connections.end()) {
+            pending = std::make_shared<pending_connect>();
+            connect_pending = pending;
+        }
+
+        return nullptr;
+    }
+
+    return *least;
+}
+
+asio::awaitable<std::shared_ptr<multiplexer>> pool::add(std::shared_ptr<pending_connect> connect_pending) {
+    auto strand = asio::make_strand(executor);
+    std::shared_ptr<multiplexer> m;
+    std::exception_ptr failure;
+
+    try {
+        std::shared_ptr<encrypted_connection> ec = co_await asio::co_spawn(strand, connect(), asio::use_awaitable);
+        m = std::make_shared<multiplexer>(strand, std::move(ec));
+    } catch (...) {
+        failure = std::current_exception();
+    }
+
+    if (m) {
+        asio::co_spawn(
+            strand,
+            [m]() -> asio::awaitable<void> {
+                try {
+                    co_await m->run();
+                } catch (const std::exception& e) {
+                    spdlog::warn("Multiplexed connection: {}", e.what());
+                }
+            },
+            asio::detached);
+    }
+
+    std::vector<std::shared_ptr<steady_timer>> waiters;
+
+    {
+        std::lock_guard lock{mtx};
+        connecting--;
+
+        // kept even if the pool filled up meanwhile, so that it is closed once idle
+        if (m) {
+            connections.push_back(m);
+        }
+
+        if (connect_pending) {
+            connect_pending->failure = failure;
+            waiters = std::move(connect_pending->waiters);
+
+            if (pending == connect_pending) {
+                pending.reset();
+            }
+        }
+    }
+
+    for (auto& waiter : waiters) {
+        // on the executor of the waiter, setting the expiry also completes a wait which hasn't started yet
+        asio::post(waiter->get_executor(), [waiter] {
+            waiter->expires_at(steady_timer::time_point::min());
+        });
+    }
+
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+
+    co_return m;
+}
+} // namespace mux
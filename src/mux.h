@@ -0,0 +1,219 @@
+#ifndef MUX_H
+#define MUX_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <asio/any_io_executor.hpp>
+#include <asio/awaitable.hpp>
+
+#include "awaitable.h"
+#include "encrypted_connection.h"
+#include "socks5.h"
+
+// Stream multiplexing carries many logical streams over one encrypted connection between ss-local and ss-remote,
+// so that a stream opens without a round trip: its target address and its first data go out right away.
+//
+// ss-local opts in by sending mux::host as the target address of a connection. Then both ends exchange frames:
+//
+//     +-----------+------+--------+---------+
+//     | stream ID | type | length | payload |
+//     +-----------+------+--------+---------+
+//     |     4     |  1   |   2    | length  |
+//     +-----------+------+--------+---------+
+//
+// Each stream has a receive window for flow control, so that a slow reader doesn't stall the other streams.
+namespace mux {
+// host is the target host name which starts multiplexing. Names under .invalid never resolve (RFC 2606),
+// so a server without multiplexing closes the connection.
+constexpr std::string_view host = "mux.shadowsocks-asio.invalid";
+
+enum class frame_type : std::uint8_t {
+    // opens a stream, the payload is the SOCKS5 address of its target
+    open = 0x01,
+    data = 0x02,
+    // the payload is the number of bytes the sender may send in addition
+    window_update = 0x03,
+    // the sender won't send any more data
+    fin = 0x04,
+    // the stream is aborted in both directions
+    reset = 0x05
+};
+
+constexpr std::size_t header_size = 7;
+
+// Each data frame fits in a single AEAD chunk.
+constexpr std::size_t max_payload_size = 0x3FFF - header_size;
+
+// The number of bytes a stream may receive before its reader consumes them.
+constexpr std::uint32_t initial_window = 256 * 1024;
+
+// address returns the target address which starts multiplexing.
+socks5::address address();
+
+// is_mux_address returns true if addr starts multiplexing.
+bool is_mux_address(const socks5::address& addr);
+
+class multiplexer;
+struct stream_state;
+
+// stream is a logical connection carried by a multiplexer. It can be used from any executor.
+class stream {
+public:
+    stream(std::shared_ptr<multiplexer> m, std::shared_ptr<stream_state> state);
+    ~stream();
+
+    stream(const stream&) = delete;
+    stream& operator=(const stream&) = delete;
+
+    asio::awaitable<void> wait_read();
+    asio::awaitable<std::size_t> read(std::span<std::uint8_t> buffer);
+    asio::awaitable<std::size_t> write(std::span<const std::uint8_t> buffer);
+
+    // wait_disconnect returns true if the peer closes or resets the stream, or false if data arrives or it is cancelled.
+    asio::awaitable<bool> wait_disconnect();
+    void cancel();
+
+    // close sends a fin, abort resets the stream.
+    void close();
+    void abort();
+
+    // set_read_timeout limits how long a read waits for data, and set_connection_timeout how long the stream
+    // may go without reading or writing any (0 disables them). A stream which times out is reset.
+    void set_read_timeout(int val);
+    void set_connection_timeout(int val);
+
+    asio::ip::tcp::endpoint local_endpoint() const;
+    asio::ip::tcp::endpoint remote_endpoint() const;
+
+private:
+    std::shared_ptr<multiplexer> m;
+    std::shared_ptr<stream_state> state;
+};
+
+// multiplexer runs the streams of an encrypted connection. All its work is done on strand,
+// a strand which must also be the executor of the connection.
+class multiplexer : public std::enable_shared_from_this<multiplexer> {
+public:
+    using clock = std::chrono::steady_clock;
+
+    // accept_function is called on strand for each stream the peer opens.
+    using accept_function = std::function<void(std::shared_ptr<stream> s, const socks5::address& target)>;
+
+    multiplexer(const asio::any_io_executor& strand, std::shared_ptr<encrypted_connection> ec);
+
+    // run reads and writes frames until the connection fails, and then resets the streams. It must be called on strand.
+    // Without on_accept, streams opened by the peer are reset.
+    asio::awaitable<void> run(accept_function on_accept = {});
+
+    // open opens a stream to target, without waiting for the peer.
+    asio::awaitable<std::shared_ptr<stream>> open(const socks5::address& target);
+
+    // close aborts the connection.
+    void close();
+
+    bool is_closed() const;
+
+    // stream_count returns the number of open streams.
+    std::size_t stream_count() const;
+
+    // idle_since returns when the last stream finished.
+    clock::time_point idle_since() const;
+
+private:
+    friend class stream;
+
+    // All members are used on strand.
+    asio::awaitable<void> read_frames(const accept_function& on_accept);
+    asio::awaitable<void> write_frames();
+    void accept(std::uint32_t id, std::span<const std::uint8_t> payload, const accept_function& on_accept);
+    void receive(stream_state& st, std::span<const std::uint8_t> payload);
+    void send(std::uint32_t id, frame_type type, std::span<const std::uint8_t> payload = {});
+    void reset(stream_state& st);
+    void finish(stream_state& st);
+    void shutdown();
+
+    asio::awaitable<void> wait_readable(stream_state& st);
+    asio::awaitable<std::size_t> read(stream_state& st, std::span<std::uint8_t> buffer);
+    asio::awaitable<std::size_t> write(stream_state& st, std::span<const std::uint8_t> buffer);
+    asio::awaitable<bool> wait_disconnect(stream_state& st);
+    void touch(stream_state& st);
+    void check_idle(stream_state& st);
+
+    asio::any_io_executor strand;
+    std::shared_ptr<encrypted_connection> ec;
+    asio::ip::tcp::endpoint local;
+    asio::ip::tcp::endpoint remote;
+
+    std::unordered_map<std::uint32_t, std::shared_ptr<stream_state>> streams;
+    std::uint32_t next_id = 1;
+
+    // frames waiting for the writer
+    std::vector<std::uint8_t> outbox;
+    steady_timer outbox_ready;
+    steady_timer outbox_drained;
+    bool closed = false;
+
+    // read from other threads
+    std::atomic<bool> closed_flag = false;
+    std::atomic<std::size_t> active = 0;
+    std::atomic<clock::rep> idle_since_ticks;
+};
+
+// pool opens streams on up to size multiplexed connections to ss-remote. A new connection is made only when
+// all the others carry streams, and a connection is closed after carrying none for idle_timeout. While the pool
+// has no connection, the streams opened wait for the one being made.
+// It can be used from any executor.
+class pool {
+public:
+    // connect establishes a new connection to ss-remote and sends mux::address on it. It is called on the strand
+    // the connection must be bound to.
+    using connect_function = std::function<asio::awaitable<std::shared_ptr<encrypted_connection>>()>;
+
+    pool(const asio::any_io_executor& executor, connect_function connect, std::size_t size, multiplexer::clock::duration idle_timeout);
+
+    // open opens a stream to target, and throws std::system_error if no connection can be made.
+    asio::awaitable<std::shared_ptr<stream>> open(const socks5::address& target);
+
+private:
+    // pending_connect is a connection being made while the pool has none.
+    struct pending_connect {
+        // woken up once it is made, or failed with failure
+        std::vector<std::shared_ptr<steady_timer>> waiters;
+        std::exception_ptr failure;
+    };
+
+    // acquire returns the connection carrying the fewest streams, or nullptr if a new one should be made.
+    // It sets waiter instead if the caller should wait for pending, or sets pending for the connection
+    // the caller is to make. A caller which waited makes a new connection only if there is none.
+    std::shared_ptr<multiplexer> acquire(const asio::any_io_executor& waiter_executor,
+                                         bool waited,
+                                         std::shared_ptr<steady_timer>& waiter,
+                                         std::shared_ptr<pending_connect>& pending);
+
+    // add makes a new connection, and wakes up the waiters of pending, if any.
+    asio::awaitable<std::shared_ptr<multiplexer>> add(std::shared_ptr<pending_connect> pending);
+
+    asio::any_io_executor executor;
+    connect_function connect;
+    std::size_t size;
+    multiplexer::clock::duration idle_timeout;
+
+    std::mutex mtx;
+    std::vector<std::shared_ptr<multiplexer>> connections;
+    std::size_t connecting = 0;
+    std::shared_ptr<pending_connect> pending;
+};
+} // namespace mux
+
+#endif
@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <new>
+#include <utility>
+
+#include "recycling_allocator.h"
+
+namespace {
+constexpr std::size_t min_block_size = 64;
+constexpr std::size_t max_block_size = 64 * 1024;
+constexpr std::size_t class_count = std::countr_zero(max_block_size) - std::countr_zero(min_block_size) + 1;
+
+// Each size class caches at most this many bytes per thread, but always at least 4 blocks.
+constexpr std::size_t max_cached_bytes = 256 * 1024;
+constexpr std::size_t min_cached_blocks = 4;
+
+std::size_t size_class(std::size_t size) {
+    const std::size_t block_size = std::bit_ceil(std::max(size, min_block_size));
+    return std::countr_zero(block_size) - std::countr_zero(min_block_size);
+}
+
+std::size_t block_size(std::size_t index) {
+    return min_block_size << index;
+}
+
+class thread_cache {
+public:
+    thread_cache() = default;
+
+    thread_cache(const thread_cache&) = delete;
+    thread_cache& operator=(const thread_cache&) = delete;
+
+    ~thread_cache() {
+        for (free_list& list : lists) {
+            while (list.head) {
+                ::operator delete(std::exchange(list.head, list.head->next));
+            }
+        }
+    }
+
+    void* allocate(std::size_t index) {
+        free_list& list = lists[index];
+
+        if (list.head) {
+            list.count--;
+            return std::exchange(list.head, list.head->next);
+        }
+
+        return ::operator new(block_size(index));
+    }
+
+    void deallocate(void* pointer, std::size_t index) noexcept {
+        free_list& list = lists[index];
+
+        if (list.count >= std::max(min_cached_blocks, max_cached_bytes / block_size(index))) {
+            ::operator delete(pointer);
+            return;
+        }
+
+        list.head = ::new (pointer) node{list.head};
+        list.count++;
+    }
+
+private:
+    struct node {
+        node* next;
+    };
+
+    struct free_list {
+        node* head = nullptr;
+        std::size_t count = 0;
+    };
+
+    std::array<free_list, class_count> lists;
+};
+
+thread_local thread_cache cache;
+} // namespace
+
+namespace recycling {
+void* allocate(std::size_t size) {
+    if (size > max_block_size) {
+        return ::operator new(size);
+    }
+
+    return cache.allocate(size_class(size));
+}
+
+void deallocate(void* pointer, std::size_t size) noexcept {
+    if (size > max_block_size) {
+        ::operator delete(pointer);
+        return;
+    }
+
+    cache.deallocate(pointer, size_class(size));
+}
+} // namespace recycling
@@ -0,0 +1,90 @@
+#ifndef RECYCLING_ALLOCATOR_H
+#define RECYCLING_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <utility>
+
+// The recycling pool keeps freed blocks in per-thread free lists grouped by size class,
+// so that the objects created for every connection stop hitting the heap after warm up.
+namespace recycling {
+void* allocate(std::size_t size);
+void deallocate(void* pointer, std::size_t size) noexcept;
+} // namespace recycling
+
+// recycling_allocator is a standard allocator on top of the recycling pool.
+template <typename T>
+class recycling_allocator {
+public:
+    using value_type = T;
+
+    recycling_allocator() noexcept = default;
+
+    template <typename U>
+    recycling_allocator(const recycling_allocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(recycling::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        recycling::deallocate(p, n * sizeof(T));
+    }
+
+    template <typename U>
+    friend bool operator==(const recycling_allocator&, const recycling_allocator<U>&) noexcept {
+        return true;
+    }
+};
+
+// make_recycled is std::make_shared using the recycling pool for the object and its control block.
+template <typename T, typename... Args>
+std::shared_ptr<T> make_recycled(Args&&... args) {
+    return std::allocate_shared<T>(recycling_allocator<T>{}, std::forward<Args>(args)...);
+}
+
+// recycled_buffer is a byte buffer drawn from the recycling pool.
+class recycled_buffer {
+public:
+    recycled_buffer() : ptr(nullptr), len(0) {}
+
+    explicit recycled_buffer(std::size_t size)
+        : ptr(static_cast<std::uint8_t*>(recycling::allocate(size))),
+          len(size) {}
+
+    ~recycled_buffer() {
+        if (ptr) {
+            recycling::deallocate(ptr, len);
+        }
+    }
+
+    recycled_buffer(recycled_buffer&& other) noexcept
+        : ptr(std::exchange(other.ptr, nullptr)),
+          len(std::exchange(other.len, 0)) {}
+
+    recycled_buffer& operator=(recycled_buffer&& other) noexcept {
+        std::swap(ptr, other.ptr);
+        std::swap(len, other.len);
+        return *this;
+    }
+
+    std::uint8_t* data() const {
+        return ptr;
+    }
+
+    std::size_t size() const {
+        return len;
+    }
+
+    std::span<std::uint8_t> span() const {
+        return {ptr, len};
+    }
+
+private:
+    std::uint8_t* ptr;
+    std::size_t len;
+};
+
+#endif
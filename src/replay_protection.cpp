@@ -1,46 +1,193 @@
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 
 #include <crypto/crypto.h>
 
 #include "replay_protection.h"
 
+namespace {
+void put(std::vector<std::uint8_t>& out, std::span<const std::uint8_t> bytes) {
+    const std::size_t offset = out.size();
+    out.resize(offset + bytes.size());
+    std::memcpy(out.data() + offset, bytes.data(), bytes.size());
+}
+
+void put_u64(std::vector<std::uint8_t>& out, std::uint64_t val) {
+    put(out, std::span{reinterpret_cast<const std::uint8_t*>(&val), sizeof(val)});
+}
+
+bool get_u64(std::span<const std::uint8_t>& in, std::uint64_t& val) {
+    if (in.size() < sizeof(val)) {
+        return false;
+    }
+
+    std::memcpy(&val, in.data(), sizeof(val));
+    in = in.subspan(sizeof(val));
+    return true;
+}
+} // namespace
+
 replay_protection& replay_protection::get() {
     static replay_protection instance;
     return instance;
 }
 
 replay_protection::replay_protection() {
-    bloom_parameters parameters;
-    parameters.projected_element_count = count;
-    parameters.false_positive_probability = 1e-6;
-    unsigned long long seed;
-    crypto::random_bytes(std::span{reinterpret_cast<std::uint8_t*>(&seed), sizeof(seed)});
-    parameters.random_seed = seed;
-
-    bool ok = parameters.compute_optimal_parameters();
-    assert(ok);
+    unsigned long long random = 0;
+    crypto::random_bytes(std::span{reinterpret_cast<std::uint8_t*>(&random), sizeof(random)});
+    seed = random;
 
-    for (auto& filter : filters) {
-        filter = bloom_filter{parameters};
+    for (shard& s : shards) {
+        for (auto& filter : s.filters) {
+            filter = replay_protection::filter{parameters(random)};
+        }
     }
 }
 
-void replay_protection::insert(std::span<const std::uint8_t> element) {
-    bloom_filter& bloom_filter = filters[current];
+bool replay_protection::test_and_insert(std::span<const std::uint8_t> element) {
+    shard& s = shard_of(element);
+    std::lock_guard lock{s.mtx};
+
+    if (std::any_of(s.filters.begin(), s.filters.end(), [element](auto& filter) {
+            return filter.contains(element.data(), element.size());
+        })) {
+        return true;
+    }
 
-    std::lock_guard lock{mtx};
+    bloom_filter& bloom_filter = s.filters[s.current];
     bloom_filter.insert(element.data(), element.size());
 
-    if (bloom_filter.element_count() >= count) {
-        current = !current;
-        filters[current].clear();
+    if (bloom_filter.element_count() >= count / shard_count) {
+        s.current = !s.current;
+        s.filters[s.current].clear();
     }
+
+    return false;
 }
 
 bool replay_protection::contains(std::span<const std::uint8_t> element) {
-    std::lock_guard lock{mtx};
-    return std::any_of(filters.begin(), filters.end(), [element](auto& filter) {
+    shard& s = shard_of(element);
+    std::lock_guard lock{s.mtx};
+
+    return std::any_of(s.filters.begin(), s.filters.end(), [element](auto& filter) {
         return filter.contains(element.data(), element.size());
     });
 }
+
+std::vector<std::uint8_t> replay_protection::save() {
+    std::vector<std::uint8_t> state;
+    state.reserve(2 * sizeof(std::uint64_t) + shard_count * (sizeof(std::uint64_t) + 2 * (2 * sizeof(std::uint64_t) + shards[0].filters[0].bytes().size())));
+
+    put_u64(state, seed);
+    put_u64(state, shard_count);
+
+    for (shard& s : shards) {
+        std::lock_guard lock{s.mtx};
+
+        put_u64(state, s.current);
+
+        for (const filter& f : s.filters) {
+            const std::span<const std::uint8_t> bytes = f.bytes();
+
+            put_u64(state, f.element_count());
+            put_u64(state, bytes.size());
+            put(state, bytes);
+        }
+    }
+
+    return state;
+}
+
+bool replay_protection::restore(std::span<const std::uint8_t> state) {
+    std::uint64_t saved_seed = 0;
+    std::uint64_t saved_shard_count = 0;
+
+    if (!get_u64(state, saved_seed) || !get_u64(state, saved_shard_count) || saved_shard_count != shard_count) {
+        return false;
+    }
+
+    struct restored_shard {
+        std::array<filter, 2> filters;
+        std::uint64_t current = 0;
+    };
+
+    std::vector<restored_shard> restored(shard_count);
+
+    for (restored_shard& r : restored) {
+        if (!get_u64(state, r.current) || r.current >= r.filters.size()) {
+            return false;
+        }
+
+        // the hash functions are derived from the seed
+        for (filter& f : r.filters) {
+            f = filter{parameters(saved_seed)};
+
+            std::uint64_t element_count = 0;
+            std::uint64_t size = 0;
+
+            if (!get_u64(state, element_count) || !get_u64(state, size) || size > state.size()) {
+                return false;
+            }
+
+            if (!f.load(state.first(size), element_count)) {
+                return false;
+            }
+
+            state = state.subspan(size);
+        }
+    }
+
+    // the seed also picks the shard of a salt, so all shards change at once
+    std::array<std::unique_lock<std::mutex>, shard_count> locks;
+    for (std::size_t i = 0; i != shard_count; i++) {
+        locks[i] = std::unique_lock{shards[i].mtx};
+    }
+
+    for (std::size_t i = 0; i != shard_count; i++) {
+        shards[i].filters = std::move(restored[i].filters);
+        shards[i].current = static_cast<int>(restored[i].current);
+    }
+
+    seed = saved_seed;
+
+    return true;
+}
+
+replay_protection::shard& replay_protection::shard_of(std::span<const std::uint8_t> element) {
+    // FNV-1a, keyed, so that peers can't easily crowd their salts into one shard
+    std::uint64_t hash = 0xcbf29ce484222325 ^ seed.load(std::memory_order_relaxed);
+    for (std::uint8_t b : element) {
+        hash ^= b;
+        hash *= 0x100000001b3;
+    }
+
+    return shards[(hash ^ (hash >> 32)) % shard_count];
+}
+
+bloom_parameters replay_protection::parameters(unsigned long long seed) const {
+    bloom_parameters parameters;
+    parameters.projected_element_count = count / shard_count;
+    parameters.false_positive_probability = 1e-6;
+    parameters.random_seed = seed;
+
+    bool ok = parameters.compute_optimal_parameters();
+    assert(ok);
+
+    return parameters;
+}
+
+std::span<const std::uint8_t> replay_protection::filter::bytes() const {
+    return {bit_table_.data(), bit_table_.size()};
+}
+
+bool replay_protection::filter::load(std::span<const std::uint8_t> bytes, unsigned long long element_count) {
+    if (bytes.size() != bit_table_.size()) {
+        return false;
+    }
+
+    std::copy(bytes.begin(), bytes.end(), bit_table_.begin());
+    inserted_element_count_ = element_count;
+
+    return true;
+}
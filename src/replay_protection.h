@@ -2,28 +2,62 @@
 #define REPLAY_PROTECTION_H
 
 #include <array>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <mutex>
 #include <span>
+#include <vector>
 
 #include <bloom_filter.hpp>
 
 // See https://github.com/shadowsocks/shadowsocks-org/issues/44
+//
+// The salts are spread over shards by a hash keyed with a random seed, each with its own filters and lock,
+// so that sessions starting on different threads rarely wait for each other.
 class replay_protection {
 public:
     static replay_protection& get();
 
-    void insert(std::span<const std::uint8_t> element);
+    // test_and_insert inserts element, and returns true if it was seen before.
+    bool test_and_insert(std::span<const std::uint8_t> element);
     bool contains(std::span<const std::uint8_t> element);
 
+    // save serializes the filters, so that they survive an upgrade of the process.
+    std::vector<std::uint8_t> save();
+
+    // restore replaces the filters with a state returned by save.
+    // Returns false, leaving the filters unchanged, if the state doesn't match.
+    bool restore(std::span<const std::uint8_t> state);
+
 private:
+    // bloom_filter only exposes its table for reading.
+    class filter : public bloom_filter {
+    public:
+        using bloom_filter::bloom_filter;
+
+        std::span<const std::uint8_t> bytes() const;
+        bool load(std::span<const std::uint8_t> bytes, unsigned long long element_count);
+    };
+
+    // on a cache line of its own, so that the locks of neighbouring shards don't contend
+    struct alignas(64) shard {
+        std::array<filter, 2> filters;
+        int current = 0;
+
+        std::mutex mtx;
+    };
+
+    static constexpr std::size_t shard_count = 16;
+
     replay_protection();
 
-    std::array<bloom_filter, 2> filters;
-    int current = 0;
-    int count = 1'000'000; // one million
+    shard& shard_of(std::span<const std::uint8_t> element);
+    bloom_parameters parameters(unsigned long long seed) const;
 
-    std::mutex mtx;
+    std::array<shard, shard_count> shards;
+    int count = 1'000'000; // one million, over all shards
+    std::atomic<unsigned long long> seed;
 };
 
 #endif
@@ -0,0 +1,53 @@
+#include "rule_profile.h"
+
+namespace {
+std::atomic<std::size_t> next_shard{0};
+
+thread_local const std::size_t shard = next_shard++;
+thread_local std::uint32_t calls = 0;
+} // namespace
+
+rule_profile::rule_profile(std::size_t rules)
+    : rules(rules),
+      lines_per_shard((rules + line::size - 1) / line::size),
+      lines(lines_per_shard * shard_count) {}
+
+bool rule_profile::sample() {
+    return ++calls % sample_rate == 0;
+}
+
+void rule_profile::hit(std::size_t rule) {
+    if (rule < rules) {
+        at(shard % shard_count, rule).hits.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void rule_profile::add_sample(std::size_t rule, std::chrono::nanoseconds time) {
+    if (rule < rules) {
+        at(shard % shard_count, rule).nanoseconds.fetch_add(time.count() * sample_rate, std::memory_order_relaxed);
+    }
+}
+
+rule_profile::counts rule_profile::get(std::size_t rule) const {
+    counts total{0, std::chrono::nanoseconds::zero()};
+
+    for (std::size_t i = 0; i != shard_count; i++) {
+        const counter& c = at(i, rule);
+        total.hits += c.hits.load(std::memory_order_relaxed);
+        total.time += std::chrono::nanoseconds{c.nanoseconds.load(std::memory_order_relaxed)};
+    }
+
+    return total;
+}
+
+std::size_t rule_profile::size() const {
+    return rules;
+}
+
+rule_profile::counter& rule_profile::at(std::size_t index, std::size_t rule) {
+    return lines[index * lines_per_shard + rule / line::size].counters[rule % line::size];
+}
+
+const rule_profile::counter& rule_profile::at(std::size_t index, std::size_t rule) const {
+    return lines[index * lines_per_shard + rule / line::size].counters[rule % line::size];
+}
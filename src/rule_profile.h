@@ -0,0 +1,62 @@
+#ifndef RULE_PROFILE_H
+#define RULE_PROFILE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// rule_profile counts how often each of a number of rules matches, and how long they take. The counters are
+// sharded by thread, and the shards start on cache lines of their own, so that threads rarely write to the same
+// cache line.
+//
+// Times are sampled: sample returns true for one call in sample_rate, the caller times only those, and each
+// sample counts for sample_rate.
+class rule_profile {
+public:
+    static constexpr std::uint32_t sample_rate = 64;
+
+    struct counts {
+        std::uint64_t hits;
+        std::chrono::nanoseconds time;
+    };
+
+    explicit rule_profile(std::size_t rules);
+
+    static bool sample();
+
+    // Rules out of range are ignored, such as those inserted after the profile was made.
+    void hit(std::size_t rule);
+    void add_sample(std::size_t rule, std::chrono::nanoseconds time);
+
+    counts get(std::size_t rule) const;
+    std::size_t size() const;
+
+private:
+    static constexpr std::size_t shard_count = 16;
+
+    struct counter {
+        std::atomic<std::uint64_t> hits = 0;
+        std::atomic<std::int64_t> nanoseconds = 0;
+    };
+
+    // the counters of consecutive rules of a shard, filling a cache line
+    struct alignas(64) line {
+        static constexpr std::size_t size = 4;
+        std::array<counter, size> counters;
+    };
+
+    // at returns the counter of rule in the shard index.
+    counter& at(std::size_t index, std::size_t rule);
+    const counter& at(std::size_t index, std::size_t rule) const;
+
+    std::size_t rules;
+    std::size_t lines_per_shard;
+
+    // shard_count shards of lines_per_shard lines, one after another
+    std::vector<line> lines;
+};
+
+#endif
@@ -1,11 +1,152 @@
 #include <algorithm>
+#include <cctype>
+#include <deque>
+#include <map>
 
 #include "rule_set.h"
 
+namespace {
+constexpr std::size_t npos = std::string_view::npos;
+
+// Returns the index of the ] closing the character class at i.
+std::size_t skip_class(std::string_view rule, std::size_t i) {
+    for (std::size_t j = i + 1; j < rule.size(); j++) {
+        if (rule[j] == '\\') {
+            j++;
+        } else if (rule[j] == ']') {
+            return j;
+        }
+    }
+
+    return npos;
+}
+
+// Returns the index of the ) closing the group at i.
+std::size_t skip_group(std::string_view rule, std::size_t i) {
+    int depth = 0;
+
+    for (std::size_t j = i; j < rule.size(); j++) {
+        if (rule[j] == '\\') {
+            j++;
+        } else if (rule[j] == '[') {
+            j = skip_class(rule, j);
+            if (j == npos) {
+                return npos;
+            }
+        } else if (rule[j] == '(') {
+            depth++;
+        } else if (rule[j] == ')' && --depth == 0) {
+            return j;
+        }
+    }
+
+    return npos;
+}
+
+// required_literal returns the longest text every match of an ECMAScript regex contains, or an empty string
+// if it can't tell. Only the top level is looked at, groups and character classes just end the text.
+std::string required_literal(std::string_view rule) {
+    std::string best;
+    std::string run;
+
+    auto end_run = [&] {
+        if (run.size() > best.size()) {
+            best = run;
+        }
+        run.clear();
+    };
+
+    for (std::size_t i = 0; i < rule.size(); i++) {
+        switch (const char c = rule[i]) {
+        case '|':
+            // alternatives at the top level require nothing in common
+            return {};
+        case '(':
+        case '[':
+            end_run();
+            i = c == '(' ? skip_group(rule, i) : skip_class(rule, i);
+            if (i == npos) {
+                return {};
+            }
+            break;
+        case '*':
+        case '?':
+        case '{':
+            // the character before may not be there
+            if (!run.empty()) {
+                run.pop_back();
+            }
+            end_run();
+
+            if (c == '{') {
+                i = rule.find('}', i);
+                if (i == npos) {
+                    return {};
+                }
+            }
+            break;
+        case '+':
+            end_run();
+            break;
+        case '\\': {
+            if (++i == rule.size()) {
+                return {};
+            }
+
+            const char escaped = rule[i];
+            if (!std::isalnum(static_cast<unsigned char>(escaped))) {
+                run += escaped;
+                break;
+            }
+
+            // a character class, an assertion, a back reference or a character code
+            end_run();
+            if (escaped == 'x') {
+                i += 2;
+            } else if (escaped == 'u') {
+                i += 4;
+            } else if (escaped == 'c') {
+                i += 1;
+            } else if (std::isdigit(static_cast<unsigned char>(escaped))) {
+                while (i + 1 < rule.size() && std::isdigit(static_cast<unsigned char>(rule[i + 1]))) {
+                    i++;
+                }
+            }
+            break;
+        }
+        case '.':
+        case '^':
+        case '$':
+        case ')':
+        case ']':
+        case '}':
+            end_run();
+            break;
+        default:
+            run += c;
+        }
+    }
+
+    end_run();
+
+    return best;
+}
+} // namespace
+
 bool rule_set::insert(std::string_view rule) {
+    if (std::optional<domain_set::rule> domain = domain_set::parse_rule(rule)) {
+        domains.insert(domain->domain, domain->subdomains);
+        return true;
+    }
+
     try {
-        std::regex re{rule.data()};
-        rules.emplace_back(std::move(re));
+        std::regex re{rule.begin(), rule.end()};
+        rules.push_back({std::move(re), std::string{rule}, required_literal(rule)});
+
+        // addresses are written with hexadecimal digits, dots and colons alone
+        address_rules = address_rules || std::all_of(rules.back().literal.begin(), rules.back().literal.end(), [](char c) {
+                            return std::isxdigit(static_cast<unsigned char>(c)) || c == '.' || c == ':';
+                        });
     } catch (const std::exception& e) {
         return false;
     }
@@ -14,7 +155,269 @@ bool rule_set::insert(std::string_view rule) {
 }
 
 bool rule_set::contains(std::string_view host) const {
-    return std::any_of(rules.begin(), rules.end(), [host](const std::regex& re) {
-        return std::regex_search(host.data(), re);
-    });
+    if (!rule_counts) {
+        return find(host, false) != no_match;
+    }
+
+    const bool timed = rule_profile::sample();
+    const auto start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+    const std::size_t rule = find(host, timed);
+
+    lookup_counts->hit(0);
+    if (timed) {
+        lookup_counts->add_sample(0, std::chrono::steady_clock::now() - start);
+    }
+
+    if (rule == no_match) {
+        return false;
+    }
+
+    rule_counts->hit(rule);
+    return true;
+}
+
+std::size_t rule_set::find(std::string_view host, bool timed) const {
+    if (const std::uint32_t node = domains.match(host)) {
+        return node;
+    }
+
+    // the regexes follow the domains
+    const std::size_t first_regex = domain_nodes;
+
+    for (std::uint32_t index : always) {
+        if (matches(index, host, timed)) {
+            return first_regex + index;
+        }
+    }
+
+    if (!nodes.empty()) {
+        std::uint32_t state = 0;
+
+        for (char c : host) {
+            state = step(state, static_cast<std::uint8_t>(c));
+
+            std::uint32_t found = nodes[state].output_count ? state : nodes[state].output_link;
+            for (; found != 0; found = nodes[found].output_link) {
+                const node& n = nodes[found];
+
+                for (std::uint32_t i = n.first_output; i != n.first_output + n.output_count; i++) {
+                    if (matches(outputs[i], host, timed)) {
+                        return first_regex + outputs[i];
+                    }
+                }
+            }
+        }
+    }
+
+    for (std::size_t index = compiled; index != rules.size(); index++) {
+        if (matches(static_cast<std::uint32_t>(index), host, timed)) {
+            return first_regex + index;
+        }
+    }
+
+    return no_match;
+}
+
+bool rule_set::empty() const {
+    return domains.empty() && rules.empty();
+}
+
+std::size_t rule_set::size() const {
+    return domains.size() + rules.size();
+}
+
+bool rule_set::may_match_address() const {
+    return address_rules || domains.has_numeric_top_label();
+}
+
+void rule_set::compile() {
+    // the trie of the literals
+    struct trie_node {
+        std::map<std::uint8_t, std::uint32_t> next;
+        std::vector<std::uint32_t> rules;
+    };
+
+    std::vector<trie_node> trie(1);
+    always.clear();
+
+    for (std::size_t index = 0; index != rules.size(); index++) {
+        if (rules[index].literal.empty()) {
+            always.push_back(static_cast<std::uint32_t>(index));
+            continue;
+        }
+
+        std::uint32_t state = 0;
+        for (char c : rules[index].literal) {
+            const auto [it, inserted] = trie[state].next.try_emplace(static_cast<std::uint8_t>(c), static_cast<std::uint32_t>(trie.size()));
+            state = it->second;
+
+            if (inserted) {
+                trie.emplace_back();
+            }
+        }
+
+        trie[state].rules.push_back(static_cast<std::uint32_t>(index));
+    }
+
+    // flatten it, the edges of each node sorted by character
+    nodes.assign(trie.size(), node{});
+    edges.clear();
+    outputs.clear();
+
+    for (std::size_t i = 0; i != trie.size(); i++) {
+        nodes[i].first_edge = static_cast<std::uint32_t>(edges.size());
+        nodes[i].edge_count = static_cast<std::uint32_t>(trie[i].next.size());
+        for (const auto& [c, next] : trie[i].next) {
+            edges.push_back({c, next});
+        }
+
+        nodes[i].first_output = static_cast<std::uint32_t>(outputs.size());
+        nodes[i].output_count = static_cast<std::uint32_t>(trie[i].rules.size());
+        outputs.insert(outputs.end(), trie[i].rules.begin(), trie[i].rules.end());
+    }
+
+    // the failure links, breadth first so that the links of shorter prefixes are known (those of depth 1 are the root)
+    std::deque<std::uint32_t> queue;
+    for (const auto& [c, next] : trie[0].next) {
+        queue.push_back(next);
+    }
+
+    while (!queue.empty()) {
+        const std::uint32_t state = queue.front();
+        queue.pop_front();
+
+        for (const auto& [c, next] : trie[state].next) {
+            const std::uint32_t fail = step(nodes[state].fail, c);
+            nodes[next].fail = fail;
+            nodes[next].output_link = nodes[fail].output_count ? fail : nodes[fail].output_link;
+
+            queue.push_back(next);
+        }
+    }
+
+    compiled = rules.size();
+}
+
+void rule_set::save(binary_image::writer& out) const {
+    domains.save(out);
+
+    // the texts one after another, and where each ends
+    std::vector<char> texts;
+    std::vector<std::uint64_t> ends;
+    for (const rule& r : rules) {
+        texts.insert(texts.end(), r.text.begin(), r.text.end());
+        ends.push_back(texts.size());
+    }
+
+    out.write(std::span<const char>{texts});
+    out.write(std::span<const std::uint64_t>{ends});
+}
+
+void rule_set::load(binary_image::reader& in) {
+    domains.load(in);
+
+    const std::span<const char> texts = in.read<char>();
+    const std::span<const std::uint64_t> ends = in.read<std::uint64_t>();
+
+    rules.clear();
+    address_rules = false;
+    std::uint64_t begin = 0;
+    for (std::uint64_t end : ends) {
+        if (end < begin || end > texts.size()) {
+            throw std::runtime_error{"Invalid rule table"};
+        }
+
+        const std::string_view text{texts.data() + begin, static_cast<std::size_t>(end - begin)};
+        if (!insert(text)) {
+            throw std::runtime_error{"Invalid rule table"};
+        }
+
+        begin = end;
+    }
+
+    compile();
+}
+
+bool rule_set::matches(std::uint32_t index, std::string_view host, bool timed) const {
+    if (!timed) {
+        return std::regex_search(host.begin(), host.end(), rules[index].re);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const bool matched = std::regex_search(host.begin(), host.end(), rules[index].re);
+    rule_counts->add_sample(domain_nodes + index, std::chrono::steady_clock::now() - start);
+
+    return matched;
+}
+
+void rule_set::enable_profiling() {
+    domain_nodes = domains.rules().size();
+    rule_counts = std::make_shared<rule_profile>(domain_nodes + rules.size());
+    lookup_counts = std::make_shared<rule_profile>(1);
+}
+
+std::vector<rule_set::rule_stats> rule_set::get_rule_stats() const {
+    std::vector<rule_stats> result;
+    if (!rule_counts) {
+        return result;
+    }
+
+    // the domains as the rules they were inserted as
+    const std::vector<domain_set::rule> domain_rules = domains.rules();
+    for (std::size_t node = 0; node != std::min(domain_rules.size(), domain_nodes); node++) {
+        if (domain_rules[node].domain.empty()) {
+            continue;
+        }
+
+        std::string rule = domain_rules[node].subdomains ? R"((^|\.))" : "^";
+        for (char c : domain_rules[node].domain) {
+            if (c == '.') {
+                rule += '\\';
+            }
+            rule += c;
+        }
+        rule += '$';
+
+        const rule_profile::counts counts = rule_counts->get(node);
+        result.push_back({std::move(rule), counts.hits, counts.time});
+    }
+
+    for (std::size_t index = 0; index != rules.size() && domain_nodes + index < rule_counts->size(); index++) {
+        const rule_profile::counts counts = rule_counts->get(domain_nodes + index);
+        result.push_back({rules[index].text, counts.hits, counts.time});
+    }
+
+    return result;
+}
+
+rule_set::rule_stats rule_set::get_stats() const {
+    if (!lookup_counts) {
+        return {{}, 0, std::chrono::nanoseconds::zero()};
+    }
+
+    const rule_profile::counts counts = lookup_counts->get(0);
+    return {{}, counts.hits, counts.time};
+}
+
+std::uint32_t rule_set::step(std::uint32_t state, std::uint8_t c) const {
+    while (true) {
+        const node& n = nodes[state];
+        const auto first = edges.begin() + n.first_edge;
+        const auto last = first + n.edge_count;
+
+        const auto it = std::lower_bound(first, last, c, [](const edge& e, std::uint8_t c) {
+            return e.c < c;
+        });
+
+        if (it != last && it->c == c) {
+            return it->next;
+        }
+
+        if (state == 0) {
+            return 0;
+        }
+
+        state = n.fail;
+    }
 }
@@ -1,17 +1,108 @@
 #ifndef RULE_SET_H
 #define RULE_SET_H
 
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <regex>
+#include <string>
 #include <string_view>
 #include <vector>
 
+#include "binary_image.h"
+#include "domain_set.h"
+#include "rule_profile.h"
+
+// rule_set matches host names against regular expressions.
+//
+// Rules which only match a domain, or a domain and its subdomains, go to a domain_set instead of the regex engine.
+// For the others, once compiled, a host is scanned once by an Aho-Corasick automaton over the literal text each
+// rule requires (such as ".example.com" for ^cdn[0-9]+\.example\.com$), and only the rules whose literal occurs
+// in it are run. Rules without such a literal are always run.
 class rule_set {
 public:
     bool insert(std::string_view rule);
     bool contains(std::string_view host) const;
+    bool empty() const;
+
+    // size returns the number of rules.
+    std::size_t size() const;
+
+    // may_match_address returns true if a rule may match the text of an IP address, as well as host names.
+    bool may_match_address() const;
+
+    // compile builds the automaton for the rules inserted so far.
+    // Rules inserted afterwards are run one by one until the next compile.
+    void compile();
+
+    // save writes the rules to an image. Regular expressions are kept as text, and compiled again by load.
+    void save(binary_image::writer& out) const;
+    void load(binary_image::reader& in);
+
+    struct rule_stats {
+        std::string rule;
+        std::uint64_t hits;
+        std::chrono::nanoseconds time;
+    };
+
+    // enable_profiling counts the matches of each rule inserted so far, and samples the time the lookups take
+    // from now on, in all, and by regex.
+    void enable_profiling();
+
+    // get_rule_stats returns the counts of each rule, and get_stats the lookups and their time, if profiling.
+    std::vector<rule_stats> get_rule_stats() const;
+    rule_stats get_stats() const;
 
 private:
-    std::vector<std::regex> rules;
+    struct rule {
+        std::regex re;
+        std::string text;
+        std::string literal;
+    };
+
+    struct edge {
+        std::uint8_t c;
+        std::uint32_t next;
+    };
+
+    struct node {
+        std::uint32_t first_edge = 0;
+        std::uint32_t edge_count = 0;
+        std::uint32_t fail = 0;
+
+        // the rules whose literal ends here
+        std::uint32_t first_output = 0;
+        std::uint32_t output_count = 0;
+
+        // the longest proper suffix which has outputs, 0 if none
+        std::uint32_t output_link = 0;
+    };
+
+    // find returns the index of a rule host matches: the node of a domain, or the number of nodes of the domain set
+    // plus the index of a regex. It returns no_match if none does.
+    static constexpr std::size_t no_match = static_cast<std::size_t>(-1);
+    std::size_t find(std::string_view host, bool timed) const;
+
+    bool matches(std::uint32_t index, std::string_view host, bool timed) const;
+    std::uint32_t step(std::uint32_t state, std::uint8_t c) const;
+
+    domain_set domains;
+    std::vector<rule> rules;
+
+    // whether a regex may match the text of an IP address
+    bool address_rules = false;
+
+    // the automaton, covering the first compiled rules
+    std::size_t compiled = 0;
+    std::vector<node> nodes;
+    std::vector<edge> edges;
+    std::vector<std::uint32_t> outputs;
+    std::vector<std::uint32_t> always;
+
+    // the counts by rule index, and those of the lookups, if profiling
+    std::shared_ptr<rule_profile> rule_counts;
+    std::shared_ptr<rule_profile> lookup_counts;
+    std::size_t domain_nodes = 0;
 };
 
 #endif
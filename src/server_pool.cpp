@@ -0,0 +1,296 @@
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/post.hpp>
+#include <asio/redirect_error.hpp>
+#include <asio/use_awaitable.hpp>
+#include <spdlog/spdlog.h>
+
+#include "format.h"
+#include "server_pool.h"
+
+namespace {
+// Latency samples are smoothed, so that a single slow probe doesn't move the sessions around.
+constexpr int latency_weight_percent = 30;
+} // namespace
+
+server_pool::address server_pool::parse_address(std::string_view str, std::uint16_t default_port) {
+    address addr{std::string{str}, default_port};
+    std::string_view port;
+
+    if (str.starts_with('[')) {
+        const std::size_t end = str.find(']');
+        if (end == std::string_view::npos) {
+            throw std::invalid_argument{fmt::format("Invalid server address: {}", str)};
+        }
+
+        addr.host = str.substr(1, end - 1);
+
+        std::string_view rest = str.substr(end + 1);
+        if (rest.starts_with(':')) {
+            port = rest.substr(1);
+        } else if (!rest.empty()) {
+            throw std::invalid_argument{fmt::format("Invalid server address: {}", str)};
+        }
+    } else if (const std::size_t colon = str.find(':'); colon != std::string_view::npos && colon == str.rfind(':')) {
+        // more than one colon is an IPv6 address without a port
+        addr.host = str.substr(0, colon);
+        port = str.substr(colon + 1);
+    }
+
+    if (!port.empty()) {
+        addr.port = static_cast<std::uint16_t>(std::stoul(std::string{port}));
+    }
+
+    if (addr.host.empty()) {
+        throw std::invalid_argument{fmt::format("Invalid server address: {}", str)};
+    }
+
+    return addr;
+}
+
+server_pool::server_pool(const asio::any_io_executor& executor,
+                         std::vector<address> addresses,
+                         resolve_function resolve,
+                         probe_function probe,
+                         const options& opts)
+    : strand(asio::make_strand(executor)),
+      resolve(std::move(resolve)),
+      probe(std::move(probe)),
+      opts(opts),
+      random(std::random_device{}()),
+      wakeup(strand) {
+    for (address& addr : addresses) {
+        servers.push_back(server{std::move(addr)});
+    }
+}
+
+asio::awaitable<void> server_pool::start() {
+    auto resolve_all = [self = shared_from_this()]() -> asio::awaitable<void> {
+        for (std::size_t i = 0; i != self->servers.size(); i++) {
+            co_await self->resolve_one(i);
+        }
+    };
+
+    co_await asio::co_spawn(strand, std::move(resolve_all), asio::use_awaitable);
+
+    {
+        std::lock_guard<std::mutex> lock{mtx};
+        if (std::all_of(servers.begin(), servers.end(), [](const server& s) { return s.eps.empty(); })) {
+            throw std::system_error{asio::error::host_not_found, "No remote server resolves"};
+        }
+    }
+
+    asio::co_spawn(
+        strand,
+        [self = shared_from_this()]() -> asio::awaitable<void> {
+            co_await self->run();
+        },
+        asio::detached);
+}
+
+void server_pool::stop() {
+    asio::post(strand, [self = shared_from_this()] {
+        self->stopped = true;
+        self->wakeup.cancel();
+    });
+}
+
+std::optional<server_pool::choice> server_pool::pick(std::optional<std::size_t> exclude) {
+    std::lock_guard<std::mutex> lock{mtx};
+
+    std::vector<std::size_t> candidates;
+    for (std::size_t i = 0; i != servers.size(); i++) {
+        if (i != exclude && !servers[i].eps.empty() && servers[i].healthy) {
+            candidates.push_back(i);
+        }
+    }
+
+    std::optional<std::size_t> chosen;
+
+    if (candidates.empty()) {
+        // all down, the most recent failure is the likeliest to be over
+        for (std::size_t i = 0; i != servers.size(); i++) {
+            if (i != exclude && !servers[i].eps.empty() && (!chosen || servers[i].down_since > servers[*chosen].down_since)) {
+                chosen = i;
+            }
+        }
+    } else if (opts.balance == policy::least_latency) {
+        // servers which haven't been probed yet come last
+        chosen = *std::min_element(candidates.begin(), candidates.end(), [this](std::size_t a, std::size_t b) {
+            return servers[a].latency.value_or(clock::duration::max()) < servers[b].latency.value_or(clock::duration::max());
+        });
+    } else {
+        // the weight is the inverse of the latency, servers which haven't been probed yet weigh as much as the fastest
+        std::vector<double> weights;
+        double heaviest = 0;
+
+        for (std::size_t i : candidates) {
+            double weight = 0;
+            if (const std::optional<clock::duration>& latency = servers[i].latency) {
+                weight = 1.0 / std::max(std::chrono::duration<double, std::milli>{*latency}.count(), 0.1);
+            }
+
+            weights.push_back(weight);
+            heaviest = std::max(heaviest, weight);
+        }
+
+        for (double& weight : weights) {
+            if (weight == 0) {
+                weight = heaviest == 0 ? 1 : heaviest;
+            }
+        }
+
+        std::discrete_distribution<std::size_t> distribution{weights.begin(), weights.end()};
+        chosen = candidates[distribution(random)];
+    }
+
+    if (!chosen) {
+        return std::nullopt;
+    }
+
+    servers[*chosen].picks++;
+
+    return choice{*chosen, servers[*chosen].eps};
+}
+
+void server_pool::succeeded(std::size_t index) {
+    std::lock_guard<std::mutex> lock{mtx};
+    set_healthy(servers[index], true);
+}
+
+void server_pool::failed(std::size_t index) {
+    std::lock_guard<std::mutex> lock{mtx};
+    set_healthy(servers[index], false);
+}
+
+std::vector<server_pool::server_stats> server_pool::stats() const {
+    std::lock_guard<std::mutex> lock{mtx};
+
+    std::vector<server_stats> result;
+    for (const server& s : servers) {
+        result.push_back({s.addr, s.healthy, s.latency, s.picks});
+    }
+
+    return result;
+}
+
+asio::awaitable<void> server_pool::run() {
+    clock::time_point next_probe = clock::now();
+    clock::time_point next_resolve = clock::now() + opts.resolve_interval;
+
+    while (!stopped) {
+        const clock::time_point now = clock::now();
+
+        if (now >= next_probe) {
+            for (std::size_t i = 0; i != servers.size(); i++) {
+                asio::co_spawn(
+                    strand,
+                    [self = shared_from_this(), i]() -> asio::awaitable<void> {
+                        co_await self->probe_one(i);
+                    },
+                    asio::detached);
+            }
+
+            next_probe = now + opts.probe_interval;
+        }
+
+        if (now >= next_resolve) {
+            for (std::size_t i = 0; i != servers.size(); i++) {
+                asio::co_spawn(
+                    strand,
+                    [self = shared_from_this(), i]() -> asio::awaitable<void> {
+                        co_await self->resolve_one(i);
+                    },
+                    asio::detached);
+            }
+
+            next_resolve = now + opts.resolve_interval;
+        }
+
+        std::error_code ignore_error;
+        wakeup.expires_at(std::min(next_probe, next_resolve));
+        co_await wakeup.async_wait(asio::redirect_error(asio::use_awaitable, ignore_error));
+    }
+}
+
+asio::awaitable<void> server_pool::probe_one(std::size_t index) {
+    endpoints eps;
+    {
+        std::lock_guard<std::mutex> lock{mtx};
+        eps = servers[index].eps;
+    }
+
+    if (eps.empty() || stopped) {
+        co_return;
+    }
+
+    const clock::time_point start = clock::now();
+    bool up = true;
+
+    try {
+        co_await probe(std::move(eps));
+    } catch (const std::system_error& e) {
+        spdlog::debug("Probing remote server: {}", e.what());
+        up = false;
+    }
+
+    const clock::duration sample = clock::now() - start;
+
+    std::lock_guard<std::mutex> lock{mtx};
+    server& s = servers[index];
+
+    if (up) {
+        s.latency = s.latency ? (*s.latency * (100 - latency_weight_percent) + sample * latency_weight_percent) / 100 : sample;
+    }
+
+    set_healthy(s, up);
+}
+
+asio::awaitable<void> server_pool::resolve_one(std::size_t index) {
+    address addr;
+    {
+        std::lock_guard<std::mutex> lock{mtx};
+        addr = servers[index].addr;
+    }
+
+    endpoints eps;
+
+    try {
+        eps = co_await resolve(addr.host, addr.port);
+    } catch (const std::system_error& e) {
+        // keep the endpoints resolved before
+        spdlog::warn("Resolving remote server {}: {}", addr.host, e.what());
+        co_return;
+    }
+
+    std::lock_guard<std::mutex> lock{mtx};
+    server& s = servers[index];
+
+    if (!eps.empty() && eps != s.eps) {
+        for (const asio::ip::tcp::endpoint& endpoint : eps) {
+            spdlog::info("Remote server: {}", endpoint);
+        }
+
+        s.eps = std::move(eps);
+    }
+}
+
+void server_pool::set_healthy(server& s, bool healthy) {
+    if (s.healthy == healthy) {
+        return;
+    }
+
+    s.healthy = healthy;
+
+    if (healthy) {
+        spdlog::info("Remote server {}:{} is up", s.addr.host, s.addr.port);
+    } else {
+        s.down_since = clock::now();
+        spdlog::warn("Remote server {}:{} is down", s.addr.host, s.addr.port);
+    }
+}
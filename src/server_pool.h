@@ -0,0 +1,130 @@
+#ifndef SERVER_POOL_H
+#define SERVER_POOL_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <asio/any_io_executor.hpp>
+#include <asio/awaitable.hpp>
+#include <asio/strand.hpp>
+#include <asio/ts/internet.hpp>
+
+#include "awaitable.h"
+
+// server_pool chooses the ss-remote server for the sessions of ss-local.
+//
+// Each server is probed periodically by connecting to it, which measures its latency and tells whether it is up.
+// New sessions go to the healthy server with the least latency, or are spread across the healthy servers in inverse
+// proportion to their latency. A server is taken out as soon as a probe or a session fails to connect to it, and put
+// back by the next probe that succeeds. The host names of the servers are resolved again periodically.
+//
+// A probe doesn't send a request, so the server sees a client which disconnects without a handshake, and may log
+// it as such. The caller keeps the probes far enough apart for that to stay noise.
+//
+// It can be used from any thread.
+class server_pool : public std::enable_shared_from_this<server_pool> {
+public:
+    using clock = std::chrono::steady_clock;
+    using endpoints = std::vector<asio::ip::tcp::endpoint>;
+
+    // resolve returns the endpoints of a server, and throws std::system_error on failure.
+    using resolve_function = std::function<asio::awaitable<endpoints>(std::string host, std::uint16_t port)>;
+
+    // probe connects to one of the endpoints of a server and disconnects, and throws std::system_error on failure.
+    using probe_function = std::function<asio::awaitable<void>(endpoints eps)>;
+
+    enum class policy {
+        least_latency,
+        weighted
+    };
+
+    struct options {
+        policy balance = policy::least_latency;
+        clock::duration probe_interval = std::chrono::seconds{30};
+        clock::duration resolve_interval = std::chrono::minutes{5};
+    };
+
+    struct address {
+        std::string host;
+        std::uint16_t port = 0;
+    };
+
+    // choice is the server chosen for a session.
+    struct choice {
+        std::size_t server = 0;
+        endpoints eps;
+    };
+
+    struct server_stats {
+        address addr;
+        bool healthy = false;
+        std::optional<clock::duration> latency;
+        std::uint64_t picks = 0;
+    };
+
+    // parse_address parses host[:port] or [IPv6 address][:port].
+    static address parse_address(std::string_view str, std::uint16_t default_port);
+
+    server_pool(const asio::any_io_executor& executor,
+                std::vector<address> servers,
+                resolve_function resolve,
+                probe_function probe,
+                const options& opts);
+
+    // start resolves the servers, and starts probing them and resolving them again in the background.
+    // Throws std::system_error if no server resolves.
+    asio::awaitable<void> start();
+
+    void stop();
+
+    // pick returns the server for a new session other than exclude, or std::nullopt if there is none.
+    // If no server is healthy, the one that has been down the shortest is returned, so that sessions keep trying.
+    std::optional<choice> pick(std::optional<std::size_t> exclude = std::nullopt);
+
+    // succeeded and failed report how connecting a session to server went.
+    void succeeded(std::size_t server);
+    void failed(std::size_t server);
+
+    std::vector<server_stats> stats() const;
+
+private:
+    struct server {
+        address addr;
+        endpoints eps;
+        bool healthy = true;
+        clock::time_point down_since;
+        std::optional<clock::duration> latency;
+        std::uint64_t picks = 0;
+    };
+
+    // All the coroutines run on strand, and the servers are guarded by mtx.
+    asio::awaitable<void> run();
+    asio::awaitable<void> probe_one(std::size_t index);
+    asio::awaitable<void> resolve_one(std::size_t index);
+
+    // set_healthy must be called with mtx locked.
+    static void set_healthy(server& s, bool healthy);
+
+    asio::strand<asio::any_io_executor> strand;
+    resolve_function resolve;
+    probe_function probe;
+    options opts;
+
+    mutable std::mutex mtx;
+    std::vector<server> servers;
+    std::minstd_rand random;
+
+    bool stopped = false;
+    steady_timer wakeup;
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include <utility>
+
+#include "session.h"
+
+namespace {
+std::chrono::steady_clock::rep now() {
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+} // namespace
+
+session::session(session_manager& manager) : manager(manager), last_active(now()) {}
+
+session::~session() {
+    manager.close(*this);
+}
+
+void session::established() {
+    std::lock_guard lock{manager.mtx};
+
+    if (in_handshake) {
+        in_handshake = false;
+        manager.handshakes--;
+    }
+}
+
+void session::touch() {
+    last_active.store(now(), std::memory_order_relaxed);
+}
+
+void session::set_shed_action(std::function<void()> action) {
+    std::lock_guard lock{manager.mtx};
+    shed_action = std::move(action);
+}
+
+session_manager::session_manager(std::size_t max_sessions, std::size_t max_handshakes)
+    : max_sessions(max_sessions),
+      max_handshakes(max_handshakes) {}
+
+std::shared_ptr<session> session_manager::open() {
+    auto s = make_recycled<session>(*this);
+
+    std::lock_guard lock{mtx};
+    s->pos = sessions.insert(sessions.end(), s.get());
+    handshakes++;
+
+    return s;
+}
+
+bool session_manager::is_overloaded() const {
+    std::lock_guard lock{mtx};
+
+    if (max_sessions != 0 && sessions.size() >= max_sessions) {
+        return true;
+    }
+
+    if (max_handshakes != 0 && handshakes >= max_handshakes) {
+        return true;
+    }
+
+    return false;
+}
+
+bool session_manager::shed_oldest_idle(std::chrono::steady_clock::duration min_idle) {
+    std::function<void()> action;
+
+    {
+        std::lock_guard lock{mtx};
+
+        const auto deadline = now() - min_idle.count();
+        session* oldest = nullptr;
+        auto oldest_active = deadline;
+
+        for (session* s : sessions) {
+            if (s->in_handshake || s->shed || !s->shed_action) {
+                continue;
+            }
+
+            const auto active = s->last_active.load(std::memory_order_relaxed);
+            if (active <= oldest_active) {
+                oldest = s;
+                oldest_active = active;
+            }
+        }
+
+        if (!oldest) {
+            return false;
+        }
+
+        oldest->shed = true;
+        action = oldest->shed_action;
+    }
+
+    action();
+    return true;
+}
+
+std::size_t session_manager::session_count() const {
+    std::lock_guard lock{mtx};
+    return sessions.size();
+}
+
+std::size_t session_manager::handshake_count() const {
+    std::lock_guard lock{mtx};
+    return handshakes;
+}
+
+void session_manager::close(session& s) {
+    std::lock_guard lock{mtx};
+
+    if (s.in_handshake) {
+        handshakes--;
+    }
+
+    sessions.erase(s.pos);
+}
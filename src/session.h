@@ -0,0 +1,86 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+
+#include "recycling_allocator.h"
+
+class session;
+class session_manager;
+
+using session_list = std::list<session*, recycling_allocator<session*>>;
+
+// session represents an accepted client connection for the purposes of admission control.
+// It is shared by the coroutines serving the client and unregisters itself when the last one finishes.
+class session {
+public:
+    explicit session(session_manager& manager);
+    ~session();
+
+    session(const session&) = delete;
+    session& operator=(const session&) = delete;
+
+    // established marks the end of the handshake phase.
+    void established();
+
+    // touch records data transfer activity.
+    void touch();
+
+    // set_shed_action sets the function used to close the session when it is shed under overload.
+    // The action is called from the accept loop, so it must be thread safe.
+    void set_shed_action(std::function<void()> action);
+
+private:
+    friend class session_manager;
+
+    session_manager& manager;
+    session_list::iterator pos;
+
+    std::atomic<std::chrono::steady_clock::rep> last_active;
+
+    // the following are protected by manager.mtx
+    bool in_handshake = true;
+    bool shed = false;
+    std::function<void()> shed_action;
+};
+
+// session_manager bounds the number of concurrent sessions and in-progress handshakes.
+class session_manager {
+public:
+    // A limit of 0 means unlimited.
+    session_manager(std::size_t max_sessions, std::size_t max_handshakes);
+
+    // open registers a newly accepted client.
+    std::shared_ptr<session> open();
+
+    // is_overloaded returns true if no more clients should be accepted for now.
+    bool is_overloaded() const;
+
+    // shed_oldest_idle closes the session with the oldest activity that has been idle for at least min_idle.
+    // Returns false if there is no such session.
+    bool shed_oldest_idle(std::chrono::steady_clock::duration min_idle);
+
+    std::size_t session_count() const;
+    std::size_t handshake_count() const;
+
+private:
+    friend class session;
+
+    void close(session& s);
+
+    const std::size_t max_sessions;
+    const std::size_t max_handshakes;
+
+    mutable std::mutex mtx;
+    session_list sessions; // in order of acceptance
+    std::size_t handshakes = 0;
+};
+
+#endif
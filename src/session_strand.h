@@ -0,0 +1,81 @@
+#ifndef SESSION_STRAND_H
+#define SESSION_STRAND_H
+
+#include <memory>
+#include <utility>
+
+#include <asio/execution.hpp>
+#include <asio/io_context.hpp>
+#include <asio/strand.hpp>
+
+#include "recycling_allocator.h"
+
+// basic_session_strand is a strand of an io_context, which runs the handlers of a session.
+//
+// asio::strand<asio::any_io_executor> is too large to be stored inline by asio::any_io_executor, so every
+// operation on the sockets and timers of a session would copy it to the heap, several times over.
+// A session strand refers to a strand of the concrete executor of the io_context through a single
+// pointer instead, which any_io_executor stores inline.
+template <bool NeverBlocking>
+class basic_session_strand {
+public:
+    using inner_executor_type = asio::strand<asio::io_context::executor_type>;
+
+    // executor must be an executor of an io_context.
+    explicit basic_session_strand(const asio::any_io_executor& executor)
+        : inner(make_recycled<inner_executor_type>(
+              static_cast<asio::io_context&>(asio::query(executor, asio::execution::context)).get_executor())) {}
+
+    asio::execution_context& query(asio::execution::context_t) const noexcept {
+        return asio::query(*inner, asio::execution::context);
+    }
+
+    static constexpr asio::execution::blocking_t query(asio::execution::blocking_t) noexcept {
+        if constexpr (NeverBlocking) {
+            return asio::execution::blocking.never;
+        } else {
+            return asio::execution::blocking.possibly;
+        }
+    }
+
+    basic_session_strand<true> require(asio::execution::blocking_t::never_t) const noexcept {
+        return basic_session_strand<true>{inner};
+    }
+
+    basic_session_strand<false> require(asio::execution::blocking_t::possibly_t) const noexcept {
+        return basic_session_strand<false>{inner};
+    }
+
+    template <typename Function>
+    void execute(Function&& f) const {
+        if constexpr (NeverBlocking) {
+            asio::require(*inner, asio::execution::blocking.never).execute(std::forward<Function>(f));
+        } else {
+            inner->execute(std::forward<Function>(f));
+        }
+    }
+
+    bool running_in_this_thread() const noexcept {
+        return inner->running_in_this_thread();
+    }
+
+    friend bool operator==(const basic_session_strand& a, const basic_session_strand& b) noexcept {
+        return a.inner == b.inner;
+    }
+
+    friend bool operator!=(const basic_session_strand& a, const basic_session_strand& b) noexcept {
+        return a.inner != b.inner;
+    }
+
+private:
+    template <bool>
+    friend class basic_session_strand;
+
+    explicit basic_session_strand(std::shared_ptr<inner_executor_type> inner) noexcept : inner(std::move(inner)) {}
+
+    std::shared_ptr<inner_executor_type> inner;
+};
+
+using session_strand = basic_session_strand<false>;
+
+#endif
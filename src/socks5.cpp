@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <string_view>
 #include <unordered_map>
 
@@ -16,4 +17,65 @@ const char* handshake_error::what() const noexcept {
 
     return errToStr[err_code].data();
 }
+
+atyp address::type() const {
+    return static_cast<atyp>(data[0]);
+}
+
+std::string_view address::domain() const {
+    if (type() != atyp::domainname) {
+        return {};
+    }
+
+    return {reinterpret_cast<const char*>(data.data() + 2), data[1]};
+}
+
+asio::ip::address address::ip() const {
+    if (type() == atyp::ipv4) {
+        asio::ip::address_v4::bytes_type bytes;
+        std::copy_n(data.begin() + 1, bytes.size(), bytes.begin());
+        return asio::ip::make_address_v4(bytes);
+    }
+
+    asio::ip::address_v6::bytes_type bytes;
+    std::copy_n(data.begin() + 1, bytes.size(), bytes.begin());
+    return asio::ip::make_address_v6(bytes);
+}
+
+std::uint16_t address::port() const {
+    return static_cast<std::uint16_t>(data[size - 2] << 8 | data[size - 1]);
+}
+
+std::string address::host() const {
+    if (type() == atyp::domainname) {
+        return std::string{domain()};
+    }
+
+    return ip().to_string();
+}
+
+std::span<const std::uint8_t> address::bytes() const {
+    return {data.data(), size};
+}
+
+address to_address(const asio::ip::tcp::endpoint& endpoint) {
+    address addr;
+    std::uint8_t* out = addr.data.data();
+
+    if (endpoint.address().is_v4()) {
+        *out++ = static_cast<std::uint8_t>(atyp::ipv4);
+        const asio::ip::address_v4::bytes_type bytes = endpoint.address().to_v4().to_bytes();
+        out = std::copy(bytes.begin(), bytes.end(), out);
+    } else {
+        *out++ = static_cast<std::uint8_t>(atyp::ipv6);
+        const asio::ip::address_v6::bytes_type bytes = endpoint.address().to_v6().to_bytes();
+        out = std::copy(bytes.begin(), bytes.end(), out);
+    }
+
+    *out++ = static_cast<std::uint8_t>(endpoint.port() >> 8);
+    *out++ = static_cast<std::uint8_t>(endpoint.port());
+    addr.size = static_cast<std::size_t>(out - addr.data.data());
+
+    return addr;
+}
 } // namespace socks5
@@ -1,12 +1,17 @@
 #ifndef SOCKS5_H
 #define SOCKS5_H
 
+#include <array>
+#include <cstdint>
 #include <exception>
+#include <span>
 #include <string>
+#include <string_view>
 #include <utility>
 
 #include <asio/awaitable.hpp>
 #include <asio/ts/internet.hpp>
+#include <fmt/format.h>
 
 #include "io.h"
 
@@ -59,57 +64,62 @@ private:
     handshake_err_code err_code;
 };
 
+// address is a SOCKS5 address (ATYP, DST.ADDR and DST.PORT) stored inline in wire format.
+struct address {
+    atyp type() const;
+
+    // domain returns DST.ADDR of a domain name address, or an empty string otherwise.
+    std::string_view domain() const;
+
+    // ip returns DST.ADDR of an IPv4 or IPv6 address.
+    asio::ip::address ip() const;
+
+    std::uint16_t port() const;
+
+    // host returns the domain name or the textual representation of the IP address.
+    std::string host() const;
+
+    // bytes returns the address in wire format.
+    std::span<const std::uint8_t> bytes() const;
+
+    std::array<std::uint8_t, max_addr_len> data;
+    std::size_t size = 0;
+};
+
+// to_address returns the SOCKS5 address of an endpoint.
+address to_address(const asio::ip::tcp::endpoint& endpoint);
+
 // Read a SOCK5 address from r.
-asio::awaitable<std::string> read_tgt_addr(reader auto& r, std::string& host, std::string& port) {
-    std::string socks5_addr;
-
-    std::uint8_t type;
-    co_await read_full(r, std::span{&type, 1});
-
-    atyp at = static_cast<atyp>(type);
-    socks5_addr.push_back(static_cast<char>(at));
-
-    switch (at) {
-    case atyp::ipv4: {
-        asio::ip::address_v4::bytes_type addr;
-        co_await read_full(r, addr);
-        host = asio::ip::make_address_v4(addr).to_string();
-
-        socks5_addr.append(reinterpret_cast<const char*>(addr.data()), 4);
-    } break;
-    case atyp::domainname: {
-        std::uint8_t len;
-        co_await read_full(r, std::span{&len, 1});
-
-        std::string domain_name(len, 0);
-        co_await read_full(r, std::span{reinterpret_cast<std::uint8_t*>(domain_name.data()), len});
-        host = domain_name;
-
-        socks5_addr.push_back(static_cast<char>(len));
-        socks5_addr.append(domain_name);
-    } break;
-    case atyp::ipv6: {
-        asio::ip::address_v6::bytes_type addr;
-        co_await read_full(r, addr);
-        host = asio::ip::make_address_v6(addr).to_string();
-
-        socks5_addr.append(reinterpret_cast<const char*>(addr.data()), 16);
-    } break;
+asio::awaitable<void> read_tgt_addr(reader auto& r, address& addr) {
+    std::uint8_t* data = addr.data.data();
+    co_await read_full(r, std::span{data, 1});
+
+    // the number of bytes in front of DST.ADDR
+    std::size_t offset = 1;
+    std::size_t addr_len = 0;
+
+    switch (static_cast<atyp>(data[0])) {
+    case atyp::ipv4:
+        addr_len = 4;
+        break;
+    case atyp::domainname:
+        co_await read_full(r, std::span{data + 1, 1});
+        offset = 2;
+        addr_len = data[1];
+        break;
+    case atyp::ipv6:
+        addr_len = 16;
+        break;
     default:
         throw handshake_error{handshake_err_code::atyp};
     }
 
-    std::uint16_t p;
-    co_await read_full(r, std::span{reinterpret_cast<std::uint8_t*>(&p), 2});
-    socks5_addr.append(reinterpret_cast<const char*>(&p), 2);
-
-    p = ntohs(p);
-    port = std::to_string(p);
-
-    co_return socks5_addr;
+    // read DST.ADDR and DST.PORT
+    co_await read_full(r, std::span{data + offset, addr_len + 2});
+    addr.size = offset + addr_len + 2;
 }
 
-asio::awaitable<std::string> handshake(reader_writer auto& rw, std::string& host, std::string& port) {
+asio::awaitable<void> handshake(reader_writer auto& rw, address& addr) {
     std::array<std::uint8_t, max_msg_len> buf;
 
     // stage 1
@@ -147,13 +157,28 @@ asio::awaitable<std::string> handshake(reader_writer auto& rw, std::string& host
         throw handshake_error{handshake_err_code::command};
     }
 
-    std::string socks5_addr = co_await read_tgt_addr(rw, host, port);
+    co_await read_tgt_addr(rw, addr);
 
     // ok
     std::uint8_t rsp2[] = {ver, 0x00, 0x00, static_cast<std::uint8_t>(atyp::ipv4), 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
     co_await rw.write(std::span{rsp2});
-
-    co_return socks5_addr;
 }
 } // namespace socks5
+
+template <>
+struct fmt::formatter<socks5::address> {
+    constexpr auto parse(format_parse_context& ctx) {
+        return ctx.begin();
+    }
+
+    template <typename FormatContext>
+    auto format(const socks5::address& addr, FormatContext& ctx) const {
+        if (addr.type() == socks5::atyp::ipv6) {
+            return fmt::format_to(ctx.out(), "[{}]:{}", addr.host(), addr.port());
+        }
+
+        return fmt::format_to(ctx.out(), "{}:{}", addr.host(), addr.port());
+    }
+};
+
 #endif
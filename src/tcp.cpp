@@ -1,29 +1,707 @@
 // This file implements ss-local and ss-remote
 // See https://shadowsocks.org/en/wiki/Protocol.html
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <fstream>
 #include <functional>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string>
 #include <tuple>
+#include <utility>
 #include <vector>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include <asio/co_spawn.hpp>
 #include <asio/detached.hpp>
+#include <asio/redirect_error.hpp>
+#include <asio/signal_set.hpp>
+#include <asio/thread_pool.hpp>
 #include <asio/ts/executor.hpp>
-#include <fmt/format.h>
 #include <spdlog/spdlog.h>
 
 #include <crypto/crypto.h>
 
 #include "access_control_list.h"
 #include "awaitable.h"
+#include "circuit_breaker.h"
 #include "convert.h"
+#include "dns_cache.h"
+#include "dns_forwarder.h"
+#include "dns_message.h"
+#include "dns_resolver.h"
+#include "egress_pool.h"
 #include "encrypted_connection.h"
+#include "format.h"
+#include "handoff.h"
+#include "happy_eyeballs.h"
 #include "io.h"
+#include "lifecycle.h"
+#include "live_acl.h"
+#include "mux.h"
+#include "recycling_allocator.h"
+#include "server_pool.h"
+#include "session.h"
+#include "session_strand.h"
 #include "socks5.h"
 #include "tcp.h"
+#include "warm_pool.h"
 
 namespace {
-std::tuple<crypto::aead::method, std::vector<std::uint8_t>, access_control_list> prepare(const config& conf) {
+using namespace std::chrono_literals;
+
+// The accept loop backs off within this range when it is overloaded or accepting fails.
+constexpr auto min_accept_backoff = 10ms;
+constexpr auto max_accept_backoff = 1s;
+
+// Only sessions idle for at least this long are shed under overload.
+constexpr auto shed_idle_threshold = 10s;
+
+// The utilization of the egress addresses is logged this often.
+constexpr auto egress_report_interval = 60s;
+
+// The DNS cache metrics are logged this often.
+constexpr auto dns_report_interval = 300s;
+
+// The DNS tunnel keeps at most this many idle connections, for this long, and waits this many seconds for a response.
+constexpr std::size_t dns_tunnel_max_idle = 4;
+constexpr auto dns_tunnel_idle_timeout = 10s;
+constexpr int dns_tunnel_read_timeout = 5;
+
+// Multiplexed connections carrying no streams are closed after this long, before ss-remote times them out.
+constexpr auto mux_idle_timeout = 30s;
+
+// Every probe shows up on ss-remote as a client that left without a handshake, so they are at least this far apart.
+constexpr auto min_probe_interval = 5s;
+
+// The ACL file is checked for changes this often.
+constexpr auto acl_check_interval = 5s;
+
+// The ACL decision cache metrics are logged this often.
+constexpr auto acl_report_interval = 300s;
+
+// While draining, the remaining sessions are checked and logged this often.
+constexpr auto drain_poll_interval = 100ms;
+constexpr auto drain_report_interval = 5s;
+
+using serve_function = std::function<asio::awaitable<void>(tcp_socket, std::shared_ptr<session>)>;
+
+// reserved_fd holds a spare file descriptor, so that we can still accept and close
+// a pending connection after running out of file descriptors.
+class reserved_fd {
+public:
+    reserved_fd() {
+        reserve();
+    }
+
+    ~reserved_fd() {
+        release();
+    }
+
+    reserved_fd(const reserved_fd&) = delete;
+    reserved_fd& operator=(const reserved_fd&) = delete;
+
+    void reserve() {
+#ifndef _WIN32
+        if (fd == -1) {
+            fd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+        }
+#endif
+    }
+
+    void release() {
+#ifndef _WIN32
+        if (fd != -1) {
+            ::close(fd);
+            fd = -1;
+        }
+#endif
+    }
+
+private:
+    int fd = -1;
+};
+
+bool is_out_of_descriptors(const std::error_code& err) {
+    return err == std::errc::too_many_files_open ||
+           err == std::errc::too_many_files_open_in_system ||
+           err == std::errc::no_buffer_space ||
+           err == std::errc::not_enough_memory;
+}
+
+// set_shed_action lets the session manager abort the connections of s.
+template <typename C1, typename C2>
+void set_shed_action(session& s, const asio::any_io_executor& executor, const std::shared_ptr<C1>& c1, const std::shared_ptr<C2>& c2) {
+    struct shed_target {
+        asio::any_io_executor executor;
+        std::weak_ptr<C1> c1;
+        std::weak_ptr<C2> c2;
+    };
+
+    // capturing a single pointer keeps the action small enough to be stored inline by std::function
+    auto target = make_recycled<shed_target>(shed_target{executor, c1, c2});
+
+    s.set_shed_action([target] {
+        asio::post(target->executor, [target] {
+            if (auto c = target->c1.lock()) {
+                c->abort();
+            }
+
+            if (auto c = target->c2.lock()) {
+                c->abort();
+            }
+        });
+    });
+}
+
+// egress_connection keeps its egress address leased for as long as it is alive.
+class egress_connection : public connection {
+public:
+    egress_connection(tcp_socket s, std::optional<egress_pool::lease> lease)
+        : connection(std::move(s)),
+          lease(std::move(lease)) {}
+
+private:
+    std::optional<egress_pool::lease> lease;
+};
+
+// keyed_connection is an encrypted connection which owns its key, for connections which may outlive tcp_local.
+struct keyed_connection {
+    keyed_connection(tcp_socket s, crypto::aead::method method, std::shared_ptr<const std::vector<std::uint8_t>> key)
+        : key(std::move(key)),
+          ec(std::move(s), method, *this->key) {}
+
+    std::shared_ptr<const std::vector<std::uint8_t>> key;
+    encrypted_connection ec;
+};
+
+// no_client stands in for the client when ss-local connects on its own behalf.
+struct no_client {
+    asio::awaitable<bool> wait_disconnect() {
+        co_return false;
+    }
+
+    void cancel() {}
+};
+
+// connect_remote connects socket to the ss-remote server servers picks, and fails over to another server once.
+template <typename Client>
+asio::awaitable<void> connect_remote(tcp_socket& socket, server_pool& servers, int timeout, std::shared_ptr<Client> client, circuit_breaker& breaker) {
+    std::optional<std::size_t> failed;
+    std::exception_ptr failure;
+
+    for (int attempt = 0; attempt != 2; attempt++) {
+        const std::optional<server_pool::choice> chosen = servers.pick(failed);
+        if (!chosen) {
+            break;
+        }
+
+        try {
+            co_await happy_eyeballs::connect(socket, chosen->eps, timeout, client, breaker);
+            servers.succeeded(chosen->server);
+            co_return;
+        } catch (const std::system_error& e) {
+            // the client leaving says nothing about the server
+            if (e.code() == asio::error::connection_aborted) {
+                throw;
+            }
+
+            failure = std::current_exception();
+        }
+
+        servers.failed(chosen->server);
+        failed = chosen->server;
+    }
+
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+
+    throw std::system_error{asio::error::host_unreachable, "No remote server to connect to"};
+}
+
+// server_addresses returns the ss-remote servers of ss-local, the one of -s first.
+std::vector<server_pool::address> server_addresses(const config& conf) {
+    const auto default_port = static_cast<std::uint16_t>(std::stoul(conf.remote_port));
+
+    std::vector<server_pool::address> addresses{{conf.remote_host, default_port}};
+    for (const std::string& server : conf.remote_servers) {
+        addresses.push_back(server_pool::parse_address(server, default_port));
+    }
+
+    return addresses;
+}
+
+// report_egress logs the utilization of the egress addresses periodically.
+asio::awaitable<void> report_egress(std::shared_ptr<const egress_pool> egress) {
+    steady_timer timer{co_await asio::this_coro::executor};
+
+    while (true) {
+        timer.expires_after(egress_report_interval);
+        co_await timer.async_wait();
+
+        for (const egress_pool::address_stats& stats : egress->stats()) {
+            spdlog::info("Egress {}: {} active, {} connects, {} exhausted", stats.address, stats.active, stats.connects, stats.failures);
+        }
+    }
+}
+
+flow_budget::options budget_options(const config& conf) {
+    flow_budget::options opts;
+    opts.yield_bytes = conf.yield_bytes;
+    opts.yield_time = std::chrono::milliseconds{conf.yield_time};
+
+    return opts;
+}
+
+// is_host_name returns true if addr is a host name, rather than an IP address in any form.
+bool is_host_name(const socks5::address& addr) {
+    if (addr.type() != socks5::atyp::domainname) {
+        return false;
+    }
+
+    std::error_code ec;
+    asio::ip::make_address(addr.domain(), ec);
+
+    return static_cast<bool>(ec);
+}
+
+// resolve returns the endpoints of a SOCKS5 address, IP addresses are used as is.
+asio::awaitable<std::vector<asio::ip::tcp::endpoint>> resolve(dns_cache& dns, const socks5::address& addr) {
+    if (addr.type() != socks5::atyp::domainname) {
+        co_return std::vector<asio::ip::tcp::endpoint>{{addr.ip(), addr.port()}};
+    }
+
+    // host names which are IP addresses skip the cache
+    if (!is_host_name(addr)) {
+        co_return std::vector<asio::ip::tcp::endpoint>{{asio::ip::make_address(addr.domain()), addr.port()}};
+    }
+
+    const std::vector<asio::ip::address> addresses = co_await dns.resolve(addr.domain());
+
+    std::vector<asio::ip::tcp::endpoint> endpoints;
+    endpoints.reserve(addresses.size());
+
+    for (const asio::ip::address& address : addresses) {
+        endpoints.emplace_back(address, addr.port());
+    }
+
+    co_return endpoints;
+}
+
+// outbound is what ss-remote needs for connecting to targets.
+struct outbound {
+    const live_acl& acl;
+    dns_cache& dns;
+    circuit_breaker& breaker;
+    egress_pool* egress;
+    int connect_timeout;
+};
+
+// connect_target resolves target, and connects to one of its addresses the ACL of the session allows.
+// It returns nullptr if the ACL blocks them all.
+template <typename Client>
+asio::awaitable<std::shared_ptr<egress_connection>> connect_target(const socks5::address& target,
+                                                                   std::shared_ptr<Client> client,
+                                                                   const outbound& out,
+                                                                   const live_acl::view& rules) {
+    std::vector<asio::ip::tcp::endpoint> target_endpoints = co_await resolve(out.dns, target);
+
+    // only the addresses the ACL allows are tried
+    std::erase_if(target_endpoints, [&rules, &target](const asio::ip::tcp::endpoint& endpoint) {
+        if (rules.is_block_outbound(endpoint.address(), target.domain())) {
+            spdlog::debug("Block outbound: {} ({})", target, endpoint.address());
+            return true;
+        }
+
+        spdlog::debug("Allow outbound: {} ({})", target, endpoint.address());
+        return false;
+    });
+
+    if (target_endpoints.empty()) {
+        co_return nullptr;
+    }
+
+    tcp_socket socket{co_await asio::this_coro::executor};
+    std::optional<egress_pool::lease> lease = co_await happy_eyeballs::connect(socket, target_endpoints, out.connect_timeout, client, out.breaker, out.egress);
+
+    co_return make_recycled<egress_connection>(std::move(socket), std::move(lease));
+}
+
+// serve_stream connects a stream of a multiplexed connection to its target, and proxies it.
+// Each stream is a session s of its own, so that it is counted, timed out and shed apart from the others.
+asio::awaitable<void> serve_stream(std::shared_ptr<mux::stream> stream,
+                                   socks5::address target,
+                                   std::shared_ptr<session> s,
+                                   outbound out,
+                                   flow_budget::options budget) {
+    auto executor = co_await asio::this_coro::executor;
+
+    try {
+        stream->set_connection_timeout(60); // 1 minute
+
+        // a stream which isn't proxied is reset when it is released
+        const live_acl::view rules = out.acl.get_view();
+        std::shared_ptr<egress_connection> c = co_await connect_target(target, stream, out, rules);
+        if (!c) {
+            co_return;
+        }
+
+        s->established();
+        set_shed_action(*s, executor, stream, c);
+
+        asio::co_spawn(executor, io_copy(c, stream, s, budget), asio::detached);
+        asio::co_spawn(executor, io_copy(stream, c, s, budget), asio::detached);
+    } catch (const std::system_error& e) {
+        spdlog::debug("{}: stream to {}", e.what(), target);
+    }
+}
+
+// report_dns logs the DNS cache metrics periodically, if there were queries.
+asio::awaitable<void> report_dns(std::shared_ptr<const dns_cache> dns) {
+    steady_timer timer{co_await asio::this_coro::executor};
+    std::uint64_t last_queries = 0;
+
+    while (true) {
+        timer.expires_after(dns_report_interval);
+        co_await timer.async_wait();
+
+        const dns_cache::stats stats = dns->get_stats();
+        const std::uint64_t queries = stats.hits + stats.stale_hits + stats.negative_hits + stats.misses + stats.coalesced;
+
+        if (queries == last_queries) {
+            continue;
+        }
+
+        last_queries = queries;
+
+        const dns_cache::clock::duration average = stats.lookups > 0 ? stats.lookup_time / static_cast<dns_cache::clock::rep>(stats.lookups) : dns_cache::clock::duration::zero();
+        spdlog::info("DNS cache: {} queries, {:.1f}% hits ({} stale, {} negative), {} coalesced, {} lookups ({} failed, {}ms average, {}ms max)",
+                     queries,
+                     100.0 * (stats.hits + stats.stale_hits + stats.negative_hits) / queries,
+                     stats.stale_hits,
+                     stats.negative_hits,
+                     stats.coalesced,
+                     stats.lookups,
+                     stats.lookup_failures,
+                     std::chrono::duration_cast<std::chrono::milliseconds>(average).count(),
+                     std::chrono::duration_cast<std::chrono::milliseconds>(stats.max_lookup_time).count());
+    }
+}
+
+// report_acl_cache logs the hit ratio of the ACL decision caches periodically, if there were decisions.
+asio::awaitable<void> report_acl_cache() {
+    steady_timer timer{co_await asio::this_coro::executor};
+    std::uint64_t last_decisions = 0;
+
+    while (true) {
+        timer.expires_after(acl_report_interval);
+        co_await timer.async_wait();
+
+        const acl_cache::stats stats = live_acl::get_cache_stats();
+        const std::uint64_t decisions = stats.hits + stats.misses;
+
+        if (decisions == last_decisions) {
+            continue;
+        }
+
+        last_decisions = decisions;
+
+        spdlog::info("ACL cache: {} decisions, {:.1f}% hits", decisions, 100.0 * stats.hits / decisions);
+    }
+}
+
+// report_dns_forwarder logs the DNS forwarder metrics periodically, if there were queries.
+asio::awaitable<void> report_dns_forwarder(std::shared_ptr<const dns_forwarder> forwarder) {
+    steady_timer timer{co_await asio::this_coro::executor};
+    std::uint64_t last_queries = 0;
+
+    while (true) {
+        timer.expires_after(dns_report_interval);
+        co_await timer.async_wait();
+
+        const dns_forwarder::stats stats = forwarder->get_stats();
+        const std::uint64_t queries = stats.hits + stats.misses;
+
+        if (queries == last_queries) {
+            continue;
+        }
+
+        last_queries = queries;
+
+        spdlog::info("DNS forwarder: {} queries, {:.1f}% hits, {} direct, {} tunneled, {} failed",
+                     queries,
+                     100.0 * stats.hits / queries,
+                     stats.direct,
+                     stats.tunneled,
+                     stats.failures);
+    }
+}
+
+// dns_tunnel sends DNS queries over TCP to an upstream name server through ss-remote,
+// and keeps the encrypted connections for the following queries.
+//
+// It is only used from the strand of the DNS forwarder.
+class dns_tunnel {
+public:
+    dns_tunnel(crypto::aead::method method,
+               std::vector<std::uint8_t> key,
+               std::shared_ptr<server_pool> servers,
+               const asio::ip::tcp::endpoint& upstream,
+               int connect_timeout)
+        : method(method),
+          key(std::move(key)),
+          servers(std::move(servers)),
+          upstream(socks5::to_address(upstream)),
+          connect_timeout(connect_timeout) {}
+
+    asio::awaitable<std::vector<std::uint8_t>> exchange(std::vector<std::uint8_t> query) {
+        while (true) {
+            std::shared_ptr<encrypted_connection> ec = take_idle();
+            const bool reused = ec != nullptr;
+
+            if (!ec) {
+                ec = co_await connect_upstream();
+            }
+
+            try {
+                std::vector<std::uint8_t> response = co_await exchange(*ec, query);
+
+                if (idle.size() < dns_tunnel_max_idle) {
+                    idle.push_back({std::move(ec), std::chrono::steady_clock::now()});
+                }
+
+                co_return response;
+            } catch (const std::system_error&) {
+                // either end may have closed an idle connection in the meantime, so retry with a new one
+                if (!reused) {
+                    throw;
+                }
+            }
+        }
+    }
+
+private:
+    struct idle_connection {
+        std::shared_ptr<encrypted_connection> ec;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    // take_idle returns the most recently used idle connection, if any.
+    std::shared_ptr<encrypted_connection> take_idle() {
+        const auto now = std::chrono::steady_clock::now();
+        std::erase_if(idle, [now](const idle_connection& c) {
+            return now - c.since >= dns_tunnel_idle_timeout;
+        });
+
+        if (idle.empty()) {
+            return nullptr;
+        }
+
+        std::shared_ptr<encrypted_connection> ec = std::move(idle.back().ec);
+        idle.pop_back();
+
+        return ec;
+    }
+
+    asio::awaitable<std::shared_ptr<encrypted_connection>> connect_upstream() {
+        tcp_socket socket{co_await asio::this_coro::executor};
+        co_await connect_remote(socket, *servers, connect_timeout, std::make_shared<no_client>(), breaker);
+
+        auto ec = std::make_shared<encrypted_connection>(std::move(socket), method, key);
+        co_await ec->write(upstream.bytes());
+
+        co_return ec;
+    }
+
+    static asio::awaitable<std::vector<std::uint8_t>> exchange(encrypted_connection& ec, const std::vector<std::uint8_t>& query) {
+        // messages are prefixed with their length over TCP
+        std::vector<std::uint8_t> message(2 + query.size());
+        message[0] = static_cast<std::uint8_t>(query.size() >> 8);
+        message[1] = static_cast<std::uint8_t>(query.size());
+        std::copy(query.begin(), query.end(), message.begin() + 2);
+        co_await ec.write(message);
+
+        ec.set_read_timeout(dns_tunnel_read_timeout);
+
+        std::array<std::uint8_t, 2> length;
+        co_await read_full(ec, length);
+
+        std::vector<std::uint8_t> response(length[0] << 8 | length[1]);
+        co_await read_full(ec, response);
+
+        ec.set_read_timeout(0);
+
+        if (!dns::is_response_to(response, query)) {
+            throw std::system_error{asio::error::host_not_found_try_again, "Unexpected DNS response through the tunnel"};
+        }
+
+        co_return response;
+    }
+
+    crypto::aead::method method;
+
+    // referenced by the connections
+    std::vector<std::uint8_t> key;
+
+    std::shared_ptr<server_pool> servers;
+    socks5::address upstream;
+    int connect_timeout;
+
+    // remembers whether ss-remote is down, for the queries of all clients
+    circuit_breaker breaker;
+
+    std::vector<idle_connection> idle;
+};
+
+// load_acl loads an ACL file or image, and reports how long it took.
+std::shared_ptr<const access_control_list> load_acl(const std::string& path, bool profile) {
+    const auto start = std::chrono::steady_clock::now();
+    access_control_list acl = access_control_list::from_file(path);
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+    spdlog::info("Loaded ACL {} in {} ms: {} IP ranges, {} host rules", path, elapsed.count(), acl.ip_range_count(), acl.host_rule_count());
+
+    if (profile) {
+        acl.enable_profiling();
+    }
+
+    return std::make_shared<const access_control_list>(std::move(acl));
+}
+
+// write_profile writes the profile report of acl to path, replacing it.
+void write_profile(const access_control_list& acl, const std::string& path) {
+    std::ofstream ofs{path, std::ofstream::out | std::ofstream::trunc};
+    ofs << acl.profile_report();
+
+    if (!ofs) {
+        spdlog::warn("Cannot write the ACL profile to {}", path);
+        return;
+    }
+
+    spdlog::info("Wrote the ACL profile to {}", path);
+}
+
+// file_stamp tells whether a file has changed.
+struct file_stamp {
+    std::filesystem::file_time_type time;
+    std::uintmax_t size;
+
+    bool operator==(const file_stamp&) const = default;
+};
+
+std::optional<file_stamp> stamp(const std::string& path) {
+    std::error_code ec;
+
+    const std::filesystem::file_time_type time = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return std::nullopt;
+    }
+
+    const std::uintmax_t size = std::filesystem::file_size(path, ec);
+    if (ec) {
+        return std::nullopt;
+    }
+
+    return file_stamp{time, size};
+}
+
+// watch_acl reloads the ACL on SIGHUP, or once its file has changed and then stayed the same for a check interval,
+// so that a file being written isn't loaded half way. The new ACL is built on a thread of its own, and published
+// for the new lookups; the sessions in flight keep the one they started with. A file which fails to load leaves
+// the ACL as it is.
+//
+// With profile_path, the profile of the ACL is written there on SIGUSR1, and before the ACL is replaced.
+//
+// It must run in a strand.
+asio::awaitable<void> watch_acl(std::shared_ptr<live_acl> acl, std::string path, std::optional<std::string> profile_path) {
+    auto strand = co_await asio::this_coro::executor;
+
+    // shared with the signal waiter, which wakes the timer
+    auto wakeup = std::make_shared<steady_timer>(strand);
+    auto requested = std::make_shared<bool>(false);
+
+#ifndef _WIN32
+    auto wait_signal = [wakeup, requested]() -> asio::awaitable<void> {
+        asio::signal_set signals{co_await asio::this_coro::executor, SIGHUP};
+
+        while (true) {
+            co_await signals.async_wait(asio::use_awaitable);
+
+            spdlog::info("Reload ACL on SIGHUP");
+            *requested = true;
+            wakeup->cancel();
+        }
+    };
+
+    asio::co_spawn(strand, std::move(wait_signal), asio::detached);
+
+    if (profile_path) {
+        auto wait_profile_signal = [acl, profile_path = *profile_path]() -> asio::awaitable<void> {
+            asio::signal_set signals{co_await asio::this_coro::executor, SIGUSR1};
+
+            while (true) {
+                co_await signals.async_wait(asio::use_awaitable);
+                write_profile(*acl->snapshot(), profile_path);
+            }
+        };
+
+        asio::co_spawn(strand, std::move(wait_profile_signal), asio::detached);
+    }
+#endif
+
+    asio::thread_pool builder{1};
+
+    std::optional<file_stamp> loaded = stamp(path);
+    std::optional<file_stamp> seen = loaded;
+
+    while (true) {
+        if (!*requested) {
+            std::error_code ignore_error;
+            wakeup->expires_after(acl_check_interval);
+            co_await wakeup->async_wait(asio::redirect_error(asio::use_awaitable, ignore_error));
+        }
+
+        const std::optional<file_stamp> current = stamp(path);
+        const bool changed = current && current != loaded && current == seen;
+        seen = current;
+
+        if (!std::exchange(*requested, false) && !changed) {
+            continue;
+        }
+
+        // a broken file is tried again once it changes, or on SIGHUP
+        loaded = current;
+
+        try {
+            auto load = [path, profile = profile_path.has_value()]() -> asio::awaitable<std::shared_ptr<const access_control_list>> {
+                co_return load_acl(path, profile);
+            };
+
+            std::shared_ptr<const access_control_list> next = co_await asio::co_spawn(builder, std::move(load), asio::use_awaitable);
+
+            // the counts start over with the new ACL
+            if (profile_path) {
+                write_profile(*acl->snapshot(), *profile_path);
+            }
+
+            acl->publish(std::move(next));
+        } catch (const std::exception& e) {
+            spdlog::warn("Keep the current ACL, cannot reload {}: {}", path, e.what());
+        }
+    }
+}
+
+std::tuple<crypto::aead::method, std::vector<std::uint8_t>, std::shared_ptr<live_acl>> prepare(const config& conf) {
     const crypto::aead::method method = *method_from_string(conf.method);
 
     // derive a key from password
@@ -31,28 +709,225 @@ std::tuple<crypto::aead::method, std::vector<std::uint8_t>, access_control_list>
     crypto::derive_key(std::span{reinterpret_cast<const std::uint8_t*>(conf.password.data()), conf.password.size()}, key);
 
     // access control list
-    access_control_list acl;
+    std::shared_ptr<const access_control_list> acl = std::make_shared<const access_control_list>();
     if (conf.acl_file_path) {
-        acl = access_control_list::from_file(*conf.acl_file_path);
+        acl = load_acl(*conf.acl_file_path, conf.acl_profile_path.has_value());
+    }
+
+    return {method, std::move(key), std::make_shared<live_acl>(std::move(acl))};
+}
+
+// resolver_options returns the options of resolv.conf and the hosts file, with the name servers given by --dns.
+dns_resolver::options resolver_options(const config& conf) {
+    dns_resolver::options opts = dns_resolver::system_options();
+
+    if (!conf.dns_servers.empty()) {
+        opts.servers.clear();
+
+        for (const std::string& server : conf.dns_servers) {
+            opts.servers.emplace_back(dns_resolver::parse_server(server));
+        }
+    }
+
+    return opts;
+}
+
+// dns_lookup returns how the DNS cache looks up names: with the built-in resolver,
+// or with getaddrinfo if there are no name servers to query.
+dns_cache::lookup_function dns_lookup(const config& conf) {
+    dns_resolver::options opts = resolver_options(conf);
+
+    if (opts.servers.empty()) {
+        spdlog::info("No name servers configured, resolving with the system resolver");
+        return system_lookup;
+    }
+
+    auto resolver = std::make_shared<const dns_resolver>(std::move(opts));
+    return [resolver](std::string host) {
+        return resolver->resolve(std::move(host));
+    };
+}
+
+// open_acceptor listens on endpoint, or takes over the listening socket of the predecessor after an upgrade.
+tcp_acceptor open_acceptor(const asio::any_io_executor& executor, const asio::ip::tcp::endpoint& endpoint) {
+    if (auto handle = handoff::take_listener(endpoint)) {
+        tcp_acceptor acceptor{executor};
+        acceptor.assign(endpoint.protocol(), *handle);
+        return acceptor;
     }
 
-    return {method, std::move(key), std::move(acl)};
+    return tcp_acceptor{executor, endpoint};
+}
+
+// serve_dns serves forwarder on address and port over UDP and TCP, until the process drains.
+// The sockets are opened before returning, so that they are taken over from the predecessor before it is told that we are ready.
+void serve_dns(const asio::any_io_executor& executor, std::shared_ptr<dns_forwarder> forwarder, const asio::ip::address& address, std::uint16_t port) {
+    const asio::ip::tcp::endpoint tcp_endpoint{address, port};
+    const asio::ip::udp::endpoint udp_endpoint{address, port};
+
+    // the forwarder and its sockets are only used on this strand
+    auto strand = asio::make_strand(executor);
+
+    auto socket = std::make_shared<udp_socket>(strand);
+    if (auto handle = handoff::take_datagram_socket(udp_endpoint)) {
+        socket->assign(udp_endpoint.protocol(), *handle);
+    } else {
+        socket->open(udp_endpoint.protocol());
+        socket->bind(udp_endpoint);
+    }
+
+    auto acceptor = std::make_shared<tcp_acceptor>(open_acceptor(strand, tcp_endpoint));
+    spdlog::info("DNS forwarder listen on {}", tcp_endpoint);
+
+    const std::size_t udp_id = lifecycle::get().add_listener(socket->native_handle(), [strand, socket] {
+        asio::post(strand, [socket] {
+            std::error_code ignore_error;
+            socket->close(ignore_error);
+        });
+    });
+
+    const std::size_t tcp_id = lifecycle::get().add_listener(acceptor->native_handle(), [strand, acceptor] {
+        asio::post(strand, [acceptor] {
+            std::error_code ignore_error;
+            acceptor->close(ignore_error);
+        });
+    });
+
+    asio::co_spawn(
+        strand,
+        [forwarder, socket, udp_id]() -> asio::awaitable<void> {
+            co_await forwarder->serve_udp(socket);
+            lifecycle::get().remove_listener(udp_id);
+        },
+        asio::detached);
+
+    asio::co_spawn(
+        strand,
+        [forwarder, acceptor, tcp_id]() -> asio::awaitable<void> {
+            co_await forwarder->serve_tcp(*acceptor);
+            lifecycle::get().remove_listener(tcp_id);
+        },
+        asio::detached);
 }
 
+// accept_loop accepts clients until acceptor is closed, and serves them on executor.
+asio::awaitable<void> accept_loop(asio::any_io_executor executor,
+                                  tcp_acceptor& acceptor,
+                                  session_manager& sessions,
+                                  serve_function serve) {
+    // only affects the synchronous accept used for shedding
+    acceptor.non_blocking(true);
+
+    reserved_fd spare_fd;
+    steady_timer backoff_timer{co_await asio::this_coro::executor};
+    auto backoff = std::chrono::steady_clock::duration{min_accept_backoff};
+
+    while (acceptor.is_open()) {
+        bool accepted = false;
+
+        if (lifecycle::get().is_paused()) {
+            // the clients wait in the backlog, for this process or its successor
+            backoff_timer.expires_after(drain_poll_interval);
+            co_await backoff_timer.async_wait();
+            continue;
+        }
+
+        if (sessions.is_overloaded()) {
+            spdlog::debug("Overloaded: {} sessions, {} handshakes", sessions.session_count(), sessions.handshake_count());
+            sessions.shed_oldest_idle(shed_idle_threshold);
+        } else {
+            try {
+                // bind the socket to the strand of its session, so that its timeouts are serialized with the session
+                session_strand strand{executor};
+                tcp_socket peer{strand};
+                co_await acceptor.async_accept(peer);
+                asio::co_spawn(strand, serve(std::move(peer), sessions.open()), asio::detached);
+                accepted = true;
+            } catch (const std::system_error& e) {
+                if (!acceptor.is_open()) {
+                    // closed for draining
+                    break;
+                }
+
+                if (e.code() == asio::error::operation_aborted && lifecycle::get().is_paused()) {
+                    continue;
+                }
+
+                spdlog::warn("{}", e.what());
+
+                if (is_out_of_descriptors(e.code())) {
+                    // use the spare descriptor to reject the pending connection instead of leaving it in the backlog
+                    spare_fd.release();
+                    std::error_code ignore_error;
+                    acceptor.accept(ignore_error);
+                    spare_fd.reserve();
+
+                    sessions.shed_oldest_idle(shed_idle_threshold);
+                }
+            } catch (const std::exception& e) {
+                spdlog::warn("{}", e.what());
+            }
+        }
+
+        if (accepted) {
+            backoff = min_accept_backoff;
+            continue;
+        }
+
+        // pause accepting instead of spinning
+        backoff_timer.expires_after(backoff);
+        co_await backoff_timer.async_wait();
+        backoff = std::min<std::chrono::steady_clock::duration>(backoff * 2, max_accept_backoff);
+    }
+}
 asio::awaitable<void> listen_and_serve(asio::ip::tcp::endpoint listen_endpoint,
-                                       std::function<asio::awaitable<void>(tcp_socket)> serve) {
+                                       session_manager& sessions,
+                                       serve_function serve) {
     auto executor = co_await asio::this_coro::executor;
 
-    tcp_acceptor acceptor{executor, listen_endpoint};
-    spdlog::info("Listen on {}:{}", listen_endpoint.address().to_string(), listen_endpoint.port());
+    // the acceptor is only used on this strand, so that it can be closed from any thread for draining
+    auto strand = asio::make_strand(executor);
 
-    while (true) {
-        try {
-            tcp_socket peer = co_await acceptor.async_accept();
-            asio::co_spawn(asio::make_strand(executor), serve(std::move(peer)), asio::detached);
-        } catch (const std::exception& e) {
-            spdlog::warn("{}", e.what());
+    tcp_acceptor acceptor = open_acceptor(strand, listen_endpoint);
+    spdlog::info("Listen on {}", listen_endpoint);
+
+    auto close = [strand, &acceptor] {
+        asio::post(strand, [&acceptor] {
+            std::error_code ignore_error;
+            acceptor.close(ignore_error);
+        });
+    };
+
+    auto pause = [strand, &acceptor] {
+        asio::post(strand, [&acceptor] {
+            std::error_code ignore_error;
+            acceptor.cancel(ignore_error);
+        });
+    };
+
+    const std::size_t listener_id = lifecycle::get().add_listener(acceptor.native_handle(), std::move(close), std::move(pause));
+
+    handoff::ready();
+
+    co_await asio::co_spawn(strand, accept_loop(executor, acceptor, sessions, std::move(serve)), asio::use_awaitable);
+    lifecycle::get().remove_listener(listener_id);
+
+    spdlog::info("Stopped listening on {}", listen_endpoint);
+}
+
+// wait_sessions waits until all sessions have finished.
+asio::awaitable<void> wait_sessions(const session_manager& sessions) {
+    steady_timer timer{co_await asio::this_coro::executor};
+    auto next_report = std::chrono::steady_clock::now();
+
+    while (sessions.session_count() > 0) {
+        if (std::chrono::steady_clock::now() >= next_report) {
+            spdlog::info("Draining: {} sessions left", sessions.session_count());
+            next_report += drain_report_interval;
         }
+
+        timer.expires_after(drain_poll_interval);
+        co_await timer.async_wait();
     }
 }
 } // namespace
@@ -60,142 +935,325 @@ asio::awaitable<void> listen_and_serve(asio::ip::tcp::endpoint listen_endpoint,
 asio::awaitable<void> tcp_remote(config conf) {
     auto [method, key, acl] = prepare(conf);
 
+    // shared with the watcher, which outlives this coroutine
+    if (conf.acl_file_path) {
+        asio::co_spawn(asio::make_strand(co_await asio::this_coro::executor), watch_acl(acl, *conf.acl_file_path, conf.acl_profile_path), asio::detached);
+        asio::co_spawn(co_await asio::this_coro::executor, report_acl_cache(), asio::detached);
+    }
+
+    // egress source addresses
+    std::vector<asio::ip::address> egress_addresses;
+    for (const std::string& addr : conf.egress_addresses) {
+        egress_addresses.emplace_back(asio::ip::make_address(addr));
+    }
+
+    // shared with the reporter, which outlives this coroutine
+    auto egress = std::make_shared<egress_pool>(egress_addresses);
+    if (!egress->empty()) {
+        asio::co_spawn(co_await asio::this_coro::executor, report_egress(egress), asio::detached);
+    }
+
+    // remembers the targets that are down
+    circuit_breaker breaker;
+
+    // shared with the reporter and background refreshes, which outlive this coroutine
+    auto dns = std::make_shared<dns_cache>(dns_lookup(conf));
+    asio::co_spawn(co_await asio::this_coro::executor, report_dns(dns), asio::detached);
+
+    const outbound out{*acl, *dns, breaker, egress.get(), conf.connect_timeout};
+
+    session_manager sessions{conf.max_sessions, conf.max_handshakes};
+
     auto serve_socket = [method = method,
                          key = std::move(key),
-                         acl = std::move(acl)](tcp_socket peer) -> asio::awaitable<void> {
+                         acl = acl.get(),
+                         out,
+                         budget = budget_options(conf),
+                         &sessions](tcp_socket peer, std::shared_ptr<session> s) -> asio::awaitable<void> {
         auto executor = co_await asio::this_coro::executor;
 
         const asio::ip::tcp::endpoint peer_endpoint = peer.remote_endpoint();
-        const std::string peer_ip = peer_endpoint.address().to_string();
-        const std::string peer_addr = fmt::format("{}:{}", peer_ip, peer_endpoint.port());
 
-        if (acl.is_bypass(peer_ip)) {
-            spdlog::debug("Reject client address: {}", peer_addr);
+        // the session decides with the ACL it started with
+        const live_acl::view rules = acl->get_view();
+
+        if (rules.is_bypass(peer_endpoint.address())) {
+            spdlog::debug("Reject client address: {}", peer_endpoint);
             co_return;
         } else {
-            spdlog::debug("Accept client address: {}", peer_addr);
+            spdlog::debug("Accept client address: {}", peer_endpoint);
         }
 
         try {
             // establish an encrypted connection between ss-local and ss-remote
-            auto ec = std::make_shared<encrypted_connection>(std::move(peer), method, key);
+            auto ec = make_recycled<encrypted_connection>(std::move(peer), method, key);
 
             // get target endpoint
             ec->set_read_timeout(60); // 1 minute
-            std::string host, port;
-            co_await socks5::read_tgt_addr(*ec, host, port);
+            socks5::address target;
+            co_await socks5::read_tgt_addr(*ec, target);
 
             ec->set_read_timeout(0);        // disable read timeout
             ec->set_connection_timeout(60); // 1 minute
 
-            // resolve target endpoint
-            tcp_resolver r{executor};
-            const tcp_resolver::results_type results = co_await r.async_resolve(host, port);
-            const asio::ip::tcp::endpoint& target_endpoint = *results.begin();
-            const std::string target_ip = target_endpoint.address().to_string();
-            const std::string target_addr = fmt::format("{}:{}", host, port);
+            // ss-local carries streams to many targets over this connection
+            if (mux::is_mux_address(target)) {
+                spdlog::debug("Multiplexed connection from {}", peer_endpoint);
+
+                // the streams are shed one by one, and the connection closes once it carries none for its timeout
+                s->established();
+
+                auto m = std::make_shared<mux::multiplexer>(executor, ec);
+                mux::multiplexer::accept_function on_accept = [executor, &sessions, &out, &budget](std::shared_ptr<mux::stream> stream, const socks5::address& target) {
+                    // a stream released here is reset
+                    if (sessions.is_overloaded()) {
+                        spdlog::debug("Overloaded: reset stream to {}", target);
+                        return;
+                    }
+
+                    asio::co_spawn(executor, serve_stream(std::move(stream), target, sessions.open(), out, budget), asio::detached);
+                };
+
+                co_await m->run(std::move(on_accept));
 
-            if (acl.is_block_outbound(target_ip, host)) {
-                spdlog::debug("Block outbound: {} ({})", target_addr, target_ip);
                 co_return;
-            } else {
-                spdlog::debug("Allow outbound: {} ({})", target_addr, target_ip);
             }
 
             // connect to target host
-            tcp_socket socket{executor};
-            co_await socket.async_connect(target_endpoint);
-            auto c = std::make_shared<connection>(std::move(socket));
+            std::shared_ptr<egress_connection> c = co_await connect_target(target, ec, out, rules);
+            if (!c) {
+                co_return;
+            }
 
-            // Note:
-            // The ss-local may be disconnected at this point, and we can't be notified about this event.
-            // The reason is that `async_connect` may time out while the ss-local may be disconnected in that period.
-            // So we may write a broken pipe after that.
+            s->established();
+            set_shed_action(*s, executor, c, ec);
 
             // proxy
-            asio::co_spawn(executor, io_copy(c, ec), asio::detached);
-            asio::co_spawn(executor, io_copy(ec, c), asio::detached);
+            asio::co_spawn(executor, io_copy(c, ec, s, budget), asio::detached);
+            asio::co_spawn(executor, io_copy(ec, c, s, budget), asio::detached);
         } catch (const crypto::aead::decryption_error& e) {
-            spdlog::warn("{}: peer {}", e.what(), peer_addr);
+            spdlog::warn("{}: peer {}", e.what(), peer_endpoint);
         } catch (const encrypted_connection::duplicate_salt& e) {
-            spdlog::warn("{}: peer {}", e.what(), peer_addr);
+            spdlog::warn("{}: peer {}", e.what(), peer_endpoint);
         } catch (const std::system_error& e) {
-            spdlog::debug("{}: peer {}", e.what(), peer_addr);
+            spdlog::debug("{}: peer {}", e.what(), peer_endpoint);
         } catch (const std::exception& e) {
-            spdlog::warn("{}: peer {}", e.what(), peer_addr);
+            spdlog::warn("{}: peer {}", e.what(), peer_endpoint);
         }
     };
 
-    auto serve = [&serve_socket](tcp_socket peer) -> asio::awaitable<void> {
-        co_await serve_socket(std::move(peer));
+    // serve_socket outlives the sessions, so calling it directly saves a coroutine frame per connection
+    auto serve = [&serve_socket](tcp_socket peer, std::shared_ptr<session> s) {
+        return serve_socket(std::move(peer), std::move(s));
     };
 
     // listen
     asio::ip::tcp::endpoint listen_endpoint{asio::ip::make_address(conf.remote_host), static_cast<std::uint16_t>(std::stoul(conf.remote_port))};
-    co_await listen_and_serve(std::move(listen_endpoint), std::move(serve));
+    co_await listen_and_serve(std::move(listen_endpoint), sessions, std::move(serve));
+
+    // serve_socket must outlive the sessions
+    co_await wait_sessions(sessions);
 }
 
 asio::awaitable<void> tcp_local(config conf) {
     auto executor = co_await asio::this_coro::executor;
     auto [method, key, acl] = prepare(conf);
 
-    // resolve ss-remote server endpoint
-    tcp_resolver resolver{executor};
-    const tcp_resolver::results_type results = co_await resolver.async_resolve(conf.remote_host.data(), conf.remote_port.data());
-    asio::ip::tcp::endpoint remote_endpoint = *results.begin();
+    // shared with the DNS forwarder and the watcher, which outlives this coroutine
+    if (conf.acl_file_path) {
+        asio::co_spawn(asio::make_strand(executor), watch_acl(acl, *conf.acl_file_path, conf.acl_profile_path), asio::detached);
+        asio::co_spawn(executor, report_acl_cache(), asio::detached);
+    }
+
+    // shared with the reporter and background refreshes, which outlive this coroutine
+    auto dns = std::make_shared<dns_cache>(dns_lookup(conf));
+    asio::co_spawn(executor, report_dns(dns), asio::detached);
+
+    // resolve the ss-remote servers, and keep probing them
+    auto resolve_remote = [dns](std::string host, std::uint16_t port) -> asio::awaitable<server_pool::endpoints> {
+        server_pool::endpoints endpoints;
+        for (const asio::ip::address& address : co_await dns->resolve(host)) {
+            endpoints.emplace_back(address, port);
+        }
+
+        co_return endpoints;
+    };
+
+    auto probe_remote = [connect_timeout = conf.connect_timeout](server_pool::endpoints endpoints) -> asio::awaitable<void> {
+        // probes must reach a server the sessions have given up on
+        circuit_breaker breaker;
+
+        tcp_socket socket{co_await asio::this_coro::executor};
+        co_await happy_eyeballs::connect(socket, endpoints, connect_timeout, std::make_shared<no_client>(), breaker);
+    };
+
+    server_pool::options server_opts;
+    server_opts.balance = conf.balance == "weighted" ? server_pool::policy::weighted : server_pool::policy::least_latency;
+    server_opts.probe_interval = std::max<server_pool::clock::duration>(std::chrono::seconds{conf.probe_interval}, min_probe_interval);
+
+    auto servers = std::make_shared<server_pool>(executor, server_addresses(conf), std::move(resolve_remote), std::move(probe_remote), server_opts);
+    co_await servers->start();
+
+    // the DNS forwarder sends the queries the ACL doesn't bypass through ss-remote
+    if (conf.dns_local_port) {
+        const asio::ip::udp::endpoint upstream = dns_resolver::parse_server(conf.dns_upstream);
+        auto tunnel = std::make_shared<dns_tunnel>(method, key, servers, asio::ip::tcp::endpoint{upstream.address(), upstream.port()}, conf.connect_timeout);
+
+        dns_forwarder::exchange_function through_tunnel = [tunnel](std::vector<std::uint8_t> query) {
+            return tunnel->exchange(std::move(query));
+        };
+
+        // without local name servers, bypassed names go through the tunnel as well
+        dns_forwarder::exchange_function direct = through_tunnel;
+        if (dns_resolver::options opts = resolver_options(conf); !opts.servers.empty()) {
+            auto resolver = std::make_shared<const dns_resolver>(std::move(opts));
+            direct = [resolver](std::vector<std::uint8_t> query) {
+                return resolver->forward(std::move(query));
+            };
+        }
+
+        auto forwarder = std::make_shared<dns_forwarder>(acl, std::move(direct), std::move(through_tunnel));
+        serve_dns(executor, forwarder, asio::ip::make_address(conf.dns_local_address), static_cast<std::uint16_t>(std::stoul(*conf.dns_local_port)));
+        asio::co_spawn(executor, report_dns_forwarder(forwarder), asio::detached);
+    }
+
+    // remembers the targets (and the ss-remote server) that are down, shared with the warm pool
+    auto breaker = std::make_shared<circuit_breaker>();
+
+    // connections to ss-remote established ahead of the sessions
+    std::shared_ptr<warm_pool> pool;
+    if (conf.warm_pool_size > 0) {
+        warm_pool::options opts;
+        opts.size = conf.warm_pool_size;
+        opts.max_idle = std::chrono::seconds{conf.warm_pool_idle};
+
+        auto connect_warm = [servers, breaker, connect_timeout = conf.connect_timeout]() -> asio::awaitable<tcp_socket> {
+            tcp_socket socket{co_await asio::this_coro::executor};
+            co_await connect_remote(socket, *servers, connect_timeout, std::make_shared<no_client>(), *breaker);
+            co_return socket;
+        };
+
+        pool = std::make_shared<warm_pool>(executor, std::move(connect_warm), opts);
+        pool->start();
+    }
+
+    // connections to ss-remote carrying the sessions as streams
+    std::shared_ptr<mux::pool> muxes;
+    if (conf.mux_connections > 0) {
+        // the connections may outlive this coroutine
+        auto mux_key = std::make_shared<const std::vector<std::uint8_t>>(key);
 
-    spdlog::info("Remote server: {}:{}", remote_endpoint.address().to_string(), remote_endpoint.port());
+        auto connect_mux = [method = method, mux_key, servers, breaker, connect_timeout = conf.connect_timeout]() -> asio::awaitable<std::shared_ptr<encrypted_connection>> {
+            tcp_socket socket{co_await asio::this_coro::executor};
+            co_await connect_remote(socket, *servers, connect_timeout, std::make_shared<no_client>(), *breaker);
+
+            auto kc = std::make_shared<keyed_connection>(std::move(socket), method, mux_key);
+            co_await kc->ec.write(mux::address().bytes());
+
+            co_return std::shared_ptr<encrypted_connection>{kc, &kc->ec};
+        };
+
+        muxes = std::make_shared<mux::pool>(executor, std::move(connect_mux), conf.mux_connections, mux_idle_timeout);
+    }
 
     auto serve_socket = [method = method,
                          key = std::move(key),
                          acl = std::move(acl),
-                         remote_endpoint = std::move(remote_endpoint)](tcp_socket peer) -> asio::awaitable<void> {
+                         dns = dns.get(),
+                         breaker = breaker.get(),
+                         pool = pool.get(),
+                         muxes = muxes.get(),
+                         servers = servers.get(),
+                         budget = budget_options(conf),
+                         connect_timeout = conf.connect_timeout](tcp_socket peer, std::shared_ptr<session> s) -> asio::awaitable<void> {
         auto executor = co_await asio::this_coro::executor;
 
         try {
             // connection between ss-local and client
-            auto c = std::make_shared<connection>(std::move(peer));
+            auto c = make_recycled<connection>(std::move(peer));
+
+            // socks5 handshake, bounded so that silent clients don't hold the handshake slots
+            c->set_read_timeout(60); // 1 minute
+            socks5::address target;
+            co_await socks5::handshake(*c, target);
+            c->set_read_timeout(0); // disable read timeout
+
+            // the session decides with the ACL it started with, even if it is reloaded while resolving
+            const live_acl::view rules = acl->get_view();
+
+            // host names are resolved only if they are bypassed, or the IP rules must be checked
+            std::optional<bool> bypass;
+            if (is_host_name(target)) {
+                bypass = rules.is_bypass_host(target.domain());
+            }
+
+            std::vector<asio::ip::tcp::endpoint> target_endpoints;
+            if (!bypass || *bypass) {
+                target_endpoints = co_await resolve(*dns, target);
+            }
+
+            if (!bypass) {
+                bypass = rules.is_bypass(target_endpoints.front().address(), target.domain());
+            }
+
+            if (!*bypass) {
+                spdlog::debug("Proxy target address: {}", target);
 
-            // socks5 handshake
-            std::string host, port;
-            const std::string socks5_addr = co_await socks5::handshake(*c, host, port);
+                // open a stream to the target without waiting for ss-remote
+                if (muxes) {
+                    std::shared_ptr<mux::stream> stream = co_await muxes->open(target);
 
-            // resolve target endpoint
-            tcp_resolver resolver{executor};
-            const tcp_resolver::results_type results = co_await resolver.async_resolve(host, port);
-            const asio::ip::tcp::endpoint& target_endpoint = *results.begin();
-            const std::string target_ip = target_endpoint.address().to_string();
-            const std::string target_addr = fmt::format("{}:{}", host, port);
+                    s->established();
+                    set_shed_action(*s, executor, c, stream);
 
-            if (!acl.is_bypass(target_ip, host)) {
-                spdlog::debug("Proxy target address: {} ({})", target_addr, target_ip);
+                    // proxy
+                    asio::co_spawn(executor, io_copy(c, stream, s, budget), asio::detached);
+                    asio::co_spawn(executor, io_copy(stream, c, s, budget), asio::detached);
+                    co_return;
+                }
 
-                // connect to ss-remote server
+                // take a connection to ss-remote server established ahead of time, or connect now
                 tcp_socket remote_socket{executor};
-                co_await remote_socket.async_connect(remote_endpoint);
+
+                std::optional<tcp_socket> warm;
+                if (pool) {
+                    warm = co_await pool->take(executor);
+                }
+
+                if (warm) {
+                    remote_socket = std::move(*warm);
+                } else {
+                    co_await connect_remote(remote_socket, *servers, connect_timeout, c, *breaker);
+                }
 
                 // establish an encrypted connection between ss-local and ss-remote
-                auto ec = std::make_shared<encrypted_connection>(std::move(remote_socket), method, key);
+                auto ec = make_recycled<encrypted_connection>(std::move(remote_socket), method, key);
 
                 // write target address
-                co_await ec->write(std::span{reinterpret_cast<const std::uint8_t*>(socks5_addr.data()), socks5_addr.size()});
+                co_await ec->write(target.bytes());
+
+                s->established();
+                set_shed_action(*s, executor, c, ec);
 
                 // proxy
-                asio::co_spawn(executor, io_copy(c, ec), asio::detached);
-                asio::co_spawn(executor, io_copy(ec, c), asio::detached);
+                asio::co_spawn(executor, io_copy(c, ec, s, budget), asio::detached);
+                asio::co_spawn(executor, io_copy(ec, c, s, budget), asio::detached);
             } else {
-                spdlog::debug("Bypass target address: {} ({})", target_addr, target_ip);
+                spdlog::debug("Bypass target address: {} ({})", target, target_endpoints.front().address());
 
                 // connect to target host
                 tcp_socket target_socket{executor};
-                co_await target_socket.async_connect(target_endpoint);
+                co_await happy_eyeballs::connect(target_socket, target_endpoints, connect_timeout, c, *breaker);
 
                 // establish a normal connection between ss-local and target host
-                auto conn = std::make_shared<connection>(std::move(target_socket));
+                auto conn = make_recycled<connection>(std::move(target_socket));
+
+                s->established();
+                set_shed_action(*s, executor, c, conn);
 
                 // proxy
-                asio::co_spawn(executor, io_copy(c, conn), asio::detached);
-                asio::co_spawn(executor, io_copy(conn, c), asio::detached);
+                asio::co_spawn(executor, io_copy(c, conn, s, budget), asio::detached);
+                asio::co_spawn(executor, io_copy(conn, c, s, budget), asio::detached);
             }
         } catch (const socks5::handshake_error& e) {
             spdlog::warn("{}", e.what());
@@ -206,11 +1264,23 @@ asio::awaitable<void> tcp_local(config conf) {
         }
     };
 
-    auto serve = [&serve_socket](tcp_socket peer) -> asio::awaitable<void> {
-        co_await serve_socket(std::move(peer));
+    // serve_socket outlives the sessions, so calling it directly saves a coroutine frame per connection
+    auto serve = [&serve_socket](tcp_socket peer, std::shared_ptr<session> s) {
+        return serve_socket(std::move(peer), std::move(s));
     };
 
+    session_manager sessions{conf.max_sessions, conf.max_handshakes};
+
     // listen
     asio::ip::tcp::endpoint listen_endpoint{asio::ip::tcp::v4(), static_cast<std::uint16_t>(std::stoul(conf.local_port))};
-    co_await listen_and_serve(std::move(listen_endpoint), std::move(serve));
+    co_await listen_and_serve(std::move(listen_endpoint), sessions, std::move(serve));
+
+    if (pool) {
+        pool->stop();
+    }
+
+    servers->stop();
+
+    // serve_socket must outlive the sessions
+    co_await wait_sessions(sessions);
 }
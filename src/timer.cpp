@@ -1,37 +1,113 @@
+#include <algorithm>
+
 #include "timer.h"
 
-timer::timer(const asio::any_io_executor& executor) : inner_timer(executor) {}
+timer::timer(tcp_socket& socket) : socket(socket), inner_timer(socket.get_executor()) {}
+
+timer::kind timer::expired() const {
+    return expired_kind;
+}
+
+void timer::set_read_timeout(int val) {
+    read_timeout = std::max(val, 0);
+    read_deadline = read_timeout > 0 ? clock::now() + std::chrono::seconds(read_timeout) : clock::time_point::max();
 
-bool timer::is_expired() const {
-    return err.has_value();
+    if (expired_kind == kind::read) {
+        expired_kind = kind::none;
+    }
+
+    arm();
 }
 
-void timer::set_timeout(int val, std::function<void()> action) {
-    timeout = val;
-    timeout_action = std::move(action);
+void timer::set_connection_timeout(int val) {
+    connection_timeout = std::max(val, 0);
+    connection_deadline = connection_timeout > 0 ? clock::now() + std::chrono::seconds(connection_timeout) : clock::time_point::max();
+
+    if (expired_kind == kind::connection) {
+        expired_kind = kind::none;
+    }
 
-    update();
+    arm();
 }
 
-void timer::update() {
-    cancel();
+void timer::update_read() {
+    const auto now = clock::now();
 
-    if (timeout > 0) {
-        inner_timer.expires_after(std::chrono::seconds(timeout));
-        inner_timer.async_wait([this](const std::error_code& error) {
-            if (error == asio::error::operation_aborted) {
-                return;
-            }
+    if (read_timeout > 0) {
+        read_deadline = now + std::chrono::seconds(read_timeout);
+    }
+
+    if (connection_timeout > 0) {
+        connection_deadline = now + std::chrono::seconds(connection_timeout);
+    }
+
+    expired_kind = kind::none;
+    arm();
+}
+
+void timer::update_write() {
+    if (connection_timeout > 0) {
+        connection_deadline = clock::now() + std::chrono::seconds(connection_timeout);
+    }
 
-            err = error;
-            timeout_action();
-        });
+    if (expired_kind == kind::connection) {
+        expired_kind = kind::none;
     }
+
+    arm();
 }
 
 void timer::cancel() {
-    std::error_code ignore_rrror;
-    inner_timer.cancel(ignore_rrror);
+    std::error_code ignore_error;
+    inner_timer.cancel(ignore_error);
+
+    waiting = false;
+    expired_kind = kind::none;
+}
+
+timer::clock::time_point timer::next_deadline() const {
+    return std::min(read_deadline, connection_deadline);
+}
+
+void timer::arm() {
+    const auto deadline = next_deadline();
+
+    if (deadline == clock::time_point::max()) {
+        // a pending wait will find nothing to do
+        return;
+    }
+
+    if (waiting && inner_timer.expiry() <= deadline) {
+        // the pending wait fires early and re-arms the timer
+        return;
+    }
+
+    // this cancels the pending wait, if any
+    inner_timer.expires_at(deadline);
+    waiting = true;
+
+    inner_timer.async_wait([this](const std::error_code& error) {
+        if (error == asio::error::operation_aborted) {
+            return;
+        }
+
+        waiting = false;
+
+        const auto now = clock::now();
+        if (now >= read_deadline) {
+            expired_kind = kind::read;
+            read_deadline = clock::time_point::max();
+        } else if (now >= connection_deadline) {
+            expired_kind = kind::connection;
+            connection_deadline = clock::time_point::max();
+        } else {
+            arm();
+            return;
+        }
+
+        std::error_code ignore_error;
+        socket.cancel(ignore_error);
 
-    err.reset();
+        arm();
+    });
 }
@@ -1,28 +1,59 @@
 #ifndef TIMER_H
 #define TIMER_H
 
-#include <functional>
-#include <optional>
+#include <chrono>
+#include <cstdint>
 
 #include <asio/ts/io_context.hpp>
 #include <asio/ts/timer.hpp>
 
+#include "awaitable.h"
+
+// timer enforces the read and connection timeouts of a socket with a single steady_timer.
+// When a timeout expires, the outstanding operations of the socket are cancelled.
+//
+// Refreshing a deadline only records a time point. The underlying timer is re-armed
+// when it fires before the current deadline, so reads and writes don't touch it.
 class timer {
 public:
-    explicit timer(const asio::any_io_executor& executor);
+    enum class kind : std::uint8_t {
+        none,
+        read,
+        connection
+    };
+
+    explicit timer(tcp_socket& socket);
+
+    // expired returns the timeout that cancelled the socket, if any.
+    kind expired() const;
+
+    // Timeouts are in seconds, 0 disables them.
+    void set_read_timeout(int val);
+    void set_connection_timeout(int val);
 
-    bool is_expired() const;
+    // update_read restarts both timeouts, update_write restarts the connection timeout.
+    void update_read();
+    void update_write();
 
-    void set_timeout(int val, std::function<void()> action);
-    void update();
     void cancel();
 
 private:
-    int timeout = 0;
+    using clock = std::chrono::steady_clock;
+
+    clock::time_point next_deadline() const;
+    void arm();
+
+    tcp_socket& socket;
     asio::steady_timer inner_timer;
-    std::optional<std::error_code> err;
 
-    std::function<void()> timeout_action;
+    clock::time_point read_deadline = clock::time_point::max();
+    clock::time_point connection_deadline = clock::time_point::max();
+
+    std::uint32_t read_timeout = 0;
+    std::uint32_t connection_timeout = 0;
+
+    kind expired_kind = kind::none;
+    bool waiting = false;
 };
 
 #endif
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <system_error>
+#include <utility>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/post.hpp>
+#include <asio/redirect_error.hpp>
+#include <asio/use_awaitable.hpp>
+#include <spdlog/spdlog.h>
+
+#include "warm_pool.h"
+
+warm_pool::warm_pool(const asio::any_io_executor& executor, connect_function connect, const options& opts)
+    : strand(asio::make_strand(executor)),
+      connect(std::move(connect)),
+      opts(opts),
+      wakeup(strand) {}
+
+void warm_pool::start() {
+    asio::co_spawn(
+        strand,
+        [self = shared_from_this()]() -> asio::awaitable<void> {
+            co_await self->fill();
+        },
+        asio::detached);
+}
+
+void warm_pool::stop() {
+    asio::post(strand, [self = shared_from_this()] {
+        self->stopped = true;
+
+        for (const std::shared_ptr<entry>& e : self->idle) {
+            std::error_code ignore_error;
+            e->socket.close(ignore_error);
+        }
+
+        self->idle.clear();
+        self->wakeup.cancel();
+    });
+}
+
+asio::awaitable<std::optional<tcp_socket>> warm_pool::take(asio::any_io_executor executor) {
+    // GCC 12 destroys the captures of a lambda twice if the lambda is a temporary of a co_await expression
+    auto take_on_strand = [self = shared_from_this(), executor]() -> asio::awaitable<std::optional<tcp_socket>> {
+        co_return self->take_idle(executor);
+    };
+
+    co_return co_await asio::co_spawn(strand, std::move(take_on_strand), asio::use_awaitable);
+}
+
+asio::awaitable<void> warm_pool::fill() {
+    while (!stopped) {
+        const clock::time_point now = clock::now();
+
+        // drop the connections before ss-remote times them out
+        while (!idle.empty() && now - idle.front()->since >= opts.max_idle) {
+            std::error_code ignore_error;
+            idle.front()->socket.close(ignore_error);
+            idle.pop_front();
+        }
+
+        const bool retrying = now < retry_at;
+
+        while (!retrying && idle.size() + connecting < opts.size) {
+            connecting++;
+            asio::co_spawn(
+                strand,
+                [self = shared_from_this()]() -> asio::awaitable<void> {
+                    co_await self->connect_one();
+                },
+                asio::detached);
+        }
+
+        // until the oldest connection expires, a connect can be retried, or the pool changes
+        clock::time_point next = idle.empty() ? clock::time_point::max() : idle.front()->since + opts.max_idle;
+        if (retrying && idle.size() + connecting < opts.size) {
+            next = std::min(next, retry_at);
+        }
+
+        std::error_code ignore_error;
+        wakeup.expires_at(next);
+        co_await wakeup.async_wait(asio::redirect_error(asio::use_awaitable, ignore_error));
+    }
+}
+
+asio::awaitable<void> warm_pool::connect_one() {
+    std::optional<tcp_socket> socket;
+
+    try {
+        socket.emplace(co_await connect());
+    } catch (const std::system_error& e) {
+        spdlog::debug("Warm pool: {}", e.what());
+        retry_at = clock::now() + opts.retry_delay;
+    }
+
+    connecting--;
+
+    if (socket && !stopped) {
+        auto e = std::make_shared<entry>(entry{std::move(*socket), clock::now()});
+        idle.push_back(e);
+
+        asio::co_spawn(
+            strand,
+            [self = shared_from_this(), e]() -> asio::awaitable<void> {
+                co_await self->watch(e);
+            },
+            asio::detached);
+    }
+
+    wakeup.cancel();
+}
+
+asio::awaitable<void> warm_pool::watch(std::shared_ptr<entry> e) {
+    // ss-remote doesn't send anything first, so an idle connection becomes readable only when it is closed
+    std::error_code ignore_error;
+    co_await e->socket.async_wait(asio::socket_base::wait_read, asio::redirect_error(asio::use_awaitable, ignore_error));
+
+    // taken or dropped in the meantime
+    auto it = std::find(idle.begin(), idle.end(), e);
+    if (it == idle.end()) {
+        co_return;
+    }
+
+    spdlog::debug("Warm pool: idle connection closed by ss-remote");
+
+    e->socket.close(ignore_error);
+    idle.erase(it);
+    wakeup.cancel();
+}
+
+std::optional<tcp_socket> warm_pool::take_idle(const asio::any_io_executor& executor) {
+    const clock::time_point now = clock::now();
+
+    while (!idle.empty()) {
+        std::shared_ptr<entry> e = std::move(idle.front());
+        idle.pop_front();
+        wakeup.cancel();
+
+        std::error_code error;
+        const asio::ip::tcp::endpoint endpoint = e->socket.remote_endpoint(error);
+
+        if (error || now - e->since >= opts.max_idle) {
+            e->socket.close(error);
+            continue;
+        }
+
+        // rebind the socket to the executor of the session, this cancels the watch
+        const tcp_socket::native_handle_type handle = e->socket.release(error);
+        if (error) {
+            e->socket.close(error);
+            return std::nullopt;
+        }
+
+        tcp_socket socket{executor};
+        socket.assign(endpoint.protocol(), handle);
+
+        return socket;
+    }
+
+    return std::nullopt;
+}
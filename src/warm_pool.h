@@ -0,0 +1,76 @@
+#ifndef WARM_POOL_H
+#define WARM_POOL_H
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+
+#include <asio/awaitable.hpp>
+#include <asio/strand.hpp>
+
+#include "awaitable.h"
+
+// warm_pool keeps idle connections to ss-remote established ahead of time, so that a session can send
+// its salt and target address right away, instead of waiting a round trip for its connect.
+//
+// Idle connections are dropped as soon as ss-remote closes them, and after max_idle, before ss-remote
+// times them out. The pool refills itself in the background.
+class warm_pool : public std::enable_shared_from_this<warm_pool> {
+public:
+    using clock = std::chrono::steady_clock;
+
+    // connect establishes a new connection, and throws std::system_error on failure.
+    using connect_function = std::function<asio::awaitable<tcp_socket>()>;
+
+    struct options {
+        // Number of idle connections to keep.
+        std::size_t size = 0;
+
+        // How long a connection may stay idle.
+        clock::duration max_idle = std::chrono::seconds{30};
+
+        // Refilling pauses this long after a connect fails.
+        clock::duration retry_delay = std::chrono::seconds{1};
+    };
+
+    warm_pool(const asio::any_io_executor& executor, connect_function connect, const options& opts);
+
+    // start starts filling the pool.
+    void start();
+
+    // stop closes the idle connections, and stops refilling the pool.
+    void stop();
+
+    // take returns an idle connection bound to executor, or std::nullopt if there is none.
+    asio::awaitable<std::optional<tcp_socket>> take(asio::any_io_executor executor);
+
+private:
+    struct entry {
+        tcp_socket socket;
+        clock::time_point since;
+    };
+
+    // All members are used on strand.
+    asio::awaitable<void> fill();
+    asio::awaitable<void> connect_one();
+    asio::awaitable<void> watch(std::shared_ptr<entry> e);
+    std::optional<tcp_socket> take_idle(const asio::any_io_executor& executor);
+
+    asio::strand<asio::any_io_executor> strand;
+    connect_function connect;
+    options opts;
+
+    // oldest first
+    std::deque<std::shared_ptr<entry>> idle;
+    std::size_t connecting = 0;
+    clock::time_point retry_at;
+    bool stopped = false;
+
+    // wakes up fill when the pool changes
+    steady_timer wakeup;
+};
+
+#endif
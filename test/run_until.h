@@ -0,0 +1,26 @@
+#ifndef RUN_UNTIL_H
+#define RUN_UNTIL_H
+
+#include <chrono>
+
+#include <asio/io_context.hpp>
+
+// run_until runs ctx until done returns true, or a few seconds have passed.
+template <typename Done>
+void run_until(asio::io_context& ctx, Done done) {
+    using namespace std::chrono_literals;
+
+    const auto deadline = std::chrono::steady_clock::now() + 5s;
+
+    ctx.restart();
+    while (!done() && std::chrono::steady_clock::now() < deadline) {
+        ctx.run_for(10ms);
+    }
+}
+
+// run_until runs ctx until done is set, or a few seconds have passed.
+inline void run_until(asio::io_context& ctx, const bool& done) {
+    run_until(ctx, [&done] { return done; });
+}
+
+#endif
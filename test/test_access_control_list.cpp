@@ -0,0 +1,168 @@
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include <gtest/gtest.h>
+
+#include "../src/access_control_list.h"
+
+namespace {
+access_control_list load(std::string_view content) {
+    std::istringstream in{std::string{content}};
+    return access_control_list::from_stream(in);
+}
+
+// load_image compiles content into an image, and loads the image.
+access_control_list load_image(std::string_view content) {
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "test_access_control_list.acl.bin";
+    load(content).save_image(path.string());
+
+    access_control_list acl = access_control_list::from_file(path.string());
+    std::filesystem::remove(path);
+
+    return acl;
+}
+} // namespace
+
+TEST(access_control_list, is_bypass) {
+    const access_control_list acl = load("[proxy_all]\n"
+                                         "[bypass_list]\n"
+                                         "10.0.0.0/8\n"
+                                         "(^|\\.)example\\.com$\n"
+                                         "[proxy_list]\n"
+                                         "172.16.0.0/12\n");
+
+    ASSERT_TRUE(acl.is_bypass("10.0.0.1"));
+    ASSERT_FALSE(acl.is_bypass("172.16.0.1"));
+    ASSERT_FALSE(acl.is_bypass("192.0.2.1"));
+    ASSERT_TRUE(acl.is_bypass("192.0.2.1", "www.example.com"));
+}
+
+TEST(access_control_list, is_bypass_host) {
+    const access_control_list acl = load("[bypass_all]\n"
+                                         "[proxy_list]\n"
+                                         "(^|\\.)example\\.com$\n"
+                                         "[bypass_list]\n"
+                                         "(^|\\.)example\\.org$\n");
+
+    ASSERT_EQ(acl.is_bypass_host("www.example.com"), false);
+    ASSERT_EQ(acl.is_bypass_host("example.org"), true);
+
+    // no IP rules, so the default decides
+    ASSERT_EQ(acl.is_bypass_host("example.net"), true);
+
+    // the host is the domain of a SOCKS5 address, followed by its port in the same buffer
+    const std::string_view address{"www.example.com\x01\xbb", 17};
+    ASSERT_EQ(acl.is_bypass_host(address.substr(0, 15)), false);
+}
+
+TEST(access_control_list, is_bypass_host_needs_ip) {
+    const access_control_list acl = load("[proxy_all]\n"
+                                         "[bypass_list]\n"
+                                         "10.0.0.0/8\n"
+                                         "(^|\\.)example\\.org$\n");
+
+    ASSERT_EQ(acl.is_bypass_host("example.org"), true);
+    ASSERT_EQ(acl.is_bypass_host("example.net"), std::nullopt);
+}
+
+TEST(access_control_list, is_bypass_host_address_rule) {
+    // a rule matching the text of addresses needs the address, even without IP ranges
+    const std::string_view content = "[proxy_all]\n"
+                                     "[bypass_list]\n"
+                                     "^10\\.\n";
+
+    for (const access_control_list& acl : {load(content), load_image(content)}) {
+        ASSERT_EQ(acl.is_bypass_host("example.com"), std::nullopt);
+        ASSERT_TRUE(acl.is_bypass(asio::ip::make_address("10.0.0.1"), "example.com"));
+    }
+
+    // host name rules don't, unless their top label is a number
+    ASSERT_EQ(load("[proxy_all]\n[bypass_list]\n(^|\\.)google\\.\n").is_bypass_host("example.com"), false);
+    ASSERT_EQ(load("[proxy_all]\n[bypass_list]\n(^|\\.)0\\.1$\n").is_bypass_host("example.com"), std::nullopt);
+}
+
+TEST(access_control_list, is_bypass_address) {
+    const access_control_list acl = load("[proxy_all]\n"
+                                         "[bypass_list]\n"
+                                         "10.0.0.0/8\n"
+                                         "fc00::/7\n"
+                                         "(^|\\.)example\\.com$\n"
+                                         "^192\\.0\\.2\\.7$\n"
+                                         "[proxy_list]\n"
+                                         "172.16.0.0/12\n");
+
+    ASSERT_TRUE(acl.is_bypass(asio::ip::make_address("10.0.0.1")));
+    ASSERT_TRUE(acl.is_bypass(asio::ip::make_address("fd00::1")));
+    ASSERT_FALSE(acl.is_bypass(asio::ip::make_address("172.16.0.1")));
+    ASSERT_FALSE(acl.is_bypass(asio::ip::make_address("192.0.2.1")));
+    ASSERT_TRUE(acl.is_bypass(asio::ip::make_address("192.0.2.1"), "www.example.com"));
+
+    // the text of the address is matched against the rules
+    ASSERT_TRUE(acl.is_bypass(asio::ip::make_address("192.0.2.7")));
+}
+
+TEST(access_control_list, is_block_outbound_address) {
+    const access_control_list acl = load("[accept_all]\n"
+                                         "[outbound_block_list]\n"
+                                         "127.0.0.0/8\n"
+                                         "::1/128\n");
+
+    ASSERT_TRUE(acl.is_block_outbound(asio::ip::make_address("127.0.0.1")));
+    ASSERT_TRUE(acl.is_block_outbound(asio::ip::make_address("::1")));
+    ASSERT_FALSE(acl.is_block_outbound(asio::ip::make_address("192.0.2.1")));
+    ASSERT_FALSE(acl.is_block_outbound(asio::ip::make_address("192.0.2.1"), "example.com"));
+}
+
+TEST(access_control_list, image) {
+    const access_control_list acl = load_image("[bypass_all]\n"
+                                               "[proxy_list]\n"
+                                               "10.0.0.0/8\n"
+                                               "fc00::/7\n"
+                                               "(^|\\.)example\\.com$\n"
+                                               "^cdn[0-9]+\\.example\\.org$\n"
+                                               "[outbound_block_list]\n"
+                                               "127.0.0.0/8\n");
+
+    ASSERT_FALSE(acl.is_bypass(asio::ip::make_address("10.0.0.1")));
+    ASSERT_FALSE(acl.is_bypass(asio::ip::make_address("fd00::1")));
+    ASSERT_TRUE(acl.is_bypass(asio::ip::make_address("192.0.2.1")));
+    ASSERT_EQ(acl.is_bypass_host("www.example.com"), false);
+    ASSERT_EQ(acl.is_bypass_host("cdn7.example.org"), false);
+    ASSERT_EQ(acl.is_bypass_host("example.net"), std::nullopt);
+    ASSERT_TRUE(acl.is_block_outbound(asio::ip::make_address("127.0.0.1")));
+}
+
+TEST(access_control_list, image_truncated) {
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "test_access_control_list.acl.bin";
+    load("[proxy_list]\n"
+         "10.0.0.0/8\n")
+        .save_image(path.string());
+
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 8);
+    ASSERT_THROW(access_control_list::from_file(path.string()), std::runtime_error);
+
+    std::filesystem::remove(path);
+}
+
+TEST(access_control_list, profile_report) {
+    access_control_list acl = load("[proxy_all]\n"
+                                   "[bypass_list]\n"
+                                   "10.0.0.0/8\n"
+                                   "(^|\\.)example\\.com$\n"
+                                   "^cdn[0-9]+\\.example\\.org$\n");
+    ASSERT_EQ(acl.profile_report(), "");
+
+    acl.enable_profiling();
+    ASSERT_TRUE(acl.is_bypass(asio::ip::make_address("10.0.0.1")));
+    ASSERT_TRUE(acl.is_bypass(asio::ip::make_address("10.0.0.2")));
+    ASSERT_EQ(acl.is_bypass_host("www.example.com"), true);
+    ASSERT_EQ(acl.is_bypass_host("example.net"), std::nullopt);
+
+    const std::string report = acl.profile_report();
+    ASSERT_NE(report.find("1 of 2 host rules never hit"), std::string::npos);
+    ASSERT_NE(report.find("           2        0.000  [bypass_list] IP ranges\n"), std::string::npos);
+    ASSERT_NE(report.find("           1        0.000  [bypass_list] (^|\\.)example\\.com$\n"), std::string::npos);
+    ASSERT_NE(report.find("           0        0.000  [bypass_list] ^cdn[0-9]+\\.example\\.org$\n"), std::string::npos);
+}
@@ -0,0 +1,70 @@
+#include <optional>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "../src/acl_cache.h"
+
+TEST(acl_cache, find) {
+    acl_cache cache{4};
+
+    ASSERT_EQ(cache.find("example.com"), nullptr);
+
+    cache.insert("example.com", true);
+    cache.insert("example.org", std::nullopt);
+
+    ASSERT_NE(cache.find("example.com"), nullptr);
+    ASSERT_EQ(*cache.find("example.com"), true);
+    ASSERT_EQ(*cache.find("example.org"), std::nullopt);
+
+    const acl_cache::stats stats = cache.get_stats();
+    ASSERT_EQ(stats.hits, 3);
+    ASSERT_EQ(stats.misses, 1);
+}
+
+TEST(acl_cache, evicts_unreferenced) {
+    acl_cache cache{3};
+    cache.insert("a", true);
+    cache.insert("b", true);
+    cache.insert("c", true);
+
+    // a is hit, so b goes first
+    ASSERT_NE(cache.find("a"), nullptr);
+    cache.insert("d", false);
+
+    ASSERT_EQ(cache.size(), 3);
+    ASSERT_NE(cache.find("a"), nullptr);
+    ASSERT_EQ(cache.find("b"), nullptr);
+    ASSERT_NE(cache.find("c"), nullptr);
+    ASSERT_NE(cache.find("d"), nullptr);
+}
+
+TEST(acl_cache, all_referenced) {
+    acl_cache cache{2};
+    cache.insert("a", true);
+    cache.insert("b", true);
+    cache.find("a");
+    cache.find("b");
+
+    // the hand goes round once, and evicts where it started
+    cache.insert("c", true);
+
+    ASSERT_EQ(cache.size(), 2);
+    ASSERT_EQ(cache.find("a"), nullptr);
+    ASSERT_NE(cache.find("b"), nullptr);
+    ASSERT_NE(cache.find("c"), nullptr);
+}
+
+TEST(acl_cache, clear) {
+    acl_cache cache{2};
+    cache.insert("a", true);
+    cache.clear();
+
+    ASSERT_EQ(cache.size(), 0);
+    ASSERT_EQ(cache.find("a"), nullptr);
+
+    cache.insert("b", false);
+    cache.insert("c", false);
+    cache.insert("d", false);
+    ASSERT_EQ(cache.size(), 2);
+}
@@ -0,0 +1,90 @@
+#include <chrono>
+#include <system_error>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "../src/circuit_breaker.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+const asio::ip::tcp::endpoint target{asio::ip::make_address("192.0.2.1"), 443};
+
+void fail(circuit_breaker& breaker, int n, std::error_code error = asio::error::connection_refused) {
+    for (int i = 0; i != n; i++) {
+        breaker.begin(target).failed(error);
+    }
+}
+} // namespace
+
+TEST(circuit_breaker, opens_after_threshold) {
+    circuit_breaker breaker{{.failure_threshold = 3, .cool_down = 1h}};
+
+    fail(breaker, 2);
+    ASSERT_FALSE(breaker.is_open(target));
+
+    fail(breaker, 1);
+    ASSERT_TRUE(breaker.is_open(target));
+    ASSERT_THROW(breaker.begin(target), std::system_error);
+
+    // other destinations are unaffected
+    const asio::ip::tcp::endpoint other{target.address(), 80};
+    ASSERT_NO_THROW(breaker.begin(other).succeeded());
+}
+
+TEST(circuit_breaker, success_resets) {
+    circuit_breaker breaker{{.failure_threshold = 3, .cool_down = 1h}};
+
+    fail(breaker, 2);
+    breaker.begin(target).succeeded();
+    ASSERT_EQ(breaker.size(), 0);
+
+    fail(breaker, 2);
+    ASSERT_FALSE(breaker.is_open(target));
+}
+
+TEST(circuit_breaker, ignores_local_errors) {
+    circuit_breaker breaker{{.failure_threshold = 1, .cool_down = 1h}};
+
+    fail(breaker, 10, asio::error::operation_aborted);
+    fail(breaker, 10, asio::error::connection_aborted);
+    ASSERT_FALSE(breaker.is_open(target));
+}
+
+TEST(circuit_breaker, half_open) {
+    circuit_breaker breaker{{.failure_threshold = 1, .cool_down = 10ms}};
+
+    fail(breaker, 1);
+    ASSERT_THROW(breaker.begin(target), std::system_error);
+
+    std::this_thread::sleep_for(20ms);
+
+    {
+        // a single probe is let through
+        auto probe = breaker.begin(target);
+        ASSERT_THROW(breaker.begin(target), std::system_error);
+
+        // the probe is abandoned without an outcome
+    }
+
+    auto probe = breaker.begin(target);
+    probe.failed(asio::error::timed_out);
+    ASSERT_THROW(breaker.begin(target), std::system_error);
+
+    std::this_thread::sleep_for(20ms);
+
+    breaker.begin(target).succeeded();
+    ASSERT_FALSE(breaker.is_open(target));
+    ASSERT_NO_THROW(breaker.begin(target));
+}
+
+TEST(circuit_breaker, bounded) {
+    circuit_breaker breaker{{.failure_threshold = 1, .cool_down = 1h, .max_entries = 32}};
+
+    for (std::uint16_t port = 1; port <= 1000; port++) {
+        breaker.begin({target.address(), port}).failed(asio::error::connection_refused);
+    }
+
+    ASSERT_LE(breaker.size(), 32);
+}
@@ -0,0 +1,100 @@
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/io_context.hpp>
+#include <asio/redirect_error.hpp>
+#include <asio/use_awaitable.hpp>
+#include <gtest/gtest.h>
+
+#include "../src/awaitable.h"
+#include "../src/dns_message.h"
+#include "../src/tcp.h"
+#include "run_until.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+// free_port returns a port of the loopback address nobody listens on.
+std::uint16_t free_port() {
+    asio::io_context ctx;
+    tcp_acceptor acceptor{ctx, {asio::ip::make_address("127.0.0.1"), 0}};
+    return acceptor.local_endpoint().port();
+}
+
+// lan_address returns the address of the interface of the default route, if there is one.
+asio::ip::address lan_address() {
+    asio::io_context ctx;
+    asio::ip::udp::socket socket{ctx};
+
+    // connecting a UDP socket only chooses the route, nothing is sent
+    std::error_code ec;
+    socket.connect({asio::ip::make_address("8.8.8.8"), 53}, ec);
+    if (ec) {
+        return {};
+    }
+
+    return socket.local_endpoint().address();
+}
+} // namespace
+
+TEST(tcp_local, dns_forwarder_on_lan_address) {
+    const asio::ip::address address = lan_address();
+    if (address.is_unspecified() || address.is_loopback()) {
+        GTEST_SKIP() << "no non-loopback interface";
+    }
+
+    const std::uint16_t dns_port = free_port();
+
+    // ss-remote is down, so the query is answered with SERVFAIL
+    config conf{.mode = config::running_mode::local};
+    conf.method = "chacha20-ietf-poly1305";
+    conf.remote_host = "127.0.0.1";
+    conf.remote_port = std::to_string(free_port());
+    conf.local_port = std::to_string(free_port());
+    conf.password = "password";
+    conf.dns_servers = {"127.0.0.1"};
+    conf.dns_local_port = std::to_string(dns_port);
+    conf.dns_local_address = address.to_string();
+    conf.connect_timeout = 1;
+
+    asio::io_context ctx;
+    asio::co_spawn(ctx, tcp_local(conf), asio::detached);
+
+    const std::vector<std::uint8_t> query = *dns::make_query(0x1234, "example.com", dns::record_type::a);
+    std::vector<std::uint8_t> response;
+    bool done = false;
+
+    auto ask = [&]() -> asio::awaitable<void> {
+        // the forwarder listens once ss-local has resolved ss-remote, and its TCP port opens last
+        steady_timer timer{co_await asio::this_coro::executor};
+        while (true) {
+            tcp_socket probe{co_await asio::this_coro::executor};
+            std::error_code ec;
+            co_await probe.async_connect({address, dns_port}, asio::redirect_error(asio::use_awaitable, ec));
+            if (!ec) {
+                break;
+            }
+
+            timer.expires_after(10ms);
+            co_await timer.async_wait();
+        }
+
+        udp_socket socket{co_await asio::this_coro::executor, {address, 0}};
+        co_await socket.async_send_to(asio::buffer(query), {address, dns_port});
+
+        std::array<std::uint8_t, 512> buf;
+        const std::size_t n = co_await socket.async_receive(asio::buffer(buf));
+        response.assign(buf.begin(), buf.begin() + n);
+    };
+
+    asio::co_spawn(ctx, ask, [&done](std::exception_ptr) { done = true; });
+    run_until(ctx, done);
+
+    ASSERT_TRUE(dns::is_response_to(response, query));
+}
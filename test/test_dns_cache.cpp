@@ -0,0 +1,197 @@
+#include <chrono>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/io_context.hpp>
+#include <asio/strand.hpp>
+#include <gtest/gtest.h>
+
+#include "../src/dns_cache.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+const asio::ip::address first = asio::ip::make_address("192.0.2.1");
+const asio::ip::address second = asio::ip::make_address("192.0.2.2");
+
+// fake_lookup answers with address after delay, and counts the lookups.
+struct fake_lookup {
+    asio::ip::address address = first;
+    std::error_code error;
+    dns_cache::clock::duration ttl = 1h;
+    dns_cache::clock::duration delay = 0ms;
+    int lookups = 0;
+
+    dns_cache::lookup_function function() {
+        return [this](std::string) -> asio::awaitable<dns_cache::answer> {
+            lookups++;
+
+            if (delay > 0ms) {
+                steady_timer timer{co_await asio::this_coro::executor, delay};
+                co_await timer.async_wait();
+            }
+
+            if (error) {
+                throw std::system_error{error};
+            }
+
+            co_return dns_cache::answer{.addresses = {address}, .ttl = ttl};
+        };
+    }
+};
+
+// resolve runs a query to completion, and returns its addresses or error.
+std::vector<asio::ip::address> resolve(asio::io_context& ctx, dns_cache& dns, std::error_code& error) {
+    std::vector<asio::ip::address> addresses;
+
+    asio::co_spawn(asio::make_strand(ctx), [&]() -> asio::awaitable<void> {
+        try {
+            addresses = co_await dns.resolve("example.com");
+        } catch (const std::system_error& e) {
+            error = e.code();
+        }
+    }, asio::detached);
+
+    ctx.restart();
+    ctx.run();
+
+    return addresses;
+}
+
+std::vector<asio::ip::address> resolve(asio::io_context& ctx, dns_cache& dns) {
+    std::error_code error;
+    auto addresses = resolve(ctx, dns, error);
+    EXPECT_FALSE(error);
+
+    return addresses;
+}
+
+void sleep(asio::io_context& ctx, dns_cache::clock::duration d) {
+    asio::steady_timer timer{ctx, d};
+    timer.wait();
+}
+} // namespace
+
+TEST(dns_cache, caches_for_ttl) {
+    asio::io_context ctx;
+    fake_lookup lookup{.ttl = 20ms};
+    auto dns = std::make_shared<dns_cache>(lookup.function(), dns_cache::options{.min_ttl = 0ms, .stale_ttl = 0ms});
+
+    ASSERT_EQ(resolve(ctx, *dns), std::vector{first});
+    ASSERT_EQ(resolve(ctx, *dns), std::vector{first});
+    ASSERT_EQ(lookup.lookups, 1);
+
+    sleep(ctx, 30ms);
+    lookup.address = second;
+
+    ASSERT_EQ(resolve(ctx, *dns), std::vector{second});
+    ASSERT_EQ(lookup.lookups, 2);
+
+    const dns_cache::stats stats = dns->get_stats();
+    ASSERT_EQ(stats.hits, 1);
+    ASSERT_EQ(stats.misses, 2);
+    ASSERT_EQ(stats.lookups, 2);
+}
+
+TEST(dns_cache, clamps_ttl) {
+    asio::io_context ctx;
+    fake_lookup lookup{.ttl = 0ms};
+    auto dns = std::make_shared<dns_cache>(lookup.function(), dns_cache::options{.min_ttl = 1h});
+
+    resolve(ctx, *dns);
+    resolve(ctx, *dns);
+    ASSERT_EQ(lookup.lookups, 1);
+}
+
+TEST(dns_cache, coalesces_queries) {
+    asio::io_context ctx;
+    fake_lookup lookup{.delay = 20ms};
+    auto dns = std::make_shared<dns_cache>(lookup.function());
+
+    constexpr int queries = 10;
+    int resolved = 0;
+
+    for (int i = 0; i != queries; i++) {
+        asio::co_spawn(asio::make_strand(ctx), [&]() -> asio::awaitable<void> {
+            const std::vector<asio::ip::address> addresses = co_await dns->resolve("example.com");
+            if (addresses.size() == 1 && addresses.front() == first) {
+                resolved++;
+            }
+        }, asio::detached);
+    }
+
+    ctx.run();
+
+    ASSERT_EQ(resolved, queries);
+    ASSERT_EQ(lookup.lookups, 1);
+    ASSERT_EQ(dns->get_stats().coalesced, queries - 1);
+}
+
+TEST(dns_cache, caches_negative_answers) {
+    asio::io_context ctx;
+    fake_lookup lookup{.error = asio::error::host_not_found};
+    auto dns = std::make_shared<dns_cache>(lookup.function(), dns_cache::options{.negative_ttl = 1h});
+
+    std::error_code error;
+    resolve(ctx, *dns, error);
+    ASSERT_EQ(error, asio::error::host_not_found);
+
+    error.clear();
+    resolve(ctx, *dns, error);
+    ASSERT_EQ(error, asio::error::host_not_found);
+
+    ASSERT_EQ(lookup.lookups, 1);
+    ASSERT_EQ(dns->get_stats().negative_hits, 1);
+    ASSERT_EQ(dns->get_stats().lookup_failures, 1);
+}
+
+TEST(dns_cache, serves_stale_while_revalidating) {
+    asio::io_context ctx;
+    fake_lookup lookup{.ttl = 10ms};
+    auto dns = std::make_shared<dns_cache>(lookup.function(), dns_cache::options{.min_ttl = 0ms, .stale_ttl = 1h});
+
+    resolve(ctx, *dns);
+    sleep(ctx, 20ms);
+
+    // the stale answer is served, and refreshed in the background
+    lookup.address = second;
+    ASSERT_EQ(resolve(ctx, *dns), std::vector{first});
+    ASSERT_EQ(lookup.lookups, 2);
+
+    ASSERT_EQ(resolve(ctx, *dns), std::vector{second});
+    ASSERT_EQ(dns->get_stats().stale_hits, 1);
+}
+
+TEST(dns_cache, keeps_stale_answer_on_failure) {
+    asio::io_context ctx;
+    fake_lookup lookup{.ttl = 10ms};
+    auto dns = std::make_shared<dns_cache>(lookup.function(), dns_cache::options{.min_ttl = 0ms, .stale_ttl = 1h});
+
+    resolve(ctx, *dns);
+    sleep(ctx, 20ms);
+
+    lookup.error = asio::error::host_not_found_try_again;
+    ASSERT_EQ(resolve(ctx, *dns), std::vector{first});
+    ASSERT_EQ(resolve(ctx, *dns), std::vector{first});
+}
+
+TEST(dns_cache, bounds_entries) {
+    asio::io_context ctx;
+    fake_lookup lookup;
+    auto dns = std::make_shared<dns_cache>(lookup.function(), dns_cache::options{.max_entries = 16});
+
+    for (int i = 0; i != 1000; i++) {
+        asio::co_spawn(ctx, [&, i]() -> asio::awaitable<void> {
+            co_await dns->resolve(std::to_string(i));
+        }, asio::detached);
+    }
+
+    ctx.run();
+
+    ASSERT_EQ(lookup.lookups, 1000);
+    ASSERT_LE(dns->size(), 16);
+}
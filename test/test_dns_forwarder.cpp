@@ -0,0 +1,213 @@
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/io_context.hpp>
+#include <asio/strand.hpp>
+#include <gtest/gtest.h>
+
+#include "../src/dns_forwarder.h"
+#include "../src/dns_message.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+std::shared_ptr<const live_acl> load(std::string_view content) {
+    std::istringstream in{std::string{content}};
+    return std::make_shared<const live_acl>(std::make_shared<const access_control_list>(access_control_list::from_stream(in)));
+}
+
+// respond returns a response to query with an A record of ttl, or no records if rcode isn't NOERROR.
+std::vector<std::uint8_t> respond(const std::vector<std::uint8_t>& query, std::uint32_t ttl, std::uint8_t rcode = 0) {
+    const dns::message_info info = *dns::inspect(query);
+
+    std::vector<std::uint8_t> response(query.begin(), query.begin() + info.question_end);
+    response[2] = 0x81;
+    response[3] = 0x80 | rcode;
+    response[7] = rcode == 0 ? 1 : 0;
+    response[9] = 0;
+    response[11] = 0;
+
+    if (rcode == 0) {
+        const std::uint8_t record[] = {
+            0xc0, 0x0c,                  // name, pointing to the question
+            0x00, 0x01, 0x00, 0x01,      // type A, class IN
+            static_cast<std::uint8_t>(ttl >> 24),
+            static_cast<std::uint8_t>(ttl >> 16),
+            static_cast<std::uint8_t>(ttl >> 8),
+            static_cast<std::uint8_t>(ttl),
+            0x00, 0x04, 192, 0, 2, 1,    // RDLEN and address
+        };
+
+        response.insert(response.end(), std::begin(record), std::end(record));
+    }
+
+    return response;
+}
+
+// fake_upstream answers queries with respond, or fails, and counts the queries.
+struct fake_upstream {
+    std::uint32_t ttl = 300;
+    std::uint8_t rcode = 0;
+    bool fail = false;
+    int queries = 0;
+
+    dns_forwarder::exchange_function function() {
+        return [this](std::vector<std::uint8_t> query) -> asio::awaitable<std::vector<std::uint8_t>> {
+            queries++;
+
+            if (fail) {
+                throw std::system_error{asio::error::timed_out};
+            }
+
+            co_return respond(query, ttl, rcode);
+        };
+    }
+};
+
+std::vector<std::uint8_t> query(std::uint16_t id, std::string_view name) {
+    return *dns::make_query(id, name, dns::record_type::a);
+}
+
+// answer runs a query to completion, and returns the response.
+std::vector<std::uint8_t> answer(asio::io_context& ctx, dns_forwarder& forwarder, const std::vector<std::uint8_t>& q) {
+    std::vector<std::uint8_t> response;
+
+    asio::co_spawn(asio::make_strand(ctx), [&]() -> asio::awaitable<void> {
+        response = co_await forwarder.answer(q);
+    }, asio::detached);
+
+    ctx.restart();
+    ctx.run();
+
+    return response;
+}
+
+std::uint32_t first_ttl(const std::vector<std::uint8_t>& response) {
+    const dns::message_info info = *dns::inspect(response);
+    const std::size_t offset = info.ttl_offsets.front();
+
+    return static_cast<std::uint32_t>(response[offset] << 24 | response[offset + 1] << 16 | response[offset + 2] << 8 | response[offset + 3]);
+}
+} // namespace
+
+TEST(dns_forwarder, caches_for_ttl) {
+    asio::io_context ctx;
+    fake_upstream direct;
+    fake_upstream tunnel;
+    auto forwarder = std::make_shared<dns_forwarder>(nullptr, direct.function(), tunnel.function());
+
+    const std::vector<std::uint8_t> first = answer(ctx, *forwarder, query(1, "example.com"));
+    ASSERT_EQ(tunnel.queries, 1);
+    ASSERT_EQ(first_ttl(first), 300);
+
+    std::this_thread::sleep_for(1100ms);
+
+    // served from the cache, for the ID and the case of the name of the client
+    const std::vector<std::uint8_t> q = query(2, "Example.COM");
+    const std::vector<std::uint8_t> second = answer(ctx, *forwarder, q);
+    ASSERT_EQ(tunnel.queries, 1);
+    ASSERT_TRUE(dns::is_response_to(second, q));
+    ASSERT_EQ(dns::parse_response(second, q)->addresses, std::vector{asio::ip::make_address("192.0.2.1")});
+    ASSERT_EQ(first_ttl(second), 299);
+
+    const dns_forwarder::stats stats = forwarder->get_stats();
+    ASSERT_EQ(stats.hits, 1);
+    ASSERT_EQ(stats.misses, 1);
+    ASSERT_EQ(forwarder->size(), 1);
+}
+
+TEST(dns_forwarder, expires) {
+    asio::io_context ctx;
+    fake_upstream direct;
+    fake_upstream tunnel;
+    tunnel.ttl = 1;
+    auto forwarder = std::make_shared<dns_forwarder>(nullptr, direct.function(), tunnel.function());
+
+    answer(ctx, *forwarder, query(1, "example.com"));
+    std::this_thread::sleep_for(1100ms);
+    answer(ctx, *forwarder, query(2, "example.com"));
+
+    ASSERT_EQ(tunnel.queries, 2);
+}
+
+TEST(dns_forwarder, caches_negative_responses) {
+    asio::io_context ctx;
+    fake_upstream direct;
+    fake_upstream tunnel;
+    tunnel.rcode = static_cast<std::uint8_t>(dns::rcode::name_error);
+    auto forwarder = std::make_shared<dns_forwarder>(nullptr, direct.function(), tunnel.function());
+
+    answer(ctx, *forwarder, query(1, "nonexistent.example"));
+    const std::vector<std::uint8_t> response = answer(ctx, *forwarder, query(2, "nonexistent.example"));
+
+    ASSERT_EQ(tunnel.queries, 1);
+    ASSERT_EQ(dns::inspect(response)->code, dns::rcode::name_error);
+}
+
+TEST(dns_forwarder, routes_by_acl) {
+    asio::io_context ctx;
+    fake_upstream direct;
+    fake_upstream tunnel;
+    auto forwarder = std::make_shared<dns_forwarder>(load("[proxy_all]\n"
+                                                          "[bypass_list]\n"
+                                                          "(^|\\.)example\\.org$\n"),
+                                                     direct.function(),
+                                                     tunnel.function());
+
+    answer(ctx, *forwarder, query(1, "www.example.org"));
+    ASSERT_EQ(direct.queries, 1);
+    ASSERT_EQ(tunnel.queries, 0);
+
+    answer(ctx, *forwarder, query(2, "www.example.com"));
+    ASSERT_EQ(direct.queries, 1);
+    ASSERT_EQ(tunnel.queries, 1);
+}
+
+TEST(dns_forwarder, server_failure) {
+    asio::io_context ctx;
+    fake_upstream direct;
+    fake_upstream tunnel;
+    tunnel.fail = true;
+    auto forwarder = std::make_shared<dns_forwarder>(nullptr, direct.function(), tunnel.function());
+
+    const std::vector<std::uint8_t> q = query(1, "example.com");
+    const std::vector<std::uint8_t> response = answer(ctx, *forwarder, q);
+
+    ASSERT_TRUE(dns::is_response_to(response, q));
+    ASSERT_EQ(dns::inspect(response)->code, dns::rcode::server_failure);
+
+    // failures aren't cached
+    answer(ctx, *forwarder, q);
+    ASSERT_EQ(tunnel.queries, 2);
+    ASSERT_EQ(forwarder->get_stats().failures, 2);
+}
+
+TEST(dns_forwarder, ignores_malformed_queries) {
+    asio::io_context ctx;
+    fake_upstream direct;
+    fake_upstream tunnel;
+    auto forwarder = std::make_shared<dns_forwarder>(nullptr, direct.function(), tunnel.function());
+
+    ASSERT_TRUE(answer(ctx, *forwarder, {0x00, 0x01, 0x01}).empty());
+    ASSERT_EQ(tunnel.queries, 0);
+}
+
+TEST(dns_message, make_empty_response) {
+    const std::vector<std::uint8_t> q = query(7, "example.com");
+    const std::vector<std::uint8_t> response = dns::make_empty_response(respond(q, 300), dns::inspect(q)->question_end, dns::rcode::no_error, true);
+
+    const dns::message_info info = *dns::inspect(response);
+    ASSERT_TRUE(dns::is_response_to(response, q));
+    ASSERT_TRUE(info.truncated);
+    ASSERT_EQ(info.answer_count, 0);
+    ASSERT_TRUE(info.ttl_offsets.empty());
+}
@@ -0,0 +1,360 @@
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/io_context.hpp>
+#include <asio/read.hpp>
+#include <asio/strand.hpp>
+#include <asio/write.hpp>
+#include <gtest/gtest.h>
+
+#include "../src/dns_message.h"
+#include "../src/dns_resolver.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+// fake_server answers the queries it receives on a UDP and a TCP socket with the same port.
+class fake_server {
+public:
+    explicit fake_server(asio::io_context& ctx)
+        : udp(ctx, asio::ip::udp::endpoint{asio::ip::make_address("127.0.0.1"), 0}),
+          tcp(ctx, asio::ip::tcp::endpoint{asio::ip::make_address("127.0.0.1"), udp.local_endpoint().port()}) {
+        asio::co_spawn(ctx, serve_udp(), asio::detached);
+        asio::co_spawn(ctx, serve_tcp(), asio::detached);
+    }
+
+    asio::ip::udp::endpoint endpoint() const {
+        return udp.local_endpoint();
+    }
+
+    std::map<std::string, std::vector<asio::ip::address>> records;
+    std::uint32_t ttl = 300;
+    int drop = 0;          // number of queries to drop
+    bool truncate = false; // truncate UDP responses
+    int udp_queries = 0;
+    int tcp_queries = 0;
+
+private:
+    std::vector<std::uint8_t> respond(std::span<const std::uint8_t> query, bool over_udp) {
+        // the question: name and type
+        std::size_t offset = 12;
+        std::string name;
+        while (query[offset] != 0) {
+            if (!name.empty()) {
+                name += '.';
+            }
+
+            name.append(reinterpret_cast<const char*>(&query[offset + 1]), query[offset]);
+            offset += 1 + query[offset];
+        }
+
+        const std::size_t question_end = offset + 5;
+        const std::uint16_t type = static_cast<std::uint16_t>(query[offset + 1] << 8 | query[offset + 2]);
+
+        std::vector<asio::ip::address> answers;
+        if (auto it = records.find(name); it != records.end()) {
+            for (const asio::ip::address& addr : it->second) {
+                if (addr.is_v4() == (type == static_cast<std::uint16_t>(dns::record_type::a))) {
+                    answers.push_back(addr);
+                }
+            }
+        }
+
+        const bool truncated = over_udp && truncate;
+        if (truncated) {
+            answers.clear();
+        }
+
+        const std::uint8_t rcode = records.contains(name) ? 0 : 3;
+
+        std::vector<std::uint8_t> response(query.begin(), query.begin() + question_end);
+        response[2] = 0x81 | (truncated ? 0x02 : 0x00);
+        response[3] = 0x80 | rcode;
+        response[6] = 0;
+        response[7] = static_cast<std::uint8_t>(answers.size());
+        response[10] = 0;
+        response[11] = 0;
+
+        for (const asio::ip::address& addr : answers) {
+            const std::vector<std::uint8_t> header{
+                0xc0, 0x0c,
+                static_cast<std::uint8_t>(type >> 8), static_cast<std::uint8_t>(type),
+                0x00, 0x01,
+                static_cast<std::uint8_t>(ttl >> 24), static_cast<std::uint8_t>(ttl >> 16),
+                static_cast<std::uint8_t>(ttl >> 8), static_cast<std::uint8_t>(ttl),
+                0x00, static_cast<std::uint8_t>(addr.is_v4() ? 4 : 16),
+            };
+            response.insert(response.end(), header.begin(), header.end());
+
+            if (addr.is_v4()) {
+                const auto bytes = addr.to_v4().to_bytes();
+                response.insert(response.end(), bytes.begin(), bytes.end());
+            } else {
+                const auto bytes = addr.to_v6().to_bytes();
+                response.insert(response.end(), bytes.begin(), bytes.end());
+            }
+        }
+
+        return response;
+    }
+
+    asio::awaitable<void> serve_udp() {
+        std::array<std::uint8_t, 512> buffer;
+
+        while (true) {
+            asio::ip::udp::endpoint peer;
+            const std::size_t n = co_await udp.async_receive_from(asio::buffer(buffer), peer);
+            udp_queries++;
+
+            if (drop > 0) {
+                drop--;
+                continue;
+            }
+
+            co_await udp.async_send_to(asio::buffer(respond(std::span{buffer.data(), n}, true)), peer);
+        }
+    }
+
+    asio::awaitable<void> serve_tcp() {
+        while (true) {
+            tcp_socket socket = co_await tcp.async_accept();
+            tcp_queries++;
+
+            std::array<std::uint8_t, 2> length;
+            co_await asio::async_read(socket, asio::buffer(length));
+
+            std::vector<std::uint8_t> query(length[0] << 8 | length[1]);
+            co_await asio::async_read(socket, asio::buffer(query));
+
+            const std::vector<std::uint8_t> response = respond(query, false);
+            length = {static_cast<std::uint8_t>(response.size() >> 8), static_cast<std::uint8_t>(response.size())};
+            co_await asio::async_write(socket, asio::buffer(length));
+            co_await asio::async_write(socket, asio::buffer(response));
+        }
+    }
+
+    udp_socket udp;
+    tcp_acceptor tcp;
+};
+
+const asio::ip::address v4 = asio::ip::make_address("192.0.2.1");
+const asio::ip::address v6 = asio::ip::make_address("2001:db8::1");
+
+// resolve runs a query to completion, and returns its answer or error.
+std::optional<dns_cache::answer> resolve(asio::io_context& ctx, const dns_resolver& resolver, const std::string& host, std::error_code& error) {
+    std::optional<dns_cache::answer> answer;
+    error.clear();
+
+    asio::co_spawn(asio::make_strand(ctx), [&]() -> asio::awaitable<void> {
+        try {
+            answer = co_await resolver.resolve(host);
+        } catch (const std::system_error& e) {
+            error = e.code();
+        }
+
+        // the fake servers keep running
+        ctx.stop();
+    }, asio::detached);
+
+    ctx.restart();
+    ctx.run();
+
+    return answer;
+}
+
+dns_resolver::options options_for(const fake_server& server) {
+    return {.servers = {server.endpoint()}, .timeout = 200ms, .attempts = 2, .hosts = {}};
+}
+} // namespace
+
+TEST(dns_message, make_query) {
+    ASSERT_TRUE(dns::make_query(1, "example.com", dns::record_type::a));
+    ASSERT_TRUE(dns::make_query(1, "example.com.", dns::record_type::a));
+
+    ASSERT_FALSE(dns::make_query(1, "", dns::record_type::a));
+    ASSERT_FALSE(dns::make_query(1, "example..com", dns::record_type::a));
+    ASSERT_FALSE(dns::make_query(1, std::string(64, 'a') + ".com", dns::record_type::a));
+    ASSERT_FALSE(dns::make_query(1, std::string(300, 'a'), dns::record_type::a));
+}
+
+TEST(dns_message, rejects_unrelated_responses) {
+    const std::vector<std::uint8_t> query = *dns::make_query(1, "example.com", dns::record_type::a);
+    const std::vector<std::uint8_t> other = *dns::make_query(2, "example.com", dns::record_type::a);
+    const std::vector<std::uint8_t> other_name = *dns::make_query(1, "example.org", dns::record_type::a);
+
+    // a query is not a response
+    ASSERT_FALSE(dns::parse_response(query, query));
+
+    std::vector<std::uint8_t> response = other;
+    response[2] |= 0x80;
+    ASSERT_FALSE(dns::parse_response(response, query));
+
+    response = other_name;
+    response[2] |= 0x80;
+    ASSERT_FALSE(dns::parse_response(response, query));
+
+    response = query;
+    response[2] |= 0x80;
+    ASSERT_TRUE(dns::parse_response(response, query));
+
+    // truncated messages
+    ASSERT_FALSE(dns::parse_response(std::span{response}.first(20), query));
+}
+
+TEST(dns_resolver, resolves_a_and_aaaa) {
+    asio::io_context ctx;
+    fake_server server{ctx};
+    server.records["example.com"] = {v4, v6};
+    server.ttl = 120;
+
+    dns_resolver resolver{options_for(server)};
+
+    std::error_code error;
+    auto answer = resolve(ctx, resolver, "Example.COM", error);
+
+    ASSERT_FALSE(error);
+    ASSERT_EQ(answer->addresses, (std::vector{v4, v6}));
+    ASSERT_EQ(answer->ttl, 120s);
+}
+
+TEST(dns_resolver, name_error) {
+    asio::io_context ctx;
+    fake_server server{ctx};
+
+    dns_resolver resolver{options_for(server)};
+
+    std::error_code error;
+    resolve(ctx, resolver, "nonexistent.example", error);
+
+    ASSERT_EQ(error, asio::error::host_not_found);
+}
+
+TEST(dns_resolver, no_data) {
+    asio::io_context ctx;
+    fake_server server{ctx};
+    server.records["example.com"] = {};
+
+    dns_resolver resolver{options_for(server)};
+
+    std::error_code error;
+    resolve(ctx, resolver, "example.com", error);
+
+    ASSERT_EQ(error, asio::error::no_data);
+}
+
+TEST(dns_resolver, retries_after_timeout) {
+    asio::io_context ctx;
+    fake_server server{ctx};
+    server.records["example.com"] = {v4};
+    server.drop = 2;
+
+    dns_resolver resolver{options_for(server)};
+
+    std::error_code error;
+    auto answer = resolve(ctx, resolver, "example.com", error);
+
+    ASSERT_FALSE(error);
+    ASSERT_EQ(answer->addresses, std::vector{v4});
+    ASSERT_EQ(server.udp_queries, 4);
+}
+
+TEST(dns_resolver, times_out) {
+    asio::io_context ctx;
+    fake_server server{ctx};
+    server.records["example.com"] = {v4};
+    server.drop = 100;
+
+    dns_resolver resolver{options_for(server)};
+
+    std::error_code error;
+    resolve(ctx, resolver, "example.com", error);
+
+    ASSERT_EQ(error, asio::error::timed_out);
+}
+
+TEST(dns_resolver, falls_back_to_tcp) {
+    asio::io_context ctx;
+    fake_server server{ctx};
+    server.records["example.com"] = {v4, v6};
+    server.truncate = true;
+
+    dns_resolver resolver{options_for(server)};
+
+    std::error_code error;
+    auto answer = resolve(ctx, resolver, "example.com", error);
+
+    ASSERT_FALSE(error);
+    ASSERT_EQ(answer->addresses, (std::vector{v4, v6}));
+    ASSERT_EQ(server.tcp_queries, 2);
+}
+
+TEST(dns_resolver, tries_next_server) {
+    asio::io_context ctx;
+    fake_server dead{ctx};
+    dead.drop = 100;
+
+    fake_server server{ctx};
+    server.records["example.com"] = {v4};
+
+    dns_resolver resolver{{.servers = {dead.endpoint(), server.endpoint()}, .timeout = 100ms, .attempts = 1, .hosts = {}}};
+
+    std::error_code error;
+    auto answer = resolve(ctx, resolver, "example.com", error);
+
+    ASSERT_FALSE(error);
+    ASSERT_EQ(answer->addresses, std::vector{v4});
+}
+
+TEST(dns_resolver, skips_literals_and_hosts) {
+    asio::io_context ctx;
+
+    dns_resolver::options opts;
+    dns_resolver::parse_hosts("127.0.0.1 localhost\n::1 localhost ip6-localhost # comment\n", opts);
+    dns_resolver resolver{opts};
+
+    std::error_code error;
+    auto answer = resolve(ctx, resolver, "LOCALHOST", error);
+    ASSERT_FALSE(error);
+    ASSERT_EQ(answer->addresses, (std::vector{asio::ip::make_address("127.0.0.1"), asio::ip::make_address("::1")}));
+
+    answer = resolve(ctx, resolver, "2001:db8::1", error);
+    ASSERT_FALSE(error);
+    ASSERT_EQ(answer->addresses, std::vector{v6});
+
+    // no name servers to ask
+    resolve(ctx, resolver, "example.com", error);
+    ASSERT_TRUE(error);
+}
+
+TEST(dns_resolver, parse_resolv_conf) {
+    dns_resolver::options opts;
+    dns_resolver::parse_resolv_conf("# comment\n"
+                                    "search example.com\n"
+                                    "nameserver 192.0.2.53\n"
+                                    "nameserver 2001:db8::53 ; comment\n"
+                                    "nameserver bogus\n"
+                                    "options ndots:1 timeout:3 attempts:4\n",
+                                    opts);
+
+    ASSERT_EQ(opts.servers.size(), 2);
+    ASSERT_EQ(opts.servers[0], (asio::ip::udp::endpoint{asio::ip::make_address("192.0.2.53"), 53}));
+    ASSERT_EQ(opts.servers[1], (asio::ip::udp::endpoint{asio::ip::make_address("2001:db8::53"), 53}));
+    ASSERT_EQ(opts.timeout, 3s);
+    ASSERT_EQ(opts.attempts, 4);
+}
+
+TEST(dns_resolver, parse_server) {
+    ASSERT_EQ(dns_resolver::parse_server("192.0.2.53"), (asio::ip::udp::endpoint{asio::ip::make_address("192.0.2.53"), 53}));
+    ASSERT_EQ(dns_resolver::parse_server("192.0.2.53:5353"), (asio::ip::udp::endpoint{asio::ip::make_address("192.0.2.53"), 5353}));
+    ASSERT_EQ(dns_resolver::parse_server("2001:db8::53"), (asio::ip::udp::endpoint{asio::ip::make_address("2001:db8::53"), 53}));
+    ASSERT_EQ(dns_resolver::parse_server("[2001:db8::53]:5353"), (asio::ip::udp::endpoint{asio::ip::make_address("2001:db8::53"), 5353}));
+    ASSERT_THROW(dns_resolver::parse_server("bogus"), std::system_error);
+}
@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../src/domain_set.h"
+
+TEST(domain_set, parse_rule) {
+    std::optional<domain_set::rule> rule = domain_set::parse_rule(R"((^|\.)example\.com$)");
+    ASSERT_TRUE(rule);
+    ASSERT_EQ(rule->domain, "example.com");
+    ASSERT_TRUE(rule->subdomains);
+
+    rule = domain_set::parse_rule(R"(^my-host_1\.example\.org$)");
+    ASSERT_TRUE(rule);
+    ASSERT_EQ(rule->domain, "my-host_1.example.org");
+    ASSERT_FALSE(rule->subdomains);
+
+    std::string_view regexes[] = {
+        R"((^|\.)example\.com)",
+        R"(example\.com$)",
+        R"(^example.com$)",
+        R"(^cdn[0-9]+\.example\.com$)",
+        R"((^|\.)\.com$)",
+        R"(^$)",
+        R"((^|\.)(a|b)\.com$)",
+    };
+
+    for (auto re : regexes) {
+        ASSERT_FALSE(domain_set::parse_rule(re)) << re;
+    }
+}
+
+TEST(domain_set, contains) {
+    domain_set set;
+    ASSERT_TRUE(set.empty());
+
+    set.insert("example.com", true);
+    set.insert("host.example.org", false);
+    set.insert("co.uk", false);
+    ASSERT_FALSE(set.empty());
+
+    ASSERT_TRUE(set.contains("example.com"));
+    ASSERT_TRUE(set.contains("www.example.com"));
+    ASSERT_TRUE(set.contains("a.b.example.com"));
+    ASSERT_TRUE(set.contains(".example.com"));
+    ASSERT_FALSE(set.contains("badexample.com"));
+    ASSERT_FALSE(set.contains("example.com.cn"));
+    ASSERT_FALSE(set.contains("example.com."));
+    ASSERT_FALSE(set.contains("com"));
+
+    ASSERT_TRUE(set.contains("host.example.org"));
+    ASSERT_FALSE(set.contains("www.host.example.org"));
+    ASSERT_FALSE(set.contains("example.org"));
+
+    ASSERT_TRUE(set.contains("co.uk"));
+    ASSERT_FALSE(set.contains("example.co.uk"));
+    ASSERT_FALSE(set.contains(""));
+}
+
+TEST(domain_set, domain_and_subdomains) {
+    domain_set set;
+    set.insert("example.com", false);
+    set.insert("mail.example.com", true);
+
+    ASSERT_TRUE(set.contains("example.com"));
+    ASSERT_FALSE(set.contains("www.example.com"));
+    ASSERT_TRUE(set.contains("mail.example.com"));
+    ASSERT_TRUE(set.contains("imap.mail.example.com"));
+
+    // a shorter suffix covers the longer one
+    set.insert("example.com", true);
+    ASSERT_TRUE(set.contains("www.example.com"));
+}
+
+TEST(domain_set, save_load) {
+    domain_set set;
+    for (int i = 0; i != 1000; i++) {
+        set.insert("host" + std::to_string(i) + ".example.com", i % 2 == 0);
+    }
+
+    binary_image::writer out;
+    set.save(out);
+
+    domain_set loaded;
+    binary_image::reader in{out.bytes()};
+    loaded.load(in);
+
+    ASSERT_TRUE(loaded.contains("host0.example.com"));
+    ASSERT_TRUE(loaded.contains("www.host0.example.com"));
+    ASSERT_TRUE(loaded.contains("host999.example.com"));
+    ASSERT_FALSE(loaded.contains("www.host999.example.com"));
+    ASSERT_FALSE(loaded.contains("example.com"));
+
+    // inserting copies the mapped table first
+    loaded.insert("example.org", false);
+    ASSERT_TRUE(loaded.contains("example.org"));
+    ASSERT_TRUE(loaded.contains("host0.example.com"));
+    ASSERT_FALSE(set.contains("example.org"));
+}
+
+TEST(domain_set, match_and_rules) {
+    domain_set set;
+    set.insert("example.com", true);
+    set.insert("mail.example.org", false);
+
+    const std::uint32_t node = set.match("www.example.com");
+    ASSERT_NE(node, 0);
+    ASSERT_EQ(set.match("example.com"), node);
+    ASSERT_EQ(set.match("example.org"), 0);
+
+    const std::vector<domain_set::rule> rules = set.rules();
+    ASSERT_EQ(rules[node].domain, "example.com");
+    ASSERT_TRUE(rules[node].subdomains);
+
+    const std::uint32_t mail = set.match("mail.example.org");
+    ASSERT_EQ(rules[mail].domain, "mail.example.org");
+    ASSERT_FALSE(rules[mail].subdomains);
+
+    // the nodes of the labels in between aren't domains of the set
+    ASSERT_EQ(std::count_if(rules.begin(), rules.end(), [](const domain_set::rule& r) { return !r.domain.empty(); }), 2);
+}
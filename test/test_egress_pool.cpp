@@ -0,0 +1,100 @@
+#include <optional>
+#include <vector>
+
+#include <asio/ts/io_context.hpp>
+#include <gtest/gtest.h>
+
+#include "../src/egress_pool.h"
+
+namespace {
+asio::ip::address addr(const char* s) {
+    return asio::ip::make_address(s);
+}
+} // namespace
+
+TEST(egress_pool, least_used) {
+    egress_pool pool{{addr("192.0.2.1"), addr("192.0.2.2")}};
+
+    auto a = pool.acquire(asio::ip::tcp::v4());
+    auto b = pool.acquire(asio::ip::tcp::v4());
+    ASSERT_TRUE(a && b);
+    ASSERT_NE(a->address(), b->address());
+
+    // a is released, so its address is the least used one
+    const asio::ip::address released = a->address();
+    a.reset();
+
+    auto c = pool.acquire(asio::ip::tcp::v4());
+    ASSERT_EQ(c->address(), released);
+}
+
+TEST(egress_pool, family) {
+    egress_pool pool{{addr("192.0.2.1"), addr("2001:db8::1")}};
+
+    ASSERT_EQ(pool.size(asio::ip::tcp::v4()), 1);
+    ASSERT_EQ(pool.size(asio::ip::tcp::v6()), 1);
+
+    ASSERT_EQ(pool.acquire(asio::ip::tcp::v4())->address(), addr("192.0.2.1"));
+    ASSERT_EQ(pool.acquire(asio::ip::tcp::v6())->address(), addr("2001:db8::1"));
+
+    egress_pool v4_only{{addr("192.0.2.1")}};
+    ASSERT_FALSE(v4_only.acquire(asio::ip::tcp::v6()));
+
+    egress_pool none;
+    ASSERT_TRUE(none.empty());
+    ASSERT_FALSE(none.acquire(asio::ip::tcp::v4()));
+}
+
+TEST(egress_pool, exhausted) {
+    egress_pool pool{{addr("192.0.2.1"), addr("192.0.2.2")}};
+
+    auto a = pool.acquire(asio::ip::tcp::v4());
+    const asio::ip::address exhausted = a->address();
+    a->exhausted();
+    a.reset();
+
+    // the other address is preferred even though it is busier
+    std::vector<egress_pool::lease> leases;
+    for (int i = 0; i != 3; i++) {
+        leases.emplace_back(*pool.acquire(asio::ip::tcp::v4()));
+        ASSERT_NE(leases.back().address(), exhausted);
+    }
+
+    for (const egress_pool::address_stats& stats : pool.stats()) {
+        if (stats.address == exhausted) {
+            ASSERT_EQ(stats.active, 0);
+            ASSERT_EQ(stats.connects, 1);
+            ASSERT_EQ(stats.failures, 1);
+        } else {
+            ASSERT_EQ(stats.active, 3);
+            ASSERT_EQ(stats.connects, 3);
+            ASSERT_EQ(stats.failures, 0);
+        }
+    }
+}
+
+#ifdef __linux__
+// Linux routes the whole 127.0.0.0/8 to the loopback interface.
+TEST(egress_pool, bind) {
+    asio::io_context ctx;
+    asio::ip::tcp::acceptor acceptor{ctx, {addr("127.0.0.1"), 0}};
+
+    egress_pool pool{{addr("127.0.0.2"), addr("127.0.0.3")}};
+    std::vector<egress_pool::lease> leases;
+    std::vector<asio::ip::address> sources;
+
+    for (int i = 0; i != 2; i++) {
+        auto& lease = leases.emplace_back(*pool.acquire(asio::ip::tcp::v4()));
+
+        tcp_socket socket{ctx};
+        lease.bind(socket);
+        socket.connect(acceptor.local_endpoint());
+
+        asio::ip::tcp::socket peer = acceptor.accept();
+        ASSERT_EQ(peer.remote_endpoint().address(), lease.address());
+        sources.push_back(socket.local_endpoint().address());
+    }
+
+    ASSERT_NE(sources[0], sources[1]);
+}
+#endif
@@ -0,0 +1,213 @@
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/io_context.hpp>
+#include <asio/redirect_error.hpp>
+#include <gtest/gtest.h>
+
+#include "../src/happy_eyeballs.h"
+#include "run_until.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+asio::ip::tcp::endpoint ep(const char* addr, std::uint16_t port) {
+    return {asio::ip::make_address(addr), port};
+}
+
+// fake_client disconnects after the given time.
+struct fake_client {
+    fake_client(const asio::any_io_executor& executor, std::chrono::milliseconds after) : timer(executor, after) {}
+
+    asio::awaitable<bool> wait_disconnect() {
+        std::error_code error;
+        co_await timer.async_wait(asio::redirect_error(asio::use_awaitable, error));
+        co_return !error;
+    }
+
+    void cancel() {
+        timer.cancel();
+    }
+
+    steady_timer timer;
+};
+
+struct outcome {
+    bool done = false;
+    std::error_code error;
+    std::string what;
+    std::optional<asio::ip::tcp::endpoint> peer;
+    std::optional<egress_pool::lease> lease;
+    std::chrono::steady_clock::duration elapsed{};
+};
+
+// run_connect runs happy_eyeballs::connect to endpoints until it finishes.
+outcome run_connect(asio::io_context& ctx,
+                    std::vector<asio::ip::tcp::endpoint> endpoints,
+                    int timeout,
+                    std::chrono::milliseconds client_leaves_after = 1h,
+                    egress_pool* egress = nullptr) {
+    outcome o;
+    circuit_breaker breaker;
+    auto client = std::make_shared<fake_client>(ctx.get_executor(), client_leaves_after);
+
+    auto run = [&]() -> asio::awaitable<void> {
+        const auto start = std::chrono::steady_clock::now();
+        tcp_socket socket{ctx};
+
+        try {
+            o.lease = co_await happy_eyeballs::connect(socket, endpoints, timeout, client, breaker, egress);
+            o.peer = socket.remote_endpoint();
+        } catch (const std::system_error& e) {
+            o.error = e.code();
+            o.what = e.what();
+        }
+
+        o.elapsed = std::chrono::steady_clock::now() - start;
+        o.done = true;
+    };
+    asio::co_spawn(ctx, std::move(run), asio::detached);
+
+    run_until(ctx, [&o] { return o.done; });
+    return o;
+}
+
+#ifdef __linux__
+// blackhole listens with a full backlog, so that Linux drops the SYNs of further connects,
+// which then hang as if the address were unreachable.
+struct blackhole {
+    explicit blackhole(asio::io_context& ctx) : acceptor(ctx), filler(ctx) {
+        acceptor.open(asio::ip::tcp::v4());
+        acceptor.bind(ep("127.0.0.1", 0));
+        acceptor.listen(0);
+        filler.connect(acceptor.local_endpoint());
+    }
+
+    asio::ip::tcp::endpoint endpoint() const {
+        return acceptor.local_endpoint();
+    }
+
+    tcp_acceptor acceptor;
+    tcp_socket filler;
+};
+#endif
+} // namespace
+
+TEST(happy_eyeballs, interleave) {
+    const std::vector<asio::ip::tcp::endpoint> endpoints{
+        ep("192.0.2.1", 80),
+        ep("192.0.2.2", 80),
+        ep("2001:db8::1", 80),
+        ep("192.0.2.3", 80),
+        ep("2001:db8::2", 80),
+    };
+
+    const std::vector<asio::ip::tcp::endpoint> expected{
+        ep("2001:db8::1", 80),
+        ep("192.0.2.1", 80),
+        ep("2001:db8::2", 80),
+        ep("192.0.2.2", 80),
+        ep("192.0.2.3", 80),
+    };
+
+    ASSERT_EQ(happy_eyeballs::interleave(endpoints), expected);
+
+    // a single family keeps its order
+    const std::vector<asio::ip::tcp::endpoint> v4{ep("192.0.2.2", 80), ep("192.0.2.1", 80)};
+    ASSERT_EQ(happy_eyeballs::interleave(v4), v4);
+
+    ASSERT_TRUE(happy_eyeballs::interleave({}).empty());
+}
+
+TEST(happy_eyeballs, refused_first_endpoint) {
+    asio::io_context ctx;
+    tcp_acceptor live{ctx, ep("127.0.0.1", 0)};
+
+    // nothing listens on the port of a closed acceptor
+    asio::ip::tcp::endpoint refused;
+    {
+        tcp_acceptor closed{ctx, ep("127.0.0.1", 0)};
+        refused = closed.local_endpoint();
+    }
+
+    const outcome o = run_connect(ctx, {refused, live.local_endpoint()}, 10);
+
+    ASSERT_TRUE(o.done);
+    ASSERT_FALSE(o.error) << o.what;
+    ASSERT_EQ(o.peer, live.local_endpoint());
+
+    // the second attempt starts as soon as the first fails
+    ASSERT_LT(o.elapsed, happy_eyeballs::connection_attempt_delay);
+}
+
+TEST(happy_eyeballs, no_endpoints) {
+    asio::io_context ctx;
+
+    const outcome o = run_connect(ctx, {}, 10);
+
+    ASSERT_TRUE(o.done);
+    ASSERT_EQ(o.error, asio::error::host_unreachable);
+}
+
+#ifdef __linux__
+TEST(happy_eyeballs, dead_first_endpoint) {
+    asio::io_context ctx;
+    blackhole dead{ctx};
+    tcp_acceptor live{ctx, ep("127.0.0.1", 0)};
+    egress_pool egress{{asio::ip::make_address("127.0.0.1")}};
+
+    outcome o = run_connect(ctx, {dead.endpoint(), live.local_endpoint()}, 10, 1h, &egress);
+
+    ASSERT_TRUE(o.done);
+    ASSERT_FALSE(o.error) << o.what;
+    ASSERT_EQ(o.peer, live.local_endpoint());
+    ASSERT_TRUE(o.lease);
+
+    // the second attempt only starts once the first has had its head start
+    ASSERT_GE(o.elapsed, happy_eyeballs::connection_attempt_delay);
+
+    // the losing attempt is closed, and gives its egress address back
+    auto active = [&egress] {
+        return egress.stats().front().active;
+    };
+
+    run_until(ctx, [&] { return active() == 1; });
+    ASSERT_EQ(active(), 1);
+
+    o.lease.reset();
+    ASSERT_EQ(active(), 0);
+}
+
+TEST(happy_eyeballs, timeout) {
+    asio::io_context ctx;
+    blackhole dead{ctx};
+
+    const outcome o = run_connect(ctx, {dead.endpoint()}, 1);
+
+    ASSERT_TRUE(o.done);
+    ASSERT_EQ(o.error, asio::error::timed_out);
+    ASSERT_NE(o.what.find(fmt::format("{}", dead.endpoint())), std::string::npos) << o.what;
+}
+
+TEST(happy_eyeballs, client_disconnects) {
+    asio::io_context ctx;
+    blackhole dead{ctx};
+    blackhole other{ctx};
+
+    const outcome o = run_connect(ctx, {dead.endpoint(), other.endpoint()}, 10, 50ms);
+
+    ASSERT_TRUE(o.done);
+    ASSERT_EQ(o.error, asio::error::connection_aborted);
+    ASSERT_LT(o.elapsed, 1s);
+
+    // the message names every endpoint that was tried
+    ASSERT_NE(o.what.find(fmt::format("{}", dead.endpoint())), std::string::npos) << o.what;
+    ASSERT_NE(o.what.find(fmt::format("{}", other.endpoint())), std::string::npos) << o.what;
+}
+#endif
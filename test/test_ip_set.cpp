@@ -66,3 +66,71 @@ TEST(insert, invalid) {
         ASSERT_EQ(set.insert(ip), false);
     }
 }
+
+TEST(insert, overlapping) {
+    ip_set set;
+
+    // longer prefixes first, then a prefix covering them
+    ASSERT_TRUE(set.insert("10.1.2.0/24"));
+    ASSERT_TRUE(set.insert("10.1.3.4/32"));
+    ASSERT_TRUE(set.contains("10.1.2.255"));
+    ASSERT_FALSE(set.contains("10.1.4.1"));
+
+    ASSERT_TRUE(set.insert("10.0.0.0/8"));
+    ASSERT_TRUE(set.contains("10.1.4.1"));
+    ASSERT_TRUE(set.contains("10.255.255.255"));
+
+    // and a longer prefix inside it
+    ASSERT_TRUE(set.insert("10.9.9.9/32"));
+    ASSERT_TRUE(set.contains("10.9.9.8"));
+    ASSERT_FALSE(set.contains("11.0.0.0"));
+}
+
+TEST(insert, unaligned_prefixes) {
+    ip_set set;
+
+    ASSERT_TRUE(set.insert("172.16.0.0/12"));
+    ASSERT_TRUE(set.insert("192.168.1.64/27"));
+    ASSERT_TRUE(set.insert("2001:db8:8000::/33"));
+
+    ASSERT_FALSE(set.contains("172.15.255.255"));
+    ASSERT_TRUE(set.contains("172.16.0.0"));
+    ASSERT_TRUE(set.contains("172.31.255.255"));
+    ASSERT_FALSE(set.contains("172.32.0.0"));
+
+    ASSERT_FALSE(set.contains("192.168.1.63"));
+    ASSERT_TRUE(set.contains("192.168.1.64"));
+    ASSERT_TRUE(set.contains("192.168.1.95"));
+    ASSERT_FALSE(set.contains("192.168.1.96"));
+
+    ASSERT_FALSE(set.contains("2001:db8:7fff:ffff::"));
+    ASSERT_TRUE(set.contains("2001:db8:8000::1"));
+    ASSERT_TRUE(set.contains("2001:db8:ffff:ffff::"));
+    ASSERT_FALSE(set.contains("2001:db9::"));
+}
+
+TEST(clear, empty) {
+    ip_set set;
+    ASSERT_TRUE(set.empty());
+
+    ASSERT_TRUE(set.insert("192.168.0.0/16"));
+    ASSERT_TRUE(set.insert("fe80::/10"));
+    ASSERT_FALSE(set.empty());
+
+    set.clear();
+    ASSERT_TRUE(set.empty());
+    ASSERT_FALSE(set.contains("192.168.0.1"));
+    ASSERT_FALSE(set.contains("fe80::1"));
+}
+
+TEST(contains, address) {
+    ip_set set;
+
+    ASSERT_TRUE(set.insert("192.168.0.0/16"));
+    ASSERT_TRUE(set.insert("fe80::/10"));
+
+    ASSERT_TRUE(set.contains(asio::ip::make_address("192.168.1.1")));
+    ASSERT_FALSE(set.contains(asio::ip::make_address("192.169.0.1")));
+    ASSERT_TRUE(set.contains(asio::ip::make_address("fe80::1")));
+    ASSERT_FALSE(set.contains(asio::ip::make_address("::1")));
+}
@@ -0,0 +1,65 @@
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../src/lifecycle.h"
+
+TEST(lifecycle, pause_resume) {
+    lifecycle l;
+    int closes = 0;
+    int pauses = 0;
+
+    const std::size_t id = l.add_listener(3, [&closes] { closes++; }, [&pauses] { pauses++; });
+
+    l.pause();
+    ASSERT_TRUE(l.is_paused());
+    ASSERT_EQ(pauses, 1);
+
+    // already paused
+    l.pause();
+    ASSERT_EQ(pauses, 1);
+
+    l.resume();
+    ASSERT_FALSE(l.is_paused());
+    ASSERT_FALSE(l.is_draining());
+    ASSERT_EQ(closes, 0);
+
+    l.remove_listener(id);
+    ASSERT_TRUE(l.listeners().empty());
+}
+
+TEST(lifecycle, drain) {
+    lifecycle l;
+    int closed_a = 0;
+    int closed_b = 0;
+
+    const std::size_t a = l.add_listener(3, [&closed_a] { closed_a++; });
+    l.add_listener(4, [&closed_b] { closed_b++; });
+    ASSERT_EQ(l.listeners().size(), 2);
+
+    // a removed listener isn't closed
+    l.remove_listener(a);
+    ASSERT_EQ(l.listeners(), std::vector<lifecycle::native_handle_type>{4});
+
+    ASSERT_TRUE(l.drain());
+    ASSERT_TRUE(l.is_draining());
+    ASSERT_EQ(closed_a, 0);
+    ASSERT_EQ(closed_b, 1);
+    ASSERT_TRUE(l.listeners().empty());
+
+    // only once
+    ASSERT_FALSE(l.drain());
+    ASSERT_EQ(closed_b, 1);
+}
+
+TEST(lifecycle, add_listener_after_drain) {
+    lifecycle l;
+    l.drain();
+
+    // a listener opened while draining is closed right away
+    int closes = 0;
+    l.add_listener(5, [&closes] { closes++; });
+
+    ASSERT_EQ(closes, 1);
+    ASSERT_TRUE(l.listeners().empty());
+}
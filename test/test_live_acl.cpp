@@ -0,0 +1,163 @@
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../src/live_acl.h"
+
+namespace {
+std::shared_ptr<const access_control_list> load(std::string_view content) {
+    std::istringstream in{std::string{content}};
+    return std::make_shared<const access_control_list>(access_control_list::from_stream(in));
+}
+} // namespace
+
+TEST(live_acl, publish) {
+    live_acl acl{load("[bypass_list]\n"
+                      "10.0.0.0/8\n")};
+
+    const std::shared_ptr<const access_control_list> before = acl.snapshot();
+    ASSERT_TRUE(before->is_bypass("10.0.0.1"));
+
+    const std::uint64_t generation = acl.generation();
+    acl.publish(load("[bypass_list]\n"
+                     "172.16.0.0/12\n"));
+    ASSERT_NE(acl.generation(), generation);
+
+    ASSERT_FALSE(acl.snapshot()->is_bypass("10.0.0.1"));
+    ASSERT_TRUE(acl.snapshot()->is_bypass("172.16.0.1"));
+
+    // a snapshot keeps the ACL it was taken of
+    ASSERT_TRUE(before->is_bypass("10.0.0.1"));
+    ASSERT_FALSE(before->is_bypass("172.16.0.1"));
+}
+
+TEST(live_acl, instances) {
+    live_acl first{load("[bypass_list]\n"
+                        "10.0.0.0/8\n")};
+    live_acl second{load("[bypass_list]\n"
+                         "172.16.0.0/12\n")};
+
+    ASSERT_NE(first.generation(), second.generation());
+
+    // the references of this thread don't mix them up
+    for (int i = 0; i != 3; i++) {
+        ASSERT_TRUE(first.snapshot()->is_bypass("10.0.0.1"));
+        ASSERT_TRUE(second.snapshot()->is_bypass("172.16.0.1"));
+    }
+}
+
+TEST(live_acl, concurrent_publish) {
+    const std::shared_ptr<const access_control_list> a = load("[bypass_list]\n"
+                                                              "10.0.0.0/8\n");
+    const std::shared_ptr<const access_control_list> b = load("[bypass_list]\n"
+                                                              "10.0.0.0/8\n"
+                                                              "172.16.0.0/12\n");
+
+    live_acl acl{a};
+    std::atomic<bool> done = false;
+    std::atomic<int> failures = 0;
+
+    std::vector<std::thread> readers(4);
+    for (std::thread& reader : readers) {
+        reader = std::thread{[&] {
+            while (!done) {
+                const std::shared_ptr<const access_control_list> snapshot = acl.snapshot();
+                if (snapshot != a && snapshot != b) {
+                    failures++;
+                }
+            }
+        }};
+    }
+
+    for (int i = 0; i != 1000; i++) {
+        acl.publish(i % 2 ? a : b);
+    }
+
+    done = true;
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+
+    ASSERT_EQ(failures, 0);
+    ASSERT_EQ(acl.snapshot(), a);
+}
+
+TEST(live_acl, cached_decisions) {
+    live_acl acl{load("[proxy_all]\n"
+                      "[bypass_list]\n"
+                      "10.0.0.0/8\n"
+                      "(^|\\.)example\\.com$\n")};
+
+    const acl_cache::stats before = live_acl::get_cache_stats();
+
+    ASSERT_EQ(acl.is_bypass_host("www.example.com"), true);
+    ASSERT_EQ(acl.is_bypass_host("www.example.com"), true);
+    ASSERT_EQ(acl.is_bypass_host("example.org"), std::nullopt);
+    ASSERT_TRUE(acl.is_bypass(asio::ip::make_address("10.0.0.1")));
+    ASSERT_TRUE(acl.is_bypass(asio::ip::make_address("10.0.0.1"), "www.example.org"));
+    ASSERT_FALSE(acl.is_bypass(asio::ip::make_address("192.0.2.1"), "www.example.org"));
+    ASSERT_TRUE(acl.is_bypass(asio::ip::make_address("192.0.2.1"), "www.example.com"));
+    ASSERT_FALSE(acl.is_block_outbound(asio::ip::make_address("10.0.0.1")));
+
+    const acl_cache::stats after = live_acl::get_cache_stats();
+    ASSERT_EQ(after.hits - before.hits, 1);
+    ASSERT_EQ(after.misses - before.misses, 7);
+
+    // a publish clears the cached decisions
+    acl.publish(load("[proxy_all]\n"
+                     "[bypass_list]\n"
+                     "(^|\\.)example\\.org$\n"));
+
+    ASSERT_EQ(acl.is_bypass_host("www.example.com"), false);
+    ASSERT_EQ(acl.is_bypass_host("example.org"), true);
+    ASSERT_FALSE(acl.is_bypass(asio::ip::make_address("10.0.0.1")));
+}
+
+TEST(live_acl, profiling_skips_cache) {
+    access_control_list profiled;
+    profiled.enable_profiling();
+
+    live_acl acl{std::make_shared<const access_control_list>(std::move(profiled))};
+    const acl_cache::stats before = live_acl::get_cache_stats();
+
+    ASSERT_FALSE(acl.is_bypass(asio::ip::make_address("10.0.0.1")));
+    ASSERT_FALSE(acl.is_bypass(asio::ip::make_address("10.0.0.1")));
+
+    const acl_cache::stats after = live_acl::get_cache_stats();
+    ASSERT_EQ(after.hits + after.misses, before.hits + before.misses);
+}
+
+TEST(live_acl, view_keeps_its_acl) {
+    live_acl acl{load("[proxy_all]\n"
+                      "[bypass_list]\n"
+                      "10.0.0.0/8\n"
+                      "(^|\\.)example\\.com$\n")};
+
+    const live_acl::view before = acl.get_view();
+    ASSERT_EQ(before.is_bypass_host("www.example.com"), true);
+
+    const acl_cache::stats cached = live_acl::get_cache_stats();
+    ASSERT_EQ(before.is_bypass_host("www.example.com"), true);
+    ASSERT_EQ(live_acl::get_cache_stats().hits - cached.hits, 1);
+
+    acl.publish(load("[proxy_all]\n"
+                     "[bypass_list]\n"
+                     "(^|\\.)example\\.org$\n"));
+
+    // the view decides with its ACL, and the current one with its own, whichever is asked first
+    ASSERT_EQ(acl.is_bypass_host("www.example.com"), false);
+    ASSERT_EQ(before.is_bypass_host("www.example.com"), true);
+    ASSERT_TRUE(before.is_bypass(asio::ip::make_address("10.0.0.1")));
+    ASSERT_FALSE(acl.is_bypass(asio::ip::make_address("10.0.0.1")));
+
+    const live_acl::view after = acl.get_view();
+    ASSERT_EQ(after.is_bypass_host("www.example.com"), false);
+    ASSERT_EQ(after.is_bypass_host("example.org"), true);
+}
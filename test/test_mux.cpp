@@ -0,0 +1,500 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <span>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/io_context.hpp>
+#include <asio/strand.hpp>
+#include <gtest/gtest.h>
+
+#include "../src/mux.h"
+#include "run_until.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+// serve_echo writes back what it reads from s, until s is closed.
+asio::awaitable<void> serve_echo(std::shared_ptr<mux::stream> s) {
+    std::array<std::uint8_t, 4096> buf;
+
+    try {
+        while (true) {
+            const std::size_t n = co_await s->read(buf);
+            co_await s->write(std::span{buf.data(), n});
+        }
+    } catch (const std::system_error&) {
+        s->close();
+    }
+}
+
+// mux_pair runs a client and a server multiplexer over the loopback address.
+// The server echoes the streams, unless echo is turned off.
+struct mux_pair {
+    explicit mux_pair(asio::io_context& ctx) : key(32, 0x42) {
+        auto client_strand = asio::make_strand(ctx);
+        auto server_strand = asio::make_strand(ctx);
+
+        tcp_acceptor acceptor{ctx, {asio::ip::make_address("127.0.0.1"), 0}};
+        tcp_socket a{client_strand};
+        a.connect(acceptor.local_endpoint());
+        tcp_socket b{server_strand};
+        acceptor.accept(b);
+
+        client = std::make_shared<mux::multiplexer>(client_strand, std::make_shared<encrypted_connection>(std::move(a), crypto::aead::chacha20_poly1305, key));
+        server = std::make_shared<mux::multiplexer>(server_strand, std::make_shared<encrypted_connection>(std::move(b), crypto::aead::chacha20_poly1305, key));
+
+        asio::co_spawn(client_strand, client->run(), asio::detached);
+
+        auto on_accept = [this, server_strand](std::shared_ptr<mux::stream> s, const socks5::address& target) {
+            targets.push_back(target.host());
+
+            if (echo) {
+                asio::co_spawn(server_strand, serve_echo(std::move(s)), asio::detached);
+            } else {
+                accepted.push_back(std::move(s));
+            }
+        };
+
+        asio::co_spawn(server_strand, server->run(on_accept), asio::detached);
+    }
+
+    std::vector<std::uint8_t> key;
+    std::shared_ptr<mux::multiplexer> client;
+    std::shared_ptr<mux::multiplexer> server;
+
+    bool echo = true;
+    std::vector<std::string> targets;
+    std::vector<std::shared_ptr<mux::stream>> accepted;
+};
+
+// mux_server accepts multiplexed connections over the loopback address, and echoes their streams.
+struct mux_server {
+    explicit mux_server(asio::io_context& ctx) : key(32, 0x42), acceptor(ctx, {asio::ip::make_address("127.0.0.1"), 0}) {
+        asio::co_spawn(ctx, accept(), asio::detached);
+    }
+
+    asio::awaitable<void> accept() {
+        while (true) {
+            auto strand = asio::make_strand(acceptor.get_executor());
+            tcp_socket socket{strand};
+            co_await acceptor.async_accept(socket);
+
+            auto m = std::make_shared<mux::multiplexer>(strand, std::make_shared<encrypted_connection>(std::move(socket), crypto::aead::chacha20_poly1305, key));
+            servers.push_back(m);
+
+            auto on_accept = [strand](std::shared_ptr<mux::stream> s, const socks5::address&) {
+                asio::co_spawn(strand, serve_echo(std::move(s)), asio::detached);
+            };
+
+            asio::co_spawn(strand, m->run(on_accept), asio::detached);
+        }
+    }
+
+    // connect counts the connections made to the server, which fail with error if it is set
+    asio::awaitable<std::shared_ptr<encrypted_connection>> connect() {
+        connects++;
+
+        tcp_socket socket{co_await asio::this_coro::executor};
+        if (error) {
+            steady_timer timer{co_await asio::this_coro::executor, 50ms};
+            co_await timer.async_wait();
+            throw std::system_error{error};
+        }
+
+        co_await socket.async_connect(acceptor.local_endpoint());
+        co_return std::make_shared<encrypted_connection>(std::move(socket), crypto::aead::chacha20_poly1305, key);
+    }
+
+    std::vector<std::uint8_t> key;
+    tcp_acceptor acceptor;
+    std::vector<std::shared_ptr<mux::multiplexer>> servers;
+
+    int connects = 0;
+    std::error_code error;
+};
+
+socks5::address target(std::uint16_t port) {
+    return socks5::to_address({asio::ip::make_address("192.0.2.1"), port});
+}
+
+// spawn runs f on a strand of its own, and sets done when it has finished.
+void spawn(asio::io_context& ctx, bool& done, std::function<asio::awaitable<void>()> f) {
+    asio::co_spawn(
+        asio::make_strand(ctx),
+        [&done, f = std::move(f)]() -> asio::awaitable<void> {
+            co_await f();
+            done = true;
+        },
+        asio::detached);
+}
+
+std::vector<std::uint8_t> pattern(std::size_t size) {
+    std::vector<std::uint8_t> data(size);
+    std::iota(data.begin(), data.end(), std::uint8_t{0});
+    return data;
+}
+
+asio::awaitable<std::vector<std::uint8_t>> read_until_eof(mux::stream& s) {
+    std::vector<std::uint8_t> data;
+    std::array<std::uint8_t, 4096> buf;
+
+    try {
+        while (true) {
+            const std::size_t n = co_await s.read(buf);
+            data.insert(data.end(), buf.begin(), buf.begin() + n);
+        }
+    } catch (const std::system_error& e) {
+        if (e.code() != asio::error::eof) {
+            throw;
+        }
+    }
+
+    co_return data;
+}
+} // namespace
+
+TEST(mux, address) {
+    ASSERT_TRUE(mux::is_mux_address(mux::address()));
+    ASSERT_FALSE(mux::is_mux_address(target(443)));
+}
+
+TEST(mux, echo) {
+    asio::io_context ctx;
+    mux_pair pair{ctx};
+
+    bool done = false;
+    std::vector<std::uint8_t> received;
+
+    spawn(ctx, done, [&]() -> asio::awaitable<void> {
+        std::shared_ptr<mux::stream> s = co_await pair.client->open(target(443));
+
+        const std::vector<std::uint8_t> data = pattern(100000);
+        co_await s->write(data);
+        s->close();
+
+        received = co_await read_until_eof(*s);
+    });
+
+    run_until(ctx, done);
+
+    ASSERT_TRUE(done);
+    ASSERT_EQ(received, pattern(100000));
+    ASSERT_EQ(pair.targets, std::vector<std::string>{"192.0.2.1"});
+
+    // both ends have finished the stream
+    run_until(ctx, [&pair] { return pair.client->stream_count() == 0 && pair.server->stream_count() == 0; });
+    ASSERT_EQ(pair.client->stream_count(), 0);
+    ASSERT_EQ(pair.server->stream_count(), 0);
+}
+
+TEST(mux, concurrent_streams) {
+    asio::io_context ctx;
+    mux_pair pair{ctx};
+
+    constexpr int count = 20;
+    std::array<bool, count> done{};
+    int ok = 0;
+
+    for (int i = 0; i != count; i++) {
+        spawn(ctx, done[i], [&, i]() -> asio::awaitable<void> {
+            std::shared_ptr<mux::stream> s = co_await pair.client->open(target(static_cast<std::uint16_t>(i)));
+
+            const std::vector<std::uint8_t> data(10000 + i, static_cast<std::uint8_t>(i));
+            co_await s->write(data);
+            s->close();
+
+            if (co_await read_until_eof(*s) == data) {
+                ok++;
+            }
+        });
+    }
+
+    bool all_done = false;
+    spawn(ctx, all_done, [&]() -> asio::awaitable<void> {
+        steady_timer timer{co_await asio::this_coro::executor};
+        while (ok != count) {
+            timer.expires_after(10ms);
+            co_await timer.async_wait();
+        }
+    });
+
+    run_until(ctx, all_done);
+    ASSERT_EQ(ok, count);
+}
+
+TEST(mux, flow_control) {
+    asio::io_context ctx;
+    mux_pair pair{ctx};
+    pair.echo = false;
+
+    constexpr std::size_t size = 4 * mux::initial_window;
+    const std::vector<std::uint8_t> data = pattern(size);
+    std::size_t written = 0;
+    bool done = false;
+
+    spawn(ctx, done, [&]() -> asio::awaitable<void> {
+        std::shared_ptr<mux::stream> s = co_await pair.client->open(target(80));
+
+        while (written != size) {
+            written += co_await s->write(std::span{data}.subspan(written, 16384));
+        }
+
+        s->close();
+    });
+
+    // the writer stops once the window of the reader is full
+    run_until(ctx, [&] { return pair.accepted.size() == 1 && written >= mux::initial_window; });
+    ASSERT_EQ(pair.accepted.size(), 1);
+    ASSERT_EQ(written, mux::initial_window);
+    ASSERT_FALSE(done);
+
+    // and resumes as it is read
+    bool read_done = false;
+    std::vector<std::uint8_t> received;
+    spawn(ctx, read_done, [&]() -> asio::awaitable<void> {
+        received = co_await read_until_eof(*pair.accepted.front());
+    });
+
+    run_until(ctx, read_done);
+    ASSERT_TRUE(done);
+    ASSERT_EQ(received, data);
+}
+
+TEST(mux, blocked_stream_does_not_block_others) {
+    asio::io_context ctx;
+    mux_pair pair{ctx};
+    pair.echo = false;
+
+    // fill the window of a stream nobody reads
+    bool blocked_done = false;
+    spawn(ctx, blocked_done, [&]() -> asio::awaitable<void> {
+        std::shared_ptr<mux::stream> s = co_await pair.client->open(target(80));
+        co_await s->write(pattern(2 * mux::initial_window));
+    });
+
+    run_until(ctx, [&pair] { return pair.accepted.size() == 1; });
+    ASSERT_FALSE(blocked_done);
+
+    pair.echo = true;
+
+    bool done = false;
+    std::vector<std::uint8_t> received;
+    spawn(ctx, done, [&]() -> asio::awaitable<void> {
+        std::shared_ptr<mux::stream> s = co_await pair.client->open(target(81));
+        co_await s->write(pattern(1000));
+        s->close();
+
+        received = co_await read_until_eof(*s);
+    });
+
+    run_until(ctx, done);
+    ASSERT_EQ(received, pattern(1000));
+    ASSERT_FALSE(blocked_done);
+}
+
+TEST(mux, reset) {
+    asio::io_context ctx;
+    mux_pair pair{ctx};
+    pair.echo = false;
+
+    bool done = false;
+    std::error_code error;
+
+    spawn(ctx, done, [&]() -> asio::awaitable<void> {
+        std::shared_ptr<mux::stream> s = co_await pair.client->open(target(80));
+
+        try {
+            co_await read_until_eof(*s);
+        } catch (const std::system_error& e) {
+            error = e.code();
+        }
+    });
+
+    run_until(ctx, [&pair] { return pair.accepted.size() == 1; });
+    ASSERT_EQ(pair.accepted.size(), 1);
+    pair.accepted.front()->abort();
+
+    run_until(ctx, done);
+    ASSERT_EQ(error, asio::error::connection_reset);
+}
+
+TEST(mux, connection_loss_resets_streams) {
+    asio::io_context ctx;
+    mux_pair pair{ctx};
+    pair.echo = false;
+
+    bool done = false;
+    std::error_code error;
+
+    spawn(ctx, done, [&]() -> asio::awaitable<void> {
+        std::shared_ptr<mux::stream> s = co_await pair.client->open(target(80));
+
+        try {
+            co_await read_until_eof(*s);
+        } catch (const std::system_error& e) {
+            error = e.code();
+        }
+    });
+
+    run_until(ctx, [&pair] { return pair.accepted.size() == 1; });
+    pair.server->close();
+
+    run_until(ctx, done);
+    ASSERT_EQ(error, asio::error::connection_reset);
+    ASSERT_TRUE(pair.client->is_closed());
+    ASSERT_EQ(pair.client->stream_count(), 0);
+}
+
+TEST(mux, read_timeout) {
+    asio::io_context ctx;
+    mux_pair pair{ctx};
+    pair.echo = false;
+
+    bool done = false;
+    std::error_code error;
+
+    spawn(ctx, done, [&]() -> asio::awaitable<void> {
+        std::shared_ptr<mux::stream> s = co_await pair.client->open(target(80));
+        s->set_read_timeout(1);
+
+        try {
+            co_await read_until_eof(*s);
+        } catch (const std::system_error& e) {
+            error = e.code();
+        }
+    });
+
+    run_until(ctx, done);
+    ASSERT_EQ(error, asio::error::timed_out);
+
+    // the peer is told
+    run_until(ctx, [&pair] { return pair.server->stream_count() == 0; });
+    ASSERT_EQ(pair.server->stream_count(), 0);
+}
+
+TEST(mux, connection_timeout) {
+    asio::io_context ctx;
+    mux_pair pair{ctx};
+
+    // a stream times out while another one keeps the connection busy
+    bool done = false;
+    std::error_code error;
+
+    spawn(ctx, done, [&]() -> asio::awaitable<void> {
+        std::shared_ptr<mux::stream> s = co_await pair.client->open(target(80));
+        s->set_connection_timeout(1);
+
+        try {
+            co_await read_until_eof(*s);
+        } catch (const std::system_error& e) {
+            error = e.code();
+        }
+    });
+
+    bool busy_done = false;
+    spawn(ctx, busy_done, [&]() -> asio::awaitable<void> {
+        std::shared_ptr<mux::stream> s = co_await pair.client->open(target(81));
+        steady_timer timer{co_await asio::this_coro::executor};
+        std::array<std::uint8_t, 100> buf;
+
+        while (!done) {
+            co_await s->write(pattern(100));
+            co_await s->read(buf);
+
+            timer.expires_after(100ms);
+            co_await timer.async_wait();
+        }
+
+        s->close();
+    });
+
+    run_until(ctx, done);
+    ASSERT_EQ(error, asio::error::timed_out);
+
+    run_until(ctx, busy_done);
+    ASSERT_TRUE(busy_done);
+    ASSERT_FALSE(pair.client->is_closed());
+}
+
+TEST(mux, pool_burst_shares_connection) {
+    asio::io_context ctx;
+    mux_server server{ctx};
+    mux::pool pool{ctx.get_executor(), [&server] { return server.connect(); }, 4, 60s};
+
+    // the streams opened while the first connection is being made wait for it
+    constexpr int count = 10;
+    std::array<bool, count> done{};
+    int ok = 0;
+
+    for (int i = 0; i != count; i++) {
+        spawn(ctx, done[i], [&, i]() -> asio::awaitable<void> {
+            std::shared_ptr<mux::stream> s = co_await pool.open(target(static_cast<std::uint16_t>(i)));
+
+            const std::vector<std::uint8_t> data = pattern(1000 + i);
+            co_await s->write(data);
+            s->close();
+
+            if (co_await read_until_eof(*s) == data) {
+                ok++;
+            }
+        });
+    }
+
+    bool all_done = false;
+    spawn(ctx, all_done, [&]() -> asio::awaitable<void> {
+        steady_timer timer{co_await asio::this_coro::executor};
+        while (std::count(done.begin(), done.end(), true) != count) {
+            timer.expires_after(10ms);
+            co_await timer.async_wait();
+        }
+    });
+
+    run_until(ctx, all_done);
+    ASSERT_EQ(ok, count);
+    ASSERT_EQ(server.connects, 1);
+}
+
+TEST(mux, pool_failed_connect_fails_waiters) {
+    asio::io_context ctx;
+    mux_server server{ctx};
+    server.error = asio::error::connection_refused;
+    mux::pool pool{ctx.get_executor(), [&server] { return server.connect(); }, 4, 60s};
+
+    constexpr int count = 10;
+    std::array<bool, count> done{};
+    int failed = 0;
+
+    for (int i = 0; i != count; i++) {
+        spawn(ctx, done[i], [&, i]() -> asio::awaitable<void> {
+            try {
+                co_await pool.open(target(static_cast<std::uint16_t>(i)));
+            } catch (const std::system_error& e) {
+                if (e.code() == asio::error::connection_refused) {
+                    failed++;
+                }
+            }
+        });
+    }
+
+    bool all_done = false;
+    spawn(ctx, all_done, [&]() -> asio::awaitable<void> {
+        steady_timer timer{co_await asio::this_coro::executor};
+        while (std::count(done.begin(), done.end(), true) != count) {
+            timer.expires_after(10ms);
+            co_await timer.async_wait();
+        }
+    });
+
+    run_until(ctx, all_done);
+    ASSERT_EQ(failed, count);
+    ASSERT_EQ(server.connects, 1);
+}
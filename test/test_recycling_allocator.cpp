@@ -0,0 +1,107 @@
+#include <array>
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+#include <gtest/gtest.h>
+#include <spdlog/spdlog.h>
+
+#include "../src/format.h"
+#include "../src/recycling_allocator.h"
+
+namespace {
+thread_local std::size_t allocations = 0;
+
+// count_allocations returns the number of heap allocations made by f.
+template <typename F>
+std::size_t count_allocations(F f) {
+    const std::size_t before = allocations;
+    f();
+    return allocations - before;
+}
+} // namespace
+
+void* operator new(std::size_t size) {
+    allocations++;
+
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+TEST(recycling_allocator, shared_objects) {
+    struct object {
+        std::array<std::uint8_t, 200> data;
+    };
+
+    auto setup = [] {
+        auto a = make_recycled<object>();
+        auto b = make_recycled<object>();
+    };
+
+    // warm up
+    setup();
+
+    std::size_t n = count_allocations([&setup] {
+        for (int i = 0; i != 100; i++) {
+            setup();
+        }
+    });
+
+    ASSERT_EQ(n, 0);
+}
+
+TEST(recycling_allocator, buffers) {
+    auto setup = [] {
+        recycled_buffer a{32768};
+        recycled_buffer b{16399};
+        recycled_buffer c{1};
+    };
+
+    // warm up
+    setup();
+
+    std::size_t n = count_allocations([&setup] {
+        for (int i = 0; i != 100; i++) {
+            setup();
+        }
+    });
+
+    ASSERT_EQ(n, 0);
+}
+
+TEST(recycling_allocator, large_buffers) {
+    std::size_t n = count_allocations([] {
+        recycled_buffer a{1 << 20};
+    });
+
+    ASSERT_EQ(n, 1);
+}
+
+TEST(logging, disabled_level) {
+    spdlog::set_level(spdlog::level::info);
+
+    const asio::ip::tcp::endpoint endpoint{asio::ip::make_address("2001:db8::1"), 443};
+
+    // warm up
+    spdlog::debug("Accept client address: {}", endpoint);
+
+    std::size_t n = count_allocations([&endpoint] {
+        for (int i = 0; i != 100; i++) {
+            spdlog::debug("Accept client address: {}", endpoint);
+        }
+    });
+
+    ASSERT_EQ(n, 0);
+    ASSERT_EQ(fmt::format("{}", endpoint), "[2001:db8::1]:443");
+}
@@ -0,0 +1,81 @@
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../src/replay_protection.h"
+
+namespace {
+std::array<std::uint8_t, 32> salt(std::uint8_t val) {
+    std::array<std::uint8_t, 32> s{};
+    s.fill(val);
+    return s;
+}
+} // namespace
+
+TEST(replay_protection, save_restore) {
+    auto& protection = replay_protection::get();
+
+    ASSERT_FALSE(protection.test_and_insert(salt(1)));
+    const std::vector<std::uint8_t> state = protection.save();
+
+    ASSERT_FALSE(protection.test_and_insert(salt(2)));
+    ASSERT_TRUE(protection.contains(salt(2)));
+
+    ASSERT_TRUE(protection.restore(state));
+    ASSERT_TRUE(protection.contains(salt(1)));
+    ASSERT_FALSE(protection.contains(salt(2)));
+}
+
+TEST(replay_protection, restore_invalid) {
+    auto& protection = replay_protection::get();
+
+    ASSERT_FALSE(protection.test_and_insert(salt(3)));
+    std::vector<std::uint8_t> state = protection.save();
+
+    state.resize(state.size() - 1);
+    ASSERT_FALSE(protection.restore(state));
+    ASSERT_FALSE(protection.restore({}));
+
+    ASSERT_TRUE(protection.contains(salt(3)));
+}
+
+TEST(replay_protection, test_and_insert) {
+    auto& protection = replay_protection::get();
+
+    ASSERT_FALSE(protection.test_and_insert(salt(4)));
+    ASSERT_TRUE(protection.test_and_insert(salt(4)));
+    ASSERT_TRUE(protection.contains(salt(4)));
+}
+
+TEST(replay_protection, concurrent) {
+    auto& protection = replay_protection::get();
+
+    // each salt is offered by every thread, and must be new to exactly one
+    std::atomic<int> new_salts = 0;
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t != 4; t++) {
+        threads.emplace_back([&] {
+            for (std::uint32_t i = 0; i != 1000; i++) {
+                std::array<std::uint8_t, 32> s{};
+                s[0] = 0xff;
+                std::memcpy(s.data() + 1, &i, sizeof(i));
+
+                if (!protection.test_and_insert(s)) {
+                    new_salts++;
+                }
+            }
+        });
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(new_salts, 1000);
+}
@@ -0,0 +1,72 @@
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../src/rule_profile.h"
+
+using namespace std::chrono_literals;
+
+TEST(rule_profile, hits) {
+    rule_profile profile{2};
+    profile.hit(0);
+    profile.hit(1);
+    profile.hit(1);
+
+    // out of range
+    profile.hit(2);
+
+    ASSERT_EQ(profile.get(0).hits, 1);
+    ASSERT_EQ(profile.get(1).hits, 2);
+    ASSERT_EQ(profile.size(), 2);
+}
+
+TEST(rule_profile, rules_across_cache_lines) {
+    rule_profile profile{9};
+    for (std::size_t rule = 0; rule != 9; rule++) {
+        for (std::size_t i = 0; i <= rule; i++) {
+            profile.hit(rule);
+        }
+    }
+
+    for (std::size_t rule = 0; rule != 9; rule++) {
+        ASSERT_EQ(profile.get(rule).hits, rule + 1);
+    }
+}
+
+TEST(rule_profile, samples_count_for_the_rate) {
+    rule_profile profile{1};
+    profile.add_sample(0, 1us);
+
+    ASSERT_EQ(profile.get(0).time, 1us * rule_profile::sample_rate);
+}
+
+TEST(rule_profile, sample) {
+    int sampled = 0;
+    for (std::uint32_t i = 0; i != rule_profile::sample_rate * 10; i++) {
+        sampled += rule_profile::sample();
+    }
+
+    ASSERT_EQ(sampled, 10);
+}
+
+TEST(rule_profile, threads) {
+    rule_profile profile{3};
+
+    std::vector<std::thread> threads(8);
+    for (std::thread& t : threads) {
+        t = std::thread{[&profile] {
+            for (int i = 0; i != 1000; i++) {
+                profile.hit(i % 3);
+            }
+        }};
+    }
+
+    for (std::thread& t : threads) {
+        t.join();
+    }
+
+    ASSERT_EQ(profile.get(0).hits + profile.get(1).hits + profile.get(2).hits, 8000);
+    ASSERT_EQ(profile.get(1).hits, 8 * 333);
+}
@@ -1,3 +1,6 @@
+#include <cstdint>
+#include <map>
+#include <string>
 #include <string_view>
 
 #include <gtest/gtest.h>
@@ -49,3 +52,135 @@ TEST(insert, invalid) {
         ASSERT_EQ(set.insert(rule), false);
     }
 }
+
+TEST(contains, view) {
+    rule_set set;
+    ASSERT_EQ(set.insert(R"((^|\.)example\.com$)"), true);
+
+    // only the view is matched, not what follows it in the buffer
+    const std::string_view buffer = "example.com.cn";
+    ASSERT_EQ(set.contains(buffer.substr(0, 11)), true);
+    ASSERT_EQ(set.contains(buffer), false);
+}
+
+TEST(compile, same_as_uncompiled) {
+    std::string_view rules[] = {
+        R"((^|\.)example\.com$)",
+        R"((^|\.)example\.org$)",
+        R"(^ads?\.tracker\.net$)",
+        R"(^cdn[0-9]+\.static\.io$)",
+        R"(goo+gle)",
+        R"(^(www|m)\.wiki\.test$)",
+        R"(^a\d+b\.x\.test$)",
+        R"(foo|bar\.test)",
+        R"(^\x61lpha\.test$)",
+    };
+
+    std::string_view hosts[] = {
+        "example.com",
+        "www.example.com",
+        "example.com.cn",
+        "badexample.org",
+        "ad.tracker.net",
+        "ads.tracker.net",
+        "adss.tracker.net",
+        "cdn12.static.io",
+        "cdn.static.io",
+        "gogle.com",
+        "gooogle.com",
+        "www.wiki.test",
+        "m.wiki.test",
+        "wiki.test",
+        "a12b.x.test",
+        "ab.x.test",
+        "foo.net",
+        "bar.test",
+        "alpha.test",
+        "",
+    };
+
+    rule_set uncompiled;
+    rule_set compiled;
+
+    for (auto rule : rules) {
+        ASSERT_TRUE(uncompiled.insert(rule));
+        ASSERT_TRUE(compiled.insert(rule));
+    }
+
+    compiled.compile();
+
+    for (auto host : hosts) {
+        ASSERT_EQ(compiled.contains(host), uncompiled.contains(host)) << host;
+    }
+
+    ASSERT_TRUE(compiled.contains("www.example.com"));
+    ASSERT_FALSE(compiled.contains("example.com.cn"));
+    ASSERT_TRUE(compiled.contains("ads.tracker.net"));
+    ASSERT_FALSE(compiled.contains("adss.tracker.net"));
+    ASSERT_FALSE(compiled.contains("gogle.com"));
+    ASSERT_TRUE(compiled.contains("gooogle.com"));
+    ASSERT_TRUE(compiled.contains("alpha.test"));
+}
+
+TEST(compile, rules_inserted_afterwards) {
+    rule_set set;
+
+    ASSERT_TRUE(set.insert(R"((^|\.)example\.com$)"));
+    set.compile();
+    ASSERT_TRUE(set.insert(R"((^|\.)example\.org$)"));
+
+    ASSERT_TRUE(set.contains("example.com"));
+    ASSERT_TRUE(set.contains("example.org"));
+
+    set.compile();
+    ASSERT_TRUE(set.contains("example.org"));
+    ASSERT_FALSE(set.contains("example.net"));
+}
+
+TEST(contains, not_null_terminated) {
+    rule_set set;
+    ASSERT_TRUE(set.insert(R"((^|\.)example\.com$)"));
+    set.compile();
+
+    const std::string_view host = "example.comm";
+    ASSERT_TRUE(set.contains(host.substr(0, 11)));
+}
+
+TEST(profiling, counts_hits) {
+    rule_set set;
+    set.insert(R"((^|\.)example\.com$)");
+    set.insert(R"(^example\.org$)");
+    set.insert(R"(^cdn[0-9]+\.example\.net$)");
+    set.insert(R"(^never\.example\.io$)");
+    set.compile();
+    set.enable_profiling();
+
+    ASSERT_TRUE(set.contains("www.example.com"));
+    ASSERT_TRUE(set.contains("example.com"));
+    ASSERT_TRUE(set.contains("example.org"));
+    ASSERT_TRUE(set.contains("cdn7.example.net"));
+    ASSERT_FALSE(set.contains("example.net"));
+
+    std::map<std::string, std::uint64_t> hits;
+    for (const rule_set::rule_stats& rule : set.get_rule_stats()) {
+        hits[rule.rule] = rule.hits;
+    }
+
+    const std::map<std::string, std::uint64_t> expected = {
+        {R"((^|\.)example\.com$)", 2},
+        {R"(^example\.org$)", 1},
+        {R"(^cdn[0-9]+\.example\.net$)", 1},
+        {R"(^never\.example\.io$)", 0},
+    };
+    ASSERT_EQ(hits, expected);
+    ASSERT_EQ(set.get_stats().hits, 5);
+}
+
+TEST(profiling, disabled) {
+    rule_set set;
+    set.insert(R"((^|\.)example\.com$)");
+
+    ASSERT_TRUE(set.contains("example.com"));
+    ASSERT_TRUE(set.get_rule_stats().empty());
+    ASSERT_EQ(set.get_stats().hits, 0);
+}
@@ -0,0 +1,294 @@
+#include <chrono>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/io_context.hpp>
+#include <gtest/gtest.h>
+
+#include "../src/server_pool.h"
+#include "run_until.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+// fake_server answers the probes after latency, unless it is down.
+struct fake_server {
+    std::string address;
+    std::chrono::milliseconds latency{1};
+    bool up = true;
+};
+
+// fake_servers resolves the host names of the servers to their addresses, and answers their probes.
+struct fake_servers {
+    server_pool::resolve_function resolve_function() {
+        return [this](std::string host, std::uint16_t port) -> asio::awaitable<server_pool::endpoints> {
+            resolves[host]++;
+
+            auto it = servers.find(host);
+            if (it == servers.end()) {
+                throw std::system_error{asio::error::host_not_found};
+            }
+
+            co_return server_pool::endpoints{{asio::ip::make_address(it->second.address), port}};
+        };
+    }
+
+    server_pool::probe_function probe_function() {
+        return [this](server_pool::endpoints eps) -> asio::awaitable<void> {
+            for (const auto& [host, server] : servers) {
+                if (eps.front().address() != asio::ip::make_address(server.address)) {
+                    continue;
+                }
+
+                const std::string probed = host;
+                const std::chrono::milliseconds latency = server.latency;
+                const bool up = server.up;
+
+                steady_timer timer{co_await asio::this_coro::executor};
+                timer.expires_after(latency);
+                co_await timer.async_wait();
+                probes[probed]++;
+
+                if (!up) {
+                    throw std::system_error{asio::error::connection_refused};
+                }
+
+                co_return;
+            }
+
+            throw std::system_error{asio::error::host_unreachable};
+        };
+    }
+
+    std::map<std::string, fake_server> servers;
+    std::map<std::string, int> resolves;
+
+    // the number of probes answered
+    std::map<std::string, int> probes;
+};
+
+std::shared_ptr<server_pool> make_pool(asio::io_context& ctx,
+                                       fake_servers& fake,
+                                       const std::vector<std::string>& hosts,
+                                       server_pool::policy balance = server_pool::policy::least_latency,
+                                       server_pool::clock::duration resolve_interval = 5min) {
+    std::vector<server_pool::address> addresses;
+    for (const std::string& host : hosts) {
+        addresses.push_back({host, 8388});
+    }
+
+    server_pool::options opts;
+    opts.balance = balance;
+    opts.probe_interval = 100ms;
+    opts.resolve_interval = resolve_interval;
+
+    return std::make_shared<server_pool>(ctx.get_executor(), std::move(addresses), fake.resolve_function(), fake.probe_function(), opts);
+}
+
+// start starts pool, and returns the error it throws, if any.
+std::optional<std::error_code> start(asio::io_context& ctx, server_pool& pool) {
+    std::optional<std::error_code> error;
+    bool done = false;
+
+    asio::co_spawn(ctx, [&]() -> asio::awaitable<void> {
+        try {
+            co_await pool.start();
+        } catch (const std::system_error& e) {
+            error = e.code();
+        }
+
+        done = true;
+    }, asio::detached);
+
+    run_until(ctx, done);
+
+    return error;
+}
+
+// measured returns true once the latency of every server of pool has been measured.
+bool measured(const server_pool& pool) {
+    for (const server_pool::server_stats& stats : pool.stats()) {
+        if (!stats.latency) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::size_t pick(server_pool& pool, std::optional<std::size_t> exclude = std::nullopt) {
+    std::optional<server_pool::choice> chosen = pool.pick(exclude);
+    return chosen ? chosen->server : static_cast<std::size_t>(-1);
+}
+} // namespace
+
+TEST(server_pool, parse_address) {
+    server_pool::address addr = server_pool::parse_address("example.com", 8388);
+    ASSERT_EQ(addr.host, "example.com");
+    ASSERT_EQ(addr.port, 8388);
+
+    addr = server_pool::parse_address("192.0.2.1:443", 8388);
+    ASSERT_EQ(addr.host, "192.0.2.1");
+    ASSERT_EQ(addr.port, 443);
+
+    addr = server_pool::parse_address("[2001:db8::1]:443", 8388);
+    ASSERT_EQ(addr.host, "2001:db8::1");
+    ASSERT_EQ(addr.port, 443);
+
+    addr = server_pool::parse_address("2001:db8::1", 8388);
+    ASSERT_EQ(addr.host, "2001:db8::1");
+    ASSERT_EQ(addr.port, 8388);
+
+    ASSERT_THROW(server_pool::parse_address("[2001:db8::1", 8388), std::invalid_argument);
+    ASSERT_THROW(server_pool::parse_address(":443", 8388), std::invalid_argument);
+}
+
+TEST(server_pool, picks_least_latency) {
+    asio::io_context ctx;
+    fake_servers fake;
+    fake.servers["a"] = {"127.0.0.1", 60ms};
+    fake.servers["b"] = {"127.0.0.2", 5ms};
+    fake.servers["c"] = {"127.0.0.3", 30ms};
+
+    auto pool = make_pool(ctx, fake, {"a", "b", "c"});
+    ASSERT_FALSE(start(ctx, *pool));
+    run_until(ctx, [&pool] { return measured(*pool); });
+
+    ASSERT_EQ(pick(*pool), 1);
+    ASSERT_EQ(pick(*pool, 1), 2);
+
+    // the latency is measured again
+    fake.servers["b"].latency = 90ms;
+    run_until(ctx, [&pool] { return pool->stats()[1].latency > pool->stats()[2].latency; });
+
+    ASSERT_EQ(pick(*pool), 2);
+
+    const std::vector<server_pool::server_stats> stats = pool->stats();
+    ASSERT_EQ(stats.size(), 3);
+    ASSERT_TRUE(stats[0].latency);
+    ASSERT_GE(*stats[0].latency, 60ms);
+    ASSERT_EQ(stats[2].picks, 2);
+}
+
+TEST(server_pool, fails_over) {
+    asio::io_context ctx;
+    fake_servers fake;
+    fake.servers["a"] = {"127.0.0.1", 5ms};
+    fake.servers["b"] = {"127.0.0.2", 30ms};
+
+    auto pool = make_pool(ctx, fake, {"a", "b"});
+    ASSERT_FALSE(start(ctx, *pool));
+    run_until(ctx, [&pool] { return measured(*pool); });
+    ASSERT_EQ(pick(*pool), 0);
+
+    // a session fails to connect
+    pool->failed(0);
+    ASSERT_EQ(pick(*pool), 1);
+    ASSERT_FALSE(pool->stats()[0].healthy);
+
+    // and the next probe puts it back
+    run_until(ctx, [&pool] { return pool->stats()[0].healthy; });
+    ASSERT_TRUE(pool->stats()[0].healthy);
+    ASSERT_EQ(pick(*pool), 0);
+
+    // a probe takes it out
+    fake.servers["a"].up = false;
+    run_until(ctx, [&pool] { return !pool->stats()[0].healthy; });
+    ASSERT_FALSE(pool->stats()[0].healthy);
+    ASSERT_EQ(pick(*pool), 1);
+}
+
+TEST(server_pool, all_down) {
+    asio::io_context ctx;
+    fake_servers fake;
+    fake.servers["a"] = {"127.0.0.1", 1ms, false};
+    fake.servers["b"] = {"127.0.0.2", 1ms, false};
+
+    auto pool = make_pool(ctx, fake, {"a", "b"});
+    ASSERT_FALSE(start(ctx, *pool));
+
+    // a second probe means the first has been accounted for
+    run_until(ctx, [&fake] { return fake.probes["a"] >= 2 && fake.probes["b"] >= 2; });
+
+    // the one which went down last is tried
+    pool->succeeded(0);
+    pool->failed(0);
+    ASSERT_EQ(pick(*pool), 0);
+    ASSERT_EQ(pick(*pool, 0), 1);
+}
+
+TEST(server_pool, weighted) {
+    asio::io_context ctx;
+    fake_servers fake;
+    fake.servers["a"] = {"127.0.0.1", 10ms};
+    fake.servers["b"] = {"127.0.0.2", 40ms};
+
+    auto pool = make_pool(ctx, fake, {"a", "b"}, server_pool::policy::weighted);
+    ASSERT_FALSE(start(ctx, *pool));
+    run_until(ctx, [&pool] { return measured(*pool); });
+
+    std::vector<int> counts(2);
+    for (int i = 0; i != 10000; i++) {
+        counts[pick(*pool)]++;
+    }
+
+    // 4 to 1, give or take the scheduling of the probes
+    ASSERT_GT(counts[0], 2 * counts[1]);
+    ASSERT_GT(counts[1], 500);
+}
+
+TEST(server_pool, resolves_again) {
+    asio::io_context ctx;
+    fake_servers fake;
+    fake.servers["a"] = {"127.0.0.1"};
+
+    auto pool = make_pool(ctx, fake, {"a", "b"}, server_pool::policy::least_latency, 100ms);
+    ASSERT_FALSE(start(ctx, *pool));
+    ASSERT_EQ(pick(*pool, 0), static_cast<std::size_t>(-1));
+
+    // b resolves later
+    fake.servers["b"] = {"127.0.0.2"};
+    run_until(ctx, [&pool] { return pool->pick(0).has_value(); });
+
+    ASSERT_GE(fake.resolves["b"], 2);
+    std::optional<server_pool::choice> chosen = pool->pick(0);
+    ASSERT_TRUE(chosen);
+    ASSERT_EQ(chosen->server, 1);
+    ASSERT_EQ(chosen->eps.front(), asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.2"), 8388));
+
+    // a failing resolution keeps the address
+    fake.servers.erase("a");
+    const int resolves = fake.resolves["a"];
+    run_until(ctx, [&fake, resolves] { return fake.resolves["a"] >= resolves + 2; });
+    ASSERT_GE(fake.resolves["a"], resolves + 2);
+    ASSERT_TRUE(pool->pick(1));
+}
+
+TEST(server_pool, nothing_resolves) {
+    asio::io_context ctx;
+    fake_servers fake;
+
+    auto pool = make_pool(ctx, fake, {"a"});
+    ASSERT_EQ(start(ctx, *pool), asio::error::host_not_found);
+}
+
+TEST(server_pool, stop) {
+    asio::io_context ctx;
+    fake_servers fake;
+    fake.servers["a"] = {"127.0.0.1"};
+
+    auto pool = make_pool(ctx, fake, {"a"});
+    ASSERT_FALSE(start(ctx, *pool));
+    pool->stop();
+
+    // nothing is left to run
+    ctx.restart();
+    ctx.run_for(1s);
+    ASSERT_TRUE(ctx.stopped());
+}
@@ -0,0 +1,75 @@
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../src/session.h"
+
+using namespace std::chrono_literals;
+
+TEST(session_manager, limits) {
+    session_manager manager{2, 1};
+
+    auto s1 = manager.open();
+    ASSERT_EQ(manager.session_count(), 1);
+    ASSERT_EQ(manager.handshake_count(), 1);
+    ASSERT_EQ(manager.is_overloaded(), true);
+
+    s1->established();
+    ASSERT_EQ(manager.handshake_count(), 0);
+    ASSERT_EQ(manager.is_overloaded(), false);
+
+    auto s2 = manager.open();
+    s2->established();
+    ASSERT_EQ(manager.is_overloaded(), true);
+
+    s1.reset();
+    ASSERT_EQ(manager.session_count(), 1);
+    ASSERT_EQ(manager.is_overloaded(), false);
+}
+
+TEST(session_manager, unlimited) {
+    session_manager manager{0, 0};
+
+    std::vector<std::shared_ptr<session>> sessions;
+    for (int i = 0; i != 100; i++) {
+        sessions.emplace_back(manager.open());
+    }
+
+    ASSERT_EQ(manager.is_overloaded(), false);
+
+    sessions.clear();
+    ASSERT_EQ(manager.session_count(), 0);
+    ASSERT_EQ(manager.handshake_count(), 0);
+}
+
+TEST(session_manager, shed_oldest_idle) {
+    session_manager manager{3, 0};
+
+    int shed = 0;
+    auto s1 = manager.open();
+    auto s2 = manager.open();
+    auto s3 = manager.open();
+
+    s1->established();
+    s1->set_shed_action([&shed] { shed = 1; });
+    s2->established();
+    s2->set_shed_action([&shed] { shed = 2; });
+
+    // s3 is still in handshake and can't be shed
+    s3->set_shed_action([&shed] { shed = 3; });
+
+    // no session has been idle long enough
+    ASSERT_EQ(manager.shed_oldest_idle(1h), false);
+
+    s1->touch();
+    ASSERT_EQ(manager.shed_oldest_idle(0s), true);
+    ASSERT_EQ(shed, 2);
+
+    // a shed session isn't shed twice
+    ASSERT_EQ(manager.shed_oldest_idle(0s), true);
+    ASSERT_EQ(shed, 1);
+
+    ASSERT_EQ(manager.shed_oldest_idle(0s), false);
+}
@@ -0,0 +1,189 @@
+// Counts the heap allocations ss-remote makes to set up a session, from accepting the client to proxying it.
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/io_context.hpp>
+#include <asio/write.hpp>
+#include <crypto/crypto.h>
+#include <gtest/gtest.h>
+
+#include "../src/encrypted_connection.h"
+#include "../src/io.h"
+#include "../src/socks5.h"
+#include "../src/tcp.h"
+#include "run_until.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+// only the allocations of the thread running ss-remote are counted
+std::atomic<std::size_t> server_allocations = 0;
+thread_local bool is_server_thread = false;
+
+constexpr std::string_view password = "pw";
+
+// serve_echo writes back what it reads from s, until s is closed.
+asio::awaitable<void> serve_echo(tcp_socket s) {
+    std::array<std::uint8_t, 4096> buf;
+
+    try {
+        while (true) {
+            const std::size_t n = co_await s.async_read_some(asio::buffer(buf));
+            co_await asio::async_write(s, asio::buffer(buf.data(), n), asio::use_awaitable);
+        }
+    } catch (const std::system_error&) {
+    }
+}
+
+asio::awaitable<void> accept_echo(tcp_acceptor& acceptor) {
+    while (true) {
+        tcp_socket s{acceptor.get_executor()};
+        co_await acceptor.async_accept(s);
+        asio::co_spawn(acceptor.get_executor(), serve_echo(std::move(s)), asio::detached);
+    }
+}
+
+// run_session proxies a few bytes to target through the ss-remote listening on server, and sets echoed
+// once they come back. It keeps the session open until close is set.
+asio::awaitable<void> run_session(asio::ip::tcp::endpoint server, asio::ip::tcp::endpoint target, std::span<const std::uint8_t> key, bool& echoed, const bool& close) {
+    tcp_socket socket{co_await asio::this_coro::executor};
+    co_await socket.async_connect(server);
+
+    encrypted_connection ec{std::move(socket), crypto::aead::chacha20_poly1305, key};
+
+    const std::array<std::uint8_t, 5> data{'h', 'e', 'l', 'l', 'o'};
+    co_await ec.write(socks5::to_address(target).bytes());
+    co_await ec.write(data);
+
+    std::array<std::uint8_t, 5> received{};
+    co_await read_full(ec, received);
+    echoed = received == data;
+
+    steady_timer timer{co_await asio::this_coro::executor};
+    while (!close) {
+        timer.expires_after(1ms);
+        co_await timer.async_wait();
+    }
+}
+
+// free_port returns a port of the loopback address nobody listens on.
+std::uint16_t free_port() {
+    asio::io_context ctx;
+    tcp_acceptor acceptor{ctx, {asio::ip::make_address("127.0.0.1"), 0}};
+    return acceptor.local_endpoint().port();
+}
+} // namespace
+
+void* operator new(std::size_t size) {
+    if (is_server_thread) {
+        server_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+TEST(session_setup, allocations) {
+    const asio::ip::tcp::endpoint server{asio::ip::make_address("127.0.0.1"), free_port()};
+
+    config conf{.mode = config::running_mode::remote};
+    conf.method = "chacha20-ietf-poly1305";
+    conf.remote_host = server.address().to_string();
+    conf.remote_port = std::to_string(server.port());
+    conf.password = password;
+    conf.dns_servers = {"127.0.0.1"};
+
+    asio::io_context server_ctx;
+    asio::co_spawn(server_ctx, tcp_remote(conf), asio::detached);
+
+    std::thread server_thread{[&server_ctx] {
+        is_server_thread = true;
+        server_ctx.run();
+    }};
+
+    asio::io_context ctx;
+    tcp_acceptor target{ctx, {asio::ip::make_address("127.0.0.1"), 0}};
+    asio::co_spawn(ctx, accept_echo(target), asio::detached);
+
+    std::vector<std::uint8_t> key(crypto::aead::key_size(crypto::aead::chacha20_poly1305));
+    crypto::derive_key(std::span{reinterpret_cast<const std::uint8_t*>(password.data()), password.size()}, key);
+
+    // run_session returns the allocations of ss-remote until the data came back
+    auto session = [&]() -> std::size_t {
+        bool echoed = false;
+        bool close = false;
+        bool done = false;
+
+        // let ss-remote finish tearing down the previous session first
+        std::size_t before = server_allocations;
+        for (int i = 0; i != 100; i++) {
+            std::this_thread::sleep_for(20ms);
+            if (server_allocations == before) {
+                break;
+            }
+            before = server_allocations;
+        }
+
+        asio::co_spawn(ctx, run_session(server, target.local_endpoint(), key, echoed, close), [&done](std::exception_ptr) {
+            done = true;
+        });
+
+        run_until(ctx, echoed);
+        const std::size_t n = server_allocations - before;
+        EXPECT_TRUE(echoed);
+
+        close = true;
+        run_until(ctx, done);
+
+        return n;
+    };
+
+    // wait for ss-remote to listen, then warm up its caches and pools
+    for (int i = 0; i != 500; i++) {
+        asio::io_context probe_ctx;
+        tcp_socket probe{probe_ctx};
+        std::error_code error;
+        probe.connect(server, error);
+
+        if (!error) {
+            break;
+        }
+
+        std::this_thread::sleep_for(10ms);
+    }
+
+    for (int i = 0; i != 3; i++) {
+        session();
+    }
+
+    const std::size_t n = session();
+
+    // The recycled objects, buffers and session strands come from the pools after warm up, and the session
+    // strand is stored inline by any_io_executor, so handlers no longer copy it to the heap. What is left
+    // are the coroutine frames and asio's handler operations, about 100 per session, so the bound catches
+    // a setup path that starts allocating per handler again.
+    EXPECT_LE(n, 110);
+
+    server_ctx.stop();
+    server_thread.join();
+}
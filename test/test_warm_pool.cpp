@@ -0,0 +1,160 @@
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <system_error>
+#include <vector>
+
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/io_context.hpp>
+#include <asio/strand.hpp>
+#include <gtest/gtest.h>
+
+#include "../src/warm_pool.h"
+#include "run_until.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+// fake_remote accepts connections on the loopback address, and counts the connects.
+struct fake_remote {
+    explicit fake_remote(asio::io_context& ctx) : acceptor(ctx, {asio::ip::make_address("127.0.0.1"), 0}) {
+        asio::co_spawn(ctx, accept(), asio::detached);
+    }
+
+    asio::awaitable<void> accept() {
+        while (true) {
+            accepted.push_back(co_await acceptor.async_accept());
+        }
+    }
+
+    warm_pool::connect_function function() {
+        return [this]() -> asio::awaitable<tcp_socket> {
+            connects++;
+
+            if (fail) {
+                throw std::system_error{asio::error::connection_refused};
+            }
+
+            tcp_socket socket{co_await asio::this_coro::executor};
+            co_await socket.async_connect(acceptor.local_endpoint());
+            co_return socket;
+        };
+    }
+
+    tcp_acceptor acceptor;
+    std::vector<tcp_socket> accepted;
+    bool fail = false;
+    int connects = 0;
+};
+
+std::shared_ptr<warm_pool> make_pool(asio::io_context& ctx, fake_remote& remote, std::size_t size, warm_pool::clock::duration max_idle = 30s) {
+    warm_pool::options opts;
+    opts.size = size;
+    opts.max_idle = max_idle;
+    opts.retry_delay = 100ms;
+
+    auto pool = std::make_shared<warm_pool>(ctx.get_executor(), remote.function(), opts);
+    pool->start();
+
+    return pool;
+}
+
+// take takes an idle connection from pool. If wait is set, it waits a few seconds for one to become idle.
+std::optional<tcp_socket> take(asio::io_context& ctx, warm_pool& pool, bool wait = false) {
+    std::optional<tcp_socket> socket;
+    bool done = false;
+    auto strand = asio::make_strand(ctx);
+
+    asio::co_spawn(strand, [&]() -> asio::awaitable<void> {
+        steady_timer timer{strand};
+        const auto deadline = std::chrono::steady_clock::now() + (wait ? 5s : 0s);
+
+        while (!(socket = co_await pool.take(strand)) && std::chrono::steady_clock::now() < deadline) {
+            timer.expires_after(10ms);
+            co_await timer.async_wait();
+        }
+
+        done = true;
+    }, asio::detached);
+
+    run_until(ctx, done);
+
+    return socket;
+}
+} // namespace
+
+TEST(warm_pool, fills_and_refills) {
+    asio::io_context ctx;
+    fake_remote remote{ctx};
+    auto pool = make_pool(ctx, remote, 2);
+
+    run_until(ctx, [&remote] { return remote.accepted.size() == 2; });
+    ASSERT_EQ(remote.connects, 2);
+
+    std::optional<tcp_socket> socket = take(ctx, *pool, true);
+    ASSERT_TRUE(socket);
+    ASSERT_TRUE(socket->is_open());
+    ASSERT_EQ(socket->remote_endpoint(), remote.acceptor.local_endpoint());
+
+    // the taken connection is replaced
+    run_until(ctx, [&remote] { return remote.accepted.size() == 3; });
+    ASSERT_EQ(remote.connects, 3);
+}
+
+TEST(warm_pool, replaces_closed_connections) {
+    asio::io_context ctx;
+    fake_remote remote{ctx};
+    auto pool = make_pool(ctx, remote, 1);
+
+    run_until(ctx, [&remote] { return remote.accepted.size() == 1; });
+    ASSERT_EQ(remote.accepted.size(), 1);
+
+    remote.accepted.front().close();
+    run_until(ctx, [&remote] { return remote.accepted.size() == 2; });
+    ASSERT_EQ(remote.connects, 2);
+
+    // the new connection is still up
+    std::optional<tcp_socket> socket = take(ctx, *pool, true);
+    ASSERT_TRUE(socket);
+    ASSERT_EQ(socket->local_endpoint(), remote.accepted[1].remote_endpoint());
+}
+
+TEST(warm_pool, replaces_expired_connections) {
+    asio::io_context ctx;
+    fake_remote remote{ctx};
+    auto pool = make_pool(ctx, remote, 1, 100ms);
+
+    // each connection is replaced once it has been idle for 100ms
+    const auto start = std::chrono::steady_clock::now();
+    run_until(ctx, [&remote] { return remote.connects == 3; });
+    ASSERT_EQ(remote.connects, 3);
+    ASSERT_GE(std::chrono::steady_clock::now() - start, 200ms);
+}
+
+TEST(warm_pool, retries_after_delay) {
+    asio::io_context ctx;
+    fake_remote remote{ctx};
+    remote.fail = true;
+    auto pool = make_pool(ctx, remote, 4);
+
+    // the first round of connects, and a round of retries every 100ms
+    const auto start = std::chrono::steady_clock::now();
+    run_until(ctx, [&remote] { return remote.connects >= 3 * 4; });
+    ASSERT_GE(remote.connects, 3 * 4);
+    ASSERT_GE(std::chrono::steady_clock::now() - start, 200ms);
+    ASSERT_FALSE(take(ctx, *pool));
+}
+
+TEST(warm_pool, stop) {
+    asio::io_context ctx;
+    fake_remote remote{ctx};
+    auto pool = make_pool(ctx, remote, 2);
+
+    run_until(ctx, [&remote] { return remote.accepted.size() == 2; });
+    pool->stop();
+
+    // take runs after stop on the strand of the pool
+    ASSERT_FALSE(take(ctx, *pool));
+    ASSERT_EQ(remote.connects, 2);
+}